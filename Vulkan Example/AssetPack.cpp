@@ -0,0 +1,270 @@
+#include "AssetPack.hpp"
+#include "Hash.hpp"
+#include "Lz4.hpp"
+#include "ShaderLibrary.hpp"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+namespace vulkanExample
+{
+	namespace
+	{
+		uint64_t alignUp(uint64_t value, uint64_t alignment)
+		{
+			return (value + alignment - 1) / alignment * alignment;
+		}
+
+		uint32_t getSlotCount(uint32_t entryCount)
+		{
+			//at most half full, so probe sequences stay short
+			uint32_t slotCount = 1;
+			while (slotCount < entryCount * 2)
+				slotCount *= 2;
+			return slotCount;
+		}
+
+		bool readWholeFile(const std::string& path, std::vector<unsigned char>& contents)
+		{
+			MappedFile file;
+			if (!file.open(path))
+				return false;
+			contents.assign(file.data(), file.data() + file.size());
+			return true;
+		}
+	}
+
+	bool AssetPack::open(const std::string& packPath)
+	{
+		close();
+		//random access: startup reads a few entries, the others only once they are needed. read() prefetches every entry whole
+		if (!file.open(packPath, MappedFile::Access::Random) || file.size() < sizeof(Header))
+		{
+			file.close();
+			return false;
+		}
+
+		const unsigned char* data = file.data();
+		const Header* packHeader = reinterpret_cast<const Header*>(data);
+		uint64_t indexSize = sizeof(Header) + static_cast<uint64_t>(packHeader->entryCount) * sizeof(Entry) +
+			static_cast<uint64_t>(packHeader->slotCount) * sizeof(uint32_t) + packHeader->namesSize;
+		bool valid = packHeader->magic == MAGIC && packHeader->version == VERSION && packHeader->slotCount != 0 &&
+			(packHeader->slotCount & (packHeader->slotCount - 1)) == 0 && packHeader->slotCount > packHeader->entryCount &&
+			packHeader->indexSize == indexSize && indexSize <= file.size();
+		if (!valid)
+		{
+			file.close();
+			return false;
+		}
+
+		const Entry* packEntries = reinterpret_cast<const Entry*>(data + sizeof(Header));
+		const uint32_t* packSlots = reinterpret_cast<const uint32_t*>(packEntries + packHeader->entryCount);
+		for (uint32_t i = 0; i < packHeader->entryCount && valid; i++)
+		{
+			const Entry& entry = packEntries[i];
+			valid = static_cast<uint64_t>(entry.nameOffset) + entry.nameSize <= packHeader->namesSize && entry.offset <= file.size() &&
+				entry.storedSize <= file.size() - entry.offset && ((entry.flags & FLAG_LZ4) != 0 || entry.storedSize == entry.size);
+		}
+		//find() probes until an empty slot, so there must be one even if slots repeat an entry
+		bool hasEmptySlot = false;
+		for (uint32_t i = 0; i < packHeader->slotCount && valid; i++)
+		{
+			valid = packSlots[i] == EMPTY_SLOT || packSlots[i] < packHeader->entryCount;
+			hasEmptySlot = hasEmptySlot || packSlots[i] == EMPTY_SLOT;
+		}
+		valid = valid && hasEmptySlot;
+		if (!valid)
+		{
+			file.close();
+			return false;
+		}
+
+		header = packHeader;
+		entries = packEntries;
+		slots = packSlots;
+		names = reinterpret_cast<const char*>(packSlots + packHeader->slotCount);
+		path = packPath;
+		return true;
+	}
+
+	void AssetPack::close()
+	{
+		file.close();
+		header = nullptr;
+		entries = nullptr;
+		slots = nullptr;
+		names = nullptr;
+		path.clear();
+	}
+
+	bool AssetPack::contains(const std::string& name) const
+	{
+		return find(name) != nullptr;
+	}
+
+	bool AssetPack::read(const std::string& name, Asset& asset) const
+	{
+		const Entry* entry = find(name);
+		if (entry == nullptr)
+			return false;
+
+		file.prefetch(static_cast<size_t>(entry->offset), static_cast<size_t>(entry->storedSize));
+		const unsigned char* stored = file.data() + entry->offset;
+		asset.length = static_cast<size_t>(entry->size);
+		if ((entry->flags & FLAG_LZ4) == 0)
+		{
+			asset.view = stored;
+			asset.decompressed.clear();
+			return true;
+		}
+
+		asset.view = nullptr;
+		asset.decompressed.resize(asset.length);
+		if (!lz4Decompress(stored, static_cast<size_t>(entry->storedSize), asset.decompressed.data(), asset.length))
+		{
+			asset.decompressed.clear();
+			asset.length = 0;
+			return false;
+		}
+		return true;
+	}
+
+	std::vector<std::string> AssetPack::getNames() const
+	{
+		std::vector<std::string> result;
+		if (!isOpen())
+			return result;
+		result.reserve(header->entryCount);
+		for (uint32_t i = 0; i < header->entryCount; i++)
+			result.emplace_back(names + entries[i].nameOffset, entries[i].nameSize);
+		return result;
+	}
+
+	const AssetPack::Entry* AssetPack::find(const std::string& name) const
+	{
+		if (!isOpen())
+			return nullptr;
+
+		std::string key = normalize(name);
+		uint64_t hash = hashString(key);
+		uint32_t mask = header->slotCount - 1;
+		//linear probing, open() checked the table has an empty slot
+		for (uint32_t slot = static_cast<uint32_t>(hash) & mask;; slot = (slot + 1) & mask)
+		{
+			uint32_t index = slots[slot];
+			if (index == EMPTY_SLOT)
+				return nullptr;
+			const Entry& entry = entries[index];
+			if (entry.nameHash == hash && entry.nameSize == key.size() && std::memcmp(names + entry.nameOffset, key.data(), key.size()) == 0)
+				return &entry;
+		}
+	}
+
+	std::string AssetPack::normalize(const std::string& name)
+	{
+		std::string result = name;
+		std::replace(result.begin(), result.end(), '\\', '/');
+		result = std::filesystem::path(result).lexically_normal().generic_string();
+		while (result.compare(0, 2, "./") == 0)
+			result.erase(0, 2);
+		return result;
+	}
+
+	bool AssetPack::build(const std::string& output, const std::vector<std::string>& inputs, bool compress, BuildStats& stats)
+	{
+		stats = BuildStats();
+		std::vector<std::string> packNames;
+		std::error_code error;
+		std::filesystem::path outputPath = std::filesystem::absolute(output, error);
+		auto addFile = [&](const std::filesystem::path& filePath) {
+			//a previous pack inside one of the inputs isn't packed into the new one
+			if (std::filesystem::absolute(filePath, error) != outputPath)
+				packNames.push_back(normalize(filePath.generic_string()));
+		};
+		for (const std::string& input : inputs)
+		{
+			if (std::filesystem::is_directory(input, error))
+			{
+				for (const auto& entry : std::filesystem::recursive_directory_iterator(input, error))
+				{
+					if (entry.is_regular_file())
+						addFile(entry.path());
+				}
+			}
+			else if (std::filesystem::is_regular_file(input, error))
+				addFile(input);
+			else
+				return false;
+		}
+		std::sort(packNames.begin(), packNames.end());
+		packNames.erase(std::unique(packNames.begin(), packNames.end()), packNames.end());
+
+		Header packHeader{};
+		packHeader.magic = MAGIC;
+		packHeader.version = VERSION;
+		packHeader.entryCount = static_cast<uint32_t>(packNames.size());
+		packHeader.slotCount = getSlotCount(packHeader.entryCount);
+		std::vector<Entry> packEntries(packNames.size());
+		std::string packNameData;
+		for (size_t i = 0; i < packNames.size(); i++)
+		{
+			packEntries[i].nameHash = hashString(packNames[i]);
+			packEntries[i].nameOffset = static_cast<uint32_t>(packNameData.size());
+			packEntries[i].nameSize = static_cast<uint32_t>(packNames[i].size());
+			packNameData += packNames[i];
+		}
+		std::vector<uint32_t> packSlots(packHeader.slotCount, EMPTY_SLOT);
+		for (uint32_t i = 0; i < packHeader.entryCount; i++)
+		{
+			uint32_t slot = static_cast<uint32_t>(packEntries[i].nameHash) & (packHeader.slotCount - 1);
+			while (packSlots[slot] != EMPTY_SLOT)
+				slot = (slot + 1) & (packHeader.slotCount - 1);
+			packSlots[slot] = i;
+		}
+		packHeader.namesSize = packNameData.size();
+		packHeader.indexSize = sizeof(Header) + packEntries.size() * sizeof(Entry) + packSlots.size() * sizeof(uint32_t) + packNameData.size();
+
+		//the contents after the index, the index is filled in once every entry's offset is known
+		std::vector<unsigned char> pack(alignUp(packHeader.indexSize, ALIGNMENT));
+		std::vector<unsigned char> contents;
+		std::vector<unsigned char> compressed;
+		for (size_t i = 0; i < packNames.size(); i++)
+		{
+			if (!readWholeFile(packNames[i], contents))
+				return false;
+
+			Entry& entry = packEntries[i];
+			entry.offset = pack.size();
+			entry.size = contents.size();
+			const std::vector<unsigned char>* stored = &contents;
+			if (compress && !contents.empty())
+			{
+				lz4Compress(contents.data(), contents.size(), compressed);
+				if (compressed.size() <= contents.size() - contents.size() / 8)
+				{
+					entry.flags |= FLAG_LZ4;
+					stored = &compressed;
+					stats.compressed++;
+				}
+			}
+			entry.storedSize = stored->size();
+			pack.insert(pack.end(), stored->begin(), stored->end());
+			pack.resize(alignUp(pack.size(), ALIGNMENT));
+			stats.bytes += entry.size;
+			stats.storedBytes += entry.storedSize;
+		}
+		stats.entries = packHeader.entryCount;
+
+		unsigned char* index = pack.data();
+		std::memcpy(index, &packHeader, sizeof(Header));
+		index += sizeof(Header);
+		std::memcpy(index, packEntries.data(), packEntries.size() * sizeof(Entry));
+		index += packEntries.size() * sizeof(Entry);
+		std::memcpy(index, packSlots.data(), packSlots.size() * sizeof(uint32_t));
+		index += packSlots.size() * sizeof(uint32_t);
+		std::memcpy(index, packNameData.data(), packNameData.size());
+
+		return writeFileAtomic(output, pack.data(), pack.size());
+	}
+}
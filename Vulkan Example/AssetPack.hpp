@@ -0,0 +1,98 @@
+#pragma once
+#include "MappedFile.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace vulkanExample
+{
+	// Every asset of the application in a single file, so startup opens and maps one file instead of thousands.
+	// The file starts with the index: a header, the entries, an open addressing hash table of the entries keyed by the hash
+	// of their name, and the names. The contents of every entry follow, each starting on a 4 KiB boundary so it maps and
+	// reads ahead on its own pages. Entries that shrink enough are stored LZ4 compressed.
+	// Names are the paths the application opens, relative to the working directory ("textures/viking_room.png")
+	class AssetPack
+	{
+	public:
+		// Contents of an entry: a view of the mapping, or a decompressed copy
+		class Asset
+		{
+		public:
+			const unsigned char* data() const { return view != nullptr ? view : decompressed.data(); }
+			size_t size() const { return length; }
+
+		private:
+			friend class AssetPack;
+			const unsigned char* view = nullptr;
+			std::vector<unsigned char> decompressed;
+			size_t length = 0;
+		};
+
+		struct BuildStats
+		{
+			uint32_t entries = 0;
+			uint32_t compressed = 0;
+			uint64_t bytes = 0;
+			uint64_t storedBytes = 0;
+		};
+
+		//false if the file is missing or isn't a valid pack
+		bool open(const std::string& path);
+		void close();
+		bool isOpen() const { return header != nullptr; }
+
+		bool contains(const std::string& name) const;
+		//thread safe. False if there is no such entry or its contents are corrupt
+		bool read(const std::string& name, Asset& asset) const;
+		//every entry, in the order they are stored
+		std::vector<std::string> getNames() const;
+		const std::string& getPath() const { return path; }
+
+		//packs every file under inputs (files or directories) into output, compressing the entries LZ4 shrinks by an eighth
+		//or more when compress is set. Replaces output only once it is complete
+		static bool build(const std::string& output, const std::vector<std::string>& inputs, bool compress, BuildStats& stats);
+
+	private:
+		static constexpr uint32_t MAGIC = 0x4b504556; //"VEPK"
+		static constexpr uint32_t VERSION = 1;
+		static constexpr uint64_t ALIGNMENT = 4096;
+		static constexpr uint32_t EMPTY_SLOT = UINT32_MAX;
+		static constexpr uint32_t FLAG_LZ4 = 1;
+
+		struct Header
+		{
+			uint32_t magic;
+			uint32_t version;
+			uint32_t entryCount;
+			//power of two, at least twice the entries
+			uint32_t slotCount;
+			uint64_t namesSize;
+			//the index ends there, the first entry's contents start at the next 4 KiB boundary
+			uint64_t indexSize;
+		};
+
+		struct Entry
+		{
+			uint64_t nameHash;
+			uint32_t nameOffset;
+			uint32_t nameSize;
+			uint64_t offset;
+			uint64_t storedSize;
+			uint64_t size;
+			uint32_t flags;
+			uint32_t reserved;
+		};
+
+		MappedFile file;
+		std::string path;
+		const Header* header = nullptr;
+		const Entry* entries = nullptr;
+		const uint32_t* slots = nullptr;
+		const char* names = nullptr;
+
+		const Entry* find(const std::string& name) const;
+		//forward slashes, without a leading "./"
+		static std::string normalize(const std::string& name);
+	};
+}
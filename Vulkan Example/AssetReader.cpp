@@ -0,0 +1,439 @@
+#include "AssetReader.hpp"
+#include "MappedFile.hpp"
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>) && !defined(VULKAN_EXAMPLE_NO_IO_URING)
+#include <linux/io_uring.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#define VULKAN_EXAMPLE_IO_URING
+#endif
+
+namespace vulkanExample
+{
+	namespace
+	{
+		//reads in flight at once, also the size of the submission ring
+		constexpr uint32_t QUEUE_DEPTH = 64;
+		//how long a broken ring is polled for the completions of the reads the kernel already took
+		constexpr std::chrono::milliseconds DRAIN_TIMEOUT{ 1000 };
+	}
+
+#ifdef VULKAN_EXAMPLE_IO_URING
+	// The submission and completion rings shared with the kernel, set up with the raw system calls so there is no liburing dependency
+	struct AssetReader::Ring
+	{
+		// A file being read
+		struct Read
+		{
+			int file = -1;
+			std::vector<unsigned char> data;
+			size_t offset = 0;
+			iovec vector{};
+			Completion done;
+		};
+
+		int fd = -1;
+		void* sqMapping = MAP_FAILED;
+		size_t sqMappingSize = 0;
+		void* cqMapping = MAP_FAILED;
+		size_t cqMappingSize = 0;
+		io_uring_sqe* sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+		size_t sqesSize = 0;
+
+		unsigned* sqHead = nullptr;
+		unsigned* sqTail = nullptr;
+		unsigned* sqMask = nullptr;
+		unsigned* sqArray = nullptr;
+		unsigned* cqHead = nullptr;
+		unsigned* cqTail = nullptr;
+		unsigned* cqMask = nullptr;
+		io_uring_cqe* cqes = nullptr;
+
+		//indexed by the user data of the entries, free ones have no completion
+		std::vector<Read> reads;
+		std::vector<uint32_t> freeReads;
+		//entries written to the submission ring but not submitted yet
+		uint32_t unsubmitted = 0;
+		//reads that never completed after the ring broke. The kernel may write into them until the ring is closed
+		std::vector<Read> abandoned;
+
+		bool create()
+		{
+			io_uring_params params{};
+			fd = static_cast<int>(syscall(__NR_io_uring_setup, QUEUE_DEPTH, &params));
+			if (fd < 0)
+				return false;
+
+			sqMappingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+			cqMappingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+			//both rings are in one mapping since Linux 5.4
+			bool singleMapping = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+			if (singleMapping)
+				sqMappingSize = cqMappingSize = std::max(sqMappingSize, cqMappingSize);
+
+			sqMapping = mmap(nullptr, sqMappingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+			if (sqMapping == MAP_FAILED)
+				return false;
+			if (singleMapping)
+				cqMapping = sqMapping;
+			else
+			{
+				cqMapping = mmap(nullptr, cqMappingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+				if (cqMapping == MAP_FAILED)
+					return false;
+			}
+			sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+			sqes = static_cast<io_uring_sqe*>(mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+			if (sqes == MAP_FAILED)
+				return false;
+
+			unsigned char* sq = static_cast<unsigned char*>(sqMapping);
+			sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+			sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+			sqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+			sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+			unsigned char* cq = static_cast<unsigned char*>(cqMapping);
+			cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+			cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+			cqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+			cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+			reads.resize(QUEUE_DEPTH);
+			for (uint32_t i = QUEUE_DEPTH; i-- > 0;)
+				freeReads.push_back(i);
+			return true;
+		}
+
+		~Ring()
+		{
+			if (sqes != MAP_FAILED)
+				munmap(sqes, sqesSize);
+			if (cqMapping != MAP_FAILED && cqMapping != sqMapping)
+				munmap(cqMapping, cqMappingSize);
+			if (sqMapping != MAP_FAILED)
+				munmap(sqMapping, sqMappingSize);
+			//closing the ring cancels the requests still in it, so the abandoned buffers are only released after it
+			if (fd >= 0)
+				close(fd);
+			for (Read& read : abandoned)
+				close(read.file);
+		}
+
+		uint32_t getInFlight() const { return QUEUE_DEPTH - static_cast<uint32_t>(freeReads.size()); }
+
+		//a read of the rest of the file into the submission ring. The ring has room, it is as large as the reads in flight
+		void queueRead(uint32_t index)
+		{
+			Read& read = reads[index];
+			read.vector.iov_base = read.data.data() + read.offset;
+			read.vector.iov_len = read.data.size() - read.offset;
+
+			//only this thread writes the tail, the kernel reads it
+			unsigned tail = *sqTail;
+			unsigned slot = tail & *sqMask;
+			io_uring_sqe& sqe = sqes[slot];
+			std::memset(&sqe, 0, sizeof(sqe));
+			//readv is the oldest read operation (Linux 5.1)
+			sqe.opcode = IORING_OP_READV;
+			sqe.fd = read.file;
+			sqe.addr = reinterpret_cast<uint64_t>(&read.vector);
+			sqe.len = 1;
+			sqe.off = read.offset;
+			sqe.user_data = index;
+			sqArray[slot] = slot;
+			__atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+			unsubmitted++;
+		}
+
+		//submits the queued reads and waits for at least one completion if any read is in flight. Returns false on errors
+		bool enter(uint32_t& submitted)
+		{
+			uint32_t waitFor = getInFlight() > 0 ? 1 : 0;
+			int result = static_cast<int>(syscall(__NR_io_uring_enter, fd, unsubmitted, waitFor, IORING_ENTER_GETEVENTS, nullptr, 0));
+			if (result < 0)
+				return errno == EINTR || errno == EAGAIN || errno == EBUSY;
+			submitted = static_cast<uint32_t>(result);
+			unsubmitted -= std::min(unsubmitted, submitted);
+			return true;
+		}
+	};
+#else
+	struct AssetReader::Ring
+	{
+	};
+#endif
+
+	AssetReader::AssetReader(ThreadPool& threadPool, Backend preferred)
+		: threadPool(threadPool)
+	{
+#ifdef VULKAN_EXAMPLE_IO_URING
+		if (preferred == Backend::IoUring)
+		{
+			ring = std::make_unique<Ring>();
+			if (ring->create())
+			{
+				backend = Backend::IoUring;
+				ioThread = std::thread(&AssetReader::ioLoop, this);
+				return;
+			}
+			ring.reset();
+		}
+#else
+		(void)preferred;
+#endif
+		backend = Backend::ThreadPool;
+	}
+
+	AssetReader::~AssetReader()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		condition.notify_all();
+		if (ioThread.joinable())
+			ioThread.join();
+
+		//the tasks reference the reader, they fail the requests still waiting
+		std::unique_lock<std::mutex> lock(mutex);
+		condition.wait(lock, [this]() { return activeTasks == 0; });
+		ring.reset();
+	}
+
+	AssetReader::Stats AssetReader::takeStats()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		Stats taken = stats;
+		stats = {};
+		return taken;
+	}
+
+	void AssetReader::enqueue(const std::string& path, Priority priority, Completion done)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (stopping)
+				throw std::runtime_error("asset reader is shutting down!");
+			pending.emplace(std::make_pair(static_cast<uint32_t>(priority), nextSequence++), Request{ path, std::move(done) });
+			if (backend == Backend::ThreadPool)
+				activeTasks++;
+		}
+
+		if (backend == Backend::IoUring)
+			condition.notify_all();
+		else
+			//every task reads whichever request is the most urgent when it runs, not necessarily this one
+			threadPool.submit([this]() { readNext(); });
+	}
+
+	bool AssetReader::popRequest(Request& request)
+	{
+		if (pending.empty())
+			return false;
+		auto first = pending.begin();
+		request = std::move(first->second);
+		pending.erase(first);
+		return true;
+	}
+
+	void AssetReader::countRead(size_t bytes, bool read)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (read)
+		{
+			stats.files++;
+			stats.bytes += bytes;
+		}
+		else
+			stats.failures++;
+	}
+
+	void AssetReader::readNext()
+	{
+		Request request;
+		bool stopped;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopped = stopping;
+			popRequest(request);
+		}
+
+		if (request.done)
+		{
+			MappedFile file;
+			bool read = !stopped && file.open(request.path);
+			countRead(file.size(), read);
+			request.done(file.data(), file.size(), read);
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			activeTasks--;
+		}
+		condition.notify_all();
+	}
+
+	void AssetReader::ioLoop()
+	{
+#ifdef VULKAN_EXAMPLE_IO_URING
+		Ring& ring = *this->ring;
+		bool failed = false;
+		auto finish = [&](uint32_t index, bool read) {
+			Ring::Read& entry = ring.reads[index];
+			close(entry.file);
+			countRead(entry.data.size(), read);
+			//decoded on a worker, the I/O thread only keeps the ring busy
+			threadPool.submit([done = std::move(entry.done), data = std::move(entry.data), read]() {
+				done(data.data(), data.size(), read);
+			});
+			entry = Ring::Read{};
+			ring.freeReads.push_back(index);
+		};
+		//the kernel may still write into the buffer: it is kept with its file until the ring is closed
+		auto abandon = [&](uint32_t index) {
+			Ring::Read& entry = ring.reads[index];
+			countRead(0, false);
+			threadPool.submit([done = std::move(entry.done)]() { done(nullptr, 0, false); });
+			ring.abandoned.push_back(std::move(entry));
+			entry = Ring::Read{};
+			ring.freeReads.push_back(index);
+		};
+		//handles the completions posted so far. Without retry the reads that stopped short fail instead of being queued again.
+		//Returns whether there were any
+		auto reapCompletions = [&](bool retry) {
+			unsigned head = *ring.cqHead;
+			unsigned tail = __atomic_load_n(ring.cqTail, __ATOMIC_ACQUIRE);
+			bool any = head != tail;
+			for (; head != tail; head++)
+			{
+				const io_uring_cqe& cqe = ring.cqes[head & *ring.cqMask];
+				uint32_t index = static_cast<uint32_t>(cqe.user_data);
+				Ring::Read& entry = ring.reads[index];
+				if (cqe.res == -EINTR || cqe.res == -EAGAIN)
+				{
+					if (retry)
+						ring.queueRead(index);
+					else
+						finish(index, false);
+				}
+				else if (cqe.res < 0)
+					finish(index, false);
+				else
+				{
+					entry.offset += static_cast<size_t>(cqe.res);
+					//a short read continues where it stopped, the end of the file comes early if it shrank meanwhile
+					if (cqe.res == 0)
+						entry.data.resize(entry.offset);
+					if (entry.offset == entry.data.size())
+						finish(index, true);
+					else if (retry)
+						ring.queueRead(index);
+					else
+						finish(index, false);
+				}
+			}
+			__atomic_store_n(ring.cqHead, head, __ATOMIC_RELEASE);
+			return any;
+		};
+
+		while (true)
+		{
+			std::vector<Request> batch;
+			bool stopped;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				if (ring.getInFlight() == 0)
+					condition.wait(lock, [this]() { return stopping || !pending.empty(); });
+				stopped = stopping;
+				//when stopping every waiting request fails right away, the ones in flight complete first
+				Request request;
+				while ((stopped || failed || batch.size() < ring.freeReads.size()) && popRequest(request))
+					batch.push_back(std::move(request));
+			}
+
+			for (Request& request : batch)
+			{
+				if (stopped || failed)
+				{
+					countRead(0, false);
+					request.done(nullptr, 0, false);
+					continue;
+				}
+
+				//opening and the size are metadata, usually cached, so only the reads go through the ring
+				int file = open(request.path.c_str(), O_RDONLY | O_CLOEXEC);
+				struct stat status{};
+				if (file < 0 || fstat(file, &status) != 0 || status.st_size == 0)
+				{
+					bool read = file >= 0 && status.st_size == 0;
+					if (file >= 0)
+						close(file);
+					countRead(0, read);
+					request.done(nullptr, 0, read);
+					continue;
+				}
+
+				uint32_t index = ring.freeReads.back();
+				ring.freeReads.pop_back();
+				Ring::Read& entry = ring.reads[index];
+				entry.file = file;
+				entry.data.resize(static_cast<size_t>(status.st_size));
+				entry.done = std::move(request.done);
+				ring.queueRead(index);
+			}
+
+			if (ring.getInFlight() == 0)
+			{
+				if (stopped)
+					return;
+				continue;
+			}
+
+			uint32_t submitted = 0;
+			bool hadSubmissions = ring.unsubmitted > 0;
+			if (!ring.enter(submitted))
+			{
+				//the ring is unusable. The reads the kernel never took from the submission ring fail right away, nothing will
+				//submit them now
+				failed = true;
+				unsigned sqHead = __atomic_load_n(ring.sqHead, __ATOMIC_ACQUIRE);
+				for (unsigned position = sqHead; position != *ring.sqTail; position++)
+					finish(static_cast<uint32_t>(ring.sqes[position & *ring.sqMask].user_data), false);
+				ring.unsubmitted = 0;
+
+				//the others are in the kernel and write into their buffers until they complete. Their completions still get
+				//posted without io_uring_enter (the sleep's return runs the kernel's deferred work), so they are polled for a
+				//while. The reads that never complete keep their buffers until the ring is closed
+				auto deadline = std::chrono::steady_clock::now() + DRAIN_TIMEOUT;
+				while (ring.getInFlight() > 0 && std::chrono::steady_clock::now() < deadline)
+				{
+					if (!reapCompletions(false))
+						std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				}
+				for (uint32_t index = 0; index < QUEUE_DEPTH; index++)
+				{
+					if (ring.reads[index].done)
+						abandon(index);
+				}
+				continue;
+			}
+			if (hadSubmissions && submitted > 0)
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				stats.submissions++;
+			}
+
+			reapCompletions(true);
+		}
+#endif
+	}
+}
@@ -0,0 +1,123 @@
+#pragma once
+#include "ThreadPool.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace vulkanExample
+{
+	// Reads whole asset files asynchronously and runs their decoding on the thread pool.
+	// On Linux the reads go through io_uring: an I/O thread opens the files, queues up to QUEUE_DEPTH reads in the submission
+	// ring, submits them with a single io_uring_enter and passes every completed file to a decode worker. Without io_uring
+	// (other platforms, old kernels, sandboxes that forbid it) the thread pool workers map the files and decode them themselves.
+	// Waiting requests start by priority, in submission order within a priority, so the assets of the
+	// visible draws are read before the others
+	class AssetReader
+	{
+	public:
+		enum class Backend
+		{
+			IoUring,
+			ThreadPool
+		};
+
+		// Loading order, the first ones first
+		enum class Priority : uint32_t
+		{
+			//used by a draw in view
+			Visible = 0,
+			Hidden = 1,
+			//not needed for the current frame, e.g. restoring a downgraded texture
+			Background = 2
+		};
+
+		struct Stats
+		{
+			uint64_t files = 0;
+			uint64_t bytes = 0;
+			uint64_t failures = 0;
+			//io_uring_enter calls that submitted reads, fewer than files when they are batched
+			uint64_t submissions = 0;
+		};
+
+		//falls back to the thread pool if io_uring isn't available. The pool must outlive the reader
+		explicit AssetReader(ThreadPool& threadPool, Backend preferred = Backend::IoUring);
+		~AssetReader();
+
+		AssetReader(const AssetReader&) = delete;
+		AssetReader& operator=(const AssetReader&) = delete;
+
+		//reads the whole file, then returns decode(data, size) on a worker. The data is only valid during the call.
+		//A file that can't be read, or an exception thrown by decode, is rethrown by the returned future
+		template<typename Decode>
+		auto read(const std::string& path, Priority priority, Decode&& decode)
+			-> std::future<decltype(decode(static_cast<const unsigned char*>(nullptr), size_t()))>
+		{
+			using Result = decltype(decode(static_cast<const unsigned char*>(nullptr), size_t()));
+			auto promise = std::make_shared<std::promise<Result>>();
+			std::future<Result> result = promise->get_future();
+			enqueue(path, priority, [promise, path, decode = std::forward<Decode>(decode)](const unsigned char* data, size_t size, bool read) mutable {
+				try
+				{
+					if (!read)
+						throw std::runtime_error("failed to read asset " + path + "!");
+					promise->set_value(decode(data, size));
+				}
+				catch (...)
+				{
+					promise->set_exception(std::current_exception());
+				}
+			});
+			return result;
+		}
+
+		Backend getBackend() const { return backend; }
+		const char* getBackendName() const { return backend == Backend::IoUring ? "io_uring" : "thread pool"; }
+		//counts since the last call
+		Stats takeStats();
+
+	private:
+		//data, size, read successfully
+		using Completion = std::function<void(const unsigned char*, size_t, bool)>;
+
+		struct Request
+		{
+			std::string path;
+			Completion done;
+		};
+
+		struct Ring;
+
+		ThreadPool& threadPool;
+		Backend backend = Backend::ThreadPool;
+		std::unique_ptr<Ring> ring;
+		std::thread ioThread;
+
+		std::mutex mutex;
+		std::condition_variable condition;
+		//keyed by priority, then submission order
+		std::map<std::pair<uint32_t, uint64_t>, Request> pending;
+		uint64_t nextSequence = 0;
+		bool stopping = false;
+		//thread pool backend: read tasks queued or running, the destructor waits for them
+		uint32_t activeTasks = 0;
+		Stats stats;
+
+		void enqueue(const std::string& path, Priority priority, Completion done);
+		//pops the most urgent request, false if there is none
+		bool popRequest(Request& request);
+		void countRead(size_t bytes, bool read);
+		void ioLoop();
+		void readNext();
+	};
+}
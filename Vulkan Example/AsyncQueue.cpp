@@ -0,0 +1,214 @@
+#include "AsyncQueue.hpp"
+#include <stdexcept>
+
+namespace vulkanExample
+{
+	OwnershipTransfer::OwnershipTransfer(uint32_t srcFamily, uint32_t dstFamily)
+		: srcFamily(srcFamily), dstFamily(dstFamily)
+	{
+	}
+
+	void OwnershipTransfer::addBuffer(VkBuffer buffer, VkAccessFlags srcAccess, VkPipelineStageFlags srcStages,
+		VkAccessFlags dstAccess, VkPipelineStageFlags dstStages)
+	{
+		VkBufferMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		barrier.srcAccessMask = srcAccess;
+		barrier.dstAccessMask = dstAccess;
+		barrier.srcQueueFamilyIndex = srcFamily;
+		barrier.dstQueueFamilyIndex = dstFamily;
+		barrier.buffer = buffer;
+		barrier.offset = 0;
+		barrier.size = VK_WHOLE_SIZE;
+		buffers.push_back(barrier);
+
+		this->srcStages |= srcStages;
+		this->dstStages |= dstStages;
+	}
+
+	void OwnershipTransfer::addImage(VkImage image, const VkImageSubresourceRange& range, VkImageLayout oldLayout, VkImageLayout newLayout,
+		VkAccessFlags srcAccess, VkPipelineStageFlags srcStages, VkAccessFlags dstAccess, VkPipelineStageFlags dstStages)
+	{
+		VkImageMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.srcAccessMask = srcAccess;
+		barrier.dstAccessMask = dstAccess;
+		barrier.oldLayout = oldLayout;
+		barrier.newLayout = newLayout;
+		barrier.srcQueueFamilyIndex = srcFamily;
+		barrier.dstQueueFamilyIndex = dstFamily;
+		barrier.image = image;
+		barrier.subresourceRange = range;
+		images.push_back(barrier);
+
+		this->srcStages |= srcStages;
+		this->dstStages |= dstStages;
+	}
+
+	void OwnershipTransfer::recordRelease(VkCommandBuffer commandBuffer) const
+	{
+		if (!isNeeded())
+			return;
+
+		//the destination access of a release is ignored, the acquire makes the writes visible
+		std::vector<VkBufferMemoryBarrier> bufferBarriers(buffers);
+		for (VkBufferMemoryBarrier& barrier : bufferBarriers)
+			barrier.dstAccessMask = 0;
+		std::vector<VkImageMemoryBarrier> imageBarriers(images);
+		for (VkImageMemoryBarrier& barrier : imageBarriers)
+			barrier.dstAccessMask = 0;
+
+		vkCmdPipelineBarrier(commandBuffer, srcStages, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+			0, nullptr,
+			static_cast<uint32_t>(bufferBarriers.size()), bufferBarriers.data(),
+			static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+	}
+
+	void OwnershipTransfer::recordAcquire(VkCommandBuffer commandBuffer) const
+	{
+		if (!isNeeded())
+			return;
+
+		//and the source access of an acquire, the semaphore wait already ordered it after the release
+		std::vector<VkBufferMemoryBarrier> bufferBarriers(buffers);
+		for (VkBufferMemoryBarrier& barrier : bufferBarriers)
+			barrier.srcAccessMask = 0;
+		std::vector<VkImageMemoryBarrier> imageBarriers(images);
+		for (VkImageMemoryBarrier& barrier : imageBarriers)
+			barrier.srcAccessMask = 0;
+
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, dstStages, 0,
+			0, nullptr,
+			static_cast<uint32_t>(bufferBarriers.size()), bufferBarriers.data(),
+			static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+	}
+
+	void AsyncQueue::create(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t family, VkQueue queue, GpuTimeline& graphicsTimeline,
+		uint32_t graphicsFamily, VkCommandPool graphicsPool, bool hostQueryReset)
+	{
+		if (!graphicsTimeline.usesTimelineSemaphore())
+			throw std::runtime_error("async queues need timeline semaphores!");
+
+		this->device = device;
+		this->family = family;
+		this->graphicsTimeline = &graphicsTimeline;
+		this->graphicsFamily = graphicsFamily;
+		this->graphicsPool = graphicsPool;
+
+		VkCommandPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		poolInfo.queueFamilyIndex = family;
+		//every command buffer is recorded once and freed when its submission completed
+		poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+		if (vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool) != VK_SUCCESS)
+			throw std::runtime_error("failed to create async queue command pool!");
+
+		timeline.create(device, queue, true);
+
+		//transfer only families can't record vkCmdResetQueryPool, so without host resets they are not timed
+		VkQueueFlags flags = 0;
+		uint32_t familyCount = 0;
+		vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, nullptr);
+		std::vector<VkQueueFamilyProperties> families(familyCount);
+		vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, families.data());
+		if (family < familyCount)
+			flags = families[family].queueFlags;
+		bool canResetOnQueue = (flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) != 0;
+		if (canResetOnQueue || hostQueryReset)
+			timer.create(device, physicalDevice, family, TIMER_SLOTS, !canResetOnQueue);
+		nextSlot = 0;
+		recordingSlot.reset();
+		busyTime = 0.0;
+	}
+
+	void AsyncQueue::destroy()
+	{
+		if (commandPool == VK_NULL_HANDLE)
+			return;
+
+		timeline.destroy();
+		timer.destroy();
+		vkDestroyCommandPool(device, commandPool, nullptr);
+		commandPool = VK_NULL_HANDLE;
+	}
+
+	VkCommandBuffer AsyncQueue::begin()
+	{
+		VkCommandBuffer commandBuffer = allocate(commandPool);
+
+		//a slot still in flight since TIMER_SLOTS submissions ago is left alone, this command buffer is just not timed
+		recordingSlot.reset();
+		if (timer.isSupported())
+		{
+			uint32_t slot = nextSlot;
+			nextSlot = (nextSlot + 1) % TIMER_SLOTS;
+			if (timer.isPending(slot))
+				busyTime += timer.collect(slot).value_or(0.0);
+			if (!timer.isPending(slot))
+			{
+				timer.begin(commandBuffer, slot);
+				recordingSlot = slot;
+			}
+		}
+		return commandBuffer;
+	}
+
+	uint64_t AsyncQueue::submit(VkCommandBuffer commandBuffer, const OwnershipTransfer& handoff)
+	{
+		handoff.recordRelease(commandBuffer);
+		if (recordingSlot.has_value())
+			timer.end(commandBuffer, recordingSlot.value());
+		recordingSlot.reset();
+		vkEndCommandBuffer(commandBuffer);
+
+		uint64_t value = timeline.submit({ commandBuffer });
+		timeline.deferUntil(value, [this, commandBuffer]() {
+			vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
+		});
+
+		//submitted even without anything to acquire, so the returned value is always one of the graphics timeline
+		VkCommandBuffer acquireBuffer = allocate(graphicsPool);
+		handoff.recordAcquire(acquireBuffer);
+		vkEndCommandBuffer(acquireBuffer);
+
+		uint64_t graphicsValue = graphicsTimeline->submit({ acquireBuffer },
+			{ { timeline.getSemaphore(), value, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT } });
+		VkCommandPool pool = graphicsPool;
+		VkDevice device = this->device;
+		graphicsTimeline->deferUntil(graphicsValue, [device, pool, acquireBuffer]() {
+			vkFreeCommandBuffers(device, pool, 1, &acquireBuffer);
+		});
+		return graphicsValue;
+	}
+
+	double AsyncQueue::collectBusyTime()
+	{
+		for (uint32_t slot = 0; slot < TIMER_SLOTS; slot++)
+		{
+			if (timer.isPending(slot))
+				busyTime += timer.collect(slot).value_or(0.0);
+		}
+		double time = busyTime;
+		busyTime = 0.0;
+		return time;
+	}
+
+	VkCommandBuffer AsyncQueue::allocate(VkCommandPool pool)
+	{
+		VkCommandBufferAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandPool = pool;
+		allocInfo.commandBufferCount = 1;
+
+		VkCommandBuffer commandBuffer;
+		if (vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer) != VK_SUCCESS)
+			throw std::runtime_error("failed to allocate async queue command buffer!");
+
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		vkBeginCommandBuffer(commandBuffer, &beginInfo);
+		return commandBuffer;
+	}
+}
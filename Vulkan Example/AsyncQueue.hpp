@@ -0,0 +1,91 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include "GpuTimeline.hpp"
+#include "GpuTimer.hpp"
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+namespace vulkanExample
+{
+	// Hands resources created with VK_SHARING_MODE_EXCLUSIVE from one queue family to another.
+	// The source queue records the release barriers after its last use, the destination queue waits for that submission
+	// and records the matching acquire barriers before its first use. Records nothing when both families are the same
+	class OwnershipTransfer
+	{
+	public:
+		OwnershipTransfer(uint32_t srcFamily, uint32_t dstFamily);
+
+		//srcAccess/srcStages: the last use on the source queue, dstAccess/dstStages: the first use on the destination queue
+		void addBuffer(VkBuffer buffer, VkAccessFlags srcAccess, VkPipelineStageFlags srcStages,
+			VkAccessFlags dstAccess, VkPipelineStageFlags dstStages);
+		//the layout transition (if any) happens once, between the release and the acquire
+		void addImage(VkImage image, const VkImageSubresourceRange& range, VkImageLayout oldLayout, VkImageLayout newLayout,
+			VkAccessFlags srcAccess, VkPipelineStageFlags srcStages, VkAccessFlags dstAccess, VkPipelineStageFlags dstStages);
+
+		void recordRelease(VkCommandBuffer commandBuffer) const;
+		void recordAcquire(VkCommandBuffer commandBuffer) const;
+
+		bool isNeeded() const { return srcFamily != dstFamily && (!buffers.empty() || !images.empty()); }
+		uint32_t getSrcFamily() const { return srcFamily; }
+		uint32_t getDstFamily() const { return dstFamily; }
+
+	private:
+		uint32_t srcFamily;
+		uint32_t dstFamily;
+		std::vector<VkBufferMemoryBarrier> buffers;
+		std::vector<VkImageMemoryBarrier> images;
+		VkPipelineStageFlags srcStages = 0;
+		VkPipelineStageFlags dstStages = 0;
+	};
+
+	// A queue next to the graphics queue (dedicated transfer or async compute) with its own command pool, timeline and
+	// busy timer, so the work recorded on it overlaps the frames instead of being serialized with them.
+	// submit() releases the resources the work wrote to the graphics family, and submits a small graphics command buffer
+	// that waits on this queue's timeline value on the GPU (never on the CPU) and acquires them.
+	// Needs timeline semaphores. One command buffer is recorded at a time
+	class AsyncQueue
+	{
+	public:
+		//graphicsPool allocates the acquire command buffers, graphicsTimeline frees them
+		void create(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t family, VkQueue queue, GpuTimeline& graphicsTimeline,
+			uint32_t graphicsFamily, VkCommandPool graphicsPool, bool hostQueryReset);
+		//waits for the queue and runs every pending deferred callback
+		void destroy();
+
+		VkCommandBuffer begin();
+		//ends and submits the command buffer. handoff must go from this family to the graphics family.
+		//Returns the graphics timeline value after which the resources can be used on the graphics queue
+		uint64_t submit(VkCommandBuffer commandBuffer, const OwnershipTransfer& handoff);
+
+		//GPU time (in milliseconds) of the command buffers that completed since the last call. Never blocks
+		double collectBusyTime();
+		//frees the command buffers of the completed submissions
+		void collectGarbage() { timeline.collectGarbage(); }
+
+		bool isCreated() const { return commandPool != VK_NULL_HANDLE; }
+		bool isTimed() const { return timer.isSupported(); }
+		uint32_t getFamily() const { return family; }
+		GpuTimeline& getTimeline() { return timeline; }
+
+	private:
+		static constexpr uint32_t TIMER_SLOTS = 32;
+
+		VkDevice device = VK_NULL_HANDLE;
+		uint32_t family = 0;
+		VkCommandPool commandPool = VK_NULL_HANDLE;
+		GpuTimeline timeline;
+
+		GpuTimeline* graphicsTimeline = nullptr;
+		uint32_t graphicsFamily = 0;
+		VkCommandPool graphicsPool = VK_NULL_HANDLE;
+
+		GpuTimer timer;
+		uint32_t nextSlot = 0;
+		//slot of the command buffer being recorded, none if every slot was still in flight
+		std::optional<uint32_t> recordingSlot;
+		double busyTime = 0.0;
+
+		VkCommandBuffer allocate(VkCommandPool pool);
+	};
+}
@@ -0,0 +1,1074 @@
+#include "Benchmarks.hpp"
+#include "AssetPack.hpp"
+#include "AssetReader.hpp"
+#include "DrawQueue.hpp"
+#include "JpegDecoder.hpp"
+#include "MappedFile.hpp"
+#include "PixelFormat.hpp"
+#include "RenderGraph.hpp"
+#include "Texture.hpp"
+#include "TextureDecoder.hpp"
+#include "ThreadPool.hpp"
+#include <stb_image.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <vector>
+
+namespace vulkanExample
+{
+	namespace
+	{
+		constexpr int BENCHMARK_RUNS = 5;
+
+		//best of several runs of work(input copy), in milliseconds. The copy isn't timed
+		double timeBest(const std::vector<DrawPacket>& input, std::vector<DrawPacket>& output,
+			const std::function<void(std::vector<DrawPacket>&)>& work)
+		{
+			double best = 0.0;
+			for (int run = 0; run < BENCHMARK_RUNS; run++)
+			{
+				output = input;
+				auto start = std::chrono::steady_clock::now();
+				work(output);
+				double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+				if (run == 0 || ms < best)
+					best = ms;
+			}
+			return best;
+		}
+
+		//touches every byte, so a mapping is read in full too, and tells the two paths apart if they disagree
+		uint64_t checksum(const unsigned char* data, size_t size)
+		{
+			uint64_t sum = 0;
+			size_t i = 0;
+			for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+			{
+				uint64_t word;
+				std::memcpy(&word, data + i, sizeof(word));
+				sum = (sum ^ word) * 1099511628211ull;
+			}
+			for (; i < size; i++)
+				sum = (sum ^ data[i]) * 1099511628211ull;
+			return sum;
+		}
+
+		//what VulkanInterface::readFile did: seek to get the size, then copy into a buffer
+		uint64_t readStream(const std::string& path)
+		{
+			std::ifstream file(path, std::ios::ate | std::ios::binary);
+			std::vector<unsigned char> buffer(static_cast<size_t>(file.tellg()));
+			file.seekg(0);
+			file.read(reinterpret_cast<char*>(buffer.data()), static_cast<std::streamsize>(buffer.size()));
+			return checksum(buffer.data(), buffer.size());
+		}
+
+		uint64_t readMapped(const std::string& path)
+		{
+			MappedFile file;
+			if (!file.open(path))
+				return 0;
+			return checksum(file.data(), file.size());
+		}
+
+		//every regular file under path, a file or a directory, and their total size
+		std::vector<std::string> listFiles(const std::string& path, uint64_t& totalBytes)
+		{
+			std::vector<std::string> files;
+			std::error_code error;
+			if (std::filesystem::is_directory(path, error))
+			{
+				for (const auto& entry : std::filesystem::recursive_directory_iterator(path, error))
+				{
+					if (entry.is_regular_file())
+						files.push_back(entry.path().string());
+				}
+			}
+			else if (std::filesystem::is_regular_file(path, error))
+				files.push_back(path);
+
+			totalBytes = 0;
+			for (const std::string& file : files)
+				totalBytes += std::filesystem::file_size(file, error);
+			return files;
+		}
+
+		struct ReadResult
+		{
+			double warmMs = 0.0;
+			double coldMs = 0.0;
+			uint64_t checksum = 0;
+		};
+
+		//warm: best of several runs after a first one that fills the page cache. Cold: average of runs that each start
+		//with the page cache of cachedFiles dropped
+		ReadResult timeRuns(bool cold, const std::vector<std::string>& cachedFiles, const std::function<uint64_t()>& readAll)
+		{
+			ReadResult result;
+			auto timeRun = [&]() {
+				auto start = std::chrono::steady_clock::now();
+				result.checksum = readAll();
+				return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			};
+
+			timeRun();
+			for (int run = 0; run < BENCHMARK_RUNS; run++)
+			{
+				double ms = timeRun();
+				if (run == 0 || ms < result.warmMs)
+					result.warmMs = ms;
+			}
+			if (cold)
+			{
+				for (int run = 0; run < BENCHMARK_RUNS; run++)
+				{
+					for (const std::string& file : cachedFiles)
+						dropFileCache(file);
+					result.coldMs += timeRun() / BENCHMARK_RUNS;
+				}
+			}
+			return result;
+		}
+
+		ReadResult timeReads(const std::vector<std::string>& files, bool cold, const std::function<uint64_t(const std::string&)>& read)
+		{
+			return timeRuns(cold, files, [&]() {
+				uint64_t sum = 0;
+				for (const std::string& file : files)
+					sum += read(file);
+				return sum;
+			});
+		}
+
+		bool samePackets(const std::vector<DrawPacket>& a, const std::vector<DrawPacket>& b)
+		{
+			return std::equal(a.begin(), a.end(), b.begin(), b.end(), [](const DrawPacket& x, const DrawPacket& y) {
+				return x.key == y.key && x.drawIndex == y.drawIndex;
+			});
+		}
+
+		constexpr uint32_t SYNTHETIC_IMAGES = 200;
+
+		uint32_t crc32(const unsigned char* data, size_t size)
+		{
+			static const std::vector<uint32_t> table = []() {
+				std::vector<uint32_t> values(256);
+				for (uint32_t i = 0; i < 256; i++)
+				{
+					uint32_t value = i;
+					for (int bit = 0; bit < 8; bit++)
+						value = value & 1 ? 0xedb88320u ^ (value >> 1) : value >> 1;
+					values[i] = value;
+				}
+				return values;
+			}();
+			uint32_t crc = 0xffffffffu;
+			for (size_t i = 0; i < size; i++)
+				crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+			return crc ^ 0xffffffffu;
+		}
+
+		void appendBigEndian(std::vector<unsigned char>& output, uint32_t value)
+		{
+			for (int shift = 24; shift >= 0; shift -= 8)
+				output.push_back(static_cast<unsigned char>(value >> shift));
+		}
+
+		void appendChunk(std::vector<unsigned char>& output, const char* type, const std::vector<unsigned char>& data)
+		{
+			appendBigEndian(output, static_cast<uint32_t>(data.size()));
+			size_t start = output.size();
+			output.insert(output.end(), type, type + 4);
+			output.insert(output.end(), data.begin(), data.end());
+			appendBigEndian(output, crc32(output.data() + start, output.size() - start));
+		}
+
+		//PNG of the pixels with the five filter types in turn and stored (uncompressed) deflate blocks. No encoder ships with
+		//the repository, but stb_image still parses, unfilters and converts every row like it does for a compressed file
+		std::vector<unsigned char> encodePng(uint32_t width, uint32_t height, uint32_t channels, const std::vector<unsigned char>& pixels)
+		{
+			size_t stride = static_cast<size_t>(width) * channels;
+			std::vector<unsigned char> filtered;
+			filtered.reserve((stride + 1) * height);
+			for (uint32_t y = 0; y < height; y++)
+			{
+				unsigned char filter = static_cast<unsigned char>(y % 5);
+				filtered.push_back(filter);
+				const unsigned char* row = pixels.data() + y * stride;
+				const unsigned char* up = y > 0 ? row - stride : nullptr;
+				for (size_t x = 0; x < stride; x++)
+				{
+					int a = x >= channels ? row[x - channels] : 0;
+					int b = up != nullptr ? up[x] : 0;
+					int c = up != nullptr && x >= channels ? up[x - channels] : 0;
+					int predicted = 0;
+					if (filter == 1)
+						predicted = a;
+					else if (filter == 2)
+						predicted = b;
+					else if (filter == 3)
+						predicted = (a + b) / 2;
+					else if (filter == 4)
+					{
+						int p = a + b - c;
+						int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+						predicted = pa <= pb && pa <= pc ? a : (pb <= pc ? b : c);
+					}
+					filtered.push_back(static_cast<unsigned char>(row[x] - predicted));
+				}
+			}
+
+			//zlib stream of stored blocks of up to 65535 bytes, then the Adler-32 of the filtered rows
+			std::vector<unsigned char> zlib = { 0x78, 0x01 };
+			for (size_t offset = 0; offset < filtered.size(); offset += 65535)
+			{
+				size_t length = std::min<size_t>(65535, filtered.size() - offset);
+				zlib.push_back(offset + length == filtered.size() ? 1 : 0);
+				zlib.push_back(static_cast<unsigned char>(length & 0xff));
+				zlib.push_back(static_cast<unsigned char>(length >> 8));
+				zlib.push_back(static_cast<unsigned char>(~length & 0xff));
+				zlib.push_back(static_cast<unsigned char>((~length >> 8) & 0xff));
+				zlib.insert(zlib.end(), filtered.begin() + offset, filtered.begin() + offset + length);
+			}
+			uint32_t sumA = 1, sumB = 0;
+			for (unsigned char byte : filtered)
+			{
+				sumA = (sumA + byte) % 65521;
+				sumB = (sumB + sumA) % 65521;
+			}
+			appendBigEndian(zlib, sumB << 16 | sumA);
+
+			std::vector<unsigned char> png = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+			std::vector<unsigned char> header;
+			appendBigEndian(header, width);
+			appendBigEndian(header, height);
+			//8 bits per channel, RGB or RGBA, no interlacing
+			header.insert(header.end(), { 8, static_cast<unsigned char>(channels == 4 ? 6 : 2), 0, 0, 0 });
+			appendChunk(png, "IHDR", header);
+			appendChunk(png, "IDAT", zlib);
+			appendChunk(png, "IEND", {});
+			return png;
+		}
+
+		//gradients with noise, 64 to 512 texels a side, every other one RGBA with a varying alpha
+		std::vector<std::vector<unsigned char>> makeSyntheticImages(uint32_t count)
+		{
+			std::mt19937 random(7);
+			std::vector<std::vector<unsigned char>> images;
+			for (uint32_t i = 0; i < count; i++)
+			{
+				uint32_t width = 64u << (random() % 4);
+				uint32_t height = 64u << (random() % 4);
+				uint32_t channels = i % 2 == 0 ? 3 : 4;
+				std::vector<unsigned char> pixels(static_cast<size_t>(width) * height * channels);
+				for (uint32_t y = 0; y < height; y++)
+				{
+					for (uint32_t x = 0; x < width; x++)
+					{
+						unsigned char* pixel = &pixels[(static_cast<size_t>(y) * width + x) * channels];
+						uint32_t noise = random();
+						pixel[0] = static_cast<unsigned char>(x * 255 / width + (noise & 7));
+						pixel[1] = static_cast<unsigned char>(y * 255 / height + (noise >> 3 & 7));
+						pixel[2] = static_cast<unsigned char>((x + y) * 127 / (width + height) + (noise >> 6 & 15));
+						if (channels == 4)
+							pixel[3] = static_cast<unsigned char>(x * y * 255 / (width * height) | (noise >> 10 & 3));
+					}
+				}
+				images.push_back(encodePng(width, height, channels, pixels));
+			}
+			return images;
+		}
+
+		//like VulkanInterface::decodeTextureData when keepRgb is set, like it used to otherwise (stb_image expanding RGB to
+		//RGBA). No pixels if the file isn't an image
+		TextureData decodeImage(const std::vector<unsigned char>& file, bool keepRgb)
+		{
+			TextureData image;
+			int width, height, fileChannels;
+			if (!stbi_info_from_memory(file.data(), static_cast<int>(file.size()), &width, &height, &fileChannels))
+				return image;
+			int channels = keepRgb && fileChannels == 3 ? STBI_rgb : STBI_rgb_alpha;
+			stbi_uc* pixels = stbi_load_from_memory(file.data(), static_cast<int>(file.size()), &width, &height, &fileChannels, channels);
+			if (pixels == nullptr)
+				return image;
+			image.width = static_cast<uint32_t>(width);
+			image.height = static_cast<uint32_t>(height);
+			image.channels = static_cast<uint32_t>(channels);
+			image.pixels.assign(pixels, pixels + static_cast<size_t>(width) * height * channels);
+			stbi_image_free(pixels);
+			return image;
+		}
+
+		//best of several runs of work, in milliseconds
+		double timeWork(const std::function<void()>& work)
+		{
+			double best = 0.0;
+			for (int run = 0; run < BENCHMARK_RUNS; run++)
+			{
+				auto start = std::chrono::steady_clock::now();
+				work();
+				double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+				if (run == 0 || ms < best)
+					best = ms;
+			}
+			return best;
+		}
+
+		//compares the barriers scheduled before a pass (or at the end of the frame) with the expected ones, in order
+		bool checkBarriers(const std::string& where, const RenderGraph::BarrierBatch& batch, const std::vector<RenderGraph::Barrier>& expected)
+		{
+			if (batch.barriers.size() != expected.size())
+			{
+				std::cout << "    " << where << ": " << batch.barriers.size() << " barriers, not the " << expected.size() << " expected" << std::endl;
+				return false;
+			}
+			for (size_t i = 0; i < expected.size(); i++)
+			{
+				const RenderGraph::Barrier& a = batch.barriers[i];
+				const RenderGraph::Barrier& b = expected[i];
+				if (a.resource != b.resource || a.oldLayout != b.oldLayout || a.newLayout != b.newLayout || a.srcStages != b.srcStages ||
+					a.dstStages != b.dstStages || a.srcAccess != b.srcAccess || a.dstAccess != b.dstAccess)
+				{
+					std::cout << "    " << where << ": barrier " << i << " is resource " << a.resource << ", layout " << a.oldLayout << " -> " << a.newLayout <<
+						", stages 0x" << std::hex << a.srcStages << " -> 0x" << a.dstStages << ", access 0x" << a.srcAccess << " -> 0x" << a.dstAccess <<
+						", expected resource " << std::dec << b.resource << ", layout " << b.oldLayout << " -> " << b.newLayout << ", stages 0x" << std::hex <<
+						b.srcStages << " -> 0x" << b.dstStages << ", access 0x" << b.srcAccess << " -> 0x" << b.dstAccess << std::dec << std::endl;
+					return false;
+				}
+			}
+			return true;
+		}
+
+		bool checkCondition(const std::string& what, bool condition)
+		{
+			if (!condition)
+				std::cout << "    " << what << " doesn't hold" << std::endl;
+			return condition;
+		}
+	}
+
+	int benchmarkDrawSort(size_t count)
+	{
+		//a few layers and pipelines, many materials and random depths, like a large scene
+		std::mt19937_64 random(42);
+		std::uniform_int_distribution<uint32_t> layers(0, 3), pipelines(0, 15), materials(0, 1023);
+		std::uniform_real_distribution<float> depths(0.0f, 1.0f);
+
+		DrawQueue queue;
+		queue.reserve(count);
+		for (size_t i = 0; i < count; i++)
+			queue.push(DrawQueue::makeKey(layers(random), pipelines(random), materials(random), depths(random)), static_cast<uint32_t>(i));
+		std::vector<DrawPacket> input = queue.getPackets();
+
+		ThreadPool threadPool;
+		std::vector<DrawPacket> reference, sorted, scratch;
+
+		double stdMs = timeBest(input, reference, [](std::vector<DrawPacket>& packets) {
+			std::stable_sort(packets.begin(), packets.end(), [](const DrawPacket& a, const DrawPacket& b) { return a.key < b.key; });
+		});
+		double radixMs = timeBest(input, sorted, [&](std::vector<DrawPacket>& packets) { radixSort(packets, scratch); });
+		bool radixMatches = samePackets(sorted, reference);
+		double parallelMs = timeBest(input, sorted, [&](std::vector<DrawPacket>& packets) { radixSort(packets, scratch, &threadPool); });
+		bool parallelMatches = samePackets(sorted, reference);
+
+		DrawQueue::BindCounts unsortedBinds = queue.countBinds();
+		queue.sort(&threadPool);
+		DrawQueue::BindCounts sortedBinds = queue.countBinds();
+		bool bindsMinimal = queue.isBindMinimal();
+
+		std::cout << "Sorting " << count << " draw keys (best of " << BENCHMARK_RUNS << " runs)" << std::endl
+			<< "  std::stable_sort:      " << stdMs << " ms" << std::endl
+			<< "  radix sort:            " << radixMs << " ms" << (radixMatches ? "" : " WRONG ORDER") << std::endl
+			<< "  parallel radix sort:   " << parallelMs << " ms on " << threadPool.size() + 1 << " threads"
+			<< (parallelMatches ? "" : " WRONG ORDER") << std::endl
+			<< "  binds unsorted:        " << unsortedBinds.pipelineBinds << " pipelines, " << unsortedBinds.materialBinds << " materials" << std::endl
+			<< "  binds sorted:          " << sortedBinds.pipelineBinds << " pipelines, " << sortedBinds.materialBinds << " materials"
+			<< (bindsMinimal ? " (minimal)" : " NOT MINIMAL") << std::endl;
+
+		return radixMatches && parallelMatches && bindsMinimal ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	int benchmarkFileReads(const std::string& path)
+	{
+		uint64_t totalBytes = 0;
+		std::vector<std::string> files = listFiles(path, totalBytes);
+		if (files.empty() || totalBytes == 0)
+		{
+			std::cerr << "No files to read under " << path << std::endl;
+			return EXIT_FAILURE;
+		}
+
+		//only cold if every file's cache could be dropped, otherwise the numbers would be warm ones
+		bool cold = true;
+		for (const std::string& file : files)
+			cold = dropFileCache(file) && cold;
+
+		ReadResult stream = timeReads(files, cold, readStream);
+		ReadResult mapped = timeReads(files, cold, readMapped);
+		bool matches = stream.checksum == mapped.checksum;
+
+		double megabytes = totalBytes / (1024.0 * 1024.0);
+		auto print = [megabytes](const char* name, double ms) {
+			std::cout << "  " << name << ms << " ms, " << megabytes / (ms / 1000.0) << " MiB/s" << std::endl;
+		};
+		std::cout << "Reading " << files.size() << " files, " << megabytes << " MiB under " << path << std::endl;
+		print("stream, warm:          ", stream.warmMs);
+		print("mapped, warm:          ", mapped.warmMs);
+		if (cold)
+		{
+			print("stream, cold:          ", stream.coldMs);
+			print("mapped, cold:          ", mapped.coldMs);
+		}
+		else
+			std::cout << "  cold reads skipped, the page cache can't be dropped here" << std::endl;
+		if (!matches)
+			std::cout << "  CONTENTS DIFFER" << std::endl;
+
+		return matches ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	int benchmarkAssetLoads(const std::string& path)
+	{
+		uint64_t totalBytes = 0;
+		std::vector<std::string> files = listFiles(path, totalBytes);
+		if (files.empty() || totalBytes == 0)
+		{
+			std::cerr << "No files to load under " << path << std::endl;
+			return EXIT_FAILURE;
+		}
+
+		bool cold = true;
+		for (const std::string& file : files)
+			cold = dropFileCache(file) && cold;
+
+		ThreadPool threadPool;
+		//the wall time of loading every file, the decode included
+		auto loadAll = [&](AssetReader* reader) {
+			uint64_t sum = 0;
+			if (reader == nullptr)
+			{
+				for (const std::string& file : files)
+					sum += readStream(file);
+				return sum;
+			}
+
+			std::vector<std::future<uint64_t>> loads;
+			loads.reserve(files.size());
+			for (size_t i = 0; i < files.size(); i++)
+			{
+				//every other file as if it were visible, they are started first
+				AssetReader::Priority priority = i % 2 == 0 ? AssetReader::Priority::Visible : AssetReader::Priority::Hidden;
+				loads.push_back(reader->read(files[i], priority, [](const unsigned char* data, size_t size) { return checksum(data, size); }));
+			}
+			for (std::future<uint64_t>& load : loads)
+				sum += load.get();
+			return sum;
+		};
+
+		struct Mode
+		{
+			const char* name;
+			std::unique_ptr<AssetReader> reader;
+		};
+		std::vector<Mode> modes;
+		modes.push_back({ "synchronous:           ", nullptr });
+		modes.push_back({ "thread pool:           ", std::make_unique<AssetReader>(threadPool, AssetReader::Backend::ThreadPool) });
+		auto ioUring = std::make_unique<AssetReader>(threadPool, AssetReader::Backend::IoUring);
+		bool hasIoUring = ioUring->getBackend() == AssetReader::Backend::IoUring;
+		if (hasIoUring)
+			modes.push_back({ "io_uring:              ", std::move(ioUring) });
+
+		double megabytes = totalBytes / (1024.0 * 1024.0);
+		std::cout << "Loading " << files.size() << " files, " << megabytes << " MiB under " << path << " (best of " << BENCHMARK_RUNS
+			<< " warm runs, average of " << BENCHMARK_RUNS << " cold ones), " << threadPool.size() << " decode workers" << std::endl;
+
+		uint64_t reference = 0;
+		bool matches = true;
+		for (size_t m = 0; m < modes.size(); m++)
+		{
+			Mode& mode = modes[m];
+			auto timeLoad = [&]() {
+				auto start = std::chrono::steady_clock::now();
+				uint64_t sum = loadAll(mode.reader.get());
+				double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+				if (m == 0)
+					reference = sum;
+				matches = matches && sum == reference;
+				return ms;
+			};
+
+			timeLoad();
+			double warmMs = 0.0;
+			for (int run = 0; run < BENCHMARK_RUNS; run++)
+			{
+				double ms = timeLoad();
+				if (run == 0 || ms < warmMs)
+					warmMs = ms;
+			}
+			std::cout << "  " << mode.name << "warm " << warmMs << " ms (" << megabytes / (warmMs / 1000.0) << " MiB/s)";
+
+			if (cold)
+			{
+				double coldMs = 0.0;
+				for (int run = 0; run < BENCHMARK_RUNS; run++)
+				{
+					for (const std::string& file : files)
+						dropFileCache(file);
+					coldMs += timeLoad() / BENCHMARK_RUNS;
+				}
+				std::cout << ", cold " << coldMs << " ms (" << megabytes / (coldMs / 1000.0) << " MiB/s)";
+			}
+			if (mode.reader)
+			{
+				AssetReader::Stats stats = mode.reader->takeStats();
+				if (mode.reader->getBackend() == AssetReader::Backend::IoUring)
+					std::cout << ", " << static_cast<double>(stats.files) / std::max<uint64_t>(stats.submissions, 1) << " reads per submission";
+			}
+			std::cout << std::endl;
+		}
+		if (!hasIoUring)
+			std::cout << "  io_uring isn't available here" << std::endl;
+		if (!cold)
+			std::cout << "  cold loads skipped, the page cache can't be dropped here" << std::endl;
+		if (!matches)
+			std::cout << "  CONTENTS DIFFER" << std::endl;
+
+		return matches ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	int benchmarkStartup(const std::string& packPath)
+	{
+		AssetPack pack;
+		if (!pack.open(packPath))
+		{
+			std::cerr << "Can't open the asset pack " << packPath << ", build it with --build-pack" << std::endl;
+			return EXIT_FAILURE;
+		}
+
+		//the loose copies of the packed assets, the ones the application would otherwise open
+		std::vector<std::string> names;
+		uint64_t totalBytes = 0;
+		std::error_code error;
+		for (const std::string& name : pack.getNames())
+		{
+			if (std::filesystem::is_regular_file(name, error))
+			{
+				names.push_back(name);
+				totalBytes += std::filesystem::file_size(name, error);
+			}
+		}
+		if (names.empty())
+		{
+			std::cerr << "None of the assets of " << packPath << " exist as loose files here" << std::endl;
+			return EXIT_FAILURE;
+		}
+
+		bool cold = dropFileCache(packPath);
+		for (const std::string& name : names)
+			cold = dropFileCache(name) && cold;
+
+		ReadResult loose = timeReads(names, cold, readMapped);
+		pack.close();
+		bool readable = true;
+		ReadResult packed = timeRuns(cold, { packPath }, [&]() {
+			//startup opens the pack every time too
+			AssetPack startupPack;
+			readable = startupPack.open(packPath) && readable;
+			uint64_t sum = 0;
+			AssetPack::Asset asset;
+			for (const std::string& name : names)
+			{
+				readable = startupPack.read(name, asset) && readable;
+				sum += checksum(asset.data(), asset.size());
+			}
+			return sum;
+		});
+		bool matches = readable && loose.checksum == packed.checksum;
+
+		double megabytes = totalBytes / (1024.0 * 1024.0);
+		auto print = [megabytes](const char* name, double ms) {
+			std::cout << "  " << name << ms << " ms, " << megabytes / (ms / 1000.0) << " MiB/s" << std::endl;
+		};
+		std::cout << "Loading " << names.size() << " assets, " << megabytes << " MiB, as loose files and from " << packPath << " ("
+			<< std::filesystem::file_size(packPath, error) / (1024.0 * 1024.0) << " MiB)" << std::endl;
+		print("loose files, warm:     ", loose.warmMs);
+		print("pack, warm:            ", packed.warmMs);
+		if (cold)
+		{
+			print("loose files, cold:     ", loose.coldMs);
+			print("pack, cold:            ", packed.coldMs);
+		}
+		else
+			std::cout << "  cold loads skipped, the page cache can't be dropped here" << std::endl;
+		if (!matches)
+			std::cout << "  CONTENTS DIFFER" << std::endl;
+
+		return matches ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	int benchmarkTextureDecode(const std::string& path)
+	{
+		struct ImageSet
+		{
+			std::string name;
+			std::vector<std::vector<unsigned char>> files;
+			uint64_t pixels = 0;
+		};
+		std::vector<ImageSet> sets(2);
+		uint64_t totalBytes = 0;
+		sets[0].name = "bundled textures under " + path;
+		for (const std::string& file : listFiles(path, totalBytes))
+		{
+			MappedFile mapped;
+			int width, height, channels;
+			if (mapped.open(file) && stbi_info_from_memory(mapped.data(), static_cast<int>(mapped.size()), &width, &height, &channels))
+				sets[0].files.emplace_back(mapped.data(), mapped.data() + mapped.size());
+		}
+		sets[1].name = "synthetic PNGs";
+		sets[1].files = makeSyntheticImages(SYNTHETIC_IMAGES);
+		if (sets[0].files.empty())
+		{
+			std::cout << "No images under " << path << ", only the synthetic ones are decoded" << std::endl;
+			sets.erase(sets.begin());
+		}
+
+		//stands in for the mapping of the staging buffer
+		size_t maxPixels = 0;
+		for (ImageSet& set : sets)
+		{
+			for (const std::vector<unsigned char>& file : set.files)
+			{
+				int width = 0, height = 0, channels = 0;
+				stbi_info_from_memory(file.data(), static_cast<int>(file.size()), &width, &height, &channels);
+				set.pixels += static_cast<uint64_t>(width) * height;
+				maxPixels = std::max(maxPixels, static_cast<size_t>(width) * height);
+			}
+		}
+		std::vector<unsigned char> staging(maxPixels * 4);
+
+		struct Mode
+		{
+			std::string name;
+			bool keepRgb;
+			PixelKernel kernel;
+			bool parallel;
+		};
+		ThreadPool threadPool;
+		PixelKernel best = getPixelKernel();
+		std::vector<Mode> modes;
+		modes.push_back({ "stb_image RGBA, 1 thread", false, PixelKernel::Scalar, false });
+		for (PixelKernel kernel : { PixelKernel::Scalar, PixelKernel::Ssse3, PixelKernel::Avx2 })
+		{
+			if (isPixelKernelSupported(kernel))
+				modes.push_back({ std::string("RGB + ") + getPixelKernelName(kernel) + ", 1 thread", true, kernel, false });
+		}
+		modes.push_back({ std::string("RGB + ") + getPixelKernelName(best) + ", " + std::to_string(threadPool.size()) + " workers", true, best, true });
+
+		//decodes every image then converts it into the staging buffer in order, like createTextureImages. The checksums of
+		//the staged images are kept when sums isn't null
+		bool decoded = true;
+		auto stageAll = [&](const ImageSet& set, const Mode& mode, std::vector<uint64_t>* sums) {
+			auto upload = [&](const TextureData& image) {
+				decoded = decoded && !image.pixels.empty();
+				size_t pixelCount = static_cast<size_t>(image.width) * image.height;
+				convertToRgba(image.pixels.data(), image.channels, staging.data(), pixelCount, PixelConversion(), mode.kernel);
+				if (sums != nullptr)
+					sums->push_back(checksum(staging.data(), pixelCount * 4));
+			};
+			if (!mode.parallel)
+			{
+				for (const std::vector<unsigned char>& file : set.files)
+					upload(decodeImage(file, mode.keepRgb));
+				return;
+			}
+			std::vector<std::future<TextureData>> images;
+			images.reserve(set.files.size());
+			for (const std::vector<unsigned char>& file : set.files)
+				images.push_back(threadPool.submit([&file, &mode]() { return decodeImage(file, mode.keepRgb); }));
+			for (std::future<TextureData>& image : images)
+				upload(image.get());
+		};
+
+		std::cout << "Decoding textures into a staging buffer (best of " << BENCHMARK_RUNS << " runs), " << getPixelKernelName(best)
+			<< " is the best pixel kernel here" << std::endl;
+		bool matches = true;
+		for (const ImageSet& set : sets)
+		{
+			double megapixels = set.pixels / 1e6;
+			std::cout << "  " << set.files.size() << " " << set.name << ", " << megapixels << " Mpixels" << std::endl;
+			std::vector<uint64_t> reference;
+			for (size_t m = 0; m < modes.size(); m++)
+			{
+				std::vector<uint64_t> sums;
+				stageAll(set, modes[m], &sums);
+				if (m == 0)
+					reference = sums;
+				bool same = sums == reference;
+				matches = matches && same;
+
+				double ms = timeWork([&]() { stageAll(set, modes[m], nullptr); });
+				std::string name = modes[m].name + ":";
+				name.resize(std::max<size_t>(name.size(), 30), ' ');
+				std::cout << "    " << name << ms << " ms (" << megapixels / (ms / 1000.0) << " Mpixels/s)" << (same ? "" : " PIXELS DIFFER") << std::endl;
+			}
+		}
+
+		//the other conversions on the RGBA synthetic images, fully opaque ones skipped by every kernel
+		std::vector<TextureData> images;
+		uint64_t rgbaPixels = 0;
+		for (const std::vector<unsigned char>& file : sets.back().files)
+		{
+			TextureData image = decodeImage(file, true);
+			if (image.channels == 4)
+			{
+				rgbaPixels += static_cast<uint64_t>(image.width) * image.height;
+				images.push_back(std::move(image));
+			}
+		}
+		std::vector<float> linear(maxPixels * 4);
+		std::vector<unsigned char> roundTrip(maxPixels * 4);
+		std::cout << "  " << images.size() << " RGBA synthetic images, " << rgbaPixels / 1e6 << " Mpixels" << std::endl;
+		std::vector<uint64_t> premultipliedReference;
+		for (PixelKernel kernel : { PixelKernel::Scalar, PixelKernel::Ssse3, PixelKernel::Avx2 })
+		{
+			if (!isPixelKernelSupported(kernel))
+				continue;
+			PixelConversion premultiply;
+			premultiply.premultiplyAlpha = true;
+			std::vector<uint64_t> sums;
+			bool exact = true;
+			for (const TextureData& image : images)
+			{
+				size_t pixelCount = static_cast<size_t>(image.width) * image.height;
+				convertToRgba(image.pixels.data(), 4, staging.data(), pixelCount, premultiply, kernel);
+				sums.push_back(checksum(staging.data(), pixelCount * 4));
+				srgbToLinear(image.pixels.data(), linear.data(), pixelCount, kernel);
+				linearToSrgb(linear.data(), roundTrip.data(), pixelCount, kernel);
+				exact = exact && std::memcmp(roundTrip.data(), image.pixels.data(), pixelCount * 4) == 0;
+			}
+			if (premultipliedReference.empty())
+				premultipliedReference = sums;
+			bool same = sums == premultipliedReference;
+			matches = matches && same && exact;
+
+			double premultiplyMs = timeWork([&]() {
+				for (const TextureData& image : images)
+					convertToRgba(image.pixels.data(), 4, staging.data(), static_cast<size_t>(image.width) * image.height, premultiply, kernel);
+			});
+			double toLinearMs = timeWork([&]() {
+				for (const TextureData& image : images)
+					srgbToLinear(image.pixels.data(), linear.data(), static_cast<size_t>(image.width) * image.height, kernel);
+			});
+			double toSrgbMs = timeWork([&]() {
+				for (const TextureData& image : images)
+					linearToSrgb(linear.data(), roundTrip.data(), static_cast<size_t>(image.width) * image.height, kernel);
+			});
+			std::string name = std::string(getPixelKernelName(kernel)) + ":";
+			name.resize(8, ' ');
+			std::cout << "    " << name << "premultiply (sRGB) " << premultiplyMs << " ms" << (same ? "" : " PIXELS DIFFER") << ", sRGB to linear "
+				<< toLinearMs << " ms, linear to sRGB " << toSrgbMs << " ms" << (exact ? "" : " ROUND TRIP NOT EXACT") << std::endl;
+		}
+
+		if (!decoded)
+			std::cout << "  SOME IMAGES FAILED TO DECODE" << std::endl;
+		return matches && decoded ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	int benchmarkTextureSizes(const std::string& path)
+	{
+		//below this the reduced decoding doesn't look like the full size one filtered down
+		const double minPsnr = 30.0;
+
+		struct Image
+		{
+			std::vector<unsigned char> file;
+			uint32_t width;
+			uint32_t height;
+		};
+		std::vector<Image> images;
+		uint64_t totalBytes = 0;
+		uint64_t fullPixels = 0;
+		uint64_t fullBytes = 0;
+		for (const std::string& file : listFiles(path, totalBytes))
+		{
+			MappedFile mapped;
+			int width, height, channels;
+			if (mapped.open(file) && stbi_info_from_memory(mapped.data(), static_cast<int>(mapped.size()), &width, &height, &channels))
+			{
+				images.push_back({ std::vector<unsigned char>(mapped.data(), mapped.data() + mapped.size()), static_cast<uint32_t>(width),
+					static_cast<uint32_t>(height) });
+				fullPixels += static_cast<uint64_t>(width) * height;
+				fullBytes += getMipChainBytes(static_cast<uint32_t>(width), static_cast<uint32_t>(height));
+			}
+		}
+		if (images.empty())
+		{
+			std::cout << "No images under " << path << std::endl;
+			return EXIT_FAILURE;
+		}
+
+		std::cout << "Decoding the " << images.size() << " images under " << path << " (" << fullPixels / 1e6 << " Mpixels) under each maximum "
+			<< "texture size (best of " << BENCHMARK_RUNS << " runs)" << std::endl;
+		bool valid = true;
+
+		//a Huffman table with more 1 bit codes than there are (162 of them) has to be rejected before its lookup table is filled
+		std::vector<unsigned char> corrupt = { 0xff, 0xd8, 0xff, 0xc4, 0x00, 0xb5, 0x10, 162 };
+		corrupt.resize(corrupt.size() + 15 + 162, 0);
+		corrupt.insert(corrupt.end(), { 0xff, 0xd9 });
+		TextureData rejected;
+		bool corruptRejected = !decodeJpeg(corrupt.data(), corrupt.size(), 1, rejected);
+		valid = valid && corruptRejected;
+		std::cout << "    corrupt Huffman table: " << (corruptRejected ? "rejected" : "DECODED") << std::endl;
+		for (uint32_t maxSize : { 0u, 4096u, 2048u, 1024u, 512u, 256u })
+		{
+			//like the loader: JPEGs reduced in the DCT domain, then the box filter for what is left
+			std::vector<TextureData> reduced(images.size());
+			double reducedMs = timeWork([&]() {
+				for (size_t i = 0; i < images.size(); i++)
+				{
+					const Image& image = images[i];
+					uint32_t shift = getTextureLevelShift(image.width, image.height, maxSize);
+					valid = decodeTexture(image.file.data(), image.file.size(), shift, reduced[i]) && valid;
+				}
+			});
+			//the full size decoded by stb_image, then box filtered down to the same size
+			std::vector<TextureData> filtered(images.size());
+			double filteredMs = timeWork([&]() {
+				for (size_t i = 0; i < images.size(); i++)
+				{
+					const Image& image = images[i];
+					TextureData full = decodeImage(image.file, true);
+					uint32_t factor = 1u << getTextureLevelShift(image.width, image.height, maxSize);
+					TextureData& target = filtered[i];
+					if (factor == 1 || full.pixels.empty())
+					{
+						target = std::move(full);
+						continue;
+					}
+					target.width = (full.width + factor - 1) / factor;
+					target.height = (full.height + factor - 1) / factor;
+					target.channels = full.channels;
+					target.pixels.resize(static_cast<size_t>(target.width) * target.height * target.channels);
+					downsampleBox(full.pixels.data(), full.width, full.height, full.channels, factor, target.pixels.data());
+				}
+			});
+
+			//compared as they are staged, color only unless the texture has alpha
+			uint64_t bytes = 0;
+			size_t reducedCount = 0;
+			bool sameSizes = true;
+			double squaredError = 0.0;
+			uint64_t samples = 0;
+			std::vector<unsigned char> reducedRgba, filteredRgba;
+			for (size_t i = 0; i < images.size(); i++)
+			{
+				const TextureData& a = reduced[i];
+				const TextureData& b = filtered[i];
+				bytes += getMipChainBytes(a.width, a.height);
+				if (a.skippedLevels > 0)
+					reducedCount++;
+				if (a.pixels.empty() || b.pixels.empty() || a.width != b.width || a.height != b.height)
+				{
+					sameSizes = false;
+					continue;
+				}
+				size_t pixelCount = static_cast<size_t>(a.width) * a.height;
+				reducedRgba.resize(pixelCount * 4);
+				filteredRgba.resize(pixelCount * 4);
+				convertToRgba(a.pixels.data(), a.channels, reducedRgba.data(), pixelCount, PixelConversion());
+				convertToRgba(b.pixels.data(), b.channels, filteredRgba.data(), pixelCount, PixelConversion());
+				bool alpha = a.channels == 4 || b.channels == 4;
+				for (size_t j = 0; j < reducedRgba.size(); j++)
+				{
+					if (j % 4 == 3 && !alpha)
+						continue;
+					double difference = static_cast<double>(reducedRgba[j]) - filteredRgba[j];
+					squaredError += difference * difference;
+					samples++;
+				}
+			}
+			double psnr = squaredError > 0.0 ? 10.0 * std::log10(255.0 * 255.0 * static_cast<double>(samples) / squaredError) : INFINITY;
+			bool close = sameSizes && psnr >= minPsnr;
+			valid = valid && close;
+
+			std::string name = (maxSize == 0 ? std::string("unlimited") : "max " + std::to_string(maxSize)) + ":";
+			name.resize(16, ' ');
+			std::cout << "    " << name << "reduced decode " << reducedMs << " ms, full decode + box filter " << filteredMs << " ms, "
+				<< reducedCount << " reduced, " << bytes / (1024.0 * 1024.0) << " MiB of mip chains (" << 100.0 * bytes / fullBytes << "%), ";
+			if (std::isinf(psnr))
+				std::cout << "identical";
+			else
+				std::cout << psnr << " dB PSNR";
+			std::cout << (close ? "" : " TOO FAR FROM THE FULL DECODE") << std::endl;
+		}
+		return valid ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	int testRenderGraph()
+	{
+		const VkPipelineStageFlags colorStage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		const VkPipelineStageFlags depthStages = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		const VkPipelineStageFlags fragmentStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+		const VkAccessFlags colorAccess = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		const VkAccessFlags depthAccess = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		const VkExtent2D extent = { 1920, 1080 };
+		const RenderGraph::ImageDesc colorDesc = { VK_FORMAT_B8G8R8A8_SRGB, extent, VK_SAMPLE_COUNT_1_BIT,
+			VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_IMAGE_ASPECT_COLOR_BIT };
+		const RenderGraph::ImageDesc depthDesc = { VK_FORMAT_D32_SFLOAT, extent, VK_SAMPLE_COUNT_4_BIT,
+			VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT, VK_IMAGE_ASPECT_DEPTH_BIT };
+		auto importSwapChain = [&](RenderGraph& graph) {
+			return graph.importImage("swap chain", colorDesc, VK_IMAGE_LAYOUT_UNDEFINED, colorStage, ResourceAccess::Present);
+		};
+
+		std::cout << "Compiling sample render graphs without a device and checking their schedules" << std::endl;
+		bool valid = true;
+
+		//the renderer's forward pass: multisampled targets resolved into the swap chain, then presented. A debug pass whose
+		//output nobody reads, and the pass feeding it, are culled with their images
+		{
+			RenderGraph graph;
+			RenderGraph::ImageDesc msaaDesc = colorDesc;
+			msaaDesc.samples = VK_SAMPLE_COUNT_4_BIT;
+			msaaDesc.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+			uint32_t color = graph.addTransientImage("color", msaaDesc);
+			uint32_t depth = graph.addTransientImage("depth", depthDesc);
+			uint32_t swapChain = importSwapChain(graph);
+			uint32_t debugInput = graph.addTransientImage("debug input", colorDesc);
+			uint32_t debugOutput = graph.addTransientImage("debug output", colorDesc);
+			uint32_t scene = graph.addPass("scene", {
+					{ color, ResourceAccess::ColorAttachment },
+					{ depth, ResourceAccess::DepthAttachment },
+					{ swapChain, ResourceAccess::ColorAttachment }
+				}, nullptr);
+			uint32_t debugDraw = graph.addPass("debug draw", { { debugInput, ResourceAccess::ColorAttachment } }, nullptr);
+			uint32_t debugView = graph.addPass("debug view", {
+					{ debugInput, ResourceAccess::FragmentSampled },
+					{ debugOutput, ResourceAccess::ColorAttachment }
+				}, nullptr);
+			uint32_t uploads = graph.addPass("uploads", {}, nullptr, true);
+			graph.compile();
+
+			bool same = checkBarriers("forward, scene", graph.getPassBarriers(scene), {
+					//each transient image is alone in its slot, so it waits for its own last use of the previous frame
+					{ color, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, colorStage, colorStage,
+						VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, colorAccess },
+					{ depth, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, depthStages, depthStages,
+						VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, depthAccess },
+					//waits for the acquire semaphore's stage
+					{ swapChain, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, colorStage, colorStage, 0, colorAccess }
+				});
+			same = checkBarriers("forward, end of frame", graph.getFinalBarriers(), {
+					{ swapChain, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, colorStage,
+						VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, 0 }
+				}) && same;
+			same = checkCondition("forward: the batch of the scene waits for the union of its barriers' stages",
+				graph.getPassBarriers(scene).srcStages == (colorStage | depthStages) && graph.getPassBarriers(scene).dstStages == (colorStage | depthStages)) && same;
+			same = checkCondition("forward: the debug passes are culled and the pass with side effects kept",
+				graph.isCulled(debugDraw) && graph.isCulled(debugView) && !graph.isCulled(scene) && !graph.isCulled(uploads)) && same;
+			same = checkCondition("forward: the images of the culled passes get no memory",
+				graph.getMemorySlot(debugInput) == UINT32_MAX && graph.getMemorySlot(debugOutput) == UINT32_MAX) && same;
+			same = checkCondition("forward: the color and depth targets live at the same time, so they don't alias",
+				graph.getMemorySlot(color) != graph.getMemorySlot(depth) && graph.getMemorySlot(swapChain) == UINT32_MAX) && same;
+			same = checkCondition("forward: stats", graph.getStats().passes == 2 && graph.getStats().culledPasses == 2 &&
+				graph.getStats().imageBarriers == 4 && graph.getStats().barrierBatches == 2 && graph.getStats().transientImages == 2) && same;
+			std::cout << "  forward: " << (same ? "ok" : "FAILED") << std::endl;
+			if (!same)
+				graph.printSchedule(std::cout);
+			valid = valid && same;
+		}
+
+		//a post processing chain: each image is read by the next pass only, so the first and the third share memory. The third
+		//waits for the second pass's reads of the first before overwriting it
+		{
+			RenderGraph graph;
+			uint32_t sceneColor = graph.addTransientImage("scene color", colorDesc);
+			uint32_t bloom = graph.addTransientImage("bloom", colorDesc);
+			uint32_t blur = graph.addTransientImage("blur", colorDesc);
+			uint32_t swapChain = importSwapChain(graph);
+			uint32_t scene = graph.addPass("scene", { { sceneColor, ResourceAccess::ColorAttachment } }, nullptr);
+			uint32_t bloomPass = graph.addPass("bloom", {
+					{ sceneColor, ResourceAccess::FragmentSampled },
+					{ bloom, ResourceAccess::ColorAttachment }
+				}, nullptr);
+			uint32_t blurPass = graph.addPass("blur", {
+					{ bloom, ResourceAccess::FragmentSampled },
+					{ blur, ResourceAccess::ColorAttachment }
+				}, nullptr);
+			uint32_t composite = graph.addPass("composite", {
+					{ blur, ResourceAccess::FragmentSampled },
+					{ swapChain, ResourceAccess::ColorAttachment }
+				}, nullptr);
+			graph.compile();
+
+			bool same = checkCondition("post chain: scene color and blur alias, bloom doesn't",
+				graph.getMemorySlot(sceneColor) == graph.getMemorySlot(blur) && graph.getMemorySlot(sceneColor) != graph.getMemorySlot(bloom));
+			same = checkBarriers("post chain, scene", graph.getPassBarriers(scene), {
+					//first image of its slot: waits for the composite pass's reads of blur in the previous frame
+					{ sceneColor, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, fragmentStage, colorStage, 0, colorAccess }
+				}) && same;
+			same = checkBarriers("post chain, bloom", graph.getPassBarriers(bloomPass), {
+					//read after write, with the layout transition
+					{ sceneColor, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, colorStage, fragmentStage,
+						VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT },
+					{ bloom, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, fragmentStage, colorStage, 0, colorAccess }
+				}) && same;
+			same = checkBarriers("post chain, blur", graph.getPassBarriers(blurPass), {
+					{ bloom, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, colorStage, fragmentStage,
+						VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT },
+					//aliases scene color: waits for the bloom pass's reads of it (write after read)
+					{ blur, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, fragmentStage, colorStage, 0, colorAccess }
+				}) && same;
+			same = checkBarriers("post chain, composite", graph.getPassBarriers(composite), {
+					{ blur, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, colorStage, fragmentStage,
+						VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT },
+					{ swapChain, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, colorStage, colorStage, 0, colorAccess }
+				}) && same;
+			same = checkCondition("post chain: nothing is culled", graph.getStats().culledPasses == 0 && graph.getStats().transientImages == 3) && same;
+			std::cout << "  post chain: " << (same ? "ok" : "FAILED") << std::endl;
+			if (!same)
+				graph.printSchedule(std::cout);
+			valid = valid && same;
+		}
+
+		//the occlusion culling frame: depth written, sampled by a compute pass, then loaded again. A pass that overwrites the
+		//swap chain whole makes the earlier pass writing it dead
+		{
+			RenderGraph graph;
+			uint32_t depth = graph.addTransientImage("depth", depthDesc);
+			uint32_t swapChain = importSwapChain(graph);
+			uint32_t early = graph.addPass("scene early", { { depth, ResourceAccess::DepthAttachment } }, nullptr);
+			uint32_t pyramid = graph.addPass("depth pyramid", { { depth, ResourceAccess::ComputeSampled } }, nullptr, true);
+			uint32_t late = graph.addPass("scene late", {
+					{ depth, ResourceAccess::DepthAttachmentLoad },
+					{ swapChain, ResourceAccess::ColorAttachment }
+				}, nullptr);
+			uint32_t overwritten = graph.addPass("clear", { { swapChain, ResourceAccess::TransferWrite } }, nullptr);
+			uint32_t upscale = graph.addPass("upscale", { { swapChain, ResourceAccess::ColorAttachment } }, nullptr);
+			graph.compile();
+
+			bool same = checkCondition("depth reuse: the passes before the last write of the swap chain are culled, unless they have side effects",
+				graph.isCulled(late) && graph.isCulled(overwritten) && !graph.isCulled(early) && !graph.isCulled(pyramid) && !graph.isCulled(upscale));
+			same = checkBarriers("depth reuse, depth pyramid", graph.getPassBarriers(pyramid), {
+					{ depth, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, depthStages,
+						VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT }
+				}) && same;
+			same = checkBarriers("depth reuse, upscale", graph.getPassBarriers(upscale), {
+					{ swapChain, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, colorStage, colorStage, 0, colorAccess }
+				}) && same;
+			std::cout << "  depth reuse: " << (same ? "ok" : "FAILED") << std::endl;
+			if (!same)
+				graph.printSchedule(std::cout);
+			valid = valid && same;
+		}
+
+		return valid ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+}
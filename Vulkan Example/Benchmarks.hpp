@@ -0,0 +1,37 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+namespace vulkanExample
+{
+	// Command line microbenchmarks, run without creating a window or a device.
+	// They return the process exit code, failing if the results don't check out
+
+	//sorts count random draw keys with std::stable_sort and the single and multi threaded radix sorts
+	int benchmarkDrawSort(size_t count);
+
+	//reads every file under path (a file or a directory) through a stream into a buffer, like the loaders used to, and through
+	//a read-only mapping, with the page cache warm and dropped before each run
+	int benchmarkFileReads(const std::string& path);
+
+	//loads every file under path (reads it and checksums it as a stand-in for decoding) one after the other on this thread,
+	//then through the asset reader with its thread pool and io_uring backends, warm and cold
+	int benchmarkAssetLoads(const std::string& path);
+
+	//loads every asset of the pack from its loose file and from the pack (opened each run), warm and cold
+	int benchmarkStartup(const std::string& packPath);
+
+	//decodes the images under path and a synthetic set into a staging buffer: expanded to RGBA by stb_image like the loader
+	//used to, kept RGB and expanded by each pixel kernel, and decoded on the thread pool. Then times the premultiply and sRGB
+	//conversions of every kernel. Fails if the kernels disagree
+	int benchmarkTextureDecode(const std::string& path);
+
+	//decodes the images under path under maximum texture sizes from unlimited to 256: reduced like the loader does (JPEGs in the
+	//DCT domain) and decoded whole then box filtered. Reports the decode times and the memory of the mip chains. Fails if the
+	//two disagree
+	int benchmarkTextureSizes(const std::string& path);
+
+	//compiles sample render graphs without a device and checks the barriers scheduled before each pass, the culled passes and
+	//which transient images share memory. Fails on the first difference of each graph, printing its schedule
+	int testRenderGraph();
+}
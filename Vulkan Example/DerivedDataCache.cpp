@@ -0,0 +1,226 @@
+#include "DerivedDataCache.hpp"
+#include "Hash.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+namespace vulkanExample
+{
+	namespace
+	{
+		const char* ENTRY_EXTENSION = ".dd";
+		const char* TEMPORARY_EXTENSION = ".tmp";
+	}
+
+	CacheKey::CacheKey(const std::string& kind, uint32_t version)
+		: kind(kind)
+	{
+		add(kind);
+		add(version);
+	}
+
+	CacheKey& CacheKey::add(const void* data, size_t size)
+	{
+		uint64_t length = size;
+		fields.append(reinterpret_cast<const char*>(&length), sizeof(length));
+		fields.append(static_cast<const char*>(data), size);
+		return *this;
+	}
+
+	CacheKey& CacheKey::addSource(const void* data, size_t size, ThreadPool* threadPool)
+	{
+		return add(hashSource(data, size, threadPool));
+	}
+
+	uint64_t CacheKey::getHash() const
+	{
+		return hashXxh3(fields.data(), fields.size());
+	}
+
+	std::string CacheKey::getName() const
+	{
+		char hash[17];
+		std::snprintf(hash, sizeof(hash), "%016llx", static_cast<unsigned long long>(getHash()));
+		return kind + '-' + hash;
+	}
+
+	void DerivedDataCache::create(const std::string& cacheDirectory, uint64_t maxCacheBytes)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		directory = cacheDirectory;
+		maxBytes = maxCacheBytes;
+		records.clear();
+		totalBytes = 0;
+
+		std::error_code error;
+		std::filesystem::create_directories(directory, error);
+		if (error)
+			std::cout << "Can't create derived data directory " << directory << ": " << error.message() << std::endl;
+
+		//the least recently used entries of the previous runs are the oldest files
+		std::vector<std::pair<std::filesystem::file_time_type, std::string>> found;
+		for (const auto& file : std::filesystem::directory_iterator(directory, error))
+		{
+			std::filesystem::path path = file.path();
+			if (path.extension() == TEMPORARY_EXTENSION)
+				std::filesystem::remove(path, error);
+			else if (path.extension() == ENTRY_EXTENSION)
+			{
+				std::string name = path.stem().string();
+				records[name].size = file.file_size(error);
+				totalBytes += records[name].size;
+				found.emplace_back(file.last_write_time(error), name);
+			}
+		}
+		std::sort(found.begin(), found.end());
+		useCounter = 0;
+		for (const auto& entry : found)
+			records[entry.second].lastUse = ++useCounter;
+		evict(std::string());
+	}
+
+	bool DerivedDataCache::load(const CacheKey& key, Entry& entry)
+	{
+		std::string name = key.getName();
+		std::string path = getPath(name);
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!isCreated() || records.count(name) == 0)
+			{
+				stats.misses++;
+				return false;
+			}
+		}
+
+		bool valid = entry.file.open(path) && entry.file.size() >= HEADER_SIZE;
+		if (valid)
+		{
+			Header header;
+			std::memcpy(&header, entry.file.data(), sizeof(header));
+			valid = header.magic == MAGIC && header.version == VERSION && header.key == key.getHash() &&
+				header.size == entry.size() && header.contentHash == hashXxh3(entry.data(), entry.size());
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!valid)
+		{
+			entry.file.close();
+			stats.misses++;
+			stats.corrupt++;
+			remove(name);
+			return false;
+		}
+
+		auto record = records.find(name);
+		if (record != records.end())
+			record->second.lastUse = ++useCounter;
+		std::error_code error;
+		std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), error);
+		stats.hits++;
+		stats.bytesRead += entry.size();
+		return true;
+	}
+
+	bool DerivedDataCache::store(const CacheKey& key, const void* data, size_t size)
+	{
+		if (!isCreated())
+			return false;
+
+		Header header{};
+		header.magic = MAGIC;
+		header.version = VERSION;
+		header.key = key.getHash();
+		header.size = size;
+		header.contentHash = hashXxh3(data, size);
+
+		std::string name = key.getName();
+		std::string path = getPath(name);
+		std::string temporaryPath;
+		{
+			//threads storing the same key each write their own temporary file
+			std::lock_guard<std::mutex> lock(mutex);
+			temporaryPath = path + '.' + std::to_string(++temporaryCounter) + TEMPORARY_EXTENSION;
+		}
+
+		std::error_code error;
+		{
+			std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+			file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			file.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+			file.close();
+			if (!file)
+			{
+				std::filesystem::remove(temporaryPath, error);
+				return false;
+			}
+		}
+		std::filesystem::rename(temporaryPath, path, error);
+		if (error)
+		{
+			std::filesystem::remove(temporaryPath, error);
+			return false;
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+		Record& record = records[name];
+		totalBytes = totalBytes - record.size + HEADER_SIZE + size;
+		record.size = HEADER_SIZE + size;
+		record.lastUse = ++useCounter;
+		stats.bytesWritten += size;
+		evict(name);
+		return true;
+	}
+
+	DerivedDataCache::Stats DerivedDataCache::getStats()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		Stats result = stats;
+		result.entries = records.size();
+		result.totalBytes = totalBytes;
+		return result;
+	}
+
+	std::string DerivedDataCache::getPath(const std::string& name) const
+	{
+		return (std::filesystem::path(directory) / (name + ENTRY_EXTENSION)).string();
+	}
+
+	void DerivedDataCache::remove(const std::string& name)
+	{
+		//a mapped entry can't be deleted on Windows, it is then only forgotten until the next run's scan
+		std::error_code error;
+		std::filesystem::remove(getPath(name), error);
+		auto record = records.find(name);
+		if (record == records.end())
+			return;
+		totalBytes -= record->second.size;
+		records.erase(record);
+	}
+
+	void DerivedDataCache::evict(const std::string& keep)
+	{
+		if (maxBytes == 0 || totalBytes <= maxBytes)
+			return;
+
+		std::vector<std::pair<uint64_t, std::string>> order;
+		order.reserve(records.size());
+		for (const auto& record : records)
+		{
+			if (record.first != keep)
+				order.emplace_back(record.second.lastUse, record.first);
+		}
+		std::sort(order.begin(), order.end());
+		for (const auto& entry : order)
+		{
+			if (totalBytes <= maxBytes)
+				break;
+			stats.evictions++;
+			stats.evictedBytes += records[entry.second].size;
+			remove(entry.second);
+		}
+	}
+}
@@ -0,0 +1,126 @@
+#pragma once
+#include "MappedFile.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+
+namespace vulkanExample
+{
+	class ThreadPool;
+
+	// Key of a derived artifact: its kind, the version of the code producing it, the hashes of its sources and every
+	// parameter of the processing. Fields are length prefixed, so splitting the same bytes differently gives another key
+	class CacheKey
+	{
+	public:
+		//bump version whenever the processing of the kind changes, so the old entries are never read again
+		CacheKey(const std::string& kind, uint32_t version);
+
+		CacheKey& add(const void* data, size_t size);
+		CacheKey& add(const std::string& text) { return add(text.data(), text.size()); }
+		CacheKey& add(const char* text) { return add(std::string(text)); }
+		template<typename T>
+		CacheKey& add(const T& value)
+		{
+			static_assert(std::is_trivially_copyable<T>::value, "only plain values are added as bytes");
+			return add(&value, sizeof(value));
+		}
+		//hash of a source's contents (hashSource), so a changed source gives another key
+		CacheKey& addSource(const void* data, size_t size, ThreadPool* threadPool = nullptr);
+
+		uint64_t getHash() const;
+		//file name of the entry, the kind followed by the hash
+		std::string getName() const;
+
+	private:
+		std::string kind;
+		std::string fields;
+	};
+
+	// Content addressed store of everything derived from the assets (SPIR-V, the pipeline cache, welded meshes, decoded
+	// textures), so each is only computed again when a source or a parameter of its key changes.
+	// Every entry is a file named after its key holding a header with the hash of its contents: written to a temporary file
+	// and renamed into place, so a crash leaves either the previous entry or a complete new one, and a file the OS didn't
+	// finish flushing fails the hash and is dropped. The directory is bounded: past maxBytes the least recently used entries
+	// are deleted, the order surviving restarts through the modification times touched on every hit
+	class DerivedDataCache
+	{
+	public:
+		struct Stats
+		{
+			uint64_t hits = 0;
+			uint64_t misses = 0;
+			uint64_t bytesRead = 0;
+			uint64_t bytesWritten = 0;
+			uint64_t evictions = 0;
+			uint64_t evictedBytes = 0;
+			//failed their hash (interrupted writes) or couldn't be read, counted as misses too
+			uint64_t corrupt = 0;
+			uint64_t entries = 0;
+			uint64_t totalBytes = 0;
+		};
+
+		// Contents of an entry, mapped
+		class Entry
+		{
+		public:
+			//aligned to 32 bytes, so the contents can be read as words or structs in place
+			const unsigned char* data() const { return file.data() + HEADER_SIZE; }
+			size_t size() const { return file.isOpen() ? file.size() - HEADER_SIZE : 0; }
+
+		private:
+			friend class DerivedDataCache;
+			MappedFile file;
+		};
+
+		//maxBytes 0 leaves the directory unbounded. Removes the temporary files of writes a crash interrupted
+		void create(const std::string& directory, uint64_t maxBytes);
+		bool isCreated() const { return !directory.empty(); }
+
+		//thread safe. False on a miss
+		bool load(const CacheKey& key, Entry& entry);
+		//thread safe. Replaces the entry of the same key, then evicts past the size bound
+		bool store(const CacheKey& key, const void* data, size_t size);
+		Stats getStats();
+
+	private:
+		static constexpr uint32_t MAGIC = 0x44444556; //"VEDD"
+		static constexpr uint32_t VERSION = 1;
+		static constexpr size_t HEADER_SIZE = 32;
+
+		struct Header
+		{
+			uint32_t magic;
+			uint32_t version;
+			uint64_t key;
+			uint64_t size;
+			uint64_t contentHash;
+		};
+		static_assert(sizeof(Header) == HEADER_SIZE, "the contents follow the header");
+
+		struct Record
+		{
+			uint64_t size = 0;
+			//higher is more recent
+			uint64_t lastUse = 0;
+		};
+
+		std::string directory;
+		uint64_t maxBytes = 0;
+		std::mutex mutex;
+		//keyed by file name
+		std::unordered_map<std::string, Record> records;
+		uint64_t totalBytes = 0;
+		uint64_t useCounter = 0;
+		uint64_t temporaryCounter = 0;
+		Stats stats;
+
+		std::string getPath(const std::string& name) const;
+		void remove(const std::string& name);
+		//evicts the least recently used entries but keep until the directory fits. Locked
+		void evict(const std::string& keep);
+	};
+}
@@ -0,0 +1,272 @@
+#include "DescriptorAllocator.hpp"
+#include "Hash.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+namespace vulkanExample
+{
+	namespace
+	{
+		//sets in the first pool of a class. Every new pool doubles it, up to the maximum
+		constexpr uint32_t INITIAL_POOL_SETS = 16;
+		constexpr uint32_t MAX_POOL_SETS = 1024;
+
+		template<typename T>
+		uint64_t hashValue(const T& value, uint64_t seed)
+		{
+			return hashBytes(&value, sizeof(value), seed);
+		}
+	}
+
+	void DescriptorAllocator::create(VkDevice device, uint32_t frameCount)
+	{
+		this->device = device;
+		this->frameCount = frameCount;
+		stats = Stats{};
+	}
+
+	void DescriptorAllocator::destroy()
+	{
+		if (device == VK_NULL_HANDLE)
+			return;
+
+		for (auto& entry : classes)
+		{
+			destroyPools(entry.second.persistent);
+			for (PoolList& frame : entry.second.frames)
+				destroyPools(frame);
+		}
+		classes.clear();
+		cache.clear();
+		device = VK_NULL_HANDLE;
+	}
+
+	void DescriptorAllocator::registerLayout(VkDescriptorSetLayout layout, const std::vector<VkDescriptorPoolSize>& setSizes)
+	{
+		LayoutClass& layoutClass = classes[layout];
+		layoutClass.setSizes = setSizes;
+		layoutClass.frames.resize(frameCount);
+	}
+
+	VkDescriptorSet DescriptorAllocator::allocateCached(VkDescriptorSetLayout layout, const std::vector<VkWriteDescriptorSet>& writes)
+	{
+		uint64_t hash = hashDescriptorWrites(layout, writes);
+		auto cached = cache.find(hash);
+		if (cached != cache.end())
+		{
+			stats.cacheHits++;
+			cached->second.references++;
+			return cached->second.set;
+		}
+		stats.cacheMisses++;
+
+		LayoutClass& layoutClass = getClass(layout);
+		VkDescriptorSet set;
+		if (!layoutClass.recycled.empty())
+		{
+			set = layoutClass.recycled.back();
+			layoutClass.recycled.pop_back();
+		}
+		else
+			set = allocate(layoutClass, layoutClass.persistent, layout);
+
+		std::vector<VkWriteDescriptorSet> setWrites(writes);
+		for (VkWriteDescriptorSet& write : setWrites)
+			write.dstSet = set;
+		vkUpdateDescriptorSets(device, static_cast<uint32_t>(setWrites.size()), setWrites.data(), 0, nullptr);
+
+		cache.emplace(hash, CachedSet{ set, layout, 1 });
+		return set;
+	}
+
+	VkDescriptorSet DescriptorAllocator::releaseCached(VkDescriptorSetLayout layout, const std::vector<VkWriteDescriptorSet>& writes)
+	{
+		auto cached = cache.find(hashDescriptorWrites(layout, writes));
+		if (cached == cache.end() || --cached->second.references > 0)
+			return VK_NULL_HANDLE;
+		VkDescriptorSet set = cached->second.set;
+		cache.erase(cached);
+		return set;
+	}
+
+	void DescriptorAllocator::recycle(VkDescriptorSetLayout layout, VkDescriptorSet set)
+	{
+		getClass(layout).recycled.push_back(set);
+	}
+
+	VkDescriptorSet DescriptorAllocator::allocateTransient(VkDescriptorSetLayout layout, uint32_t frame)
+	{
+		LayoutClass& layoutClass = getClass(layout);
+		if (frame >= layoutClass.frames.size())
+			throw std::runtime_error("descriptor allocator frame out of range!");
+		return allocate(layoutClass, layoutClass.frames[frame], layout);
+	}
+
+	void DescriptorAllocator::resetFrame(uint32_t frame)
+	{
+		for (auto& entry : classes)
+		{
+			if (frame < entry.second.frames.size())
+				resetPools(entry.second.frames[frame]);
+		}
+	}
+
+	void DescriptorAllocator::setFrameCount(uint32_t frameCount)
+	{
+		this->frameCount = frameCount;
+		for (auto& entry : classes)
+		{
+			std::vector<PoolList>& frames = entry.second.frames;
+			for (size_t frame = frameCount; frame < frames.size(); frame++)
+				destroyPools(frames[frame]);
+			frames.resize(frameCount);
+			for (PoolList& pools : frames)
+				resetPools(pools);
+		}
+	}
+
+	void DescriptorAllocator::resetPersistent(VkDescriptorSetLayout layout)
+	{
+		LayoutClass& layoutClass = getClass(layout);
+		resetPools(layoutClass.persistent);
+		layoutClass.recycled.clear();
+		for (auto it = cache.begin(); it != cache.end();)
+		{
+			if (it->second.layout == layout)
+				it = cache.erase(it);
+			else
+				++it;
+		}
+	}
+
+	DescriptorAllocator::LayoutClass& DescriptorAllocator::getClass(VkDescriptorSetLayout layout)
+	{
+		auto found = classes.find(layout);
+		if (found == classes.end())
+			throw std::runtime_error("descriptor set layout was not registered with the allocator!");
+		return found->second;
+	}
+
+	VkDescriptorSet DescriptorAllocator::allocate(const LayoutClass& layoutClass, PoolList& pools, VkDescriptorSetLayout layout)
+	{
+		VkDescriptorSetAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocInfo.descriptorSetCount = 1;
+		allocInfo.pSetLayouts = &layout;
+
+		VkDescriptorSet set = VK_NULL_HANDLE;
+		if (!pools.used.empty())
+		{
+			allocInfo.descriptorPool = pools.used.back();
+			VkResult result = vkAllocateDescriptorSets(device, &allocInfo, &set);
+			if (result == VK_SUCCESS)
+			{
+				stats.setsAllocated++;
+				return set;
+			}
+			//anything else than a full pool is a real error
+			if (result != VK_ERROR_OUT_OF_POOL_MEMORY && result != VK_ERROR_FRAGMENTED_POOL)
+				throw std::runtime_error("failed to allocate descriptor set!");
+		}
+
+		//the current pool is full, continue in a fresh one
+		allocInfo.descriptorPool = createPool(layoutClass, pools);
+		if (vkAllocateDescriptorSets(device, &allocInfo, &set) != VK_SUCCESS)
+			throw std::runtime_error("failed to allocate descriptor set!");
+		stats.setsAllocated++;
+		return set;
+	}
+
+	VkDescriptorPool DescriptorAllocator::createPool(const LayoutClass& layoutClass, PoolList& pools)
+	{
+		if (!pools.free.empty())
+		{
+			pools.used.push_back(pools.free.back());
+			pools.free.pop_back();
+			return pools.used.back();
+		}
+
+		if (pools.nextPoolSets == 0)
+			pools.nextPoolSets = INITIAL_POOL_SETS;
+		uint32_t setCount = pools.nextPoolSets;
+		pools.nextPoolSets = std::min(setCount * 2, MAX_POOL_SETS);
+
+		std::vector<VkDescriptorPoolSize> poolSizes(layoutClass.setSizes);
+		for (VkDescriptorPoolSize& poolSize : poolSizes)
+			poolSize.descriptorCount *= setCount;
+
+		VkDescriptorPoolCreateInfo createInfo{};
+		createInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		createInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+		createInfo.pPoolSizes = poolSizes.data();
+		createInfo.maxSets = setCount;
+
+		VkDescriptorPool pool;
+		if (vkCreateDescriptorPool(device, &createInfo, nullptr, &pool) != VK_SUCCESS)
+			throw std::runtime_error("failed to create descriptor pool!");
+
+		stats.pools++;
+		pools.used.push_back(pool);
+		return pool;
+	}
+
+	void DescriptorAllocator::resetPools(PoolList& pools)
+	{
+		for (VkDescriptorPool pool : pools.used)
+		{
+			vkResetDescriptorPool(device, pool, 0);
+			pools.free.push_back(pool);
+		}
+		pools.used.clear();
+	}
+
+	void DescriptorAllocator::destroyPools(PoolList& pools)
+	{
+		for (VkDescriptorPool pool : pools.used)
+			vkDestroyDescriptorPool(device, pool, nullptr);
+		for (VkDescriptorPool pool : pools.free)
+			vkDestroyDescriptorPool(device, pool, nullptr);
+		stats.pools -= static_cast<uint32_t>(pools.used.size() + pools.free.size());
+		pools.used.clear();
+		pools.free.clear();
+		pools.nextPoolSets = 0;
+	}
+
+	uint64_t hashDescriptorWrites(VkDescriptorSetLayout layout, const std::vector<VkWriteDescriptorSet>& writes)
+	{
+		uint64_t hash = hashValue(layout, HASH_SEED);
+		for (const VkWriteDescriptorSet& write : writes)
+		{
+			hash = hashValue(write.dstBinding, hash);
+			hash = hashValue(write.dstArrayElement, hash);
+			hash = hashValue(write.descriptorType, hash);
+			hash = hashValue(write.descriptorCount, hash);
+
+			//only the array the descriptor type reads is valid. Field by field, the structures may have padding
+			for (uint32_t i = 0; i < write.descriptorCount; i++)
+			{
+				switch (write.descriptorType)
+				{
+				case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER:
+				case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER:
+				case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC:
+				case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC:
+					hash = hashValue(write.pBufferInfo[i].buffer, hash);
+					hash = hashValue(write.pBufferInfo[i].offset, hash);
+					hash = hashValue(write.pBufferInfo[i].range, hash);
+					break;
+				case VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER:
+				case VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER:
+					hash = hashValue(write.pTexelBufferView[i], hash);
+					break;
+				default:
+					hash = hashValue(write.pImageInfo[i].sampler, hash);
+					hash = hashValue(write.pImageInfo[i].imageView, hash);
+					hash = hashValue(write.pImageInfo[i].imageLayout, hash);
+					break;
+				}
+			}
+		}
+		return hash;
+	}
+}
@@ -0,0 +1,96 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace vulkanExample
+{
+	// Allocates descriptor sets from lists of pools, one list per layout class, so every pool is sized for the sets it serves.
+	// A class grows by creating a larger pool when the current one runs out, instead of failing the allocation.
+	// Persistent sets live until resetPersistent(), or are recycled for later sets of their layout. Sets with the same layout
+	// and writes are shared through a cache.
+	// Transient sets belong to a frame in flight, and their pools are reset together once the GPU finished that frame
+	class DescriptorAllocator
+	{
+	public:
+		struct Stats
+		{
+			uint32_t pools = 0;
+			uint64_t setsAllocated = 0;
+			uint64_t cacheHits = 0;
+			uint64_t cacheMisses = 0;
+		};
+
+		void create(VkDevice device, uint32_t frameCount);
+		void destroy();
+
+		//descriptors of each type one set of the layout needs. Must be called before allocating sets of that layout
+		void registerLayout(VkDescriptorSetLayout layout, const std::vector<VkDescriptorPoolSize>& setSizes);
+
+		//returns a set of the layout holding the writes (their dstSet is ignored). A previous set with identical writes is reused,
+		//so the set must never be written again
+		VkDescriptorSet allocateCached(VkDescriptorSetLayout layout, const std::vector<VkWriteDescriptorSet>& writes);
+		//drops one allocateCached() reference to the set of those writes. With the last one its cache entry goes too, e.g. before
+		//the image they point to is destroyed (a new one could get the same handle), and the set is returned for recycle().
+		//VK_NULL_HANDLE while the set is still shared
+		VkDescriptorSet releaseCached(VkDescriptorSetLayout layout, const std::vector<VkWriteDescriptorSet>& writes);
+		//hands a released set back, to be rewritten for a later allocateCached(). The GPU must be done with it
+		void recycle(VkDescriptorSetLayout layout, VkDescriptorSet set);
+		//valid until resetFrame(frame)
+		VkDescriptorSet allocateTransient(VkDescriptorSetLayout layout, uint32_t frame);
+
+		//the GPU must be done with every transient set of the frame
+		void resetFrame(uint32_t frame);
+		//resets every transient pool and changes the number of frames. The GPU must be idle
+		void setFrameCount(uint32_t frameCount);
+		//drops the persistent sets of the layout and their cache entries, e.g. when the resources they point to are destroyed.
+		//The GPU must be done with them
+		void resetPersistent(VkDescriptorSetLayout layout);
+
+		const Stats& getStats() const { return stats; }
+
+	private:
+		// Pools of one layout class, for one lifetime
+		struct PoolList
+		{
+			//the last one is the one sets are allocated from
+			std::vector<VkDescriptorPool> used;
+			//reset pools ready to be reused
+			std::vector<VkDescriptorPool> free;
+			uint32_t nextPoolSets = 0;
+		};
+
+		struct LayoutClass
+		{
+			std::vector<VkDescriptorPoolSize> setSizes;
+			PoolList persistent;
+			//released persistent sets, allocated again before the pools
+			std::vector<VkDescriptorSet> recycled;
+			std::vector<PoolList> frames;
+		};
+
+		struct CachedSet
+		{
+			VkDescriptorSet set;
+			VkDescriptorSetLayout layout;
+			uint32_t references;
+		};
+
+		VkDevice device = VK_NULL_HANDLE;
+		uint32_t frameCount = 0;
+		std::unordered_map<VkDescriptorSetLayout, LayoutClass> classes;
+		//hash of the layout and the writes to the set holding them
+		std::unordered_map<uint64_t, CachedSet> cache;
+		Stats stats;
+
+		LayoutClass& getClass(VkDescriptorSetLayout layout);
+		VkDescriptorSet allocate(const LayoutClass& layoutClass, PoolList& pools, VkDescriptorSetLayout layout);
+		VkDescriptorPool createPool(const LayoutClass& layoutClass, PoolList& pools);
+		void resetPools(PoolList& pools);
+		void destroyPools(PoolList& pools);
+	};
+
+	//hash of everything a write puts in a set (binding, type and the buffers, images or views), ignoring dstSet
+	uint64_t hashDescriptorWrites(VkDescriptorSetLayout layout, const std::vector<VkWriteDescriptorSet>& writes);
+}
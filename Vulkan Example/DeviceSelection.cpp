@@ -0,0 +1,124 @@
+#include "DeviceSelection.hpp"
+#include <algorithm>
+#include <cctype>
+#include <sstream>
+#include <stdexcept>
+
+namespace vulkanExample
+{
+	namespace
+	{
+		//each type is worth more than anything the memory and the features can add up to
+		constexpr uint64_t TYPE_STEP = 2000;
+		//one point per 64 MiB of device local memory, up to 64 GiB
+		constexpr uint64_t MEMORY_UNIT = 64ull * 1024 * 1024;
+		constexpr uint64_t MAX_MEMORY_POINTS = 1000;
+		constexpr uint64_t FEATURE_POINTS = 100;
+
+		uint64_t getTypeRank(VkPhysicalDeviceType type)
+		{
+			switch (type)
+			{
+			case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU: return 4;
+			case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: return 3;
+			case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU: return 2;
+			case VK_PHYSICAL_DEVICE_TYPE_CPU: return 0;
+			default: return 1;
+			}
+		}
+
+		std::string toLower(std::string text)
+		{
+			std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+			return text;
+		}
+
+		bool isIndex(const std::string& text)
+		{
+			return !text.empty() && std::all_of(text.begin(), text.end(), [](unsigned char c) { return std::isdigit(c) != 0; });
+		}
+	}
+
+	uint64_t scoreDevice(const DeviceCandidate& candidate)
+	{
+		uint64_t score = getTypeRank(candidate.type) * TYPE_STEP;
+		score += std::min<uint64_t>(candidate.deviceLocalMemory / MEMORY_UNIT, MAX_MEMORY_POINTS);
+
+		bool features[] = { candidate.timelineSemaphore, candidate.descriptorIndexing, candidate.multiDrawIndirect,
+			candidate.pipelineStatistics, candidate.dedicatedTransfer, candidate.asyncCompute };
+		for (bool feature : features)
+			score += feature ? FEATURE_POINTS : 0;
+		return score;
+	}
+
+	std::optional<size_t> selectDevice(const std::vector<DeviceCandidate>& candidates, const std::string& selection)
+	{
+		if (!selection.empty())
+		{
+			std::optional<size_t> match;
+			for (size_t i = 0; i < candidates.size() && !match.has_value(); i++)
+			{
+				bool matches = isIndex(selection) ? std::to_string(candidates[i].index) == selection
+					: toLower(candidates[i].name).find(toLower(selection)) != std::string::npos;
+				if (matches)
+					match = i;
+			}
+
+			if (!match.has_value())
+				throw std::runtime_error("no Vulkan device matches \"" + selection + "\"!");
+			const DeviceCandidate& candidate = candidates[match.value()];
+			if (!candidate.missing.empty())
+				throw std::runtime_error("device " + candidate.name + " can't run the renderer: " + candidate.missing + "!");
+			return match;
+		}
+
+		//ties keep the enumeration order
+		std::optional<size_t> best;
+		for (size_t i = 0; i < candidates.size(); i++)
+		{
+			if (!candidates[i].missing.empty())
+				continue;
+			if (!best.has_value() || scoreDevice(candidates[i]) > scoreDevice(candidates[best.value()]))
+				best = i;
+		}
+		return best;
+	}
+
+	std::string describeDevice(const DeviceCandidate& candidate)
+	{
+		std::ostringstream text;
+		text << getDeviceTypeName(candidate.type) << ", " << candidate.deviceLocalMemory / (1024 * 1024) << " MiB device local, Vulkan "
+			<< VK_API_VERSION_MAJOR(candidate.apiVersion) << "." << VK_API_VERSION_MINOR(candidate.apiVersion) << "."
+			<< VK_API_VERSION_PATCH(candidate.apiVersion);
+
+		std::pair<bool, const char*> features[] = {
+			{ candidate.timelineSemaphore, "timeline semaphores" },
+			{ candidate.descriptorIndexing, "descriptor indexing" },
+			{ candidate.multiDrawIndirect, "multi draw indirect" },
+			{ candidate.pipelineStatistics, "pipeline statistics" },
+			{ candidate.dedicatedTransfer, "transfer queue" },
+			{ candidate.asyncCompute, "async compute queue" }
+		};
+		std::string separator = ", with ";
+		for (const auto& feature : features)
+		{
+			if (!feature.first)
+				continue;
+			text << separator << feature.second;
+			separator = ", ";
+		}
+		return text.str();
+	}
+
+	const char* getDeviceTypeName(VkPhysicalDeviceType type)
+	{
+		switch (type)
+		{
+		case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU: return "discrete GPU";
+		case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: return "integrated GPU";
+		case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU: return "virtual GPU";
+		case VK_PHYSICAL_DEVICE_TYPE_CPU: return "CPU";
+		default: return "other";
+		}
+	}
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace vulkanExample
+{
+	// What the device selection knows about one physical device
+	struct DeviceCandidate
+	{
+		VkPhysicalDevice device = VK_NULL_HANDLE;
+		//position in vkEnumeratePhysicalDevices, what an index override refers to
+		uint32_t index = 0;
+		std::string name;
+		VkPhysicalDeviceType type = VK_PHYSICAL_DEVICE_TYPE_OTHER;
+		uint32_t apiVersion = 0;
+		//largest device local heap (integrated GPUs report the shared system memory)
+		VkDeviceSize deviceLocalMemory = 0;
+		//empty if the device can run the renderer, otherwise the first requirement it misses
+		std::string missing;
+
+		//optional features and queues the renderer uses when they are there
+		bool timelineSemaphore = false;
+		bool descriptorIndexing = false;
+		bool multiDrawIndirect = false;
+		bool pipelineStatistics = false;
+		bool dedicatedTransfer = false;
+		bool asyncCompute = false;
+	};
+
+	// Ranks a suitable device. The type dominates (discrete, integrated, virtual, other, then CPU),
+	// the device local memory and the optional features only order devices of the same type
+	uint64_t scoreDevice(const DeviceCandidate& candidate);
+
+	// Best suitable candidate, or the one named by selection: its index or a case insensitive part of its name.
+	// Throws if the selection matches no device or an unsuitable one. No value if no device is suitable
+	std::optional<size_t> selectDevice(const std::vector<DeviceCandidate>& candidates, const std::string& selection);
+
+	// One line summary: type, memory, API version and the optional features
+	std::string describeDevice(const DeviceCandidate& candidate);
+	const char* getDeviceTypeName(VkPhysicalDeviceType type);
+}
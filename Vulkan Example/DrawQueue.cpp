@@ -0,0 +1,156 @@
+#include "DrawQueue.hpp"
+#include "ThreadPool.hpp"
+#include <algorithm>
+#include <array>
+#include <future>
+#include <unordered_set>
+
+namespace vulkanExample
+{
+	namespace
+	{
+		constexpr uint32_t DIGIT_BITS = 8;
+		constexpr uint32_t DIGIT_COUNT = 1u << DIGIT_BITS;
+		constexpr uint32_t PASS_COUNT = 64 / DIGIT_BITS;
+		//below this many packets per chunk the threads cost more than they save
+		constexpr size_t MIN_PACKETS_PER_CHUNK = 16384;
+		//clearing and scanning the histograms dominates for a handful of draws
+		constexpr size_t MIN_PACKETS_FOR_RADIX = 256;
+
+		using Histogram = std::array<size_t, DIGIT_COUNT>;
+
+		inline uint32_t digitOf(uint64_t key, uint32_t pass)
+		{
+			return static_cast<uint32_t>(key >> (pass * DIGIT_BITS)) & (DIGIT_COUNT - 1);
+		}
+
+		//runs job(0) .. job(count - 1), the first one on the calling thread
+		template<typename Job>
+		void runChunks(ThreadPool* threadPool, size_t count, const Job& job)
+		{
+			std::vector<std::future<void>> pending;
+			pending.reserve(count);
+			for (size_t chunk = 1; chunk < count; chunk++)
+				pending.push_back(threadPool->submit([&job, chunk]() { job(chunk); }));
+			job(0);
+			for (std::future<void>& result : pending)
+				result.get();
+		}
+	}
+
+	uint64_t DrawQueue::makeKey(uint32_t layer, uint32_t pipeline, uint32_t material, float depth)
+	{
+		depth = std::min(std::max(depth, 0.0f), 1.0f);
+		uint64_t quantizedDepth = static_cast<uint64_t>(static_cast<double>(depth) * 4294967295.0);
+
+		return (static_cast<uint64_t>(layer & ((1u << LAYER_BITS) - 1)) << (DEPTH_BITS + MATERIAL_BITS + PIPELINE_BITS))
+			| (static_cast<uint64_t>(pipeline & ((1u << PIPELINE_BITS) - 1)) << (DEPTH_BITS + MATERIAL_BITS))
+			| (static_cast<uint64_t>(material & ((1u << MATERIAL_BITS) - 1)) << DEPTH_BITS)
+			| quantizedDepth;
+	}
+
+	void DrawQueue::sort(ThreadPool* threadPool)
+	{
+		radixSort(packets, scratch, threadPool);
+	}
+
+	DrawQueue::BindCounts DrawQueue::countBinds() const
+	{
+		BindCounts counts;
+		for (size_t i = 0; i < packets.size(); i++)
+		{
+			uint64_t key = packets[i].key;
+			bool first = i == 0;
+			uint64_t previous = first ? 0 : packets[i - 1].key;
+			bool pipelineChanged = first || getPipeline(key) != getPipeline(previous);
+			if (pipelineChanged)
+				counts.pipelineBinds++;
+			if (pipelineChanged || getMaterial(key) != getMaterial(previous))
+				counts.materialBinds++;
+		}
+		return counts;
+	}
+
+	bool DrawQueue::isBindMinimal() const
+	{
+		//the layer and pipeline fields are the top 16 bits, layer, pipeline and material the top 32 bits
+		std::unordered_set<uint64_t> pipelineGroups;
+		std::unordered_set<uint64_t> materialGroups;
+		for (const DrawPacket& packet : packets)
+		{
+			pipelineGroups.insert(packet.key >> (DEPTH_BITS + MATERIAL_BITS));
+			materialGroups.insert(packet.key >> DEPTH_BITS);
+		}
+
+		BindCounts counts = countBinds();
+		return counts.pipelineBinds <= pipelineGroups.size() && counts.materialBinds <= materialGroups.size();
+	}
+
+	void radixSort(std::vector<DrawPacket>& packets, std::vector<DrawPacket>& scratch, ThreadPool* threadPool)
+	{
+		size_t count = packets.size();
+		if (count < 2)
+			return;
+		if (count < MIN_PACKETS_FOR_RADIX)
+		{
+			std::stable_sort(packets.begin(), packets.end(), [](const DrawPacket& a, const DrawPacket& b) { return a.key < b.key; });
+			return;
+		}
+		scratch.resize(count);
+
+		size_t chunkCount = 1;
+		if (threadPool != nullptr)
+			chunkCount = std::max<size_t>(1, std::min<size_t>(threadPool->size() + 1, count / MIN_PACKETS_PER_CHUNK));
+		size_t chunkSize = (count + chunkCount - 1) / chunkCount;
+
+		std::vector<Histogram> histograms(chunkCount);
+		std::vector<DrawPacket>* source = &packets;
+		std::vector<DrawPacket>* destination = &scratch;
+
+		for (uint32_t pass = 0; pass < PASS_COUNT; pass++)
+		{
+			const DrawPacket* input = source->data();
+			DrawPacket* output = destination->data();
+
+			runChunks(threadPool, chunkCount, [&](size_t chunk) {
+				Histogram& histogram = histograms[chunk];
+				histogram.fill(0);
+				size_t end = std::min(count, (chunk + 1) * chunkSize);
+				for (size_t i = chunk * chunkSize; i < end; i++)
+					histogram[digitOf(input[i].key, pass)]++;
+			});
+
+			//every key has the same digit, so the pass wouldn't move anything
+			Histogram totals{};
+			for (const Histogram& histogram : histograms)
+				for (uint32_t digit = 0; digit < DIGIT_COUNT; digit++)
+					totals[digit] += histogram[digit];
+			if (std::find(totals.begin(), totals.end(), count) != totals.end())
+				continue;
+
+			//turns the counts into write offsets. For a digit, lower chunks come first, which keeps the sort stable
+			size_t offset = 0;
+			for (uint32_t digit = 0; digit < DIGIT_COUNT; digit++)
+			{
+				for (Histogram& histogram : histograms)
+				{
+					size_t digitCount = histogram[digit];
+					histogram[digit] = offset;
+					offset += digitCount;
+				}
+			}
+
+			runChunks(threadPool, chunkCount, [&](size_t chunk) {
+				Histogram& offsets = histograms[chunk];
+				size_t end = std::min(count, (chunk + 1) * chunkSize);
+				for (size_t i = chunk * chunkSize; i < end; i++)
+					output[offsets[digitOf(input[i].key, pass)]++] = input[i];
+			});
+
+			std::swap(source, destination);
+		}
+
+		if (source != &packets)
+			packets.swap(scratch);
+	}
+}
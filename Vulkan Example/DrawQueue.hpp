@@ -0,0 +1,67 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace vulkanExample
+{
+	class ThreadPool;
+
+	// One draw waiting to be recorded. drawIndex points into the renderer's draw list
+	struct DrawPacket
+	{
+		uint64_t key;
+		uint32_t drawIndex;
+	};
+
+	// Draw packets ordered by a packed 64 bit key before recording. From the most significant bits:
+	// | layer 8 | pipeline 8 | material 16 | depth 32 |
+	// so sorting the keys as integers groups the draws by layer, then pipeline, then material
+	// and finally goes front to back inside a material for early depth rejection
+	class DrawQueue
+	{
+	public:
+		static constexpr uint32_t DEPTH_BITS = 32;
+		static constexpr uint32_t MATERIAL_BITS = 16;
+		static constexpr uint32_t PIPELINE_BITS = 8;
+		static constexpr uint32_t LAYER_BITS = 8;
+
+		//depth is the normalized distance to the camera (0 is the near plane), clamped to [0, 1]
+		static uint64_t makeKey(uint32_t layer, uint32_t pipeline, uint32_t material, float depth);
+		static uint32_t getLayer(uint64_t key) { return static_cast<uint32_t>(key >> (DEPTH_BITS + MATERIAL_BITS + PIPELINE_BITS)); }
+		static uint32_t getPipeline(uint64_t key) { return static_cast<uint32_t>(key >> (DEPTH_BITS + MATERIAL_BITS)) & ((1u << PIPELINE_BITS) - 1); }
+		static uint32_t getMaterial(uint64_t key) { return static_cast<uint32_t>(key >> DEPTH_BITS) & ((1u << MATERIAL_BITS) - 1); }
+
+		// State changes needed to record the packets in their current order
+		struct BindCounts
+		{
+			uint64_t pipelineBinds = 0;
+			uint64_t materialBinds = 0;
+		};
+
+		void clear() { packets.clear(); }
+		void reserve(size_t count) { packets.reserve(count); }
+		void push(uint64_t key, uint32_t drawIndex) { packets.push_back({ key, drawIndex }); }
+
+		//stable LSD radix sort of the keys. Large queues are split across the thread pool, if any
+		void sort(ThreadPool* threadPool = nullptr);
+
+		const std::vector<DrawPacket>& getPackets() const { return packets; }
+		size_t size() const { return packets.size(); }
+		bool empty() const { return packets.empty(); }
+
+		//binds recorded when a pipeline or material is only bound when it differs from the previous draw
+		BindCounts countBinds() const;
+		//true if every layer/pipeline and layer/pipeline/material group is bound once at most, which holds once sorted
+		bool isBindMinimal() const;
+
+	private:
+		std::vector<DrawPacket> packets;
+		//ping-pong buffer of the radix sort, kept to avoid allocating every frame
+		std::vector<DrawPacket> scratch;
+	};
+
+	//sorts packets by key with a stable 8 bit LSD radix sort, using scratch as a second buffer.
+	//Passes where every key has the same digit are skipped
+	void radixSort(std::vector<DrawPacket>& packets, std::vector<DrawPacket>& scratch, ThreadPool* threadPool = nullptr);
+}
@@ -0,0 +1,209 @@
+#include "FileWatcher.hpp"
+#include <filesystem>
+#include <iostream>
+#include <map>
+
+#if defined(__linux__)
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#elif defined(_WIN32)
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#endif
+
+namespace vulkanExample
+{
+	FileWatcher::~FileWatcher()
+	{
+		stop();
+	}
+
+	void FileWatcher::start(const std::string& directory, const std::vector<std::string>& extensions, std::function<void()> onChange)
+	{
+		stop();
+		this->directory = directory;
+		this->extensions = extensions;
+		this->onChange = std::move(onChange);
+
+#if defined(__linux__)
+		inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		//editors either rewrite the file in place or write a new one and rename it over the old one
+		if (inotifyFd < 0 || inotify_add_watch(inotifyFd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0 || pipe(wakePipe) != 0)
+		{
+			std::cout << "Can't watch " << directory << " for changes" << std::endl;
+			stop();
+			return;
+		}
+#elif defined(_WIN32)
+		HANDLE handle = CreateFileA(directory.c_str(), FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+			nullptr, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, nullptr);
+		if (handle == INVALID_HANDLE_VALUE)
+		{
+			std::cout << "Can't watch " << directory << " for changes" << std::endl;
+			return;
+		}
+		directoryHandle = handle;
+#endif
+
+		running = true;
+		thread = std::thread(&FileWatcher::watchLoop, this);
+	}
+
+	void FileWatcher::stop()
+	{
+		bool wasRunning = running.exchange(false);
+		if (wasRunning)
+		{
+#if defined(__linux__)
+			char wake = 0;
+			(void)write(wakePipe[1], &wake, 1);
+#elif defined(_WIN32)
+			//ReadDirectoryChangesW blocks until something changes
+			CancelSynchronousIo(thread.native_handle());
+#endif
+		}
+		if (thread.joinable())
+			thread.join();
+
+#if defined(__linux__)
+		if (inotifyFd >= 0)
+			close(inotifyFd);
+		for (int& fd : wakePipe)
+		{
+			if (fd >= 0)
+				close(fd);
+			fd = -1;
+		}
+		inotifyFd = -1;
+#elif defined(_WIN32)
+		if (directoryHandle != nullptr)
+			CloseHandle(directoryHandle);
+		directoryHandle = nullptr;
+#endif
+	}
+
+	std::vector<std::string> FileWatcher::takeChanges()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		std::vector<std::string> result(changes.begin(), changes.end());
+		changes.clear();
+		return result;
+	}
+
+	bool FileWatcher::isWatched(const std::string& fileName) const
+	{
+		std::string extension = std::filesystem::path(fileName).extension().string();
+		for (const std::string& watched : extensions)
+		{
+			if (extension == watched)
+				return true;
+		}
+		return false;
+	}
+
+	void FileWatcher::publish(std::set<std::string>& pending)
+	{
+		if (pending.empty())
+			return;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			changes.insert(pending.begin(), pending.end());
+		}
+		pending.clear();
+		if (onChange)
+			onChange();
+	}
+
+#if defined(__linux__)
+	void FileWatcher::watchLoop()
+	{
+		std::set<std::string> pending;
+		alignas(inotify_event) char buffer[4096];
+
+		while (running)
+		{
+			pollfd fds[2] = { { inotifyFd, POLLIN, 0 }, { wakePipe[0], POLLIN, 0 } };
+			//once something changed, waits for the burst to settle before publishing it
+			int timeout = pending.empty() ? -1 : static_cast<int>(settleTime.count());
+			int ready = poll(fds, 2, timeout);
+			if (ready == 0)
+			{
+				publish(pending);
+				continue;
+			}
+			if (ready < 0 || (fds[1].revents & POLLIN))
+				continue;
+
+			ssize_t length;
+			while ((length = read(inotifyFd, buffer, sizeof(buffer))) > 0)
+			{
+				for (char* event = buffer; event < buffer + length;)
+				{
+					const inotify_event* info = reinterpret_cast<const inotify_event*>(event);
+					if (info->len > 0 && isWatched(info->name))
+						pending.insert(info->name);
+					event += sizeof(inotify_event) + info->len;
+				}
+			}
+		}
+	}
+#elif defined(_WIN32)
+	void FileWatcher::watchLoop()
+	{
+		std::set<std::string> pending;
+		alignas(DWORD) char buffer[4096];
+
+		while (running)
+		{
+			DWORD length = 0;
+			if (!ReadDirectoryChangesW(directoryHandle, buffer, sizeof(buffer), FALSE, FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME,
+				&length, nullptr, nullptr))
+				break;
+
+			for (char* event = buffer; length > 0;)
+			{
+				const FILE_NOTIFY_INFORMATION* info = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(event);
+				std::wstring name(info->FileName, info->FileNameLength / sizeof(WCHAR));
+				std::string fileName = std::filesystem::path(name).string();
+				if (isWatched(fileName))
+					pending.insert(fileName);
+				if (info->NextEntryOffset == 0)
+					break;
+				event += info->NextEntryOffset;
+			}
+
+			//there is no timeout on the blocking read, so the burst is merged with a short sleep instead
+			std::this_thread::sleep_for(settleTime);
+			publish(pending);
+		}
+	}
+#else
+	void FileWatcher::watchLoop()
+	{
+		std::map<std::string, std::filesystem::file_time_type> timestamps;
+		bool firstScan = true;
+
+		while (running)
+		{
+			std::set<std::string> pending;
+			std::error_code error;
+			for (const auto& entry : std::filesystem::directory_iterator(directory, error))
+			{
+				std::string fileName = entry.path().filename().string();
+				if (!isWatched(fileName))
+					continue;
+				auto time = entry.last_write_time(error);
+				auto found = timestamps.find(fileName);
+				if (!firstScan && (found == timestamps.end() || found->second != time))
+					pending.insert(fileName);
+				timestamps[fileName] = time;
+			}
+			firstScan = false;
+			publish(pending);
+			std::this_thread::sleep_for(std::chrono::milliseconds(250));
+		}
+	}
+#endif
+}
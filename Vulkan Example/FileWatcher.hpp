@@ -0,0 +1,53 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace vulkanExample
+{
+	// Watches the files directly inside a directory on a background thread.
+	// Uses inotify on Linux and ReadDirectoryChangesW on Windows, otherwise polls the modification times.
+	// Bursts of events (editors often write a file in several steps) are merged before they are published
+	class FileWatcher
+	{
+	public:
+		~FileWatcher();
+
+		//only files with one of the extensions (e.g. ".frag") are reported. onChange is called on the watcher thread
+		void start(const std::string& directory, const std::vector<std::string>& extensions, std::function<void()> onChange = {});
+		void stop();
+
+		//names of the files changed since the last call
+		std::vector<std::string> takeChanges();
+
+	private:
+		std::string directory;
+		std::vector<std::string> extensions;
+		std::function<void()> onChange;
+		std::thread thread;
+		std::atomic<bool> running{ false };
+
+		std::mutex mutex;
+		std::set<std::string> changes;
+
+		//events closer than this are merged
+		const std::chrono::milliseconds settleTime{ 50 };
+
+#if defined(__linux__)
+		int inotifyFd = -1;
+		//written by stop() to wake the watcher thread
+		int wakePipe[2] = { -1, -1 };
+#elif defined(_WIN32)
+		void* directoryHandle = nullptr;
+#endif
+
+		void watchLoop();
+		bool isWatched(const std::string& fileName) const;
+		void publish(std::set<std::string>& pending);
+	};
+}
@@ -0,0 +1,63 @@
+#include "FragmentCounter.hpp"
+#include <stdexcept>
+
+namespace vulkanExample
+{
+	bool FragmentCounter::create(VkDevice device, bool pipelineStatisticsEnabled, uint32_t slotCount)
+	{
+		this->device = device;
+		if (!pipelineStatisticsEnabled)
+			return false;
+
+		VkQueryPoolCreateInfo createInfo{};
+		createInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		createInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+		createInfo.queryCount = slotCount;
+		createInfo.pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+
+		if (vkCreateQueryPool(device, &createInfo, nullptr, &queryPool) != VK_SUCCESS)
+			throw std::runtime_error("failed to create pipeline statistics query pool!");
+		pending.assign(slotCount, false);
+		return true;
+	}
+
+	void FragmentCounter::destroy()
+	{
+		if (queryPool != VK_NULL_HANDLE)
+			vkDestroyQueryPool(device, queryPool, nullptr);
+		queryPool = VK_NULL_HANDLE;
+		pending.clear();
+	}
+
+	void FragmentCounter::begin(VkCommandBuffer commandBuffer, uint32_t slot)
+	{
+		if (queryPool == VK_NULL_HANDLE)
+			return;
+		vkCmdResetQueryPool(commandBuffer, queryPool, slot, 1);
+		vkCmdBeginQuery(commandBuffer, queryPool, slot, 0);
+	}
+
+	void FragmentCounter::end(VkCommandBuffer commandBuffer, uint32_t slot)
+	{
+		if (queryPool == VK_NULL_HANDLE)
+			return;
+		vkCmdEndQuery(commandBuffer, queryPool, slot);
+		pending[slot] = true;
+	}
+
+	std::optional<uint64_t> FragmentCounter::collect(uint32_t slot)
+	{
+		if (queryPool == VK_NULL_HANDLE || !pending[slot])
+			return std::nullopt;
+
+		//invocations, availability
+		uint64_t results[2] = {};
+		VkResult result = vkGetQueryPoolResults(device, queryPool, slot, 1, sizeof(results), results, sizeof(results),
+			VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+		if ((result != VK_SUCCESS && result != VK_NOT_READY) || results[1] == 0)
+			return std::nullopt;
+
+		pending[slot] = false;
+		return results[0];
+	}
+}
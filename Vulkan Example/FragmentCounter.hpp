@@ -0,0 +1,33 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+namespace vulkanExample
+{
+	// Counts the fragment shader invocations of a render pass with a pipeline statistics query per slot (one slot per command buffer).
+	// Divided by the pixels drawn, it is the average number of times each pixel was shaded. Needs the pipelineStatisticsQuery feature
+	class FragmentCounter
+	{
+	public:
+		//returns false if the feature isn't enabled. The counter then does nothing
+		bool create(VkDevice device, bool pipelineStatisticsEnabled, uint32_t slotCount);
+		void destroy();
+
+		//records outside of a render pass, around the passes to count
+		void begin(VkCommandBuffer commandBuffer, uint32_t slot);
+		void end(VkCommandBuffer commandBuffer, uint32_t slot);
+
+		//invocations between begin and end of the slot's last recording, no value if there is none (or not available yet)
+		std::optional<uint64_t> collect(uint32_t slot);
+
+		bool isSupported() const { return queryPool != VK_NULL_HANDLE; }
+
+	private:
+		VkDevice device = VK_NULL_HANDLE;
+		VkQueryPool queryPool = VK_NULL_HANDLE;
+		//recorded since the last collect
+		std::vector<bool> pending;
+	};
+}
@@ -0,0 +1,105 @@
+#include "FramePacer.hpp"
+#include <algorithm>
+#include <thread>
+
+namespace vulkanExample
+{
+	void FramePacer::setFrameRateLimit(double framesPerSecond)
+	{
+		frameRateLimit = std::max(0.0, framesPerSecond);
+		if (frameRateLimit > 0.0)
+			frameInterval = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / frameRateLimit));
+		else
+			frameInterval = Clock::duration::zero();
+		nextFrameDeadline = Clock::now();
+	}
+
+	void FramePacer::waitForNextFrame()
+	{
+		if (frameRateLimit <= 0.0)
+			return;
+
+		auto now = Clock::now();
+		//if we fell behind by more than a frame, don't try to catch up with a burst of frames
+		if (now - nextFrameDeadline > frameInterval)
+			nextFrameDeadline = now;
+
+		auto remaining = nextFrameDeadline - now;
+		if (remaining > spinThreshold)
+			std::this_thread::sleep_for(remaining - spinThreshold);
+
+		while (Clock::now() < nextFrameDeadline)
+			std::this_thread::yield();
+
+		nextFrameDeadline += frameInterval;
+	}
+
+	void FramePacer::recordInput()
+	{
+		if (!pendingInput.has_value())
+			pendingInput = Clock::now();
+	}
+
+	void FramePacer::onPresentQueued(uint64_t presentId)
+	{
+		if (!pendingInput.has_value())
+			return;
+
+		if (queuedInputs.size() >= MAX_QUEUED_INPUTS)
+			queuedInputs.pop_front();
+		queuedInputs.emplace_back(presentId, pendingInput.value());
+		pendingInput.reset();
+	}
+
+	void FramePacer::onPresentCompleted(uint64_t presentId)
+	{
+		auto now = Clock::now();
+		while (!queuedInputs.empty() && queuedInputs.front().first <= presentId)
+		{
+			double latencyMs = std::chrono::duration<double, std::milli>(now - queuedInputs.front().second).count();
+			latencyStats.samples++;
+			latencyStats.totalMs += latencyMs;
+			latencyStats.maxMs = std::max(latencyStats.maxMs, latencyMs);
+			queuedInputs.pop_front();
+		}
+	}
+
+	std::optional<uint64_t> FramePacer::getOldestQueuedPresent() const
+	{
+		if (queuedInputs.empty())
+			return std::nullopt;
+		return queuedInputs.front().first;
+	}
+
+	FramePacer::LatencyStats FramePacer::takeLatencyStats()
+	{
+		LatencyStats stats = latencyStats;
+		latencyStats = LatencyStats{};
+		return stats;
+	}
+
+	const char* presentModeName(VkPresentModeKHR presentMode)
+	{
+		switch (presentMode)
+		{
+		case VK_PRESENT_MODE_IMMEDIATE_KHR: return "IMMEDIATE";
+		case VK_PRESENT_MODE_MAILBOX_KHR: return "MAILBOX";
+		case VK_PRESENT_MODE_FIFO_KHR: return "FIFO";
+		case VK_PRESENT_MODE_FIFO_RELAXED_KHR: return "FIFO_RELAXED";
+		default: return "UNKNOWN";
+		}
+	}
+
+	std::optional<VkPresentModeKHR> parsePresentMode(const std::string& name)
+	{
+		if (name == "immediate")
+			return VK_PRESENT_MODE_IMMEDIATE_KHR;
+		if (name == "mailbox")
+			return VK_PRESENT_MODE_MAILBOX_KHR;
+		if (name == "fifo")
+			return VK_PRESENT_MODE_FIFO_KHR;
+		if (name == "fifo-relaxed")
+			return VK_PRESENT_MODE_FIFO_RELAXED_KHR;
+		return std::nullopt;
+	}
+}
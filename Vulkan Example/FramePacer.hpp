@@ -0,0 +1,59 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <chrono>
+#include <deque>
+#include <optional>
+#include <string>
+
+namespace vulkanExample
+{
+	// Keeps frames on a steady cadence and measures how long input takes to reach the screen
+	class FramePacer
+	{
+	public:
+		using Clock = std::chrono::steady_clock;
+
+		struct LatencyStats
+		{
+			uint64_t samples = 0;
+			double totalMs = 0.0;
+			double maxMs = 0.0;
+
+			double averageMs() const { return samples > 0 ? totalMs / samples : 0.0; }
+		};
+
+		//0 disables the frame limiter
+		void setFrameRateLimit(double framesPerSecond);
+		double getFrameRateLimit() const { return frameRateLimit; }
+
+		//sleeps most of the remaining frame time, then spins for the last part so the deadline is hit precisely
+		void waitForNextFrame();
+
+		//timestamps an input event. Only the oldest input not yet presented is tracked
+		void recordInput();
+		//associates the pending input (if any) with the present about to be queued
+		void onPresentQueued(uint64_t presentId);
+		//every present up to presentId reached the screen (or the present call returned when present wait is unavailable)
+		void onPresentCompleted(uint64_t presentId);
+		//present the oldest tracked input is waiting for, if any
+		std::optional<uint64_t> getOldestQueuedPresent() const;
+
+		LatencyStats takeLatencyStats();
+
+	private:
+		double frameRateLimit = 0.0;
+		Clock::duration frameInterval{};
+		Clock::time_point nextFrameDeadline{};
+		//below this remaining time the OS sleep is too coarse, so we busy wait instead
+		const Clock::duration spinThreshold = std::chrono::milliseconds(2);
+
+		std::optional<Clock::time_point> pendingInput;
+		//the oldest inputs are dropped unmeasured past this, so presents that never complete can't grow the queue forever
+		static constexpr size_t MAX_QUEUED_INPUTS = 64;
+		std::deque<std::pair<uint64_t, Clock::time_point>> queuedInputs;
+		LatencyStats latencyStats;
+	};
+
+	const char* presentModeName(VkPresentModeKHR presentMode);
+	std::optional<VkPresentModeKHR> parsePresentMode(const std::string& name);
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <cstdint>
+
+namespace vulkanExample
+{
+	// Counters accumulated between two statistics reports
+	struct FrameStats
+	{
+		uint64_t framesDrawn = 0;
+		//main loop iterations that woke up but had nothing to redraw
+		uint64_t framesSkipped = 0;
+		//wall clock and process CPU time spent waiting for events while idle (in seconds)
+		double idleWallTime = 0.0;
+		double idleCpuTime = 0.0;
+		//command buffer state changes recorded for the drawn frames
+		uint64_t drawCalls = 0;
+		uint64_t pipelineBinds = 0;
+		uint64_t descriptorSetBinds = 0;
+		uint64_t pushConstantUpdates = 0;
+		//GPU time of the frames whose timestamps were read back (in milliseconds)
+		double gpuTime = 0.0;
+		uint64_t gpuFramesTimed = 0;
+		//fragment shader invocations of the scene pass, and the pixels it covered, for the frames whose statistics were read back
+		uint64_t fragmentInvocations = 0;
+		uint64_t fragmentPixels = 0;
+		uint64_t framesCounted = 0;
+		//clusters of the frames whose occlusion culling results were read back
+		uint64_t clustersDrawnEarly = 0;
+		uint64_t clustersDrawnLate = 0;
+		uint64_t clustersOccluded = 0;
+		uint64_t clustersOutsideFrustum = 0;
+		uint64_t framesCulled = 0;
+		//GPU time of the completed submissions to the dedicated transfer and async compute queues (in milliseconds).
+		//The graphics queue's is gpuTime
+		double transferBusyTime = 0.0;
+		double computeBusyTime = 0.0;
+		//device memory budget and usage of the last frame (in bytes)
+		uint64_t memoryBudget = 0;
+		uint64_t memoryUsage = 0;
+		bool memoryMeasured = false;
+
+		void reset()
+		{
+			*this = FrameStats{};
+		}
+	};
+}
@@ -0,0 +1,216 @@
+#include "GpuTimeline.hpp"
+#include <stdexcept>
+
+namespace vulkanExample
+{
+	void GpuTimeline::create(VkDevice device, VkQueue queue, bool useTimelineSemaphore)
+	{
+		this->device = device;
+		this->queue = queue;
+		submittedValue = 0;
+		completed = 0;
+
+		if (!useTimelineSemaphore)
+			return;
+
+		VkSemaphoreTypeCreateInfo typeInfo{};
+		typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+		typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+		typeInfo.initialValue = 0;
+
+		VkSemaphoreCreateInfo createInfo{};
+		createInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+		createInfo.pNext = &typeInfo;
+
+		if (vkCreateSemaphore(device, &createInfo, nullptr, &timelineSemaphore) != VK_SUCCESS)
+			throw std::runtime_error("failed to create timeline semaphore!");
+	}
+
+	void GpuTimeline::destroy()
+	{
+		if (device == VK_NULL_HANDLE)
+			return;
+
+		wait(submittedValue);
+		collectGarbage();
+
+		for (auto& pending : pendingFences)
+			vkDestroyFence(device, pending.second, nullptr);
+		for (VkFence fence : freeFences)
+			vkDestroyFence(device, fence, nullptr);
+		pendingFences.clear();
+		freeFences.clear();
+
+		if (timelineSemaphore != VK_NULL_HANDLE)
+			vkDestroySemaphore(device, timelineSemaphore, nullptr);
+		timelineSemaphore = VK_NULL_HANDLE;
+		device = VK_NULL_HANDLE;
+	}
+
+	uint64_t GpuTimeline::submit(const std::vector<VkCommandBuffer>& commandBuffers, const std::vector<Wait>& waits,
+		const std::vector<VkSemaphore>& signalSemaphores)
+	{
+		uint64_t value = submittedValue + 1;
+
+		std::vector<VkSemaphore> waitSemaphores;
+		std::vector<uint64_t> waitValues;
+		std::vector<VkPipelineStageFlags> waitStages;
+		for (const Wait& wait : waits)
+		{
+			waitSemaphores.push_back(wait.semaphore);
+			waitValues.push_back(wait.value);
+			waitStages.push_back(wait.stageMask);
+		}
+
+		std::vector<VkSemaphore> signals(signalSemaphores);
+		//binary semaphores ignore their value, but the arrays must match in size
+		std::vector<uint64_t> signalValues(signals.size(), 0);
+
+		VkSubmitInfo submitInfo{};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.waitSemaphoreCount = static_cast<uint32_t>(waitSemaphores.size());
+		submitInfo.pWaitSemaphores = waitSemaphores.data();
+		submitInfo.pWaitDstStageMask = waitStages.data();
+		submitInfo.commandBufferCount = static_cast<uint32_t>(commandBuffers.size());
+		submitInfo.pCommandBuffers = commandBuffers.data();
+
+		VkTimelineSemaphoreSubmitInfo timelineInfo{};
+		VkFence fence = VK_NULL_HANDLE;
+		if (usesTimelineSemaphore())
+		{
+			signals.push_back(timelineSemaphore);
+			signalValues.push_back(value);
+
+			timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+			timelineInfo.waitSemaphoreValueCount = static_cast<uint32_t>(waitValues.size());
+			timelineInfo.pWaitSemaphoreValues = waitValues.data();
+			timelineInfo.signalSemaphoreValueCount = static_cast<uint32_t>(signalValues.size());
+			timelineInfo.pSignalSemaphoreValues = signalValues.data();
+			submitInfo.pNext = &timelineInfo;
+		}
+		else
+		{
+			fence = acquireFence();
+		}
+
+		submitInfo.signalSemaphoreCount = static_cast<uint32_t>(signals.size());
+		submitInfo.pSignalSemaphores = signals.data();
+
+		if (vkQueueSubmit(queue, 1, &submitInfo, fence) != VK_SUCCESS)
+		{
+			if (fence != VK_NULL_HANDLE)
+				freeFences.push_back(fence);
+			throw std::runtime_error("failed to submit command buffer!");
+		}
+
+		if (fence != VK_NULL_HANDLE)
+			pendingFences.emplace_back(value, fence);
+		submittedValue = value;
+		return value;
+	}
+
+	uint64_t GpuTimeline::completedValue()
+	{
+		if (usesTimelineSemaphore())
+		{
+			vkGetSemaphoreCounterValue(device, timelineSemaphore, &completed);
+			return completed;
+		}
+
+		//submissions on a queue complete in order, so we can stop at the first unsignaled fence
+		while (!pendingFences.empty() && vkGetFenceStatus(device, pendingFences.front().second) == VK_SUCCESS)
+		{
+			completed = pendingFences.front().first;
+			vkResetFences(device, 1, &pendingFences.front().second);
+			freeFences.push_back(pendingFences.front().second);
+			pendingFences.pop_front();
+		}
+		return completed;
+	}
+
+	bool GpuTimeline::isComplete(uint64_t value)
+	{
+		return value <= completed || value <= completedValue();
+	}
+
+	void GpuTimeline::wait(uint64_t value)
+	{
+		if (isComplete(value))
+			return;
+
+		if (usesTimelineSemaphore())
+		{
+			VkSemaphoreWaitInfo waitInfo{};
+			waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+			waitInfo.semaphoreCount = 1;
+			waitInfo.pSemaphores = &timelineSemaphore;
+			waitInfo.pValues = &value;
+			vkWaitSemaphores(device, &waitInfo, UINT64_MAX);
+		}
+		else
+		{
+			for (auto& pending : pendingFences)
+			{
+				if (pending.first >= value)
+				{
+					vkWaitForFences(device, 1, &pending.second, VK_TRUE, UINT64_MAX);
+					break;
+				}
+			}
+		}
+		completedValue();
+	}
+
+	void GpuTimeline::deferUntilIdle(std::function<void()> callback)
+	{
+		deferUntil(submittedValue, std::move(callback));
+	}
+
+	void GpuTimeline::deferUntil(uint64_t value, std::function<void()> callback)
+	{
+		deferredCallbacks.emplace_back(value, std::move(callback));
+	}
+
+	void GpuTimeline::collectGarbage()
+	{
+		if (deferredCallbacks.empty())
+			return;
+
+		uint64_t done = completedValue();
+		//callbacks are mostly queued in increasing order, but a deferUntil with an older value must not block the rest.
+		//ready ones are moved out first, as a callback may defer new work
+		std::vector<std::function<void()>> ready;
+		for (auto it = deferredCallbacks.begin(); it != deferredCallbacks.end();)
+		{
+			if (it->first <= done)
+			{
+				ready.push_back(std::move(it->second));
+				it = deferredCallbacks.erase(it);
+			}
+			else
+			{
+				++it;
+			}
+		}
+
+		for (auto& callback : ready)
+			callback();
+	}
+
+	VkFence GpuTimeline::acquireFence()
+	{
+		if (!freeFences.empty())
+		{
+			VkFence fence = freeFences.back();
+			freeFences.pop_back();
+			return fence;
+		}
+
+		VkFenceCreateInfo fenceInfo{};
+		fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+		VkFence fence;
+		if (vkCreateFence(device, &fenceInfo, nullptr, &fence) != VK_SUCCESS)
+			throw std::runtime_error("failed to create fence!");
+		return fence;
+	}
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <vector>
+
+namespace vulkanExample
+{
+	// Tracks the progress of one queue with a monotonically increasing value.
+	// Every submission signals the next value, so anything (a frame slot, a staging buffer, a retired pipeline)
+	// can be tied to "the GPU reached value N" instead of to a fence or a frame slot.
+	// Uses a timeline semaphore when available, otherwise one fence per submission
+	class GpuTimeline
+	{
+	public:
+		struct Wait
+		{
+			VkSemaphore semaphore;
+			//only used for timeline semaphores, ignored for binary ones
+			uint64_t value;
+			VkPipelineStageFlags stageMask;
+		};
+
+		void create(VkDevice device, VkQueue queue, bool useTimelineSemaphore);
+		//waits for the queue and runs every pending deferred callback
+		void destroy();
+
+		//submits the command buffers and returns the timeline value signaled when they complete
+		uint64_t submit(const std::vector<VkCommandBuffer>& commandBuffers, const std::vector<Wait>& waits = {},
+			const std::vector<VkSemaphore>& signalSemaphores = {});
+
+		//non blocking query of the last value the GPU finished
+		uint64_t completedValue();
+		bool isComplete(uint64_t value);
+		//blocks until the GPU reached the value. Returns immediately if it already did
+		void wait(uint64_t value);
+
+		//runs the callback once everything submitted so far has completed (e.g. to free a staging buffer)
+		void deferUntilIdle(std::function<void()> callback);
+		void deferUntil(uint64_t value, std::function<void()> callback);
+		//runs the deferred callbacks whose value was reached. Never blocks
+		void collectGarbage();
+
+		uint64_t lastSubmittedValue() const { return submittedValue; }
+		bool usesTimelineSemaphore() const { return timelineSemaphore != VK_NULL_HANDLE; }
+		//only valid with timeline semaphores, so other submissions can wait on a value of this queue on the GPU
+		VkSemaphore getSemaphore() const { return timelineSemaphore; }
+		VkQueue getQueue() const { return queue; }
+
+	private:
+		VkDevice device = VK_NULL_HANDLE;
+		VkQueue queue = VK_NULL_HANDLE;
+		VkSemaphore timelineSemaphore = VK_NULL_HANDLE;
+		uint64_t submittedValue = 0;
+		uint64_t completed = 0;
+
+		//fallback path: fence of every submission still in flight, in submission order
+		std::deque<std::pair<uint64_t, VkFence>> pendingFences;
+		std::vector<VkFence> freeFences;
+
+		std::deque<std::pair<uint64_t, std::function<void()>>> deferredCallbacks;
+
+		VkFence acquireFence();
+	};
+}
@@ -0,0 +1,78 @@
+#include "GpuTimer.hpp"
+#include <stdexcept>
+
+namespace vulkanExample
+{
+	bool GpuTimer::create(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t queueFamily, uint32_t slotCount, bool resetOnHost)
+	{
+		this->device = device;
+		this->resetOnHost = resetOnHost;
+
+		uint32_t familyCount = 0;
+		vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, nullptr);
+		std::vector<VkQueueFamilyProperties> families(familyCount);
+		vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, families.data());
+		uint32_t validBits = queueFamily < familyCount ? families[queueFamily].timestampValidBits : 0;
+		if (validBits == 0)
+			return false;
+
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+		timestampPeriod = properties.limits.timestampPeriod;
+		timestampMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+
+		VkQueryPoolCreateInfo createInfo{};
+		createInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		createInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		createInfo.queryCount = slotCount * 2;
+
+		if (vkCreateQueryPool(device, &createInfo, nullptr, &queryPool) != VK_SUCCESS)
+			throw std::runtime_error("failed to create timestamp query pool!");
+		pending.assign(slotCount, false);
+		return true;
+	}
+
+	void GpuTimer::destroy()
+	{
+		if (queryPool != VK_NULL_HANDLE)
+			vkDestroyQueryPool(device, queryPool, nullptr);
+		queryPool = VK_NULL_HANDLE;
+		pending.clear();
+	}
+
+	void GpuTimer::begin(VkCommandBuffer commandBuffer, uint32_t slot)
+	{
+		if (queryPool == VK_NULL_HANDLE)
+			return;
+		if (resetOnHost)
+			vkResetQueryPool(device, queryPool, slot * 2, 2);
+		else
+			vkCmdResetQueryPool(commandBuffer, queryPool, slot * 2, 2);
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, slot * 2);
+	}
+
+	void GpuTimer::end(VkCommandBuffer commandBuffer, uint32_t slot)
+	{
+		if (queryPool == VK_NULL_HANDLE)
+			return;
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, slot * 2 + 1);
+		pending[slot] = true;
+	}
+
+	std::optional<double> GpuTimer::collect(uint32_t slot)
+	{
+		if (queryPool == VK_NULL_HANDLE || !pending[slot])
+			return std::nullopt;
+
+		//begin, availability, end, availability
+		uint64_t results[4] = {};
+		VkResult result = vkGetQueryPoolResults(device, queryPool, slot * 2, 2, sizeof(results), results, sizeof(uint64_t) * 2,
+			VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+		if ((result != VK_SUCCESS && result != VK_NOT_READY) || results[1] == 0 || results[3] == 0)
+			return std::nullopt;
+
+		pending[slot] = false;
+		uint64_t ticks = ((results[2] & timestampMask) - (results[0] & timestampMask)) & timestampMask;
+		return static_cast<double>(ticks) * timestampPeriod / 1000000.0;
+	}
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+namespace vulkanExample
+{
+	// Measures the GPU time of command buffers with a pair of timestamp queries per slot (one slot per command buffer).
+	// Results are read without waiting, once the caller knows the GPU finished the slot's last submission
+	class GpuTimer
+	{
+	public:
+		//returns false if the queue family doesn't support timestamps. The timer then does nothing.
+		//Transfer only queues can't reset queries, resetOnHost resets them with vkResetQueryPool instead (needs hostQueryReset)
+		bool create(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t queueFamily, uint32_t slotCount, bool resetOnHost = false);
+		void destroy();
+
+		//records outside of a render pass
+		void begin(VkCommandBuffer commandBuffer, uint32_t slot);
+		void end(VkCommandBuffer commandBuffer, uint32_t slot);
+
+		//milliseconds between begin and end of the slot's last recording, no value if there is none (or not available yet)
+		std::optional<double> collect(uint32_t slot);
+
+		bool isSupported() const { return queryPool != VK_NULL_HANDLE; }
+		//recorded but not collected yet. A pending slot must not be recorded again before the GPU is done with it
+		bool isPending(uint32_t slot) const { return slot < pending.size() && pending[slot]; }
+
+	private:
+		VkDevice device = VK_NULL_HANDLE;
+		VkQueryPool queryPool = VK_NULL_HANDLE;
+		//nanoseconds per tick
+		double timestampPeriod = 1.0;
+		uint64_t timestampMask = ~0ull;
+		bool resetOnHost = false;
+		//recorded since the last collect
+		std::vector<bool> pending;
+	};
+}
@@ -0,0 +1,304 @@
+#include "Hash.hpp"
+#include "ThreadPool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace vulkanExample
+{
+	namespace
+	{
+		constexpr uint64_t PRIME32_1 = 0x9E3779B1u;
+		constexpr uint64_t PRIME32_2 = 0x85EBCA77u;
+		constexpr uint64_t PRIME32_3 = 0xC2B2AE3Du;
+		constexpr uint64_t PRIME64_1 = 0x9E3779B185EBCA87ull;
+		constexpr uint64_t PRIME64_2 = 0xC2B2AE3D27D4EB4Full;
+		constexpr uint64_t PRIME64_3 = 0x165667B19E3779F9ull;
+		constexpr uint64_t PRIME64_4 = 0x85EBCA77C2B2AE63ull;
+		constexpr uint64_t PRIME64_5 = 0x27D4EB2F165667C5ull;
+		constexpr uint64_t PRIME_MX1 = 0x165667919E3779F9ull;
+		constexpr uint64_t PRIME_MX2 = 0x9FB21C651E98DF25ull;
+
+		constexpr size_t SECRET_SIZE = 192;
+		constexpr size_t STRIPE_LEN = 64;
+		constexpr size_t SECRET_CONSUME_RATE = 8;
+		constexpr size_t STRIPES_PER_BLOCK = (SECRET_SIZE - STRIPE_LEN) / SECRET_CONSUME_RATE;
+		constexpr size_t BLOCK_LEN = STRIPE_LEN * STRIPES_PER_BLOCK;
+
+		//inputs of at least two chunks are hashed in parallel
+		constexpr size_t SOURCE_CHUNK_SIZE = 4 * 1024 * 1024;
+
+		const unsigned char SECRET[SECRET_SIZE] = {
+			0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe, 0x7c, 0x01, 0x81, 0x2c, 0xf7, 0x21, 0xad, 0x1c,
+			0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90, 0x97, 0xdb, 0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f,
+			0xcb, 0x79, 0xe6, 0x4e, 0xcc, 0xc0, 0xe5, 0x78, 0x82, 0x5a, 0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21,
+			0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e, 0xe0, 0x35, 0x90, 0xe6, 0x81, 0x3a, 0x26, 0x4c,
+			0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb, 0x88, 0xd0, 0x65, 0x8b, 0x1b, 0x53, 0x2e, 0xa3,
+			0x71, 0x64, 0x48, 0x97, 0xa2, 0x0d, 0xf9, 0x4e, 0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8,
+			0xa8, 0xfa, 0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f, 0xf9, 0xdc, 0xbb, 0xc7, 0xc7, 0x0b, 0x4f, 0x1d,
+			0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31, 0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64,
+			0xea, 0xc5, 0xac, 0x83, 0x34, 0xd3, 0xeb, 0xc3, 0xc5, 0x81, 0xa0, 0xff, 0xfa, 0x13, 0x63, 0xeb,
+			0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49, 0xd3, 0x16, 0x55, 0x26, 0x29, 0xd4, 0x68, 0x9e,
+			0x2b, 0x16, 0xbe, 0x58, 0x7d, 0x47, 0xa1, 0xfc, 0x8f, 0xf8, 0xb8, 0xd1, 0x7a, 0xd0, 0x31, 0xce,
+			0x45, 0xcb, 0x3a, 0x8f, 0x95, 0x16, 0x04, 0x28, 0xaf, 0xd7, 0xfb, 0xca, 0xbb, 0x4b, 0x40, 0x7e,
+		};
+
+		uint32_t read32(const unsigned char* data)
+		{
+			uint32_t value;
+			std::memcpy(&value, data, sizeof(value));
+			return value;
+		}
+
+		uint64_t read64(const unsigned char* data)
+		{
+			uint64_t value;
+			std::memcpy(&value, data, sizeof(value));
+			return value;
+		}
+
+		uint64_t rotl64(uint64_t value, int bits)
+		{
+			return value << bits | value >> (64 - bits);
+		}
+
+		uint32_t swap32(uint32_t value)
+		{
+			return (value << 24) | ((value << 8) & 0x00ff0000u) | ((value >> 8) & 0x0000ff00u) | (value >> 24);
+		}
+
+		uint64_t swap64(uint64_t value)
+		{
+			return static_cast<uint64_t>(swap32(static_cast<uint32_t>(value))) << 32 | swap32(static_cast<uint32_t>(value >> 32));
+		}
+
+		//the low and high halves of the 128 bit product, xored
+		uint64_t multiplyFold(uint64_t a, uint64_t b)
+		{
+#if defined(__SIZEOF_INT128__)
+			unsigned __int128 product = static_cast<unsigned __int128>(a) * b;
+			return static_cast<uint64_t>(product) ^ static_cast<uint64_t>(product >> 64);
+#else
+			uint64_t lowLow = (a & 0xffffffff) * (b & 0xffffffff);
+			uint64_t highLow = (a >> 32) * (b & 0xffffffff);
+			uint64_t lowHigh = (a & 0xffffffff) * (b >> 32);
+			uint64_t highHigh = (a >> 32) * (b >> 32);
+			uint64_t cross = (lowLow >> 32) + (highLow & 0xffffffff) + lowHigh;
+			uint64_t upper = (highLow >> 32) + (cross >> 32) + highHigh;
+			uint64_t lower = (cross << 32) | (lowLow & 0xffffffff);
+			return lower ^ upper;
+#endif
+		}
+
+		uint64_t avalanche64(uint64_t hash)
+		{
+			hash ^= hash >> 33;
+			hash *= PRIME64_2;
+			hash ^= hash >> 29;
+			hash *= PRIME64_3;
+			return hash ^ (hash >> 32);
+		}
+
+		uint64_t avalanche(uint64_t hash)
+		{
+			hash ^= hash >> 37;
+			hash *= PRIME_MX1;
+			return hash ^ (hash >> 32);
+		}
+
+		uint64_t rrmxmx(uint64_t hash, uint64_t length)
+		{
+			hash ^= rotl64(hash, 49) ^ rotl64(hash, 24);
+			hash *= PRIME_MX2;
+			hash ^= (hash >> 35) + length;
+			hash *= PRIME_MX2;
+			return hash ^ (hash >> 28);
+		}
+
+		uint64_t mix16(const unsigned char* data, const unsigned char* secret, uint64_t seed)
+		{
+			return multiplyFold(read64(data) ^ (read64(secret) + seed), read64(data + 8) ^ (read64(secret + 8) - seed));
+		}
+
+		uint64_t hashShort(const unsigned char* data, size_t size, uint64_t seed)
+		{
+			if (size > 8)
+			{
+				uint64_t low = read64(data) ^ ((read64(SECRET + 24) ^ read64(SECRET + 32)) + seed);
+				uint64_t high = read64(data + size - 8) ^ ((read64(SECRET + 40) ^ read64(SECRET + 48)) - seed);
+				return avalanche(size + swap64(low) + high + multiplyFold(low, high));
+			}
+			if (size >= 4)
+			{
+				seed ^= static_cast<uint64_t>(swap32(static_cast<uint32_t>(seed))) << 32;
+				uint64_t input = read32(data + size - 4) + (static_cast<uint64_t>(read32(data)) << 32);
+				return rrmxmx(input ^ ((read64(SECRET + 8) ^ read64(SECRET + 16)) - seed), size);
+			}
+			if (size > 0)
+			{
+				uint32_t combined = static_cast<uint32_t>(data[0]) << 16 | static_cast<uint32_t>(data[size >> 1]) << 24 |
+					static_cast<uint32_t>(data[size - 1]) | static_cast<uint32_t>(size) << 8;
+				uint64_t bitflip = (read32(SECRET) ^ read32(SECRET + 4)) + seed;
+				return avalanche64(combined ^ bitflip);
+			}
+			return avalanche64(seed ^ read64(SECRET + 56) ^ read64(SECRET + 64));
+		}
+
+		uint64_t hashMedium(const unsigned char* data, size_t size, uint64_t seed)
+		{
+			uint64_t accumulator = size * PRIME64_1;
+			if (size <= 128)
+			{
+				if (size > 32)
+				{
+					if (size > 64)
+					{
+						if (size > 96)
+						{
+							accumulator += mix16(data + 48, SECRET + 96, seed);
+							accumulator += mix16(data + size - 64, SECRET + 112, seed);
+						}
+						accumulator += mix16(data + 32, SECRET + 64, seed);
+						accumulator += mix16(data + size - 48, SECRET + 80, seed);
+					}
+					accumulator += mix16(data + 16, SECRET + 32, seed);
+					accumulator += mix16(data + size - 32, SECRET + 48, seed);
+				}
+				accumulator += mix16(data, SECRET, seed);
+				accumulator += mix16(data + size - 16, SECRET + 16, seed);
+				return avalanche(accumulator);
+			}
+
+			//129 to 240 bytes
+			for (size_t i = 0; i < 8; i++)
+				accumulator += mix16(data + 16 * i, SECRET + 16 * i, seed);
+			uint64_t accumulatorEnd = mix16(data + size - 16, SECRET + 136 - 17, seed);
+			accumulator = avalanche(accumulator);
+			for (size_t i = 8; i < size / 16; i++)
+				accumulatorEnd += mix16(data + 16 * i, SECRET + 16 * (i - 8) + 3, seed);
+			return avalanche(accumulator + accumulatorEnd);
+		}
+
+		void accumulateStripe(uint64_t* accumulators, const unsigned char* data, const unsigned char* secret)
+		{
+			for (size_t i = 0; i < 8; i++)
+			{
+				uint64_t value = read64(data + 8 * i);
+				uint64_t key = value ^ read64(secret + 8 * i);
+				accumulators[i ^ 1] += value;
+				accumulators[i] += (key & 0xffffffff) * (key >> 32);
+			}
+		}
+
+		void scramble(uint64_t* accumulators, const unsigned char* secret)
+		{
+			for (size_t i = 0; i < 8; i++)
+			{
+				uint64_t accumulator = accumulators[i];
+				accumulator ^= accumulator >> 47;
+				accumulator ^= read64(secret + 8 * i);
+				accumulators[i] = accumulator * PRIME32_1;
+			}
+		}
+
+		//more than 240 bytes, always with the default secret (a non zero seed would derive its own)
+		uint64_t hashLong(const unsigned char* data, size_t size, const unsigned char* secret)
+		{
+			uint64_t accumulators[8] = { PRIME32_3, PRIME64_1, PRIME64_2, PRIME64_3, PRIME64_4, PRIME32_2, PRIME64_5, PRIME32_1 };
+			size_t blocks = (size - 1) / BLOCK_LEN;
+			for (size_t block = 0; block < blocks; block++)
+			{
+				for (size_t stripe = 0; stripe < STRIPES_PER_BLOCK; stripe++)
+					accumulateStripe(accumulators, data + block * BLOCK_LEN + stripe * STRIPE_LEN, secret + stripe * SECRET_CONSUME_RATE);
+				scramble(accumulators, secret + SECRET_SIZE - STRIPE_LEN);
+			}
+
+			size_t stripes = ((size - 1) - BLOCK_LEN * blocks) / STRIPE_LEN;
+			for (size_t stripe = 0; stripe < stripes; stripe++)
+				accumulateStripe(accumulators, data + blocks * BLOCK_LEN + stripe * STRIPE_LEN, secret + stripe * SECRET_CONSUME_RATE);
+			accumulateStripe(accumulators, data + size - STRIPE_LEN, secret + SECRET_SIZE - STRIPE_LEN - 7);
+
+			uint64_t result = size * PRIME64_1;
+			for (size_t i = 0; i < 4; i++)
+				result += multiplyFold(accumulators[2 * i] ^ read64(secret + 11 + 16 * i), accumulators[2 * i + 1] ^ read64(secret + 11 + 16 * i + 8));
+			return avalanche(result);
+		}
+	}
+
+	uint64_t hashXxh3(const void* data, size_t size, uint64_t seed)
+	{
+		const unsigned char* bytes = static_cast<const unsigned char*>(data);
+		if (size <= 16)
+			return hashShort(bytes, size, seed);
+		if (size <= 240)
+			return hashMedium(bytes, size, seed);
+		if (seed == 0)
+			return hashLong(bytes, size, SECRET);
+
+		//the secret of a seed: every 16 byte pair of words offset by +seed and -seed
+		unsigned char secret[SECRET_SIZE];
+		for (size_t i = 0; i < SECRET_SIZE; i += 16)
+		{
+			uint64_t low = read64(SECRET + i) + seed;
+			uint64_t high = read64(SECRET + i + 8) - seed;
+			std::memcpy(secret + i, &low, sizeof(low));
+			std::memcpy(secret + i + 8, &high, sizeof(high));
+		}
+		return hashLong(bytes, size, secret);
+	}
+
+	uint64_t hashSource(const void* data, size_t size, ThreadPool* threadPool)
+	{
+		size_t chunks = (size + SOURCE_CHUNK_SIZE - 1) / SOURCE_CHUNK_SIZE;
+		if (chunks <= 1)
+			return hashXxh3(data, size);
+
+		// Chunks are claimed by the workers and by this thread alike, so the caller never waits for jobs stuck in the queue
+		// (it may be a worker itself, e.g. a texture decode)
+		struct Hashing
+		{
+			const unsigned char* bytes;
+			size_t size;
+			size_t chunks;
+			std::vector<uint64_t> hashes;
+			std::atomic<size_t> next{ 0 };
+			std::atomic<size_t> done{ 0 };
+			std::mutex mutex;
+			std::condition_variable finished;
+		};
+		auto hashing = std::make_shared<Hashing>();
+		hashing->bytes = static_cast<const unsigned char*>(data);
+		hashing->size = size;
+		hashing->chunks = chunks;
+		hashing->hashes.resize(chunks + 1);
+		auto work = [hashing]() {
+			for (size_t chunk = hashing->next++; chunk < hashing->chunks; chunk = hashing->next++)
+			{
+				size_t offset = chunk * SOURCE_CHUNK_SIZE;
+				hashing->hashes[chunk] = hashXxh3(hashing->bytes + offset, std::min(SOURCE_CHUNK_SIZE, hashing->size - offset));
+				if (++hashing->done == hashing->chunks)
+				{
+					std::lock_guard<std::mutex> lock(hashing->mutex);
+					hashing->finished.notify_all();
+				}
+			}
+		};
+
+		if (threadPool != nullptr)
+		{
+			for (size_t i = 1; i < std::min<size_t>(chunks, threadPool->size() + 1); i++)
+				threadPool->submit(work);
+		}
+		work();
+		{
+			std::unique_lock<std::mutex> lock(hashing->mutex);
+			hashing->finished.wait(lock, [&]() { return hashing->done == chunks; });
+		}
+		hashing->hashes[chunks] = size;
+		return hashXxh3(hashing->hashes.data(), hashing->hashes.size() * sizeof(uint64_t));
+	}
+}
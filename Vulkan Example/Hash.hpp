@@ -0,0 +1,39 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace vulkanExample
+{
+	constexpr uint64_t HASH_SEED = 14695981039346656037ull;
+
+	// 64 bit FNV-1a. Not cryptographic, only used to key caches by content.
+	// Pass the previous result as seed to hash several pieces as one
+	inline uint64_t hashBytes(const void* data, size_t size, uint64_t seed = HASH_SEED)
+	{
+		const unsigned char* bytes = static_cast<const unsigned char*>(data);
+		uint64_t hash = seed;
+		for (size_t i = 0; i < size; i++)
+		{
+			hash ^= bytes[i];
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+	inline uint64_t hashString(const std::string& text, uint64_t seed = HASH_SEED)
+	{
+		//includes the terminator so "ab" + "c" and "a" + "bc" differ
+		return hashBytes(text.c_str(), text.size() + 1, seed);
+	}
+
+	class ThreadPool;
+
+	// 64 bit XXH3 with the default secret, the same values as XXH3_64bits_withSeed. Several GB/s where FNV-1a does
+	// one byte at a time, for hashing whole source files
+	uint64_t hashXxh3(const void* data, size_t size, uint64_t seed = 0);
+
+	// Content hash of a source file for derived data keys. Large inputs are cut into chunks hashed on the thread pool,
+	// then the chunk hashes are hashed: stable for a given size, but not the XXH3 of the whole input past one chunk
+	uint64_t hashSource(const void* data, size_t size, ThreadPool* threadPool = nullptr);
+}
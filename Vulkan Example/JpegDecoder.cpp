@@ -0,0 +1,809 @@
+#include "JpegDecoder.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace vulkanExample
+{
+	namespace
+	{
+		//Huffman codes up to this long are decoded with a single table lookup
+		constexpr int FAST_BITS = 9;
+		//larger images are left to stb_image, which has its own limits
+		constexpr uint64_t MAX_PIXELS = uint64_t(1) << 28;
+
+		//position in the block of each zigzag ordered coefficient
+		constexpr uint8_t NATURAL_ORDER[64] = {
+			0, 1, 8, 16, 9, 2, 3, 10, 17, 24, 32, 25, 18, 11, 4, 5,
+			12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6, 7, 14, 21, 28,
+			35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+			58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63
+		};
+
+		struct HuffmanTable
+		{
+			//the next FAST_BITS bits to the code length << 8 | the symbol, 0 for longer codes
+			uint16_t fast[1 << FAST_BITS];
+			//largest code of each length (-1 if there is none), and what to add to a code of that length to index symbols
+			int32_t maxCode[17];
+			int32_t symbolOffset[17];
+			uint8_t symbols[256];
+			bool defined = false;
+		};
+
+		bool buildHuffmanTable(const uint8_t* counts, const uint8_t* symbols, HuffmanTable& table)
+		{
+			uint32_t total = 0;
+			for (int i = 0; i < 16; i++)
+				total += counts[i];
+			if (total > 256)
+				return false;
+			table.defined = false;
+			std::memcpy(table.symbols, symbols, total);
+			std::fill(std::begin(table.fast), std::end(table.fast), uint16_t(0));
+
+			//canonical codes: consecutive within a length, doubled from one length to the next
+			int32_t code = 0;
+			int32_t index = 0;
+			for (int length = 1; length <= 16; length++)
+			{
+				table.symbolOffset[length] = index - code;
+				for (uint32_t i = 0; i < counts[length - 1]; i++, index++, code++)
+				{
+					//more codes than the length has bits for, checked before the fast table is written
+					if (code >= 1 << length)
+						return false;
+					if (length <= FAST_BITS)
+					{
+						int32_t first = code << (FAST_BITS - length);
+						for (int32_t j = 0; j < 1 << (FAST_BITS - length); j++)
+							table.fast[first + j] = static_cast<uint16_t>(length << 8 | symbols[index]);
+					}
+				}
+				table.maxCode[length] = counts[length - 1] != 0 ? code - 1 : -1;
+				code <<= 1;
+			}
+			table.defined = true;
+			return true;
+		}
+
+		// Entropy coded data: removes the stuffed zero bytes and reads zeros once it reaches a marker
+		class BitReader
+		{
+		public:
+			BitReader(const uint8_t* data, size_t size, size_t position)
+				: data(data), size(size), position(position)
+			{
+			}
+
+			uint32_t readBits(int count)
+			{
+				if (count == 0)
+					return 0;
+				if (bits < count)
+					fill();
+				uint32_t value = static_cast<uint32_t>(buffer >> (64 - count));
+				consume(count);
+				return value;
+			}
+
+			//the symbol of the next code, -1 if no code of the table matches
+			int decode(const HuffmanTable& table)
+			{
+				if (bits < 16)
+					fill();
+				uint32_t entry = table.fast[buffer >> (64 - FAST_BITS)];
+				if (entry != 0)
+				{
+					consume(static_cast<int>(entry >> 8));
+					return static_cast<int>(entry & 0xff);
+				}
+				for (int length = FAST_BITS + 1; length <= 16; length++)
+				{
+					int32_t code = static_cast<int32_t>(buffer >> (64 - length));
+					if (code <= table.maxCode[length])
+					{
+						consume(length);
+						return table.symbols[code + table.symbolOffset[length]];
+					}
+				}
+				return -1;
+			}
+
+			//drops the padding bits of the interval and skips its RSTn marker
+			void restart()
+			{
+				buffer = 0;
+				bits = 0;
+				atMarker = false;
+				while (position + 1 < size && !(data[position] == 0xff && data[position + 1] >= 0xd0 && data[position + 1] <= 0xd7))
+					position++;
+				position = std::min(position + 2, size);
+			}
+
+			//at or before the marker that ended the entropy coded data
+			size_t getPosition() const { return position; }
+
+		private:
+			const uint8_t* data;
+			size_t size;
+			size_t position;
+			uint64_t buffer = 0;
+			int bits = 0;
+			bool atMarker = false;
+
+			void fill()
+			{
+				while (bits <= 56)
+				{
+					uint32_t byte = 0;
+					if (!atMarker && position < size)
+					{
+						byte = data[position];
+						if (byte != 0xff)
+							position++;
+						else if (position + 1 < size && data[position + 1] == 0x00)
+							position += 2;
+						else
+						{
+							atMarker = true;
+							byte = 0;
+						}
+					}
+					buffer |= static_cast<uint64_t>(byte) << (56 - bits);
+					bits += 8;
+				}
+			}
+
+			void consume(int count)
+			{
+				buffer <<= count;
+				bits -= count;
+			}
+		};
+
+		int32_t receiveExtend(BitReader& reader, int count)
+		{
+			int32_t value = static_cast<int32_t>(reader.readBits(count));
+			return count != 0 && value < 1 << (count - 1) ? value - (1 << count) + 1 : value;
+		}
+
+		struct Component
+		{
+			uint32_t id = 0;
+			uint32_t h = 1;
+			uint32_t v = 1;
+			uint32_t quantTable = 0;
+			//blocks covering the component (the order of single component scans), and blocks stored (whole MCUs)
+			uint32_t widthInBlocks = 0;
+			uint32_t heightInBlocks = 0;
+			uint32_t blocksPerLine = 0;
+			uint32_t blocksPerColumn = 0;
+			std::vector<int16_t> coefficients;
+			int32_t dcPredictor = 0;
+			uint32_t dcTable = 0;
+			uint32_t acTable = 0;
+
+			int16_t* getBlock(uint32_t row, uint32_t column)
+			{
+				return &coefficients[(static_cast<size_t>(row) * blocksPerLine + column) * 64];
+			}
+		};
+
+		// Inverse DCT of the lowest size x size frequencies of a block, for the sizes 1, 2, 4 and 8. With the same 1/4 scale
+		// as the 8 point transform, the smaller ones give the block's pixels averaged down
+		struct InverseTransform
+		{
+			//[log2 size][x][u]: C(u) cos((2x + 1) u pi / 2 size) / 2
+			float cosines[4][8][8];
+
+			InverseTransform()
+			{
+				const double pi = 3.14159265358979323846;
+				for (uint32_t sizeShift = 0; sizeShift < 4; sizeShift++)
+				{
+					uint32_t size = 1u << sizeShift;
+					for (uint32_t x = 0; x < size; x++)
+					{
+						for (uint32_t u = 0; u < size; u++)
+						{
+							double c = u == 0 ? std::sqrt(0.5) : 1.0;
+							cosines[sizeShift][x][u] = static_cast<float>(c * std::cos((2 * x + 1) * u * pi / (2.0 * size)) / 2.0);
+						}
+					}
+				}
+			}
+
+			void apply(const int16_t* block, const uint16_t* quant, uint32_t widthShift, uint32_t heightShift, uint8_t* target, size_t stride) const
+			{
+				uint32_t width = 1u << widthShift;
+				uint32_t height = 1u << heightShift;
+				float coefficients[8][8];
+				bool flat = true;
+				for (uint32_t v = 0; v < height; v++)
+				{
+					for (uint32_t u = 0; u < width; u++)
+					{
+						coefficients[v][u] = static_cast<float>(block[v * 8 + u] * quant[v * 8 + u]);
+						flat = flat && (block[v * 8 + u] == 0 || (u == 0 && v == 0));
+					}
+				}
+				if (flat)
+				{
+					uint8_t value = clamp(coefficients[0][0] / 8.0f);
+					for (uint32_t y = 0; y < height; y++)
+						std::memset(target + y * stride, value, width);
+					return;
+				}
+
+				float rows[8][8];
+				const float (*horizontal)[8] = cosines[widthShift];
+				const float (*vertical)[8] = cosines[heightShift];
+				for (uint32_t v = 0; v < height; v++)
+				{
+					for (uint32_t x = 0; x < width; x++)
+					{
+						float sum = 0.0f;
+						for (uint32_t u = 0; u < width; u++)
+							sum += coefficients[v][u] * horizontal[x][u];
+						rows[v][x] = sum;
+					}
+				}
+				for (uint32_t y = 0; y < height; y++)
+				{
+					for (uint32_t x = 0; x < width; x++)
+					{
+						float sum = 0.0f;
+						for (uint32_t v = 0; v < height; v++)
+							sum += rows[v][x] * vertical[y][v];
+						target[y * stride + x] = clamp(sum);
+					}
+				}
+			}
+
+			static uint8_t clamp(float value)
+			{
+				int32_t rounded = static_cast<int32_t>(value + 128.5f);
+				return static_cast<uint8_t>(rounded < 0 ? 0 : (rounded > 255 ? 255 : rounded));
+			}
+		};
+
+		uint32_t log2(uint32_t value)
+		{
+			uint32_t shift = 0;
+			while ((1u << shift) < value)
+				shift++;
+			return shift;
+		}
+
+		class JpegDecoder
+		{
+		public:
+			JpegDecoder(const uint8_t* data, size_t size)
+				: data(data), size(size)
+			{
+			}
+
+			bool decode(uint32_t scaleShift, TextureData& image)
+			{
+				if (!isJpeg(data, size) || scaleShift > 3)
+					return false;
+				position = 2;
+				while (position + 1 < size)
+				{
+					//anything between segments is skipped, fill bytes and stray entropy data included
+					if (data[position] != 0xff || data[position + 1] == 0xff)
+					{
+						position++;
+						continue;
+					}
+					uint8_t marker = data[position + 1];
+					position += 2;
+					//end of image, then the markers without a segment
+					if (marker == 0xd9)
+						break;
+					if (marker == 0x00 || marker == 0x01 || (marker >= 0xd0 && marker <= 0xd7))
+						continue;
+
+					if (position + 2 > size)
+						return false;
+					size_t length = static_cast<size_t>(data[position]) << 8 | data[position + 1];
+					if (length < 2 || position + length > size)
+						return false;
+					const uint8_t* segment = data + position + 2;
+					size_t segmentSize = length - 2;
+					position += length;
+
+					bool valid = true;
+					if (marker == 0xdb)
+						valid = readQuantTables(segment, segmentSize);
+					else if (marker == 0xc4)
+						valid = readHuffmanTables(segment, segmentSize);
+					else if (marker == 0xc0 || marker == 0xc1 || marker == 0xc2)
+						valid = !frameRead && readFrame(segment, segmentSize, marker == 0xc2);
+					else if (marker == 0xdd)
+						valid = segmentSize >= 2 && (restartInterval = static_cast<uint32_t>(segment[0]) << 8 | segment[1], true);
+					else if (marker == 0xee && segmentSize >= 12 && std::memcmp(segment, "Adobe", 5) == 0)
+						adobeTransform = segment[11];
+					else if (marker == 0xda)
+						valid = frameRead && readScan(segment, segmentSize);
+					//the other frame types: lossless, hierarchical and arithmetic coded
+					else if (marker >= 0xc3 && marker <= 0xcf && marker != 0xc4 && marker != 0xcc)
+						valid = false;
+					if (!valid)
+						return false;
+				}
+				//a truncated file still gives what its scans had
+				return scanned && writeImage(scaleShift, image);
+			}
+
+		private:
+			const uint8_t* data;
+			size_t size;
+			size_t position = 0;
+
+			//natural order
+			uint16_t quantTables[4][64] = {};
+			HuffmanTable dcTables[4];
+			HuffmanTable acTables[4];
+			std::vector<Component> components;
+			uint32_t width = 0;
+			uint32_t height = 0;
+			uint32_t maxH = 1;
+			uint32_t maxV = 1;
+			uint32_t mcusPerLine = 0;
+			uint32_t mcusPerColumn = 0;
+			bool progressive = false;
+			bool frameRead = false;
+			bool scanned = false;
+			uint32_t restartInterval = 0;
+			//of the Adobe segment, 0 for RGB. -1 without one
+			int adobeTransform = -1;
+			//blocks left whose band is all zero (progressive AC scans)
+			uint32_t eobRun = 0;
+
+			bool readQuantTables(const uint8_t* segment, size_t segmentSize)
+			{
+				for (size_t offset = 0; offset < segmentSize;)
+				{
+					uint32_t precision = segment[offset] >> 4;
+					uint32_t table = segment[offset] & 15;
+					offset++;
+					size_t bytes = precision != 0 ? 128 : 64;
+					if (table > 3 || precision > 1 || offset + bytes > segmentSize)
+						return false;
+					for (uint32_t k = 0; k < 64; k++)
+					{
+						quantTables[table][NATURAL_ORDER[k]] = precision != 0 ?
+							static_cast<uint16_t>(segment[offset + k * 2] << 8 | segment[offset + k * 2 + 1]) : segment[offset + k];
+					}
+					offset += bytes;
+				}
+				return true;
+			}
+
+			bool readHuffmanTables(const uint8_t* segment, size_t segmentSize)
+			{
+				for (size_t offset = 0; offset < segmentSize;)
+				{
+					uint32_t tableClass = segment[offset] >> 4;
+					uint32_t index = segment[offset] & 15;
+					offset++;
+					if (tableClass > 1 || index > 3 || offset + 16 > segmentSize)
+						return false;
+					const uint8_t* counts = segment + offset;
+					offset += 16;
+					size_t total = 0;
+					for (int i = 0; i < 16; i++)
+						total += counts[i];
+					if (offset + total > segmentSize)
+						return false;
+					if (!buildHuffmanTable(counts, segment + offset, tableClass == 0 ? dcTables[index] : acTables[index]))
+						return false;
+					offset += total;
+				}
+				return true;
+			}
+
+			bool readFrame(const uint8_t* segment, size_t segmentSize, bool isProgressive)
+			{
+				if (segmentSize < 6 || segment[0] != 8)
+					return false;
+				height = static_cast<uint32_t>(segment[1]) << 8 | segment[2];
+				width = static_cast<uint32_t>(segment[3]) << 8 | segment[4];
+				uint32_t count = segment[5];
+				//a height of 0 (given by a DNL marker after the first scan) isn't supported
+				if (width == 0 || height == 0 || static_cast<uint64_t>(width) * height > MAX_PIXELS || (count != 1 && count != 3) ||
+					segmentSize < 6 + count * 3)
+					return false;
+
+				components.resize(count);
+				for (uint32_t i = 0; i < count; i++)
+				{
+					Component& component = components[i];
+					component.id = segment[6 + i * 3];
+					component.h = segment[7 + i * 3] >> 4;
+					component.v = segment[7 + i * 3] & 15;
+					component.quantTable = segment[8 + i * 3];
+					if (component.h < 1 || component.h > 4 || component.v < 1 || component.v > 4 || component.quantTable > 3)
+						return false;
+					maxH = std::max(maxH, component.h);
+					maxV = std::max(maxV, component.v);
+				}
+				mcusPerLine = (width + 8 * maxH - 1) / (8 * maxH);
+				mcusPerColumn = (height + 8 * maxV - 1) / (8 * maxV);
+				for (Component& component : components)
+				{
+					//subsampling by powers of two only, so every scaled block size is one too
+					uint32_t ratioH = maxH / component.h;
+					uint32_t ratioV = maxV / component.v;
+					if (maxH % component.h != 0 || maxV % component.v != 0 || (ratioH & (ratioH - 1)) != 0 || (ratioV & (ratioV - 1)) != 0)
+						return false;
+					component.widthInBlocks = ((width * component.h + maxH - 1) / maxH + 7) / 8;
+					component.heightInBlocks = ((height * component.v + maxV - 1) / maxV + 7) / 8;
+					component.blocksPerLine = mcusPerLine * component.h;
+					component.blocksPerColumn = mcusPerColumn * component.v;
+					component.coefficients.assign(static_cast<size_t>(component.blocksPerLine) * component.blocksPerColumn * 64, 0);
+				}
+				progressive = isProgressive;
+				frameRead = true;
+				return true;
+			}
+
+			bool readScan(const uint8_t* segment, size_t segmentSize)
+			{
+				uint32_t count = segmentSize > 0 ? segment[0] : 0;
+				if (count < 1 || count > components.size() || segmentSize < 4 + count * 2)
+					return false;
+				std::vector<Component*> scanComponents;
+				for (uint32_t i = 0; i < count; i++)
+				{
+					auto component = std::find_if(components.begin(), components.end(), [&](const Component& c) { return c.id == segment[1 + i * 2]; });
+					if (component == components.end())
+						return false;
+					component->dcTable = segment[2 + i * 2] >> 4;
+					component->acTable = segment[2 + i * 2] & 15;
+					if (component->dcTable > 3 || component->acTable > 3)
+						return false;
+					scanComponents.push_back(&*component);
+				}
+				uint32_t spectralStart = segment[1 + count * 2];
+				uint32_t spectralEnd = segment[2 + count * 2];
+				uint32_t approximationHigh = segment[3 + count * 2] >> 4;
+				uint32_t approximationLow = segment[3 + count * 2] & 15;
+				if (!progressive)
+				{
+					spectralStart = 0;
+					spectralEnd = 63;
+					approximationHigh = 0;
+					approximationLow = 0;
+				}
+				//DC scans may interleave components, AC scans only hold one
+				else if ((spectralStart == 0 && spectralEnd != 0) || (spectralStart != 0 && (count != 1 || spectralEnd < spectralStart || spectralEnd > 63)) ||
+					approximationLow > 13)
+					return false;
+
+				bool needsDc = spectralStart == 0 && approximationHigh == 0;
+				bool needsAc = spectralEnd != 0;
+				for (Component* component : scanComponents)
+				{
+					if ((needsDc && !dcTables[component->dcTable].defined) || (needsAc && !acTables[component->acTable].defined))
+						return false;
+					component->dcPredictor = 0;
+				}
+				eobRun = 0;
+
+				BitReader reader(data, size, position);
+				uint32_t mcuCount = count == 1 ? scanComponents[0]->widthInBlocks * scanComponents[0]->heightInBlocks : mcusPerLine * mcusPerColumn;
+				for (uint32_t mcu = 0; mcu < mcuCount; mcu++)
+				{
+					if (restartInterval != 0 && mcu != 0 && mcu % restartInterval == 0)
+					{
+						reader.restart();
+						for (Component* component : scanComponents)
+							component->dcPredictor = 0;
+						eobRun = 0;
+					}
+
+					bool valid = true;
+					if (count == 1)
+					{
+						Component& component = *scanComponents[0];
+						int16_t* block = component.getBlock(mcu / component.widthInBlocks, mcu % component.widthInBlocks);
+						valid = decodeBlock(reader, component, block, spectralStart, spectralEnd, approximationHigh, approximationLow);
+					}
+					else
+					{
+						uint32_t mcuRow = mcu / mcusPerLine;
+						uint32_t mcuColumn = mcu % mcusPerLine;
+						for (Component* component : scanComponents)
+						{
+							for (uint32_t v = 0; v < component->v && valid; v++)
+							{
+								for (uint32_t h = 0; h < component->h && valid; h++)
+								{
+									int16_t* block = component->getBlock(mcuRow * component->v + v, mcuColumn * component->h + h);
+									valid = decodeBlock(reader, *component, block, spectralStart, spectralEnd, approximationHigh, approximationLow);
+								}
+							}
+						}
+					}
+					if (!valid)
+						return false;
+				}
+				position = reader.getPosition();
+				scanned = true;
+				return true;
+			}
+
+			bool decodeBlock(BitReader& reader, Component& component, int16_t* block, uint32_t spectralStart, uint32_t spectralEnd,
+				uint32_t approximationHigh, uint32_t approximationLow)
+			{
+				if (!progressive)
+					return decodeSequential(reader, component, block);
+				if (spectralStart == 0)
+					return approximationHigh == 0 ? decodeDcFirst(reader, component, block, approximationLow) : decodeDcRefine(reader, block, approximationLow);
+				if (approximationHigh == 0)
+					return decodeAcFirst(reader, component, block, spectralStart, spectralEnd, approximationLow);
+				return decodeAcRefine(reader, component, block, spectralStart, spectralEnd, approximationLow);
+			}
+
+			bool decodeDc(BitReader& reader, Component& component)
+			{
+				int category = reader.decode(dcTables[component.dcTable]);
+				if (category < 0 || category > 15)
+					return false;
+				component.dcPredictor += receiveExtend(reader, category);
+				return true;
+			}
+
+			bool decodeSequential(BitReader& reader, Component& component, int16_t* block)
+			{
+				if (!decodeDc(reader, component))
+					return false;
+				block[0] = static_cast<int16_t>(component.dcPredictor);
+				const HuffmanTable& table = acTables[component.acTable];
+				for (uint32_t k = 1; k < 64;)
+				{
+					int symbol = reader.decode(table);
+					if (symbol < 0)
+						return false;
+					uint32_t run = static_cast<uint32_t>(symbol) >> 4;
+					int category = symbol & 15;
+					if (category == 0)
+					{
+						//end of block, or 16 zeros
+						if (run != 15)
+							break;
+						k += 16;
+						continue;
+					}
+					k += run;
+					if (k > 63)
+						return false;
+					block[NATURAL_ORDER[k++]] = static_cast<int16_t>(receiveExtend(reader, category));
+				}
+				return true;
+			}
+
+			bool decodeDcFirst(BitReader& reader, Component& component, int16_t* block, uint32_t shift)
+			{
+				if (!decodeDc(reader, component))
+					return false;
+				block[0] = static_cast<int16_t>(component.dcPredictor * (1 << shift));
+				return true;
+			}
+
+			bool decodeDcRefine(BitReader& reader, int16_t* block, uint32_t shift)
+			{
+				if (reader.readBits(1) != 0)
+					block[0] = static_cast<int16_t>(block[0] | 1 << shift);
+				return true;
+			}
+
+			bool decodeAcFirst(BitReader& reader, Component& component, int16_t* block, uint32_t start, uint32_t end, uint32_t shift)
+			{
+				if (eobRun > 0)
+				{
+					eobRun--;
+					return true;
+				}
+				const HuffmanTable& table = acTables[component.acTable];
+				for (uint32_t k = start; k <= end;)
+				{
+					int symbol = reader.decode(table);
+					if (symbol < 0)
+						return false;
+					uint32_t run = static_cast<uint32_t>(symbol) >> 4;
+					int category = symbol & 15;
+					if (category == 0)
+					{
+						//this block and the next 2^run - 1 + extra bits ones end here
+						if (run < 15)
+						{
+							eobRun = (1u << run) - 1 + reader.readBits(static_cast<int>(run));
+							break;
+						}
+						k += 16;
+						continue;
+					}
+					k += run;
+					if (k > 63)
+						return false;
+					block[NATURAL_ORDER[k++]] = static_cast<int16_t>(receiveExtend(reader, category) * (1 << shift));
+				}
+				return true;
+			}
+
+			//successive approximation: one more bit of every nonzero coefficient of the band, and the coefficients that become
+			//nonzero with it (libjpeg's decode_mcu_AC_refine)
+			bool decodeAcRefine(BitReader& reader, Component& component, int16_t* block, uint32_t start, uint32_t end, uint32_t shift)
+			{
+				const int32_t positive = 1 << shift;
+				const int32_t negative = -positive;
+				auto refine = [&](int16_t& coefficient) {
+					if (reader.readBits(1) != 0 && (coefficient & positive) == 0)
+						coefficient = static_cast<int16_t>(coefficient + (coefficient >= 0 ? positive : negative));
+				};
+
+				const HuffmanTable& table = acTables[component.acTable];
+				uint32_t k = start;
+				if (eobRun == 0)
+				{
+					for (; k <= end; k++)
+					{
+						int symbol = reader.decode(table);
+						if (symbol < 0)
+							return false;
+						int32_t run = symbol >> 4;
+						int category = symbol & 15;
+						int32_t value = 0;
+						if (category != 0)
+						{
+							if (category != 1)
+								return false;
+							value = reader.readBits(1) != 0 ? positive : negative;
+						}
+						else if (run != 15)
+						{
+							eobRun = (1u << run) + reader.readBits(run);
+							break;
+						}
+
+						//skips run zero coefficients, refining the nonzero ones on the way, then places the new one
+						for (; k <= end; k++)
+						{
+							int16_t& coefficient = block[NATURAL_ORDER[k]];
+							if (coefficient != 0)
+								refine(coefficient);
+							else if (--run < 0)
+								break;
+						}
+						if (value != 0 && k <= end)
+							block[NATURAL_ORDER[k]] = static_cast<int16_t>(value);
+					}
+				}
+				if (eobRun > 0)
+				{
+					for (; k <= end; k++)
+					{
+						int16_t& coefficient = block[NATURAL_ORDER[k]];
+						if (coefficient != 0)
+							refine(coefficient);
+					}
+					eobRun--;
+				}
+				return true;
+			}
+
+			bool writeImage(uint32_t scaleShift, TextureData& image)
+			{
+				static const InverseTransform transform;
+				uint32_t scale = 8u >> scaleShift;
+				image.width = (width * scale + 7) / 8;
+				image.height = (height * scale + 7) / 8;
+				image.channels = 3;
+				image.pixels.resize(static_cast<size_t>(image.width) * image.height * 3);
+
+				// A component's blocks transformed at the size that matches the output: subsampled chroma gets the larger
+				// transform, so it needs no upsampling unless that would be past 8x8
+				struct Plane
+				{
+					std::vector<uint8_t> pixels;
+					uint32_t width;
+					//output pixels per plane pixel
+					uint32_t upsampleShiftX;
+					uint32_t upsampleShiftY;
+				};
+				std::vector<Plane> planes(components.size());
+				for (size_t i = 0; i < components.size(); i++)
+				{
+					Component& component = components[i];
+					uint32_t sizeShiftX = log2(scale * maxH / component.h);
+					uint32_t sizeShiftY = log2(scale * maxV / component.v);
+					uint32_t blockShiftX = std::min(sizeShiftX, 3u);
+					uint32_t blockShiftY = std::min(sizeShiftY, 3u);
+					Plane& plane = planes[i];
+					plane.width = component.blocksPerLine << blockShiftX;
+					plane.upsampleShiftX = sizeShiftX - blockShiftX;
+					plane.upsampleShiftY = sizeShiftY - blockShiftY;
+					plane.pixels.resize(static_cast<size_t>(plane.width) * (component.blocksPerColumn << blockShiftY));
+					const uint16_t* quant = quantTables[component.quantTable];
+					for (uint32_t row = 0; row < component.blocksPerColumn; row++)
+					{
+						for (uint32_t column = 0; column < component.blocksPerLine; column++)
+						{
+							uint8_t* target = &plane.pixels[(static_cast<size_t>(row << blockShiftY) * plane.width) + (column << blockShiftX)];
+							transform.apply(component.getBlock(row, column), quant, blockShiftX, blockShiftY, target, plane.width);
+						}
+					}
+					//the coefficients aren't needed anymore
+					std::vector<int16_t>().swap(component.coefficients);
+				}
+
+				if (components.size() == 1)
+				{
+					const Plane& grey = planes[0];
+					for (uint32_t y = 0; y < image.height; y++)
+					{
+						const uint8_t* source = &grey.pixels[static_cast<size_t>(y >> grey.upsampleShiftY) * grey.width];
+						uint8_t* target = &image.pixels[static_cast<size_t>(y) * image.width * 3];
+						for (uint32_t x = 0; x < image.width; x++, target += 3)
+							target[0] = target[1] = target[2] = source[x >> grey.upsampleShiftX];
+					}
+					return true;
+				}
+
+				//JFIF files are YCbCr. Adobe's transform flag, or components named R, G and B, mark RGB
+				bool rgb = adobeTransform == 0 || (components[0].id == 'R' && components[1].id == 'G' && components[2].id == 'B');
+				//16.16 fixed point BT.601 full range
+				auto fixed = [](double value) { return static_cast<int32_t>(value * 65536.0 + 0.5); };
+				const int32_t crToR = fixed(1.402), cbToG = fixed(0.344136), crToG = fixed(0.714136), cbToB = fixed(1.772);
+				for (uint32_t y = 0; y < image.height; y++)
+				{
+					const uint8_t* rows[3];
+					for (int c = 0; c < 3; c++)
+						rows[c] = &planes[c].pixels[static_cast<size_t>(y >> planes[c].upsampleShiftY) * planes[c].width];
+					uint8_t* target = &image.pixels[static_cast<size_t>(y) * image.width * 3];
+					for (uint32_t x = 0; x < image.width; x++, target += 3)
+					{
+						int32_t first = rows[0][x >> planes[0].upsampleShiftX];
+						int32_t second = rows[1][x >> planes[1].upsampleShiftX];
+						int32_t third = rows[2][x >> planes[2].upsampleShiftX];
+						if (rgb)
+						{
+							target[0] = static_cast<uint8_t>(first);
+							target[1] = static_cast<uint8_t>(second);
+							target[2] = static_cast<uint8_t>(third);
+							continue;
+						}
+						int32_t luma = first << 16 | 0x8000;
+						int32_t cb = second - 128;
+						int32_t cr = third - 128;
+						target[0] = clampByte((luma + crToR * cr) >> 16);
+						target[1] = clampByte((luma - cbToG * cb - crToG * cr) >> 16);
+						target[2] = clampByte((luma + cbToB * cb) >> 16);
+					}
+				}
+				return true;
+			}
+
+			static uint8_t clampByte(int32_t value)
+			{
+				return static_cast<uint8_t>(value < 0 ? 0 : (value > 255 ? 255 : value));
+			}
+		};
+	}
+
+	bool isJpeg(const unsigned char* data, size_t size)
+	{
+		return size >= 4 && data[0] == 0xff && data[1] == 0xd8 && data[2] == 0xff;
+	}
+
+	bool decodeJpeg(const unsigned char* data, size_t size, uint32_t scaleShift, TextureData& image)
+	{
+		JpegDecoder decoder(data, size);
+		return decoder.decode(scaleShift, image);
+	}
+}
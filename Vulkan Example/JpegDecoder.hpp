@@ -0,0 +1,16 @@
+#pragma once
+#include "Texture.hpp"
+#include <cstddef>
+#include <cstdint>
+
+namespace vulkanExample
+{
+	//true if the data starts like a JPEG file
+	bool isJpeg(const unsigned char* data, size_t size);
+
+	//decodes a baseline or progressive JPEG (Huffman coded, 8 bits, grey, YCbCr or RGB) to RGB at 1/2^scaleShift of its size,
+	//scaleShift up to 3. The size is reduced in the DCT domain: each 8x8 block only goes through a 4x4, 2x2 or 1x1 inverse
+	//transform of its lowest frequencies, so the skipped resolution is never computed. Each side is rounded up like libjpeg's
+	//scaled decoding. False if the file is corrupt or uses a feature it doesn't support (arithmetic coding, 12 bits, CMYK)
+	bool decodeJpeg(const unsigned char* data, size_t size, uint32_t scaleShift, TextureData& image);
+}
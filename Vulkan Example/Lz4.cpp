@@ -0,0 +1,165 @@
+#include "Lz4.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+namespace vulkanExample
+{
+	namespace
+	{
+		constexpr size_t MIN_MATCH = 4;
+		//the block format requires the last 5 bytes to be literals, and the last match to start 12 bytes before the end
+		constexpr size_t LAST_LITERALS = 5;
+		constexpr size_t MATCH_FIND_LIMIT = 12;
+		constexpr size_t MAX_OFFSET = 65535;
+		constexpr uint32_t HASH_BITS = 16;
+		//short copies are done as one fixed size copy when both sides have room past their end
+		constexpr size_t WILD_COPY = 16;
+
+		uint32_t read32(const unsigned char* data)
+		{
+			uint32_t value;
+			std::memcpy(&value, data, sizeof(value));
+			return value;
+		}
+
+		uint32_t hashSequence(uint32_t sequence)
+		{
+			return (sequence * 2654435761u) >> (32 - HASH_BITS);
+		}
+
+		//the 4 bit field of the token, then 255s and the remainder for lengths of 15 and more
+		void writeLengthExtra(std::vector<unsigned char>& output, size_t length)
+		{
+			if (length < 15)
+				return;
+			length -= 15;
+			for (; length >= 255; length -= 255)
+				output.push_back(255);
+			output.push_back(static_cast<unsigned char>(length));
+		}
+
+		//the literals, then the match if matchLength isn't 0
+		void writeSequence(std::vector<unsigned char>& output, const unsigned char* literals, size_t literalLength, size_t offset, size_t matchLength)
+		{
+			size_t matchCode = matchLength != 0 ? matchLength - MIN_MATCH : 0;
+			unsigned char token = static_cast<unsigned char>((literalLength < 15 ? literalLength : 15) << 4 | (matchCode < 15 ? matchCode : 15));
+			output.push_back(token);
+			writeLengthExtra(output, literalLength);
+			output.insert(output.end(), literals, literals + literalLength);
+			if (matchLength == 0)
+				return;
+			output.push_back(static_cast<unsigned char>(offset & 0xff));
+			output.push_back(static_cast<unsigned char>(offset >> 8));
+			writeLengthExtra(output, matchCode);
+		}
+
+		//false if it runs past the end of the input
+		bool readLengthExtra(const unsigned char* data, size_t size, size_t& position, size_t& length)
+		{
+			if (length != 15)
+				return true;
+			unsigned char byte;
+			do
+			{
+				if (position >= size)
+					return false;
+				byte = data[position++];
+				length += byte;
+			} while (byte == 255);
+			return true;
+		}
+	}
+
+	void lz4Compress(const unsigned char* data, size_t size, std::vector<unsigned char>& output)
+	{
+		output.clear();
+		output.reserve(size + size / 255 + 16);
+
+		size_t anchor = 0;
+		if (size > MATCH_FIND_LIMIT)
+		{
+			//last position a match may start at, and the end of the bytes a match may cover
+			size_t findLimit = size - MATCH_FIND_LIMIT;
+			size_t matchLimit = size - LAST_LITERALS;
+			std::vector<uint32_t> table(size_t(1) << HASH_BITS, UINT32_MAX);
+			size_t position = 0;
+			while (position <= findLimit)
+			{
+				uint32_t sequence = read32(data + position);
+				uint32_t& slot = table[hashSequence(sequence)];
+				size_t candidate = slot;
+				slot = static_cast<uint32_t>(position);
+				if (candidate == UINT32_MAX || position - candidate > MAX_OFFSET || read32(data + candidate) != sequence)
+				{
+					position++;
+					continue;
+				}
+
+				size_t length = MIN_MATCH;
+				while (position + length < matchLimit && data[candidate + length] == data[position + length])
+					length++;
+				writeSequence(output, data + anchor, position - anchor, position - candidate, length);
+				position += length;
+				anchor = position;
+			}
+		}
+		writeSequence(output, data + anchor, size - anchor, 0, 0);
+	}
+
+	bool lz4Decompress(const unsigned char* data, size_t size, unsigned char* output, size_t outputSize)
+	{
+		size_t position = 0;
+		size_t written = 0;
+		while (position < size)
+		{
+			unsigned char token = data[position++];
+			size_t literalLength = token >> 4;
+			if (!readLengthExtra(data, size, position, literalLength) || literalLength > size - position || literalLength > outputSize - written)
+				return false;
+			if (literalLength <= WILD_COPY && size - position >= WILD_COPY && outputSize - written >= WILD_COPY)
+				std::memcpy(output + written, data + position, WILD_COPY);
+			else if (literalLength != 0)
+				std::memcpy(output + written, data + position, literalLength);
+			position += literalLength;
+			written += literalLength;
+			//the last sequence has no match
+			if (position == size)
+				break;
+
+			if (size - position < 2)
+				return false;
+			size_t offset = data[position] | static_cast<size_t>(data[position + 1]) << 8;
+			position += 2;
+			size_t matchLength = token & 15;
+			if (offset == 0 || offset > written || !readLengthExtra(data, size, position, matchLength))
+				return false;
+			matchLength += MIN_MATCH;
+			if (matchLength > outputSize - written)
+				return false;
+			const unsigned char* source = output + written - offset;
+			unsigned char* target = output + written;
+			if (offset >= WILD_COPY && outputSize - written >= matchLength + WILD_COPY)
+			{
+				//chunks no longer than the offset never read bytes they write
+				for (size_t copied = 0; copied < matchLength; copied += WILD_COPY)
+					std::memcpy(target + copied, source + copied, WILD_COPY);
+			}
+			else if (offset >= matchLength)
+				std::memcpy(target, source, matchLength);
+			else
+			{
+				//the match overlaps the bytes it writes (a run of period offset): copy one period, then double the copied part
+				std::memcpy(target, source, offset);
+				for (size_t copied = offset; copied < matchLength;)
+				{
+					size_t chunk = std::min(copied, matchLength - copied);
+					std::memcpy(target + copied, target, chunk);
+					copied += chunk;
+				}
+			}
+			written += matchLength;
+		}
+		return written == outputSize;
+	}
+}
@@ -0,0 +1,15 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+
+namespace vulkanExample
+{
+	// The LZ4 block format (no frame header, sizes are stored by the caller), so packed assets decompress at memory speed.
+	// The compressor is the greedy single probe one: a fraction of the reference implementation's speed, but its output
+	// is a valid block any LZ4 decoder reads
+
+	//replaces output with the compressed block
+	void lz4Compress(const unsigned char* data, size_t size, std::vector<unsigned char>& output);
+	//false if the block is malformed or doesn't decompress to exactly outputSize bytes
+	bool lz4Decompress(const unsigned char* data, size_t size, unsigned char* output, size_t outputSize);
+}
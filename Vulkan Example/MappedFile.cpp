@@ -0,0 +1,183 @@
+#include "MappedFile.hpp"
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <filesystem>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include <algorithm>
+#include <fstream>
+#include <utility>
+
+namespace vulkanExample
+{
+	namespace
+	{
+		//the whole file through a stream, when it can't be mapped
+		bool readWhole(const std::string& path, std::vector<unsigned char>& buffer)
+		{
+			std::ifstream file(path, std::ios::ate | std::ios::binary);
+			if (!file.is_open())
+				return false;
+			buffer.resize(static_cast<size_t>(file.tellg()));
+			file.seekg(0);
+			file.read(reinterpret_cast<char*>(buffer.data()), static_cast<std::streamsize>(buffer.size()));
+			return file.good() || buffer.empty();
+		}
+	}
+
+	MappedFile::~MappedFile()
+	{
+		close();
+	}
+
+	MappedFile::MappedFile(MappedFile&& other) noexcept
+	{
+		*this = std::move(other);
+	}
+
+	MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+	{
+		if (this != &other)
+		{
+			close();
+			mapping = std::exchange(other.mapping, nullptr);
+#ifdef _WIN32
+			mappingHandle = std::exchange(other.mappingHandle, nullptr);
+#endif
+			buffer = std::move(other.buffer);
+			length = std::exchange(other.length, 0);
+			opened = std::exchange(other.opened, false);
+		}
+		return *this;
+	}
+
+	bool MappedFile::open(const std::string& path, Access access)
+	{
+		close();
+
+#ifdef _WIN32
+		DWORD flags = access == Access::Sequential ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_FLAG_RANDOM_ACCESS;
+		HANDLE file = CreateFileW(std::filesystem::path(path).wstring().c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, flags, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+			return false;
+
+		LARGE_INTEGER fileSize{};
+		if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0)
+		{
+			//the view keeps the mapping object alive, the file handle isn't needed anymore
+			mappingHandle = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			if (mappingHandle != nullptr)
+			{
+				mapping = MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+				if (mapping == nullptr)
+				{
+					CloseHandle(mappingHandle);
+					mappingHandle = nullptr;
+				}
+			}
+		}
+		CloseHandle(file);
+		if (mapping != nullptr)
+			length = static_cast<size_t>(fileSize.QuadPart);
+#else
+		int file = ::open(path.c_str(), O_RDONLY);
+		if (file < 0)
+			return false;
+
+		struct stat status{};
+		if (fstat(file, &status) == 0 && status.st_size > 0)
+		{
+			void* view = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+			if (view != MAP_FAILED)
+			{
+				mapping = view;
+				length = static_cast<size_t>(status.st_size);
+				//only hints, the mapping works the same if they are ignored
+				madvise(mapping, length, access == Access::Sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+				if (access == Access::Sequential)
+					madvise(mapping, length, MADV_WILLNEED);
+			}
+		}
+		//the mapping stays valid after the descriptor is closed
+		::close(file);
+#endif
+
+		if (mapping == nullptr)
+		{
+			if (!readWhole(path, buffer))
+			{
+				buffer.clear();
+				return false;
+			}
+			length = buffer.size();
+		}
+		opened = true;
+		return true;
+	}
+
+	void MappedFile::close()
+	{
+		if (mapping != nullptr)
+		{
+#ifdef _WIN32
+			UnmapViewOfFile(mapping);
+			CloseHandle(mappingHandle);
+			mappingHandle = nullptr;
+#else
+			munmap(mapping, length);
+#endif
+			mapping = nullptr;
+		}
+		buffer.clear();
+		buffer.shrink_to_fit();
+		length = 0;
+		opened = false;
+	}
+
+	void MappedFile::prefetch(size_t offset, size_t size) const
+	{
+		if (mapping == nullptr || offset >= length)
+			return;
+		size = std::min(size, length - offset);
+#ifdef _WIN32
+		WIN32_MEMORY_RANGE_ENTRY range{ static_cast<unsigned char*>(mapping) + offset, size };
+		PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#else
+		//madvise wants a page aligned start
+		size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+		size_t start = offset / pageSize * pageSize;
+		madvise(static_cast<unsigned char*>(mapping) + start, size + offset - start, MADV_WILLNEED);
+#endif
+	}
+
+	bool dropFileCache(const std::string& path)
+	{
+#ifdef _WIN32
+		//opening a file without buffering flushes and drops its cached pages, as long as no other handle has it open
+		HANDLE file = CreateFileW(std::filesystem::path(path).wstring().c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+			FILE_FLAG_NO_BUFFERING, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+			return false;
+		CloseHandle(file);
+		return true;
+#elif defined(POSIX_FADV_DONTNEED)
+		int file = ::open(path.c_str(), O_RDONLY);
+		if (file < 0)
+			return false;
+		//clean pages only, the assets are never written while they are read
+		bool dropped = posix_fadvise(file, 0, 0, POSIX_FADV_DONTNEED) == 0;
+		::close(file);
+		return dropped;
+#else
+		(void)path;
+		return false;
+#endif
+	}
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+namespace vulkanExample
+{
+	// A file mapped read-only into memory, so loaders parse the page cache in place instead of copying it into their own buffers.
+	// The hint is passed to the kernel (madvise on POSIX, the scan flags on Windows) so it reads ahead the way the file is consumed.
+	// Where mapping fails (empty files, file systems that can't map) the contents are read into an owned buffer instead,
+	// so callers only ever see the bytes
+	class MappedFile
+	{
+	public:
+		enum class Access
+		{
+			//read once from start to end: read ahead aggressively and drop pages behind
+			Sequential,
+			//read in small pieces in any order, e.g. pages of a virtual texture
+			Random
+		};
+
+		MappedFile() = default;
+		~MappedFile();
+		MappedFile(MappedFile&& other) noexcept;
+		MappedFile& operator=(MappedFile&& other) noexcept;
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		//false if the file can't be opened or read, the previous contents are released either way
+		bool open(const std::string& path, Access access = Access::Sequential);
+		void close();
+
+		//aligned to the page size when mapped, so the data can be read as 32 bit words (SPIR-V)
+		const unsigned char* data() const { return mapping != nullptr ? static_cast<const unsigned char*>(mapping) : buffer.data(); }
+		size_t size() const { return length; }
+		bool isOpen() const { return opened; }
+		//mapped rather than read into a buffer
+		bool isMapped() const { return mapping != nullptr; }
+		//starts reading a range in the background, for files opened for random access whose pieces are read whole
+		void prefetch(size_t offset, size_t size) const;
+
+	private:
+		void* mapping = nullptr;
+#ifdef _WIN32
+		void* mappingHandle = nullptr;
+#endif
+		std::vector<unsigned char> buffer;
+		size_t length = 0;
+		bool opened = false;
+	};
+
+	// Read-only stream buffer over memory, so parsers that take a std::istream (tinyobjloader) read a mapping without a copy
+	class MemoryStreamBuffer : public std::streambuf
+	{
+	public:
+		MemoryStreamBuffer(const unsigned char* data, size_t size)
+		{
+			//the get area is never written through
+			char* begin = reinterpret_cast<char*>(const_cast<unsigned char*>(data));
+			setg(begin, begin, begin + size);
+		}
+	};
+
+	//asks the OS to drop the cached pages of the file, so the next read comes from the disk. False where it isn't supported
+	bool dropFileCache(const std::string& path);
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <glm/glm.hpp>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define VULKAN_EXAMPLE_SSE
+#endif
+
+namespace vulkanExample
+{
+	// 4x4 matrix product (a * b) using SSE. Both glm and GLSL store matrices column major,
+	// so every result column is a linear combination of the columns of a weighted by one column of b
+	inline glm::mat4 multiplySimd(const glm::mat4& a, const glm::mat4& b)
+	{
+#ifdef VULKAN_EXAMPLE_SSE
+		const float* pa = &a[0][0];
+		const float* pb = &b[0][0];
+		glm::mat4 result;
+		float* pr = &result[0][0];
+
+		//glm matrices are not guaranteed to be 16 bytes aligned, hence the unaligned loads
+		__m128 a0 = _mm_loadu_ps(pa + 0);
+		__m128 a1 = _mm_loadu_ps(pa + 4);
+		__m128 a2 = _mm_loadu_ps(pa + 8);
+		__m128 a3 = _mm_loadu_ps(pa + 12);
+
+		for (int column = 0; column < 4; column++)
+		{
+			const float* bc = pb + column * 4;
+			__m128 r = _mm_mul_ps(a0, _mm_set1_ps(bc[0]));
+			r = _mm_add_ps(r, _mm_mul_ps(a1, _mm_set1_ps(bc[1])));
+			r = _mm_add_ps(r, _mm_mul_ps(a2, _mm_set1_ps(bc[2])));
+			r = _mm_add_ps(r, _mm_mul_ps(a3, _mm_set1_ps(bc[3])));
+			_mm_storeu_ps(pr + column * 4, r);
+		}
+		return result;
+#else
+		return a * b;
+#endif
+	}
+}
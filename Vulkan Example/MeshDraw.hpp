@@ -0,0 +1,20 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <cstdint>
+
+namespace vulkanExample
+{
+	// Range of the index buffer drawn with one material
+	struct MeshDraw
+	{
+		uint32_t firstIndex;
+		uint32_t indexCount;
+		//index into the texture table, passed to the fragment shader as a push constant
+		uint32_t materialIndex;
+		//center of the range's bounding box in model space, for the depth of the sort key
+		glm::vec3 center;
+		//clusters of the range, drawn with indirect draws when occlusion culling is enabled
+		uint32_t firstCluster;
+		uint32_t clusterCount;
+	};
+}
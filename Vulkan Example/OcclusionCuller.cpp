@@ -0,0 +1,490 @@
+#include "OcclusionCuller.hpp"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace vulkanExample
+{
+	namespace
+	{
+		constexpr uint32_t CULL_GROUP_SIZE = 64;
+		constexpr uint32_t PYRAMID_GROUP_SIZE = 8;
+		//per slot: the constants, then the stats. 256 bytes satisfies every uniform and storage buffer offset alignment
+		constexpr VkDeviceSize STATS_OFFSET = 256;
+		constexpr VkDeviceSize FRAME_STRIDE = 512;
+
+		uint32_t previousPowerOfTwo(uint32_t value)
+		{
+			uint32_t result = 1;
+			while (result * 2 <= value)
+				result *= 2;
+			return result;
+		}
+
+		void memoryBarrier(VkCommandBuffer commandBuffer, VkPipelineStageFlags srcStages, VkAccessFlags srcAccess,
+			VkPipelineStageFlags dstStages, VkAccessFlags dstAccess)
+		{
+			VkMemoryBarrier barrier{};
+			barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+			barrier.srcAccessMask = srcAccess;
+			barrier.dstAccessMask = dstAccess;
+			vkCmdPipelineBarrier(commandBuffer, srcStages, dstStages, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+		}
+	}
+
+	void buildClusters(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, uint32_t firstIndex,
+		uint32_t indexCount, std::vector<Cluster>& clusters)
+	{
+		const uint32_t clusterIndices = OcclusionCuller::CLUSTER_TRIANGLES * 3;
+		for (uint32_t first = firstIndex; first < firstIndex + indexCount; first += clusterIndices)
+		{
+			Cluster cluster{};
+			cluster.firstIndex = first;
+			cluster.indexCount = std::min(clusterIndices, firstIndex + indexCount - first);
+			glm::vec3 boundsMin = vertices[indices[first]].pos;
+			glm::vec3 boundsMax = boundsMin;
+			for (uint32_t i = first; i < first + cluster.indexCount; i++)
+			{
+				boundsMin = glm::min(boundsMin, vertices[indices[i]].pos);
+				boundsMax = glm::max(boundsMax, vertices[indices[i]].pos);
+			}
+			cluster.boundsMin = glm::vec4(boundsMin, 1.0f);
+			cluster.boundsMax = glm::vec4(boundsMax, 1.0f);
+			clusters.push_back(cluster);
+		}
+	}
+
+	void OcclusionCuller::create(VkDevice device, const MemoryTypeFinder& findMemoryType, ShaderLibrary& shaderLibrary,
+		VkPipelineCache pipelineCache, DescriptorAllocator& descriptorAllocator, const std::vector<Cluster>& clusters)
+	{
+		this->device = device;
+		this->findMemoryType = findMemoryType;
+		this->descriptorAllocator = &descriptorAllocator;
+		clusterCount = static_cast<uint32_t>(clusters.size());
+
+		//pyramid level: the level below (or the depth buffer) and the level written
+		std::vector<VkDescriptorSetLayoutBinding> pyramidBindings = {
+			{ 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
+			{ 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr }
+		};
+		//clusters, draws, flags, stats, constants and the pyramid
+		std::vector<VkDescriptorSetLayoutBinding> cullBindings = {
+			{ 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
+			{ 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
+			{ 2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
+			{ 3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
+			{ 4, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
+			{ 5, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr }
+		};
+
+		VkDescriptorSetLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layoutInfo.bindingCount = static_cast<uint32_t>(pyramidBindings.size());
+		layoutInfo.pBindings = pyramidBindings.data();
+		if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &pyramidSetLayout) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create depth pyramid descriptor set layout!");
+		}
+		layoutInfo.bindingCount = static_cast<uint32_t>(cullBindings.size());
+		layoutInfo.pBindings = cullBindings.data();
+		if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &cullSetLayout) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create culling descriptor set layout!");
+		}
+		descriptorAllocator.registerLayout(pyramidSetLayout, { { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 }, { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1 } });
+		descriptorAllocator.registerLayout(cullSetLayout, { { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4 }, { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1 },
+			{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 } });
+
+		//source and destination size of the level
+		VkPushConstantRange pyramidPush{ VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(int32_t) * 4 };
+		VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		pipelineLayoutInfo.setLayoutCount = 1;
+		pipelineLayoutInfo.pSetLayouts = &pyramidSetLayout;
+		pipelineLayoutInfo.pushConstantRangeCount = 1;
+		pipelineLayoutInfo.pPushConstantRanges = &pyramidPush;
+		if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pyramidPipelineLayout) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create depth pyramid pipeline layout!");
+		}
+		//the phase
+		VkPushConstantRange cullPush{ VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t) };
+		pipelineLayoutInfo.pSetLayouts = &cullSetLayout;
+		pipelineLayoutInfo.pPushConstantRanges = &cullPush;
+		if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &cullPipelineLayout) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create culling pipeline layout!");
+		}
+
+		//not hot reloaded, only the scene pipelines are
+		pyramidDepthPipeline = createPipeline(shaderLibrary, pipelineCache, pyramidPipelineLayout, { "DEPTH_SOURCE" }, "shaders/hiz.comp", "shaders/hiz_depth_comp.spv");
+		pyramidPipeline = createPipeline(shaderLibrary, pipelineCache, pyramidPipelineLayout, {}, "shaders/hiz.comp", "shaders/hiz_comp.spv");
+		cullPipeline = createPipeline(shaderLibrary, pipelineCache, cullPipelineLayout, {}, "shaders/cull.comp", "shaders/cull_comp.spv");
+
+		//texelFetch only, the sampler is required by the descriptor type
+		VkSamplerCreateInfo samplerInfo{};
+		samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+		samplerInfo.magFilter = VK_FILTER_NEAREST;
+		samplerInfo.minFilter = VK_FILTER_NEAREST;
+		samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+		if (vkCreateSampler(device, &samplerInfo, nullptr, &sampler) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create depth pyramid sampler!");
+		}
+
+		//written once, read by every cull dispatch
+		VkDeviceSize clusterSize = sizeof(Cluster) * std::max(clusterCount, 1u);
+		clusterBuffer = createBuffer(clusterSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+		void* data;
+		vkMapMemory(device, clusterBuffer.memory, 0, clusterSize, 0, &data);
+		if (clusterCount > 0)
+			memcpy(data, clusters.data(), sizeof(Cluster) * clusterCount);
+		vkUnmapMemory(device, clusterBuffer.memory);
+
+		drawCommands = createBuffer(sizeof(VkDrawIndexedIndirectCommand) * 2 * std::max(clusterCount, 1u),
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		flagBuffer = createBuffer(sizeof(uint32_t) * std::max(clusterCount, 1u), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+	}
+
+	void OcclusionCuller::destroy()
+	{
+		if (device == VK_NULL_HANDLE)
+			return;
+
+		destroyTargets();
+		destroyBuffer(clusterBuffer);
+		destroyBuffer(drawCommands);
+		destroyBuffer(flagBuffer);
+		vkDestroySampler(device, sampler, nullptr);
+		vkDestroyPipeline(device, pyramidDepthPipeline, nullptr);
+		vkDestroyPipeline(device, pyramidPipeline, nullptr);
+		vkDestroyPipeline(device, cullPipeline, nullptr);
+		vkDestroyPipelineLayout(device, pyramidPipelineLayout, nullptr);
+		vkDestroyPipelineLayout(device, cullPipelineLayout, nullptr);
+		vkDestroyDescriptorSetLayout(device, pyramidSetLayout, nullptr);
+		vkDestroyDescriptorSetLayout(device, cullSetLayout, nullptr);
+		sampler = VK_NULL_HANDLE;
+		pyramidDepthPipeline = VK_NULL_HANDLE;
+		pyramidPipeline = VK_NULL_HANDLE;
+		cullPipeline = VK_NULL_HANDLE;
+		pyramidPipelineLayout = VK_NULL_HANDLE;
+		cullPipelineLayout = VK_NULL_HANDLE;
+		pyramidSetLayout = VK_NULL_HANDLE;
+		cullSetLayout = VK_NULL_HANDLE;
+		device = VK_NULL_HANDLE;
+	}
+
+	void OcclusionCuller::createTargets(VkImage depthImage, VkFormat depthFormat, VkExtent2D depthExtent, uint32_t slotCount)
+	{
+		//a power of two below the depth size, so every level halves exactly and a texel never covers less than the source
+		VkExtent2D extent{ previousPowerOfTwo(depthExtent.width), previousPowerOfTwo(depthExtent.height) };
+		uint32_t levelCount = 1;
+		while ((std::max(extent.width, extent.height) >> levelCount) > 0)
+			levelCount++;
+
+		VkImageCreateInfo imageInfo{};
+		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imageInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageInfo.format = VK_FORMAT_R32_SFLOAT;
+		imageInfo.extent = { extent.width, extent.height, 1 };
+		imageInfo.mipLevels = levelCount;
+		imageInfo.arrayLayers = 1;
+		imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		if (vkCreateImage(device, &imageInfo, nullptr, &pyramidImage) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create depth pyramid image!");
+		}
+
+		VkMemoryRequirements memRequirements;
+		vkGetImageMemoryRequirements(device, pyramidImage, &memRequirements);
+		std::optional<uint32_t> memoryType = findMemoryType(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		if (!memoryType.has_value()) {
+			throw std::runtime_error("failed to find suitable memory type for the depth pyramid!");
+		}
+		VkMemoryAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		allocInfo.allocationSize = memRequirements.size;
+		allocInfo.memoryTypeIndex = memoryType.value();
+		if (vkAllocateMemory(device, &allocInfo, nullptr, &pyramidMemory) != VK_SUCCESS) {
+			throw std::runtime_error("failed to allocate depth pyramid memory!");
+		}
+		vkBindImageMemory(device, pyramidImage, pyramidMemory, 0);
+
+		VkImageViewCreateInfo viewInfo{};
+		viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		viewInfo.image = pyramidImage;
+		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewInfo.format = VK_FORMAT_R32_SFLOAT;
+		viewInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, levelCount, 0, 1 };
+		if (vkCreateImageView(device, &viewInfo, nullptr, &pyramidView) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create depth pyramid view!");
+		}
+		levelViews.resize(levelCount);
+		levelExtents.resize(levelCount);
+		for (uint32_t level = 0; level < levelCount; level++)
+		{
+			viewInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, level, 1, 0, 1 };
+			if (vkCreateImageView(device, &viewInfo, nullptr, &levelViews[level]) != VK_SUCCESS) {
+				throw std::runtime_error("failed to create depth pyramid level view!");
+			}
+			levelExtents[level] = { std::max(extent.width >> level, 1u), std::max(extent.height >> level, 1u) };
+		}
+
+		//depth only, the stencil aspect can't be sampled together with it
+		viewInfo.image = depthImage;
+		viewInfo.format = depthFormat;
+		viewInfo.subresourceRange = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1 };
+		if (vkCreateImageView(device, &viewInfo, nullptr, &depthView) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create depth sampling view!");
+		}
+
+		pyramidSets.resize(levelCount);
+		for (uint32_t level = 0; level < levelCount; level++)
+		{
+			VkDescriptorImageInfo sourceInfo{ sampler, level == 0 ? depthView : levelViews[level - 1],
+				level == 0 ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL };
+			VkDescriptorImageInfo destinationInfo{ VK_NULL_HANDLE, levelViews[level], VK_IMAGE_LAYOUT_GENERAL };
+			std::vector<VkWriteDescriptorSet> writes(2);
+			for (VkWriteDescriptorSet& write : writes)
+			{
+				write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+				write.descriptorCount = 1;
+			}
+			writes[0].dstBinding = 0;
+			writes[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			writes[0].pImageInfo = &sourceInfo;
+			writes[1].dstBinding = 1;
+			writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+			writes[1].pImageInfo = &destinationInfo;
+			pyramidSets[level] = descriptorAllocator->allocateCached(pyramidSetLayout, writes);
+		}
+
+		frameStride = FRAME_STRIDE;
+		frameBuffer = createBuffer(frameStride * slotCount, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+		vkMapMemory(device, frameBuffer.memory, 0, frameStride * slotCount, 0, &frameData);
+		pending.assign(slotCount, false);
+
+		cullSets.resize(slotCount);
+		for (uint32_t slot = 0; slot < slotCount; slot++)
+		{
+			VkDescriptorBufferInfo bufferInfos[5] = {
+				{ clusterBuffer.buffer, 0, VK_WHOLE_SIZE },
+				{ drawCommands.buffer, 0, VK_WHOLE_SIZE },
+				{ flagBuffer.buffer, 0, VK_WHOLE_SIZE },
+				{ frameBuffer.buffer, frameStride * slot + STATS_OFFSET, sizeof(Stats) },
+				{ frameBuffer.buffer, frameStride * slot, sizeof(CullConstants) }
+			};
+			VkDescriptorImageInfo pyramidInfo{ sampler, pyramidView, VK_IMAGE_LAYOUT_GENERAL };
+			std::vector<VkWriteDescriptorSet> writes(6);
+			for (uint32_t binding = 0; binding < writes.size(); binding++)
+			{
+				writes[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+				writes[binding].dstBinding = binding;
+				writes[binding].descriptorCount = 1;
+				if (binding < 4) {
+					writes[binding].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+					writes[binding].pBufferInfo = &bufferInfos[binding];
+				}
+				else if (binding == 4) {
+					writes[binding].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+					writes[binding].pBufferInfo = &bufferInfos[binding];
+				}
+				else {
+					writes[binding].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+					writes[binding].pImageInfo = &pyramidInfo;
+				}
+			}
+			cullSets[slot] = descriptorAllocator->allocateCached(cullSetLayout, writes);
+		}
+
+		//the new pyramid is empty until the first frame built it
+		pyramidValid = false;
+	}
+
+	void OcclusionCuller::destroyTargets()
+	{
+		if (pyramidImage == VK_NULL_HANDLE)
+			return;
+
+		//point to the views and the frame buffer destroyed below
+		descriptorAllocator->resetPersistent(pyramidSetLayout);
+		descriptorAllocator->resetPersistent(cullSetLayout);
+		pyramidSets.clear();
+		cullSets.clear();
+
+		vkDestroyImageView(device, depthView, nullptr);
+		for (VkImageView view : levelViews)
+			vkDestroyImageView(device, view, nullptr);
+		vkDestroyImageView(device, pyramidView, nullptr);
+		vkDestroyImage(device, pyramidImage, nullptr);
+		vkFreeMemory(device, pyramidMemory, nullptr);
+		depthView = VK_NULL_HANDLE;
+		levelViews.clear();
+		levelExtents.clear();
+		pyramidView = VK_NULL_HANDLE;
+		pyramidImage = VK_NULL_HANDLE;
+		pyramidMemory = VK_NULL_HANDLE;
+
+		vkUnmapMemory(device, frameBuffer.memory);
+		frameData = nullptr;
+		destroyBuffer(frameBuffer);
+		pending.clear();
+		pyramidValid = false;
+	}
+
+	void OcclusionCuller::recordEarlyCull(VkCommandBuffer commandBuffer, uint32_t slot, const glm::mat4& mvp)
+	{
+		//the GPU finished the slot's previous frame before it's recorded again, so its constants can be overwritten
+		CullConstants constants{};
+		constants.mvp = mvp;
+		constants.previousMvp = pyramidMvp;
+		constants.pyramidSize = glm::vec2(levelExtents[0].width, levelExtents[0].height);
+		constants.pyramidLevels = static_cast<float>(levelExtents.size());
+		constants.pyramidValid = pyramidValid ? 1 : 0;
+		constants.clusterCount = clusterCount;
+		memcpy(static_cast<char*>(frameData) + frameStride * slot, &constants, sizeof(constants));
+		frameMvp = mvp;
+
+		//the previous frame's late cull wrote the flags and draws this frame overwrites, and its draws read them
+		memoryBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+		vkCmdFillBuffer(commandBuffer, frameBuffer.buffer, frameStride * slot + STATS_OFFSET, sizeof(Stats), 0);
+		memoryBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+		uint32_t phase = static_cast<uint32_t>(Phase::Early);
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipeline);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipelineLayout, 0, 1, &cullSets[slot], 0, nullptr);
+		vkCmdPushConstants(commandBuffer, cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(phase), &phase);
+		vkCmdDispatch(commandBuffer, (clusterCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+
+		memoryBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+			VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT);
+	}
+
+	void OcclusionCuller::recordPyramid(VkCommandBuffer commandBuffer, VkExtent2D drawnExtent)
+	{
+		//every level is rewritten, so the old contents are discarded. The early cull read them
+		VkImageMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = pyramidImage;
+		barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, static_cast<uint32_t>(levelExtents.size()), 0, 1 };
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+			0, nullptr, 0, nullptr, 1, &barrier);
+
+		VkExtent2D sourceExtent = drawnExtent;
+		for (uint32_t level = 0; level < levelExtents.size(); level++)
+		{
+			VkExtent2D extent = levelExtents[level];
+			int32_t sizes[4] = { static_cast<int32_t>(sourceExtent.width), static_cast<int32_t>(sourceExtent.height),
+				static_cast<int32_t>(extent.width), static_cast<int32_t>(extent.height) };
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, level == 0 ? pyramidDepthPipeline : pyramidPipeline);
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pyramidPipelineLayout, 0, 1, &pyramidSets[level], 0, nullptr);
+			vkCmdPushConstants(commandBuffer, pyramidPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(sizes), sizes);
+			vkCmdDispatch(commandBuffer, (extent.width + PYRAMID_GROUP_SIZE - 1) / PYRAMID_GROUP_SIZE,
+				(extent.height + PYRAMID_GROUP_SIZE - 1) / PYRAMID_GROUP_SIZE, 1);
+
+			//the next level (or the late cull) reads it
+			memoryBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+				VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+			sourceExtent = extent;
+		}
+
+		pyramidMvp = frameMvp;
+		pyramidValid = true;
+	}
+
+	void OcclusionCuller::recordLateCull(VkCommandBuffer commandBuffer, uint32_t slot)
+	{
+		uint32_t phase = static_cast<uint32_t>(Phase::Late);
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipeline);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipelineLayout, 0, 1, &cullSets[slot], 0, nullptr);
+		vkCmdPushConstants(commandBuffer, cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(phase), &phase);
+		vkCmdDispatch(commandBuffer, (clusterCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+
+		memoryBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+			VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_HOST_READ_BIT);
+		pending[slot] = true;
+	}
+
+	VkDeviceSize OcclusionCuller::getDrawOffset(Phase phase, uint32_t cluster) const
+	{
+		return sizeof(VkDrawIndexedIndirectCommand) * (static_cast<uint32_t>(phase) * clusterCount + cluster);
+	}
+
+	std::optional<OcclusionCuller::Stats> OcclusionCuller::collect(uint32_t slot)
+	{
+		if (slot >= pending.size() || !pending[slot])
+			return std::nullopt;
+
+		pending[slot] = false;
+		Stats stats;
+		memcpy(&stats, static_cast<const char*>(frameData) + frameStride * slot + STATS_OFFSET, sizeof(stats));
+		return stats;
+	}
+
+	OcclusionCuller::Allocation OcclusionCuller::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties)
+	{
+		Allocation allocation;
+		VkBufferCreateInfo bufferInfo{};
+		bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		bufferInfo.size = size;
+		bufferInfo.usage = usage;
+		bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		if (vkCreateBuffer(device, &bufferInfo, nullptr, &allocation.buffer) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create culling buffer!");
+		}
+
+		VkMemoryRequirements memRequirements;
+		vkGetBufferMemoryRequirements(device, allocation.buffer, &memRequirements);
+		std::optional<uint32_t> memoryType = findMemoryType(memRequirements.memoryTypeBits, properties);
+		if (!memoryType.has_value()) {
+			throw std::runtime_error("failed to find suitable memory type for a culling buffer!");
+		}
+		VkMemoryAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		allocInfo.allocationSize = memRequirements.size;
+		allocInfo.memoryTypeIndex = memoryType.value();
+		if (vkAllocateMemory(device, &allocInfo, nullptr, &allocation.memory) != VK_SUCCESS) {
+			throw std::runtime_error("failed to allocate culling buffer memory!");
+		}
+		vkBindBufferMemory(device, allocation.buffer, allocation.memory, 0);
+		return allocation;
+	}
+
+	void OcclusionCuller::destroyBuffer(Allocation& allocation)
+	{
+		vkDestroyBuffer(device, allocation.buffer, nullptr);
+		vkFreeMemory(device, allocation.memory, nullptr);
+		allocation = Allocation();
+	}
+
+	VkPipeline OcclusionCuller::createPipeline(ShaderLibrary& shaderLibrary, VkPipelineCache pipelineCache, VkPipelineLayout layout,
+		const std::vector<std::string>& defines, const std::string& source, const std::string& precompiled)
+	{
+		VkComputePipelineCreateInfo pipelineInfo{};
+		pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+		pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+		pipelineInfo.stage.module = shaderLibrary.getModule({ source, VK_SHADER_STAGE_COMPUTE_BIT, defines, precompiled });
+		pipelineInfo.stage.pName = "main";
+		pipelineInfo.layout = layout;
+
+		VkPipeline pipeline;
+		if (vkCreateComputePipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create " + source + " pipeline!");
+		}
+		return pipeline;
+	}
+}
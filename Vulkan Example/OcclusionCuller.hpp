@@ -0,0 +1,151 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include "DescriptorAllocator.hpp"
+#include "ShaderLibrary.hpp"
+#include "Vertex.hpp"
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <vector>
+
+namespace vulkanExample
+{
+	// Triangles of a draw that are culled together. Layout matches Cluster in cull.comp (std430)
+	struct Cluster
+	{
+		//model space bounding box, w unused
+		glm::vec4 boundsMin;
+		glm::vec4 boundsMax;
+		uint32_t firstIndex;
+		uint32_t indexCount;
+		uint32_t padding[2];
+	};
+
+	//splits the index range into clusters of at most OcclusionCuller::CLUSTER_TRIANGLES consecutive triangles
+	void buildClusters(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices, uint32_t firstIndex,
+		uint32_t indexCount, std::vector<Cluster>& clusters);
+
+	// Culls clusters on the GPU in two phases against a hierarchical depth pyramid (HiZ), where every texel of a level holds
+	// the farthest depth of the texels it covers in the level below.
+	// The early phase tests the clusters inside the frustum against the pyramid of the previous frame, projected with that
+	// frame's matrix, and the ones that pass are drawn. The pyramid is then rebuilt from that depth, and the late phase tests
+	// the clusters the early phase rejected again with the current matrix. The ones that became visible (the camera moved,
+	// an occluder went away) are drawn on top in the same frame, so nothing pops in a frame late.
+	// Each phase writes one indirect draw per cluster in cluster order, culled ones with instanceCount 0
+	class OcclusionCuller
+	{
+	public:
+		static constexpr uint32_t CLUSTER_TRIANGLES = 256;
+
+		//no value if none of the types has the properties
+		using MemoryTypeFinder = std::function<std::optional<uint32_t>(uint32_t typeBits, VkMemoryPropertyFlags properties)>;
+
+		enum class Phase : uint32_t
+		{
+			Early = 0,
+			Late = 1
+		};
+
+		// Clusters of one frame. Matches Stats in cull.comp
+		struct Stats
+		{
+			uint32_t earlyDrawn = 0;
+			uint32_t lateDrawn = 0;
+			//rejected by both phases
+			uint32_t occluded = 0;
+			uint32_t frustumCulled = 0;
+		};
+
+		//compute pipelines and the buffers of the clusters and their draws
+		void create(VkDevice device, const MemoryTypeFinder& findMemoryType, ShaderLibrary& shaderLibrary, VkPipelineCache pipelineCache,
+			DescriptorAllocator& descriptorAllocator, const std::vector<Cluster>& clusters);
+		void destroy();
+
+		//pyramid for the depth target (which needs VK_IMAGE_USAGE_SAMPLED_BIT) and the per frame data of slotCount slots.
+		//The first frame afterwards draws every cluster inside the frustum in the early phase
+		void createTargets(VkImage depthImage, VkFormat depthFormat, VkExtent2D depthExtent, uint32_t slotCount);
+		void destroyTargets();
+
+		//record outside of a render pass. mvp is the matrix the clusters are drawn with this frame
+		void recordEarlyCull(VkCommandBuffer commandBuffer, uint32_t slot, const glm::mat4& mvp);
+		//the depth target must be in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL. drawnExtent is the part of it rendered to
+		void recordPyramid(VkCommandBuffer commandBuffer, VkExtent2D drawnExtent);
+		void recordLateCull(VkCommandBuffer commandBuffer, uint32_t slot);
+
+		VkBuffer getDrawBuffer() const { return drawCommands.buffer; }
+		//offset of the phase's draw of the cluster, a VkDrawIndexedIndirectCommand
+		VkDeviceSize getDrawOffset(Phase phase, uint32_t cluster) const;
+
+		//counts of the slot's last frame, no value if there is none. The GPU must be done with it
+		std::optional<Stats> collect(uint32_t slot);
+
+		uint32_t getClusterCount() const { return clusterCount; }
+		bool isCreated() const { return cullPipeline != VK_NULL_HANDLE; }
+
+	private:
+		// Uniforms of cull.comp (std140)
+		struct CullConstants
+		{
+			glm::mat4 mvp;
+			glm::mat4 previousMvp;
+			glm::vec2 pyramidSize;
+			float pyramidLevels;
+			uint32_t pyramidValid;
+			uint32_t clusterCount;
+		};
+
+		// Buffer and the memory bound to it
+		struct Allocation
+		{
+			VkBuffer buffer = VK_NULL_HANDLE;
+			VkDeviceMemory memory = VK_NULL_HANDLE;
+		};
+
+		VkDevice device = VK_NULL_HANDLE;
+		MemoryTypeFinder findMemoryType;
+		DescriptorAllocator* descriptorAllocator = nullptr;
+		uint32_t clusterCount = 0;
+
+		VkDescriptorSetLayout pyramidSetLayout = VK_NULL_HANDLE;
+		VkDescriptorSetLayout cullSetLayout = VK_NULL_HANDLE;
+		VkPipelineLayout pyramidPipelineLayout = VK_NULL_HANDLE;
+		VkPipelineLayout cullPipelineLayout = VK_NULL_HANDLE;
+		//the first level reads the depth buffer, the others the level below
+		VkPipeline pyramidDepthPipeline = VK_NULL_HANDLE;
+		VkPipeline pyramidPipeline = VK_NULL_HANDLE;
+		VkPipeline cullPipeline = VK_NULL_HANDLE;
+		VkSampler sampler = VK_NULL_HANDLE;
+
+		Allocation clusterBuffer;
+		//early draws of every cluster, then the late ones
+		Allocation drawCommands;
+		//early phase result of every cluster
+		Allocation flagBuffer;
+
+		//constants and stats of every slot, persistently mapped
+		Allocation frameBuffer;
+		void* frameData = nullptr;
+		VkDeviceSize frameStride = 0;
+		std::vector<bool> pending;
+
+		VkImage pyramidImage = VK_NULL_HANDLE;
+		VkDeviceMemory pyramidMemory = VK_NULL_HANDLE;
+		VkImageView pyramidView = VK_NULL_HANDLE;
+		std::vector<VkImageView> levelViews;
+		std::vector<VkExtent2D> levelExtents;
+		VkImageView depthView = VK_NULL_HANDLE;
+		std::vector<VkDescriptorSet> pyramidSets;
+		std::vector<VkDescriptorSet> cullSets;
+
+		//matrix the pyramid was rendered with, and the one of the frame being recorded
+		glm::mat4 pyramidMvp = glm::mat4(1.0f);
+		glm::mat4 frameMvp = glm::mat4(1.0f);
+		bool pyramidValid = false;
+
+		Allocation createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties);
+		void destroyBuffer(Allocation& allocation);
+		VkPipeline createPipeline(ShaderLibrary& shaderLibrary, VkPipelineCache pipelineCache, VkPipelineLayout layout,
+			const std::vector<std::string>& defines, const std::string& source, const std::string& precompiled);
+	};
+}
@@ -0,0 +1,155 @@
+#include "PipelineLibrary.hpp"
+#include <iostream>
+
+namespace vulkanExample
+{
+	template<typename T>
+	static bool isReady(const std::future<T>& future)
+	{
+		return future.valid() && future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+	}
+
+	void PipelineLibrary::create(VkDevice device, ThreadPool& threadPool, Builder builder, Retire retire)
+	{
+		this->device = device;
+		this->threadPool = &threadPool;
+		this->builder = std::move(builder);
+		this->retire = std::move(retire);
+	}
+
+	VkPipeline PipelineLibrary::request(const PipelineVariant& variant)
+	{
+		Entry& entry = findOrBuild(variant);
+		if (isReady(entry.pending))
+		{
+			try
+			{
+				entry.pipeline = entry.pending.get();
+			}
+			catch (const std::exception& e)
+			{
+				//stays unavailable until a reload builds it successfully
+				std::cerr << "Build of pipeline variant " << debugViewName(entry.variant.debugView) << " failed: " << e.what() << std::endl;
+			}
+			if (entry.stale)
+			{
+				entry.stale = false;
+				entry.reloadStart = Clock::now();
+				entry.replacement = build(entry.variant);
+			}
+		}
+		if (isReady(entry.replacement))
+			swapReplacement(entry);
+		return entry.pipeline;
+	}
+
+	VkPipeline PipelineLibrary::get(const PipelineVariant& variant)
+	{
+		Entry& entry = findOrBuild(variant);
+		if (entry.pending.valid())
+			entry.pipeline = entry.pending.get();
+		return request(variant);
+	}
+
+	void PipelineLibrary::reload()
+	{
+		for (auto& pair : entries)
+		{
+			Entry& entry = pair.second;
+			//a build in progress may already have read the old sources. It's finished first and rebuilt afterwards
+			if (entry.pending.valid() || entry.replacement.valid())
+			{
+				entry.stale = true;
+				continue;
+			}
+			entry.reloadStart = Clock::now();
+			entry.replacement = build(entry.variant);
+		}
+	}
+
+	void PipelineLibrary::clear()
+	{
+		for (auto& pair : entries)
+		{
+			Entry& entry = pair.second;
+			for (std::future<VkPipeline>* future : { &entry.pending, &entry.replacement })
+			{
+				if (!future->valid())
+					continue;
+				//a failed build has nothing to destroy
+				try
+				{
+					VkPipeline pipeline = future->get();
+					if (future == &entry.pending)
+						entry.pipeline = pipeline;
+					else
+						vkDestroyPipeline(device, pipeline, nullptr);
+				}
+				catch (const std::exception&)
+				{
+				}
+			}
+			if (entry.pipeline != VK_NULL_HANDLE)
+				vkDestroyPipeline(device, entry.pipeline, nullptr);
+		}
+		entries.clear();
+	}
+
+	PipelineLibrary::Entry& PipelineLibrary::findOrBuild(const PipelineVariant& variant)
+	{
+		auto found = entries.find(variant.key());
+		if (found != entries.end())
+			return found->second;
+
+		Entry& entry = entries[variant.key()];
+		entry.variant = variant;
+		entry.pending = build(variant);
+		return entry;
+	}
+
+	std::future<VkPipeline> PipelineLibrary::build(const PipelineVariant& variant)
+	{
+		Builder build = builder;
+		return threadPool->submit([build, variant]() {
+			auto start = Clock::now();
+			VkPipeline pipeline = build(variant);
+			double elapsedMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+			std::cout << "Built pipeline variant " << debugViewName(variant.debugView)
+				<< (variant.pushConstantMVP ? " (push constant MVP)" : " (uniform buffer MVP)") << " in " << elapsedMs << " ms" << std::endl;
+			return pipeline;
+		});
+	}
+
+	void PipelineLibrary::swapReplacement(Entry& entry)
+	{
+		VkPipeline pipeline;
+		try
+		{
+			pipeline = entry.replacement.get();
+		}
+		catch (const std::exception& e)
+		{
+			//a shader with errors must not take the application down while editing it
+			std::cerr << "Reload of pipeline variant " << debugViewName(entry.variant.debugView) << " failed, keeping the previous one: "
+				<< e.what() << std::endl;
+			pipeline = VK_NULL_HANDLE;
+		}
+
+		if (pipeline != VK_NULL_HANDLE)
+		{
+			double swapMs = std::chrono::duration<double, std::milli>(Clock::now() - entry.reloadStart).count();
+			std::cout << "Swapped pipeline variant " << debugViewName(entry.variant.debugView) << " " << swapMs
+				<< " ms after the reload started" << std::endl;
+			if (entry.pipeline != VK_NULL_HANDLE)
+				retire(entry.pipeline);
+			entry.pipeline = pipeline;
+		}
+
+		if (entry.stale)
+		{
+			entry.stale = false;
+			entry.reloadStart = Clock::now();
+			entry.replacement = build(entry.variant);
+		}
+	}
+}
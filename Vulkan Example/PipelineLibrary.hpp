@@ -0,0 +1,67 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include "PipelineVariant.hpp"
+#include "ThreadPool.hpp"
+#include <chrono>
+#include <functional>
+#include <future>
+#include <unordered_map>
+
+namespace vulkanExample
+{
+	// Creates graphics pipelines lazily, one per variant, on the thread pool and keeps them until cleared.
+	// Requesting a variant that is still being built returns VK_NULL_HANDLE, so the caller keeps drawing
+	// with the previous pipeline instead of stalling the frame.
+	// reload() rebuilds every variant in the background (e.g. after a shader changed). The old pipeline is served until
+	// its replacement is ready and then handed to the retire callback, as frames in flight may still use it
+	class PipelineLibrary
+	{
+	public:
+		//called on a worker thread. Must be thread safe
+		using Builder = std::function<VkPipeline(const PipelineVariant&)>;
+		//called on the requesting thread with a pipeline that was replaced
+		using Retire = std::function<void(VkPipeline)>;
+
+		void create(VkDevice device, ThreadPool& threadPool, Builder builder, Retire retire);
+
+		//non blocking. Starts building the variant if it's not cached yet, and swaps in finished replacements
+		VkPipeline request(const PipelineVariant& variant);
+		//blocks until the variant is built
+		VkPipeline get(const PipelineVariant& variant);
+
+		//rebuilds every cached variant in the background
+		void reload();
+
+		//waits for the builds in progress and destroys every pipeline. The caller must make sure the GPU no longer uses them
+		void clear();
+
+		size_t size() const { return entries.size(); }
+
+	private:
+		using Clock = std::chrono::steady_clock;
+
+		struct Entry
+		{
+			PipelineVariant variant;
+			VkPipeline pipeline = VK_NULL_HANDLE;
+			//first build of the variant
+			std::future<VkPipeline> pending;
+			//rebuild after a reload, swapped in when ready
+			std::future<VkPipeline> replacement;
+			Clock::time_point reloadStart;
+			//reload() was called while a build was running, so that build may have read the old sources
+			bool stale = false;
+		};
+
+		VkDevice device = VK_NULL_HANDLE;
+		ThreadPool* threadPool = nullptr;
+		Builder builder;
+		Retire retire;
+		//only accessed from the thread that records the frames
+		std::unordered_map<uint64_t, Entry> entries;
+
+		Entry& findOrBuild(const PipelineVariant& variant);
+		std::future<VkPipeline> build(const PipelineVariant& variant);
+		void swapReplacement(Entry& entry);
+	};
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include <cstdint>
+#include <optional>
+#include <string>
+
+namespace vulkanExample
+{
+	// Debug views of the fragment shader. Passed as a specialization constant, so each one is a separate pipeline
+	// without runtime branches. Values must match DEBUG_VIEW in shader.frag
+	enum class DebugView : uint32_t
+	{
+		Textured = 0,
+		TexCoords = 1,
+		VertexColor = 2,
+		//adds a constant per shaded fragment, so the brightness shows how often each pixel was shaded
+		Overdraw = 3,
+		Count
+	};
+
+	// Everything that selects a different graphics pipeline for the same render pass
+	struct PipelineVariant
+	{
+		DebugView debugView = DebugView::Textured;
+		//selects the PUSH_CONSTANT_MVP vertex shader variant
+		bool pushConstantMVP = true;
+		//selects the BINDLESS_TEXTURES fragment shader variant. Fixed for a device
+		bool bindlessTextures = false;
+		//the render pass starts with a depth only subpass, so this variant shades in the second one with an EQUAL depth test
+		bool depthPrepass = false;
+		//position only pipeline of the depth pre-pass, without fragment shader
+		bool depthOnly = false;
+		//selects the VIRTUAL_TEXTURES fragment shader variant, which needs descriptor set 2. Fixed for a device
+		bool virtualTextures = false;
+
+		uint64_t key() const
+		{
+			return (virtualTextures ? 1ull << 32 : 0) | (static_cast<uint64_t>(debugView) << 4) | (depthOnly ? 8 : 0) | (depthPrepass ? 4 : 0) | (bindlessTextures ? 2 : 0) |
+				(pushConstantMVP ? 1 : 0);
+		}
+		//the pre-pass pipeline drawn before this variant. Only the vertex transform has to match, so the depth is the same
+		PipelineVariant getDepthOnly() const
+		{
+			PipelineVariant variant;
+			variant.pushConstantMVP = pushConstantMVP;
+			variant.depthPrepass = true;
+			variant.depthOnly = true;
+			return variant;
+		}
+		bool operator==(const PipelineVariant& other) const { return key() == other.key(); }
+		bool operator!=(const PipelineVariant& other) const { return key() != other.key(); }
+	};
+
+	inline const char* debugViewName(DebugView debugView)
+	{
+		switch (debugView)
+		{
+		case DebugView::Textured:
+			return "textured";
+		case DebugView::TexCoords:
+			return "uv";
+		case DebugView::VertexColor:
+			return "vertex-color";
+		case DebugView::Overdraw:
+			return "overdraw";
+		default:
+			return "unknown";
+		}
+	}
+
+	inline std::optional<DebugView> parseDebugView(const std::string& name)
+	{
+		for (uint32_t i = 0; i < static_cast<uint32_t>(DebugView::Count); i++)
+		{
+			if (name == debugViewName(static_cast<DebugView>(i)))
+				return static_cast<DebugView>(i);
+		}
+		return std::nullopt;
+	}
+}
@@ -0,0 +1,490 @@
+#include "PixelFormat.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define VULKAN_EXAMPLE_PIXEL_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+//GCC and Clang only emit the instructions of the functions compiled for them, MSVC always can
+#if defined(__GNUC__) || defined(__clang__)
+#define TARGET_SSSE3 __attribute__((target("ssse3")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_SSSE3
+#define TARGET_AVX2
+#endif
+
+namespace vulkanExample
+{
+	namespace
+	{
+		//the linear to sRGB table has 2^12 entries, enough for every 8 bit value to survive the round trip
+		constexpr uint32_t ENCODE_SIZE = 1u << 12;
+		constexpr float ENCODE_SCALE = static_cast<float>(ENCODE_SIZE - 1);
+		//premultiplied RGBA is staged through a block this big, so the target is still written once
+		constexpr size_t BLOCK_PIXELS = 1024;
+		constexpr uint32_t COLOR_MASK = 0x00ffffffu;
+		constexpr uint32_t ALPHA_MASK = 0xff000000u;
+
+		struct SrgbTables
+		{
+			alignas(32) float decode[256];
+			//32 bits per entry, so AVX2 gathers read it directly
+			alignas(32) int32_t encode[ENCODE_SIZE];
+
+			SrgbTables()
+			{
+				for (uint32_t i = 0; i < 256; i++)
+				{
+					double c = i / 255.0;
+					decode[i] = static_cast<float>(c <= 0.04045 ? c / 12.92 : std::pow((c + 0.055) / 1.055, 2.4));
+				}
+				for (uint32_t i = 0; i < ENCODE_SIZE; i++)
+				{
+					double c = i / static_cast<double>(ENCODE_SIZE - 1);
+					double value = c <= 0.0031308 ? c * 12.92 : 1.055 * std::pow(c, 1.0 / 2.4) - 0.055;
+					encode[i] = static_cast<int32_t>(value * 255.0 + 0.5);
+				}
+			}
+		};
+
+		const SrgbTables& getSrgbTables()
+		{
+			static const SrgbTables tables;
+			return tables;
+		}
+
+		//NaN clamps to 0, like the max then min of the vector versions
+		float clampUnit(float value)
+		{
+			return value > 0.0f ? (value < 1.0f ? value : 1.0f) : 0.0f;
+		}
+
+		PixelKernel detectPixelKernel()
+		{
+#ifdef VULKAN_EXAMPLE_PIXEL_X86
+#ifdef _MSC_VER
+			int info[4];
+			__cpuid(info, 0);
+			int maxLeaf = info[0];
+			__cpuid(info, 1);
+			bool ssse3 = (info[2] & (1 << 9)) != 0;
+			//AVX2 also needs the OS to save the upper halves of the registers (OSXSAVE, then XCR0)
+			bool avxState = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 && (_xgetbv(0) & 6) == 6;
+			bool avx2 = false;
+			if (maxLeaf >= 7 && avxState)
+			{
+				__cpuidex(info, 7, 0);
+				avx2 = (info[1] & (1 << 5)) != 0;
+			}
+#else
+			__builtin_cpu_init();
+			bool ssse3 = __builtin_cpu_supports("ssse3");
+			bool avx2 = __builtin_cpu_supports("avx2");
+#endif
+			if (avx2)
+				return PixelKernel::Avx2;
+			if (ssse3)
+				return PixelKernel::Ssse3;
+#endif
+			return PixelKernel::Scalar;
+		}
+
+		void expandRgbScalar(const unsigned char* rgb, unsigned char* rgba, size_t pixelCount)
+		{
+			for (size_t i = 0; i < pixelCount; i++)
+			{
+				rgba[i * 4 + 0] = rgb[i * 3 + 0];
+				rgba[i * 4 + 1] = rgb[i * 3 + 1];
+				rgba[i * 4 + 2] = rgb[i * 3 + 2];
+				rgba[i * 4 + 3] = 255;
+			}
+		}
+
+		//c * a / 255 rounded, exactly, for c and a up to 255
+		unsigned char multiplyAlpha(uint32_t c, uint32_t a)
+		{
+			uint32_t t = c * a + 128;
+			return static_cast<unsigned char>((t + (t >> 8)) >> 8);
+		}
+
+		void premultiplyScalar(unsigned char* rgba, size_t pixelCount, bool srgb)
+		{
+			const SrgbTables& tables = getSrgbTables();
+			for (size_t i = 0; i < pixelCount; i++)
+			{
+				unsigned char* pixel = rgba + i * 4;
+				uint32_t a = pixel[3];
+				if (a == 255)
+					continue;
+				if (!srgb)
+				{
+					for (int c = 0; c < 3; c++)
+						pixel[c] = multiplyAlpha(pixel[c], a);
+					continue;
+				}
+				float alpha = static_cast<float>(a) * (1.0f / 255.0f);
+				for (int c = 0; c < 3; c++)
+					pixel[c] = static_cast<unsigned char>(tables.encode[static_cast<int32_t>(tables.decode[pixel[c]] * alpha * ENCODE_SCALE + 0.5f)]);
+			}
+		}
+
+		void srgbToLinearScalar(const unsigned char* rgba, float* linear, size_t pixelCount)
+		{
+			const SrgbTables& tables = getSrgbTables();
+			for (size_t i = 0; i < pixelCount * 4; i += 4)
+			{
+				linear[i + 0] = tables.decode[rgba[i + 0]];
+				linear[i + 1] = tables.decode[rgba[i + 1]];
+				linear[i + 2] = tables.decode[rgba[i + 2]];
+				linear[i + 3] = static_cast<float>(rgba[i + 3]) * (1.0f / 255.0f);
+			}
+		}
+
+		void linearToSrgbScalar(const float* linear, unsigned char* rgba, size_t pixelCount)
+		{
+			const SrgbTables& tables = getSrgbTables();
+			for (size_t i = 0; i < pixelCount * 4; i += 4)
+			{
+				for (int c = 0; c < 3; c++)
+					rgba[i + c] = static_cast<unsigned char>(tables.encode[static_cast<int32_t>(clampUnit(linear[i + c]) * ENCODE_SCALE + 0.5f)]);
+				rgba[i + 3] = static_cast<unsigned char>(static_cast<int32_t>(clampUnit(linear[i + 3]) * 255.0f + 0.5f));
+			}
+		}
+
+#ifdef VULKAN_EXAMPLE_PIXEL_X86
+		//lambdas don't inherit the target of the function they are in, so the helpers of the kernels are functions of their own
+
+		//two 16 byte loads into the lanes of a 256 bit register
+		TARGET_AVX2 __m256i loadLanes(const unsigned char* low, const unsigned char* high)
+		{
+			return _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(low))),
+				_mm_loadu_si128(reinterpret_cast<const __m128i*>(high)), 1);
+		}
+
+		//c * a / 255 rounded of the 2 pixels in 16 bit lanes, alpha included (it is restored after)
+		TARGET_SSSE3 __m128i multiplyAlpha(__m128i pixels)
+		{
+			//the alpha of each pixel in all its lanes
+			const __m128i alphaShuffle = _mm_setr_epi8(6, 7, 6, 7, 6, 7, 6, 7, 14, 15, 14, 15, 14, 15, 14, 15);
+			__m128i t = _mm_add_epi16(_mm_mullo_epi16(pixels, _mm_shuffle_epi8(pixels, alphaShuffle)), _mm_set1_epi16(128));
+			return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+		}
+
+		TARGET_AVX2 __m256i multiplyAlpha(__m256i pixels)
+		{
+			const __m256i alphaShuffle = _mm256_broadcastsi128_si256(_mm_setr_epi8(6, 7, 6, 7, 6, 7, 6, 7, 14, 15, 14, 15, 14, 15, 14, 15));
+			__m256i t = _mm256_add_epi16(_mm256_mullo_epi16(pixels, _mm256_shuffle_epi8(pixels, alphaShuffle)), _mm256_set1_epi16(128));
+			return _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+		}
+
+		//16 pixels per iteration: three 16 byte loads realigned so each holds 4 whole pixels
+		TARGET_SSSE3 void expandRgbSsse3(const unsigned char* rgb, unsigned char* rgba, size_t pixelCount)
+		{
+			//4 RGB pixels (the low 12 bytes) to RGBA, alpha ORed in after
+			const __m128i shuffle = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+			const __m128i alpha = _mm_set1_epi32(static_cast<int>(ALPHA_MASK));
+			size_t i = 0;
+			for (; i + 16 <= pixelCount; i += 16)
+			{
+				const unsigned char* source = rgb + i * 3;
+				__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source));
+				__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + 16));
+				__m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + 32));
+				__m128i* target = reinterpret_cast<__m128i*>(rgba + i * 4);
+				_mm_storeu_si128(target + 0, _mm_or_si128(_mm_shuffle_epi8(a, shuffle), alpha));
+				_mm_storeu_si128(target + 1, _mm_or_si128(_mm_shuffle_epi8(_mm_alignr_epi8(b, a, 12), shuffle), alpha));
+				_mm_storeu_si128(target + 2, _mm_or_si128(_mm_shuffle_epi8(_mm_alignr_epi8(c, b, 8), shuffle), alpha));
+				_mm_storeu_si128(target + 3, _mm_or_si128(_mm_shuffle_epi8(_mm_srli_si128(c, 4), shuffle), alpha));
+			}
+			expandRgbScalar(rgb + i * 3, rgba + i * 4, pixelCount - i);
+		}
+
+		//16 pixels per iteration, each 256 bit register loaded with 4 pixels per lane. The last load reads 4 bytes past the 16
+		//pixels, so the final ones go through the SSSE3 loop
+		TARGET_AVX2 void expandRgbAvx2(const unsigned char* rgb, unsigned char* rgba, size_t pixelCount)
+		{
+			const __m256i shuffle = _mm256_broadcastsi128_si256(_mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1));
+			const __m256i alpha = _mm256_set1_epi32(static_cast<int>(ALPHA_MASK));
+			size_t i = 0;
+			for (; i + 18 <= pixelCount; i += 16)
+			{
+				const unsigned char* source = rgb + i * 3;
+				__m256i first = _mm256_shuffle_epi8(loadLanes(source, source + 12), shuffle);
+				__m256i second = _mm256_shuffle_epi8(loadLanes(source + 24, source + 36), shuffle);
+				__m256i* target = reinterpret_cast<__m256i*>(rgba + i * 4);
+				_mm256_storeu_si256(target + 0, _mm256_or_si256(first, alpha));
+				_mm256_storeu_si256(target + 1, _mm256_or_si256(second, alpha));
+			}
+			expandRgbSsse3(rgb + i * 3, rgba + i * 4, pixelCount - i);
+		}
+
+		//4 pixels per iteration in 16 bit lanes, blocks that are fully opaque are left alone
+		TARGET_SSSE3 void premultiplySsse3(unsigned char* rgba, size_t pixelCount)
+		{
+			const __m128i colorMask = _mm_set1_epi32(static_cast<int>(COLOR_MASK));
+			const __m128i ones = _mm_set1_epi32(-1);
+			const __m128i zero = _mm_setzero_si128();
+			size_t i = 0;
+			for (; i + 4 <= pixelCount; i += 4)
+			{
+				__m128i* pointer = reinterpret_cast<__m128i*>(rgba + i * 4);
+				__m128i v = _mm_loadu_si128(pointer);
+				if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_or_si128(v, colorMask), ones)) == 0xffff)
+					continue;
+				__m128i result = _mm_packus_epi16(multiplyAlpha(_mm_unpacklo_epi8(v, zero)), multiplyAlpha(_mm_unpackhi_epi8(v, zero)));
+				_mm_storeu_si128(pointer, _mm_or_si128(_mm_and_si128(result, colorMask), _mm_andnot_si128(colorMask, v)));
+			}
+			premultiplyScalar(rgba + i * 4, pixelCount - i, false);
+		}
+
+		TARGET_AVX2 void premultiplyAvx2(unsigned char* rgba, size_t pixelCount)
+		{
+			const __m256i colorMask = _mm256_set1_epi32(static_cast<int>(COLOR_MASK));
+			const __m256i ones = _mm256_set1_epi32(-1);
+			const __m256i zero = _mm256_setzero_si256();
+			size_t i = 0;
+			for (; i + 8 <= pixelCount; i += 8)
+			{
+				__m256i* pointer = reinterpret_cast<__m256i*>(rgba + i * 4);
+				__m256i v = _mm256_loadu_si256(pointer);
+				if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_or_si256(v, colorMask), ones)) == -1)
+					continue;
+				//unpacking and packing stay within each 128 bit lane, so the pixels keep their order
+				__m256i result = _mm256_packus_epi16(multiplyAlpha(_mm256_unpacklo_epi8(v, zero)), multiplyAlpha(_mm256_unpackhi_epi8(v, zero)));
+				_mm256_storeu_si256(pointer, _mm256_or_si256(_mm256_and_si256(result, colorMask), _mm256_andnot_si256(colorMask, v)));
+			}
+			premultiplySsse3(rgba + i * 4, pixelCount - i);
+		}
+
+		//8 pixels per iteration: each color channel is gathered from the decode table, scaled by alpha and gathered back from
+		//the encode table
+		TARGET_AVX2 void premultiplySrgbAvx2(unsigned char* rgba, size_t pixelCount)
+		{
+			const SrgbTables& tables = getSrgbTables();
+			const __m256i colorMask = _mm256_set1_epi32(static_cast<int>(COLOR_MASK));
+			const __m256i ones = _mm256_set1_epi32(-1);
+			const __m256i byteMask = _mm256_set1_epi32(0xff);
+			const __m256 toUnit = _mm256_set1_ps(1.0f / 255.0f);
+			const __m256 scale = _mm256_set1_ps(ENCODE_SCALE);
+			const __m256 half = _mm256_set1_ps(0.5f);
+			size_t i = 0;
+			for (; i + 8 <= pixelCount; i += 8)
+			{
+				__m256i* pointer = reinterpret_cast<__m256i*>(rgba + i * 4);
+				__m256i v = _mm256_loadu_si256(pointer);
+				if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_or_si256(v, colorMask), ones)) == -1)
+					continue;
+				__m256 alpha = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(v, 24)), toUnit);
+				__m256i result = _mm256_andnot_si256(colorMask, v);
+				for (int c = 0; c < 3; c++)
+				{
+					__m128i shift = _mm_cvtsi32_si128(c * 8);
+					__m256i index = _mm256_and_si256(_mm256_srl_epi32(v, shift), byteMask);
+					__m256 linear = _mm256_mul_ps(_mm256_i32gather_ps(tables.decode, index, 4), alpha);
+					__m256i encodeIndex = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(linear, scale), half));
+					result = _mm256_or_si256(result, _mm256_sll_epi32(_mm256_i32gather_epi32(tables.encode, encodeIndex, 4), shift));
+				}
+				_mm256_storeu_si256(pointer, result);
+			}
+			premultiplyScalar(rgba + i * 4, pixelCount - i, true);
+		}
+
+		//2 pixels per iteration, the color gathered from the table and alpha converted
+		TARGET_AVX2 void srgbToLinearAvx2(const unsigned char* rgba, float* linear, size_t pixelCount)
+		{
+			const SrgbTables& tables = getSrgbTables();
+			const __m256 toUnit = _mm256_set1_ps(1.0f / 255.0f);
+			size_t i = 0;
+			for (; i + 2 <= pixelCount; i += 2)
+			{
+				__m256i values = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(rgba + i * 4)));
+				__m256 color = _mm256_i32gather_ps(tables.decode, values, 4);
+				__m256 alpha = _mm256_mul_ps(_mm256_cvtepi32_ps(values), toUnit);
+				_mm256_storeu_ps(linear + i * 4, _mm256_blend_ps(color, alpha, 0x88));
+			}
+			srgbToLinearScalar(rgba + i * 4, linear + i * 4, pixelCount - i);
+		}
+
+		TARGET_AVX2 void linearToSrgbAvx2(const float* linear, unsigned char* rgba, size_t pixelCount)
+		{
+			const SrgbTables& tables = getSrgbTables();
+			const __m256 zero = _mm256_setzero_ps();
+			const __m256 one = _mm256_set1_ps(1.0f);
+			const __m256 scale = _mm256_set1_ps(ENCODE_SCALE);
+			const __m256 toByte = _mm256_set1_ps(255.0f);
+			const __m256 half = _mm256_set1_ps(0.5f);
+			size_t i = 0;
+			for (; i + 2 <= pixelCount; i += 2)
+			{
+				__m256 values = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(linear + i * 4), zero), one);
+				__m256i color = _mm256_i32gather_epi32(tables.encode, _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(values, scale), half)), 4);
+				__m256i alpha = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(values, toByte), half));
+				__m256i result = _mm256_blend_epi32(color, alpha, 0x88);
+				__m128i words = _mm_packus_epi32(_mm256_castsi256_si128(result), _mm256_extracti128_si256(result, 1));
+				_mm_storel_epi64(reinterpret_cast<__m128i*>(rgba + i * 4), _mm_packus_epi16(words, words));
+			}
+			linearToSrgbScalar(linear + i * 4, rgba + i * 4, pixelCount - i);
+		}
+#endif
+
+		//an unsupported kernel falls back to the best supported one, they are ordered by what they require
+		PixelKernel clampKernel(PixelKernel kernel)
+		{
+			return std::min(kernel, getPixelKernel());
+		}
+
+		void expandRgb(const unsigned char* rgb, unsigned char* rgba, size_t pixelCount, PixelKernel kernel)
+		{
+#ifdef VULKAN_EXAMPLE_PIXEL_X86
+			if (kernel == PixelKernel::Avx2)
+				return expandRgbAvx2(rgb, rgba, pixelCount);
+			if (kernel == PixelKernel::Ssse3)
+				return expandRgbSsse3(rgb, rgba, pixelCount);
+#endif
+			expandRgbScalar(rgb, rgba, pixelCount);
+		}
+
+		void premultiply(unsigned char* rgba, size_t pixelCount, bool srgb, PixelKernel kernel)
+		{
+#ifdef VULKAN_EXAMPLE_PIXEL_X86
+			//without gathers the table lookups of sRGB are scalar either way
+			if (kernel == PixelKernel::Avx2)
+				return srgb ? premultiplySrgbAvx2(rgba, pixelCount) : premultiplyAvx2(rgba, pixelCount);
+			if (kernel == PixelKernel::Ssse3 && !srgb)
+				return premultiplySsse3(rgba, pixelCount);
+#endif
+			premultiplyScalar(rgba, pixelCount, srgb);
+		}
+	}
+
+	PixelKernel getPixelKernel()
+	{
+		static const PixelKernel kernel = detectPixelKernel();
+		return kernel;
+	}
+
+	bool isPixelKernelSupported(PixelKernel kernel)
+	{
+		return kernel <= getPixelKernel();
+	}
+
+	const char* getPixelKernelName(PixelKernel kernel)
+	{
+		switch (kernel)
+		{
+		case PixelKernel::Avx2:
+			return "AVX2";
+		case PixelKernel::Ssse3:
+			return "SSSE3";
+		default:
+			return "scalar";
+		}
+	}
+
+	void convertToRgba(const unsigned char* source, uint32_t channels, unsigned char* target, size_t pixelCount,
+		const PixelConversion& conversion, PixelKernel kernel)
+	{
+		kernel = clampKernel(kernel);
+		if (channels == 3)
+		{
+			//opaque, premultiplying changes nothing
+			expandRgb(source, target, pixelCount, kernel);
+			return;
+		}
+		if (channels != 4)
+			throw std::runtime_error("failed to convert pixels with " + std::to_string(channels) + " channels!");
+
+		if (!conversion.premultiplyAlpha)
+		{
+			std::memcpy(target, source, pixelCount * 4);
+			return;
+		}
+		alignas(32) unsigned char block[BLOCK_PIXELS * 4];
+		for (size_t i = 0; i < pixelCount; i += BLOCK_PIXELS)
+		{
+			size_t count = std::min(BLOCK_PIXELS, pixelCount - i);
+			std::memcpy(block, source + i * 4, count * 4);
+			premultiply(block, count, conversion.srgb, kernel);
+			std::memcpy(target + i * 4, block, count * 4);
+		}
+	}
+
+	void srgbToLinear(const unsigned char* rgba, float* linear, size_t pixelCount, PixelKernel kernel)
+	{
+#ifdef VULKAN_EXAMPLE_PIXEL_X86
+		if (clampKernel(kernel) == PixelKernel::Avx2)
+			return srgbToLinearAvx2(rgba, linear, pixelCount);
+#endif
+		srgbToLinearScalar(rgba, linear, pixelCount);
+	}
+
+	void linearToSrgb(const float* linear, unsigned char* rgba, size_t pixelCount, PixelKernel kernel)
+	{
+#ifdef VULKAN_EXAMPLE_PIXEL_X86
+		if (clampKernel(kernel) == PixelKernel::Avx2)
+			return linearToSrgbAvx2(linear, rgba, pixelCount);
+#endif
+		linearToSrgbScalar(linear, rgba, pixelCount);
+	}
+
+	void downsampleBox(const unsigned char* source, uint32_t width, uint32_t height, uint32_t channels, uint32_t factor,
+		unsigned char* target, PixelKernel kernel)
+	{
+		uint32_t targetWidth = (width + factor - 1) / factor;
+		uint32_t targetHeight = (height + factor - 1) / factor;
+		const PixelConversion conversion;
+		std::vector<unsigned char> rgba(static_cast<size_t>(width) * 4);
+		std::vector<float> linear(static_cast<size_t>(width) * 4);
+		std::vector<float> sums(static_cast<size_t>(targetWidth) * 4);
+		std::vector<unsigned char> averages(static_cast<size_t>(targetWidth) * 4);
+		for (uint32_t targetY = 0; targetY < targetHeight; targetY++)
+		{
+			//one source row at a time through the same conversions as the staging buffer
+			uint32_t firstY = targetY * factor;
+			uint32_t lastY = std::min(height, firstY + factor);
+			std::fill(sums.begin(), sums.end(), 0.0f);
+			for (uint32_t y = firstY; y < lastY; y++)
+			{
+				convertToRgba(source + static_cast<size_t>(y) * width * channels, channels, rgba.data(), width, conversion, kernel);
+				srgbToLinear(rgba.data(), linear.data(), width, kernel);
+				for (uint32_t targetX = 0; targetX < targetWidth; targetX++)
+				{
+					float* sum = &sums[targetX * 4];
+					uint32_t lastX = std::min(width, (targetX + 1) * factor);
+					for (uint32_t x = targetX * factor; x < lastX; x++)
+					{
+						for (uint32_t c = 0; c < 4; c++)
+							sum[c] += linear[x * 4 + c];
+					}
+				}
+			}
+			for (uint32_t targetX = 0; targetX < targetWidth; targetX++)
+			{
+				uint32_t columns = std::min(width, (targetX + 1) * factor) - targetX * factor;
+				float scale = 1.0f / static_cast<float>(columns * (lastY - firstY));
+				for (uint32_t c = 0; c < 4; c++)
+					sums[targetX * 4 + c] *= scale;
+			}
+			linearToSrgb(sums.data(), averages.data(), targetWidth, kernel);
+
+			unsigned char* row = target + static_cast<size_t>(targetY) * targetWidth * channels;
+			if (channels == 4)
+				std::memcpy(row, averages.data(), averages.size());
+			else
+			{
+				for (uint32_t targetX = 0; targetX < targetWidth; targetX++)
+					std::memcpy(row + targetX * 3, &averages[targetX * 4], 3);
+			}
+		}
+	}
+}
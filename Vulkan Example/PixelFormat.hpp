@@ -0,0 +1,44 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+namespace vulkanExample
+{
+	// Instruction sets the pixel conversions are written for. The best one the CPU supports is detected once and used unless
+	// another one is asked for (the benchmarks compare them)
+	enum class PixelKernel
+	{
+		Scalar,
+		Ssse3,
+		Avx2
+	};
+
+	PixelKernel getPixelKernel();
+	bool isPixelKernelSupported(PixelKernel kernel);
+	const char* getPixelKernelName(PixelKernel kernel);
+
+	// What is done to decoded pixels on their way to the RGBA8 staging buffer
+	struct PixelConversion
+	{
+		//multiplies the color by alpha, for materials blended with VK_BLEND_FACTOR_ONE
+		bool premultiplyAlpha = false;
+		//the color is sRGB encoded (VK_FORMAT_R8G8B8A8_SRGB), so it is premultiplied in linear space
+		bool srgb = true;
+	};
+
+	//RGB (3 channels) or RGBA (4 channels) pixels to RGBA8, alpha 255 for RGB. target is written once and in order, so it
+	//may be a mapping of write-combined memory
+	void convertToRgba(const unsigned char* source, uint32_t channels, unsigned char* target, size_t pixelCount,
+		const PixelConversion& conversion, PixelKernel kernel = getPixelKernel());
+
+	//RGBA8 with sRGB encoded color to linear floats, alpha divided by 255
+	void srgbToLinear(const unsigned char* rgba, float* linear, size_t pixelCount, PixelKernel kernel = getPixelKernel());
+	//linear RGBA floats to RGBA8 with sRGB encoded color, clamped to [0, 1]
+	void linearToSrgb(const float* linear, unsigned char* rgba, size_t pixelCount, PixelKernel kernel = getPixelKernel());
+
+	//averages the factor x factor blocks of RGB or RGBA pixels in linear space, like the blits that make the mip levels, to
+	//ceil(width / factor) x ceil(height / factor) pixels with the same channels. Blocks cut by the right or bottom edge
+	//average the pixels they have
+	void downsampleBox(const unsigned char* source, uint32_t width, uint32_t height, uint32_t channels, uint32_t factor,
+		unsigned char* target, PixelKernel kernel = getPixelKernel());
+}
@@ -0,0 +1,55 @@
+#include "PlatformUtils.hpp"
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#endif
+#include <cstdlib>
+
+namespace vulkanExample
+{
+	double getProcessCpuTime()
+	{
+#ifdef _WIN32
+		FILETIME creationTime, exitTime, kernelTime, userTime;
+		if (!GetProcessTimes(GetCurrentProcess(), &creationTime, &exitTime, &kernelTime, &userTime))
+			return 0.0;
+
+		//FILETIME is expressed in 100 nanoseconds units
+		auto toSeconds = [](const FILETIME& time) {
+			ULARGE_INTEGER value;
+			value.LowPart = time.dwLowDateTime;
+			value.HighPart = time.dwHighDateTime;
+			return static_cast<double>(value.QuadPart) * 1e-7;
+		};
+		return toSeconds(kernelTime) + toSeconds(userTime);
+#else
+		rusage usage{};
+		if (getrusage(RUSAGE_SELF, &usage) != 0)
+			return 0.0;
+
+		return static_cast<double>(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) +
+			static_cast<double>(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1e-6;
+#endif
+	}
+
+	std::string getEnvironmentVariable(const char* name)
+	{
+#ifdef _WIN32
+		//getenv is deprecated (and an error with SDL checks) on MSVC
+		char* buffer = nullptr;
+		size_t size = 0;
+		if (_dupenv_s(&buffer, &size, name) != 0 || buffer == nullptr)
+			return {};
+		std::string value(buffer);
+		std::free(buffer);
+		return value;
+#else
+		const char* value = std::getenv(name);
+		return value != nullptr ? value : std::string();
+#endif
+	}
+}
@@ -0,0 +1,11 @@
+#pragma once
+#include <string>
+
+namespace vulkanExample
+{
+	// CPU time (user + kernel) consumed by the whole process so far, in seconds
+	double getProcessCpuTime();
+
+	// Value of an environment variable, empty if it isn't set
+	std::string getEnvironmentVariable(const char* name);
+}
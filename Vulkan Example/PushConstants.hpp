@@ -0,0 +1,14 @@
+#pragma once
+#include <glm/glm.hpp>
+
+namespace vulkanExample
+{
+	// Per draw constants. Layout must match the push_constant blocks in the shaders
+	struct PushConstants
+	{
+		//proj * view * model, multiplied once per draw on the CPU. Vertex shader, offset 0
+		glm::mat4 mvp;
+		//texture table index of the draw. Fragment shader, offset 64
+		uint32_t materialIndex;
+	};
+}
@@ -7,6 +7,9 @@ namespace vulkanExample
 	{
 		std::optional<uint32_t> graphicsFamily;
 		std::optional<uint32_t> presentFamily;
+		//families without graphics, only set if the device has them. Their queues run next to the graphics queue
+		std::optional<uint32_t> transferFamily;
+		std::optional<uint32_t> computeFamily;
 
 		bool isValid() {
 			return graphicsFamily.has_value() && presentFamily.has_value();
@@ -0,0 +1,678 @@
+#include "RenderGraph.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+namespace vulkanExample
+{
+	namespace
+	{
+		//only writes have to be made available, reads just need an execution dependency
+		constexpr VkAccessFlags WRITE_ACCESS = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+			VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_HOST_WRITE_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+
+		const char* layoutName(VkImageLayout layout)
+		{
+			switch (layout)
+			{
+			case VK_IMAGE_LAYOUT_UNDEFINED: return "undefined";
+			case VK_IMAGE_LAYOUT_GENERAL: return "general";
+			case VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL: return "color attachment";
+			case VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL: return "depth attachment";
+			case VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL: return "depth read only";
+			case VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL: return "shader read only";
+			case VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL: return "transfer src";
+			case VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL: return "transfer dst";
+			case VK_IMAGE_LAYOUT_PRESENT_SRC_KHR: return "present";
+			default: return "other";
+			}
+		}
+	}
+
+	AccessInfo getAccessInfo(ResourceAccess access)
+	{
+		switch (access)
+		{
+		case ResourceAccess::ColorAttachment:
+			return { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+				VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, false, true };
+		case ResourceAccess::DepthAttachment:
+			return { VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+				VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+				VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, false, true };
+		case ResourceAccess::ColorAttachmentLoad:
+			return { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+				VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, true, true };
+		case ResourceAccess::DepthAttachmentLoad:
+			return { VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+				VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+				VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, true, true };
+		case ResourceAccess::DepthReadOnly:
+			return { VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT,
+				VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, true, false };
+		case ResourceAccess::FragmentSampled:
+			return { VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, true, false };
+		case ResourceAccess::ComputeSampled:
+			return { VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, true, false };
+		case ResourceAccess::ComputeStorageRead:
+			return { VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_GENERAL, true, false };
+		case ResourceAccess::ComputeStorageWrite:
+			return { VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL, false, true };
+		case ResourceAccess::ComputeStorageReadWrite:
+			return { VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL, true, true };
+		case ResourceAccess::TransferRead:
+			return { VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, true, false };
+		case ResourceAccess::TransferWrite:
+			return { VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, false, true };
+		case ResourceAccess::Present:
+			//the presentation engine waits on a semaphore, the barrier only has to do the layout transition
+			return { VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, true, false };
+		}
+		throw std::invalid_argument("unknown resource access!");
+	}
+
+	AccessInfo getLayoutAccessInfo(VkImageLayout layout)
+	{
+		switch (layout)
+		{
+		case VK_IMAGE_LAYOUT_UNDEFINED:
+			return { VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0, layout, false, false };
+		case VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL:
+			return getAccessInfo(ResourceAccess::ColorAttachment);
+		case VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL:
+			return getAccessInfo(ResourceAccess::DepthAttachment);
+		case VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL:
+			return getAccessInfo(ResourceAccess::DepthReadOnly);
+		case VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL:
+			return getAccessInfo(ResourceAccess::FragmentSampled);
+		case VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL:
+			return getAccessInfo(ResourceAccess::TransferRead);
+		case VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL:
+			return getAccessInfo(ResourceAccess::TransferWrite);
+		case VK_IMAGE_LAYOUT_PRESENT_SRC_KHR:
+			return getAccessInfo(ResourceAccess::Present);
+		default:
+			//general and anything uncommon: assume the worst
+			return { VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT, layout, true, true };
+		}
+	}
+
+	uint32_t RenderGraph::addTransientImage(const std::string& name, const ImageDesc& desc)
+	{
+		Resource resource;
+		resource.name = name;
+		resource.desc = desc;
+		resources.push_back(resource);
+		return static_cast<uint32_t>(resources.size() - 1);
+	}
+
+	uint32_t RenderGraph::importImage(const std::string& name, const ImageDesc& desc, VkImageLayout initialLayout,
+		VkPipelineStageFlags initialStages, std::optional<ResourceAccess> finalAccess)
+	{
+		Resource resource;
+		resource.name = name;
+		resource.desc = desc;
+		resource.imported = true;
+		resource.initialLayout = initialLayout;
+		resource.initialStages = initialStages;
+		resource.finalAccess = finalAccess;
+		resources.push_back(resource);
+		return static_cast<uint32_t>(resources.size() - 1);
+	}
+
+	uint32_t RenderGraph::addPass(const std::string& name, const std::vector<ResourceUse>& uses, Execute execute, bool sideEffects)
+	{
+		for (size_t i = 0; i < uses.size(); i++)
+		{
+			if (uses[i].resource >= resources.size())
+				throw std::invalid_argument("pass " + name + " uses an unknown resource!");
+			for (size_t j = 0; j < i; j++)
+			{
+				//one layout per image and pass
+				if (uses[j].resource == uses[i].resource)
+					throw std::invalid_argument("pass " + name + " uses " + resources[uses[i].resource].name + " twice!");
+			}
+		}
+
+		Pass pass;
+		pass.name = name;
+		pass.uses = uses;
+		pass.execute = std::move(execute);
+		pass.sideEffects = sideEffects;
+		passes.push_back(std::move(pass));
+		return static_cast<uint32_t>(passes.size() - 1);
+	}
+
+	void RenderGraph::compile()
+	{
+		stats = Stats{};
+		finalBarriers = BarrierBatch{};
+		slots.clear();
+		for (Pass& pass : passes)
+		{
+			pass.culled = false;
+			pass.barriers = BarrierBatch{};
+		}
+		for (Resource& resource : resources)
+		{
+			resource.firstUse = UINT32_MAX;
+			resource.lastUse = 0;
+			resource.slot = UINT32_MAX;
+		}
+
+		cullPasses();
+
+		for (uint32_t passIndex = 0; passIndex < passes.size(); passIndex++)
+		{
+			if (passes[passIndex].culled)
+				continue;
+			for (const ResourceUse& use : passes[passIndex].uses)
+			{
+				Resource& resource = resources[use.resource];
+				resource.firstUse = std::min(resource.firstUse, passIndex);
+				resource.lastUse = std::max(resource.lastUse, passIndex);
+			}
+		}
+
+		assignMemorySlots();
+		scheduleBarriers();
+
+		for (const Pass& pass : passes)
+		{
+			if (pass.culled)
+			{
+				stats.culledPasses++;
+				continue;
+			}
+			stats.passes++;
+			if (!pass.barriers.barriers.empty())
+				stats.barrierBatches++;
+			stats.imageBarriers += static_cast<uint32_t>(pass.barriers.barriers.size());
+		}
+		if (!finalBarriers.barriers.empty())
+			stats.barrierBatches++;
+		stats.imageBarriers += static_cast<uint32_t>(finalBarriers.barriers.size());
+	}
+
+	void RenderGraph::cullPasses()
+	{
+		//walks the passes backwards: a pass is needed if it writes something a later needed pass reads, or an output
+		std::vector<bool> needed(resources.size(), false);
+		for (size_t i = 0; i < resources.size(); i++)
+			needed[i] = resources[i].finalAccess.has_value();
+
+		for (size_t i = passes.size(); i-- > 0;)
+		{
+			Pass& pass = passes[i];
+			bool keep = pass.sideEffects;
+			for (const ResourceUse& use : pass.uses)
+			{
+				if (getAccessInfo(use.access).write && needed[use.resource])
+					keep = true;
+			}
+
+			pass.culled = !keep;
+			if (!keep)
+				continue;
+
+			//a pure write replaces the contents, so earlier writers of the resource are only needed if someone reads them before
+			for (const ResourceUse& use : pass.uses)
+			{
+				AccessInfo info = getAccessInfo(use.access);
+				if (info.write && !info.read)
+					needed[use.resource] = false;
+			}
+			for (const ResourceUse& use : pass.uses)
+			{
+				if (getAccessInfo(use.access).read)
+					needed[use.resource] = true;
+			}
+		}
+	}
+
+	void RenderGraph::assignMemorySlots()
+	{
+		std::vector<uint32_t> transients;
+		for (uint32_t i = 0; i < resources.size(); i++)
+		{
+			if (!resources[i].imported && resources[i].firstUse != UINT32_MAX)
+				transients.push_back(i);
+		}
+		std::stable_sort(transients.begin(), transients.end(), [this](uint32_t a, uint32_t b) {
+			return resources[a].firstUse < resources[b].firstUse;
+		});
+
+		//first fit: a slot is free once its last image was used for the last time before this one starts
+		for (uint32_t index : transients)
+		{
+			Resource& resource = resources[index];
+			for (uint32_t slot = 0; slot < slots.size(); slot++)
+			{
+				if (resources[slots[slot].resources.back()].lastUse < resource.firstUse)
+				{
+					resource.slot = slot;
+					break;
+				}
+			}
+			if (resource.slot == UINT32_MAX)
+			{
+				resource.slot = static_cast<uint32_t>(slots.size());
+				slots.emplace_back();
+			}
+			slots[resource.slot].resources.push_back(index);
+		}
+		stats.transientImages = static_cast<uint32_t>(transients.size());
+	}
+
+	void RenderGraph::scheduleBarriers()
+	{
+		// Synchronization state of an image while walking the passes
+		struct State
+		{
+			bool used = false;
+			VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+			//last write, and the stages that read since then
+			VkPipelineStageFlags writeStages = 0;
+			VkAccessFlags writeAccess = 0;
+			VkPipelineStageFlags readStages = 0;
+			//stages the last write was already made visible to
+			VkPipelineStageFlags visibleStages = 0;
+		};
+		std::vector<State> states(resources.size());
+
+		// First use of a transient image. Its source scope is the previous image of its memory slot, only known at the end
+		struct FirstUse
+		{
+			uint32_t pass;
+			size_t barrier;
+		};
+		std::vector<FirstUse> firstUses;
+
+		for (uint32_t passIndex = 0; passIndex < passes.size(); passIndex++)
+		{
+			Pass& pass = passes[passIndex];
+			if (pass.culled)
+				continue;
+
+			for (const ResourceUse& use : pass.uses)
+			{
+				const Resource& resource = resources[use.resource];
+				State& state = states[use.resource];
+				AccessInfo info = getAccessInfo(use.access);
+
+				Barrier barrier{ use.resource, state.layout, info.layout, 0, info.stages, 0, info.access };
+				bool needsBarrier = false;
+				bool firstUse = !state.used;
+
+				if (firstUse)
+				{
+					if (resource.imported)
+					{
+						barrier.oldLayout = resource.initialLayout;
+						barrier.srcStages = resource.initialStages;
+						needsBarrier = barrier.oldLayout != barrier.newLayout || resource.initialStages != 0;
+					}
+					else
+					{
+						//the contents of a transient image are never kept, whatever used the memory before
+						barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+						needsBarrier = true;
+					}
+				}
+				else
+				{
+					bool layoutChange = state.layout != info.layout;
+					if (info.write || layoutChange)
+					{
+						//write after write/read, or a layout transition, which is a write too
+						needsBarrier = layoutChange || state.writeStages != 0 || state.readStages != 0;
+						barrier.srcStages = state.writeStages | state.readStages;
+						barrier.srcAccess = state.writeAccess;
+					}
+					else if (state.writeStages != 0 && (info.stages & ~state.visibleStages) != 0)
+					{
+						//read after write from a stage the write isn't visible to yet
+						needsBarrier = true;
+						barrier.srcStages = state.writeStages;
+						barrier.srcAccess = state.writeAccess;
+					}
+				}
+
+				if (needsBarrier)
+				{
+					if (firstUse && !resource.imported)
+						firstUses.push_back({ passIndex, pass.barriers.barriers.size() });
+					pass.barriers.barriers.push_back(barrier);
+				}
+
+				bool transitioned = needsBarrier && barrier.oldLayout != barrier.newLayout;
+				state.used = true;
+				state.layout = info.layout;
+				if (info.write)
+				{
+					state.writeStages = info.stages;
+					state.writeAccess = info.access & WRITE_ACCESS;
+					state.readStages = 0;
+					state.visibleStages = 0;
+				}
+				else if (transitioned)
+				{
+					//later readers in other stages have to wait for the transition
+					state.writeStages = info.stages;
+					state.writeAccess = 0;
+					state.readStages = info.stages;
+					state.visibleStages = info.stages;
+				}
+				else
+				{
+					state.readStages |= info.stages;
+					if (needsBarrier)
+						state.visibleStages |= info.stages;
+				}
+			}
+		}
+
+		for (size_t i = 0; i < resources.size(); i++)
+		{
+			resources[i].endStages = states[i].writeStages | states[i].readStages;
+			resources[i].endAccess = states[i].writeAccess;
+		}
+
+		//a transient image waits for the previous image of its slot in this frame. The first one of the slot waits for the last one,
+		//used by the previous frame, which is earlier in submission order
+		for (const FirstUse& firstUse : firstUses)
+		{
+			Barrier& barrier = passes[firstUse.pass].barriers.barriers[firstUse.barrier];
+			const MemorySlot& slot = slots[resources[barrier.resource].slot];
+			auto position = std::find(slot.resources.begin(), slot.resources.end(), barrier.resource);
+			uint32_t previous = position == slot.resources.begin() ? slot.resources.back() : *(position - 1);
+			barrier.srcStages = resources[previous].endStages;
+			barrier.srcAccess = resources[previous].endAccess;
+		}
+
+		for (size_t i = 0; i < resources.size(); i++)
+		{
+			const Resource& resource = resources[i];
+			const State& state = states[i];
+			if (!resource.finalAccess.has_value() || !state.used)
+				continue;
+
+			AccessInfo info = getAccessInfo(resource.finalAccess.value());
+			if (state.layout == info.layout && state.writeStages == 0)
+				continue;
+			finalBarriers.barriers.push_back({ static_cast<uint32_t>(i), state.layout, info.layout,
+				resource.endStages, info.stages, resource.endAccess, info.access });
+		}
+
+		//one vkCmdPipelineBarrier per batch, waiting for the union of the source stages
+		auto mergeStages = [](BarrierBatch& batch) {
+			for (const Barrier& barrier : batch.barriers)
+			{
+				batch.srcStages |= barrier.srcStages;
+				batch.dstStages |= barrier.dstStages;
+			}
+			if (batch.srcStages == 0)
+				batch.srcStages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+			if (batch.dstStages == 0)
+				batch.dstStages = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+		};
+		for (Pass& pass : passes)
+		{
+			if (!pass.barriers.barriers.empty())
+				mergeStages(pass.barriers);
+		}
+		if (!finalBarriers.barriers.empty())
+			mergeStages(finalBarriers);
+	}
+
+	void RenderGraph::realize(VkDevice device, const MemoryTypeFinder& findMemoryType)
+	{
+		this->device = device;
+		blocks.clear();
+		heaps.clear();
+
+		for (const MemorySlot& slot : slots)
+		{
+			size_t firstBlock = blocks.size();
+			for (uint32_t index : slot.resources)
+			{
+				Resource& resource = resources[index];
+
+				VkImageCreateInfo imageInfo{};
+				imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+				imageInfo.imageType = VK_IMAGE_TYPE_2D;
+				imageInfo.extent = { resource.desc.extent.width, resource.desc.extent.height, 1 };
+				imageInfo.mipLevels = 1;
+				imageInfo.arrayLayers = 1;
+				imageInfo.format = resource.desc.format;
+				imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+				imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+				imageInfo.usage = resource.desc.usage;
+				imageInfo.samples = resource.desc.samples;
+				imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+				if (vkCreateImage(device, &imageInfo, nullptr, &resource.image) != VK_SUCCESS)
+					throw std::runtime_error("failed to create render graph image " + resource.name + "!");
+
+				VkMemoryRequirements requirements;
+				vkGetImageMemoryRequirements(device, resource.image, &requirements);
+				stats.requestedBytes += requirements.size;
+
+				//images of a slot share a block unless their memory types are incompatible.
+				//Lazily allocated memory only takes transient attachments, so those are kept apart from the others
+				bool transientAttachment = (resource.desc.usage & VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT) != 0;
+				size_t blockIndex = firstBlock;
+				while (blockIndex < blocks.size() && ((blocks[blockIndex].typeBits & requirements.memoryTypeBits) == 0
+					|| blocks[blockIndex].transientAttachments != transientAttachment))
+					blockIndex++;
+				if (blockIndex == blocks.size())
+				{
+					blocks.emplace_back();
+					blocks.back().transientAttachments = transientAttachment;
+				}
+
+				MemoryBlock& block = blocks[blockIndex];
+				block.size = std::max(block.size, requirements.size);
+				block.alignment = std::max(block.alignment, requirements.alignment);
+				block.typeBits &= requirements.memoryTypeBits;
+				block.resources.push_back(index);
+			}
+		}
+
+		//blocks of the same memory type go one after the other into a heap, so the frame needs one allocation per type
+		for (uint32_t blockIndex = 0; blockIndex < blocks.size(); blockIndex++)
+		{
+			MemoryBlock& block = blocks[blockIndex];
+			std::optional<uint32_t> memoryType;
+			bool lazy = false;
+			if (block.transientAttachments)
+			{
+				memoryType = findMemoryType(block.typeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT);
+				lazy = memoryType.has_value();
+			}
+			if (!memoryType.has_value())
+				memoryType = findMemoryType(block.typeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+			if (!memoryType.has_value())
+				throw std::runtime_error("failed to find a memory type for the render graph images!");
+
+			auto heap = std::find_if(heaps.begin(), heaps.end(), [&](const TransientHeap& candidate) {
+				return candidate.memoryType == memoryType.value();
+			});
+			if (heap == heaps.end())
+			{
+				heaps.push_back({ VK_NULL_HANDLE, 0, memoryType.value(), lazy });
+				heap = heaps.end() - 1;
+			}
+
+			block.heap = static_cast<uint32_t>(heap - heaps.begin());
+			block.offset = (heap->size + block.alignment - 1) / block.alignment * block.alignment;
+			heap->size = block.offset + block.size;
+		}
+
+		for (TransientHeap& heap : heaps)
+		{
+			VkMemoryAllocateInfo allocInfo{};
+			allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+			allocInfo.allocationSize = heap.size;
+			allocInfo.memoryTypeIndex = heap.memoryType;
+
+			if (vkAllocateMemory(device, &allocInfo, nullptr, &heap.memory) != VK_SUCCESS)
+				throw std::runtime_error("failed to allocate render graph memory!");
+			if (heap.lazy)
+				stats.lazyBytes += heap.size;
+			else
+				stats.allocatedBytes += heap.size;
+		}
+
+		for (const MemoryBlock& block : blocks)
+		{
+			for (uint32_t index : block.resources)
+			{
+				Resource& resource = resources[index];
+				vkBindImageMemory(device, resource.image, heaps[block.heap].memory, block.offset);
+
+				//views of depth/stencil images only see the depth
+				VkImageAspectFlags viewAspect = (resource.desc.aspect & VK_IMAGE_ASPECT_DEPTH_BIT) ? static_cast<VkImageAspectFlags>(VK_IMAGE_ASPECT_DEPTH_BIT) : resource.desc.aspect;
+				VkImageViewCreateInfo viewInfo{};
+				viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+				viewInfo.image = resource.image;
+				viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+				viewInfo.format = resource.desc.format;
+				viewInfo.subresourceRange = { viewAspect, 0, 1, 0, 1 };
+
+				if (vkCreateImageView(device, &viewInfo, nullptr, &resource.view) != VK_SUCCESS)
+					throw std::runtime_error("failed to create render graph image view " + resource.name + "!");
+			}
+		}
+		stats.memoryBlocks = static_cast<uint32_t>(blocks.size());
+		stats.heaps = static_cast<uint32_t>(heaps.size());
+	}
+
+	void RenderGraph::reset()
+	{
+		if (device != VK_NULL_HANDLE)
+		{
+			for (Resource& resource : resources)
+			{
+				if (resource.imported)
+					continue;
+				if (resource.view != VK_NULL_HANDLE)
+					vkDestroyImageView(device, resource.view, nullptr);
+				if (resource.image != VK_NULL_HANDLE)
+					vkDestroyImage(device, resource.image, nullptr);
+			}
+			for (TransientHeap& heap : heaps)
+				vkFreeMemory(device, heap.memory, nullptr);
+		}
+
+		resources.clear();
+		passes.clear();
+		slots.clear();
+		blocks.clear();
+		heaps.clear();
+		finalBarriers = BarrierBatch{};
+		stats = Stats{};
+		device = VK_NULL_HANDLE;
+	}
+
+	VkDeviceSize RenderGraph::getCommittedLazyBytes() const
+	{
+		VkDeviceSize committed = 0;
+		for (const TransientHeap& heap : heaps)
+		{
+			if (!heap.lazy)
+				continue;
+			VkDeviceSize heapCommitted = 0;
+			vkGetDeviceMemoryCommitment(device, heap.memory, &heapCommitted);
+			committed += heapCommitted;
+		}
+		return committed;
+	}
+
+	void RenderGraph::printMemoryReport(std::ostream& out) const
+	{
+		constexpr double MB = 1024.0 * 1024.0;
+		//lazily allocated memory counts as saved until the device commits it
+		VkDeviceSize saved = stats.requestedBytes - std::min(stats.requestedBytes, stats.allocatedBytes);
+		out << "Transient attachments: " << stats.transientImages << " images, " << stats.requestedBytes / MB << " MB requested, "
+			<< stats.allocatedBytes / MB << " MB allocated in " << stats.heaps << " heaps";
+		if (stats.lazyBytes > 0)
+			out << " + " << stats.lazyBytes / MB << " MB lazily allocated";
+		out << ", " << saved / MB << " MB saved" << std::endl;
+	}
+
+	void RenderGraph::setImportedImage(uint32_t resource, VkImage image, VkImageView view)
+	{
+		if (!resources[resource].imported)
+			throw std::invalid_argument("only imported images can be replaced!");
+		resources[resource].image = image;
+		resources[resource].view = view;
+	}
+
+	void RenderGraph::execute(VkCommandBuffer commandBuffer) const
+	{
+		for (const Pass& pass : passes)
+		{
+			if (pass.culled)
+				continue;
+			recordBarriers(commandBuffer, pass.barriers);
+			if (pass.execute)
+				pass.execute(commandBuffer);
+		}
+		recordBarriers(commandBuffer, finalBarriers);
+	}
+
+	void RenderGraph::recordBarriers(VkCommandBuffer commandBuffer, const BarrierBatch& batch) const
+	{
+		if (batch.barriers.empty())
+			return;
+
+		std::vector<VkImageMemoryBarrier> imageBarriers;
+		imageBarriers.reserve(batch.barriers.size());
+		for (const Barrier& barrier : batch.barriers)
+		{
+			const Resource& resource = resources[barrier.resource];
+			VkImageMemoryBarrier imageBarrier{};
+			imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			imageBarrier.srcAccessMask = barrier.srcAccess;
+			imageBarrier.dstAccessMask = barrier.dstAccess;
+			imageBarrier.oldLayout = barrier.oldLayout;
+			imageBarrier.newLayout = barrier.newLayout;
+			imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			imageBarrier.image = resource.image;
+			imageBarrier.subresourceRange = { resource.desc.aspect, 0, 1, 0, 1 };
+			imageBarriers.push_back(imageBarrier);
+		}
+
+		vkCmdPipelineBarrier(commandBuffer, batch.srcStages, batch.dstStages, 0, 0, nullptr, 0, nullptr,
+			static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+	}
+
+	void RenderGraph::printSchedule(std::ostream& out) const
+	{
+		out << "Render graph: " << stats.passes << " passes (" << stats.culledPasses << " culled), "
+			<< stats.imageBarriers << " image barriers in " << stats.barrierBatches << " batches, "
+			<< stats.transientImages << " transient images in " << slots.size() << " memory slots" << std::endl;
+		for (const Pass& pass : passes)
+		{
+			out << "  " << pass.name << (pass.culled ? " (culled)" : "") << std::endl;
+			if (!pass.culled)
+				printBatch(out, pass.barriers);
+		}
+		if (!finalBarriers.barriers.empty())
+		{
+			out << "  end of frame" << std::endl;
+			printBatch(out, finalBarriers);
+		}
+	}
+
+	void RenderGraph::printBatch(std::ostream& out, const BarrierBatch& batch) const
+	{
+		for (const Barrier& barrier : batch.barriers)
+		{
+			out << "    " << resources[barrier.resource].name << ": " << layoutName(barrier.oldLayout) << " -> " << layoutName(barrier.newLayout)
+				<< std::hex << " (stages 0x" << barrier.srcStages << " -> 0x" << barrier.dstStages
+				<< ", access 0x" << barrier.srcAccess << " -> 0x" << barrier.dstAccess << ")" << std::dec << std::endl;
+		}
+	}
+}
@@ -0,0 +1,224 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace vulkanExample
+{
+	// How a pass uses an image. Decides the layout, the pipeline stages and the memory accesses of its barriers
+	enum class ResourceAccess : uint32_t
+	{
+		//attachments written from scratch (cleared or fully overwritten), so their previous contents aren't needed
+		ColorAttachment,
+		DepthAttachment,
+		//attachments whose previous contents are loaded and drawn on top of
+		ColorAttachmentLoad,
+		DepthAttachmentLoad,
+		//depth test without depth writes
+		DepthReadOnly,
+		FragmentSampled,
+		ComputeSampled,
+		ComputeStorageRead,
+		ComputeStorageWrite,
+		ComputeStorageReadWrite,
+		TransferRead,
+		TransferWrite,
+		Present
+	};
+
+	struct AccessInfo
+	{
+		VkPipelineStageFlags stages;
+		VkAccessFlags access;
+		VkImageLayout layout;
+		bool read;
+		bool write;
+	};
+
+	AccessInfo getAccessInfo(ResourceAccess access);
+	//stages and accesses that use an image in the layout, for one-off transitions outside of the graph
+	AccessInfo getLayoutAccessInfo(VkImageLayout layout);
+
+	// Frame graph: passes declare which images they read and write, and the graph derives everything in between.
+	// compile() drops the passes whose results nobody uses, schedules the barriers (one vkCmdPipelineBarrier per pass at most,
+	// only where a layout changes or a hazard exists) and lets transient images with disjoint lifetimes share memory.
+	// Compiling is CPU only, so the schedule can be inspected without a device
+	class RenderGraph
+	{
+	public:
+		struct ImageDesc
+		{
+			VkFormat format;
+			VkExtent2D extent;
+			VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+			VkImageUsageFlags usage = 0;
+			VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+		};
+
+		struct ResourceUse
+		{
+			uint32_t resource;
+			ResourceAccess access;
+		};
+
+		struct Barrier
+		{
+			uint32_t resource;
+			VkImageLayout oldLayout;
+			VkImageLayout newLayout;
+			VkPipelineStageFlags srcStages;
+			VkPipelineStageFlags dstStages;
+			VkAccessFlags srcAccess;
+			VkAccessFlags dstAccess;
+		};
+
+		// Barriers recorded with a single vkCmdPipelineBarrier
+		struct BarrierBatch
+		{
+			VkPipelineStageFlags srcStages = 0;
+			VkPipelineStageFlags dstStages = 0;
+			std::vector<Barrier> barriers;
+		};
+
+		struct Stats
+		{
+			uint32_t passes = 0;
+			uint32_t culledPasses = 0;
+			uint32_t barrierBatches = 0;
+			uint32_t imageBarriers = 0;
+			uint32_t transientImages = 0;
+			//aliased blocks backing the transient images, and the heaps (allocations) they are placed in
+			uint32_t memoryBlocks = 0;
+			uint32_t heaps = 0;
+			//memory the transient images would need without aliasing, and what the heaps take.
+			//Lazily allocated heaps only get physical memory once the tiles are touched, see getCommittedLazyBytes()
+			VkDeviceSize requestedBytes = 0;
+			VkDeviceSize allocatedBytes = 0;
+			VkDeviceSize lazyBytes = 0;
+		};
+
+		using Execute = std::function<void(VkCommandBuffer)>;
+		//no value if none of the types has the properties
+		using MemoryTypeFinder = std::function<std::optional<uint32_t>(uint32_t typeBits, VkMemoryPropertyFlags properties)>;
+
+		//image created and owned by the graph. Its contents don't survive from one frame to the next.
+		//Attachments with VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT get lazily allocated memory where the device has it
+		uint32_t addTransientImage(const std::string& name, const ImageDesc& desc);
+		//image owned by someone else, e.g. the swap chain. Its contents are discarded if initialLayout is undefined.
+		//The first use waits for initialStages (the wait stage of the acquire semaphore for the swap chain).
+		//finalAccess is the state it's left in after the last pass, which also makes the passes writing it needed
+		uint32_t importImage(const std::string& name, const ImageDesc& desc, VkImageLayout initialLayout,
+			VkPipelineStageFlags initialStages, std::optional<ResourceAccess> finalAccess);
+		//passes run in the order they are added. Passes with side effects are never culled
+		uint32_t addPass(const std::string& name, const std::vector<ResourceUse>& uses, Execute execute, bool sideEffects = false);
+
+		//culls the unused passes, schedules the barriers and assigns the transient images to memory slots
+		void compile();
+		//creates the transient images and places them in one heap per memory type
+		void realize(VkDevice device, const MemoryTypeFinder& findMemoryType);
+		//destroys the transient images and removes every pass and resource
+		void reset();
+
+		//the imported image can change every frame (one swap chain image per frame)
+		void setImportedImage(uint32_t resource, VkImage image, VkImageView view);
+		//records the passes that survived culling and their barriers
+		void execute(VkCommandBuffer commandBuffer) const;
+
+		VkImage getImage(uint32_t resource) const { return resources[resource].image; }
+		VkImageView getImageView(uint32_t resource) const { return resources[resource].view; }
+		const Stats& getStats() const { return stats; }
+		//compile results, for checking the schedule without a device
+		bool isCulled(uint32_t pass) const { return passes[pass].culled; }
+		const BarrierBatch& getPassBarriers(uint32_t pass) const { return passes[pass].barriers; }
+		const BarrierBatch& getFinalBarriers() const { return finalBarriers; }
+		//memory slot of a transient image, UINT32_MAX for imported or unused images
+		uint32_t getMemorySlot(uint32_t resource) const { return resources[resource].slot; }
+		//physical memory the device actually committed to the lazily allocated heaps so far
+		VkDeviceSize getCommittedLazyBytes() const;
+		//requested, allocated and saved attachment memory
+		void printMemoryReport(std::ostream& out) const;
+		//human readable barrier schedule
+		void printSchedule(std::ostream& out) const;
+
+	private:
+		struct Resource
+		{
+			std::string name;
+			ImageDesc desc;
+			bool imported = false;
+			VkImageLayout initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			VkPipelineStageFlags initialStages = 0;
+			std::optional<ResourceAccess> finalAccess;
+
+			//compile results: first and last pass using it (in pass order), memory slot of transient images
+			uint32_t firstUse = UINT32_MAX;
+			uint32_t lastUse = 0;
+			uint32_t slot = UINT32_MAX;
+			//synchronization state after the last use of the frame
+			VkPipelineStageFlags endStages = 0;
+			VkAccessFlags endAccess = 0;
+
+			VkImage image = VK_NULL_HANDLE;
+			VkImageView view = VK_NULL_HANDLE;
+		};
+
+		struct Pass
+		{
+			std::string name;
+			std::vector<ResourceUse> uses;
+			Execute execute;
+			bool sideEffects = false;
+			bool culled = false;
+			//barriers recorded right before the pass
+			BarrierBatch barriers;
+		};
+
+		// Transient images sharing memory, ordered by lifetime
+		struct MemorySlot
+		{
+			std::vector<uint32_t> resources;
+		};
+
+		// Images of a memory slot bound to the same range
+		struct MemoryBlock
+		{
+			VkDeviceSize size = 0;
+			VkDeviceSize alignment = 1;
+			uint32_t typeBits = ~0u;
+			//every image is a transient attachment, so the block may use lazily allocated memory
+			bool transientAttachments = true;
+			std::vector<uint32_t> resources;
+			uint32_t heap = 0;
+			VkDeviceSize offset = 0;
+		};
+
+		// One allocation holding the blocks of a memory type next to each other
+		struct TransientHeap
+		{
+			VkDeviceMemory memory = VK_NULL_HANDLE;
+			VkDeviceSize size = 0;
+			uint32_t memoryType = 0;
+			bool lazy = false;
+		};
+
+		std::vector<Resource> resources;
+		std::vector<Pass> passes;
+		std::vector<MemorySlot> slots;
+		std::vector<MemoryBlock> blocks;
+		std::vector<TransientHeap> heaps;
+		//transitions of the imported images to their final state, after the last pass
+		BarrierBatch finalBarriers;
+		VkDevice device = VK_NULL_HANDLE;
+		Stats stats;
+
+		void cullPasses();
+		void assignMemorySlots();
+		void scheduleBarriers();
+		void recordBarriers(VkCommandBuffer commandBuffer, const BarrierBatch& batch) const;
+		void printBatch(std::ostream& out, const BarrierBatch& batch) const;
+	};
+}
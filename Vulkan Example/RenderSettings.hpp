@@ -0,0 +1,98 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include "PipelineVariant.hpp"
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+namespace vulkanExample
+{
+	// Runtime configuration of the renderer. Filled from the command line in main.cpp
+	struct RenderSettings
+	{
+		//only draws a new frame when something changed (camera, model, window size or streamed data)
+		bool renderOnDemand = false;
+		//when rendering on demand, a frame is still presented at least this often (in seconds)
+		double minRefreshInterval = 1.0;
+		//how often frame statistics are printed (in seconds). 0 disables it
+		double statsInterval = 5.0;
+
+		//physical device to use: its index or a part of its name. Empty picks the best scored one (VULKAN_EXAMPLE_DEVICE
+		//in the environment is used if this is empty)
+		std::string device;
+
+		//preferred present mode. Falls back to FIFO (always supported) if the surface doesn't offer it
+		VkPresentModeKHR presentMode = VK_PRESENT_MODE_MAILBOX_KHR;
+		//how many frames the CPU may record ahead of the GPU. Lower means less latency, higher means more throughput
+		uint32_t framesInFlight = 2;
+		//caps the frame rate with a sleep-then-spin limiter. 0 means unlimited
+		double frameRateLimit = 0.0;
+		//with VK_KHR_present_wait, blocks until at most this many presents are queued ahead of the display. 0 disables it
+		uint32_t maxQueuedPresents = 0;
+
+		//passes the CPU multiplied model-view-projection matrix as a push constant instead of 3 matrices in the uniform buffer
+		bool pushConstantMVP = true;
+
+		//fragment shader debug view (C cycles at runtime)
+		DebugView debugView = DebugView::Textured;
+		//everything derived from the assets (SPIR-V variants, the pipeline cache, welded meshes, decoded textures) is stored here
+		std::string derivedDataDirectory = "derived_data";
+		//the least recently used derived data is deleted past this size, 0 is unbounded
+		uint32_t derivedDataMaxMB = 2048;
+		//watches the shaders directory and rebuilds the pipelines in the background when a shader changes
+		bool hotReloadShaders = true;
+
+		//binds every material texture at once through descriptor indexing when the device supports it
+		bool bindlessTextures = true;
+		//size of the texture table, lowered to the device limits
+		uint32_t maxTextures = 4096;
+		//multiplies the color of the textures by their alpha (in linear space) while they are uploaded, for materials blended
+		//with VK_BLEND_FACTOR_ONE. The scene is opaque, so it is off. The pages of virtual textures are streamed as they were decoded
+		bool premultiplyAlpha = false;
+		//textures are loaded with their longest side at most this many texels: the levels above it are neither decoded (JPEGs
+		//are reduced in the DCT domain) nor uploaded. 0 is unlimited, the device's maxImageDimension2D always applies
+		uint32_t maxTextureSize = 0;
+		//maximum size of single textures (by the path the materials name them with), instead of maxTextureSize
+		std::unordered_map<std::string, uint32_t> textureSizes;
+		//memory the mip chains of the textures may take (in MiB). The maximum texture size is lowered to the largest power of
+		//two that fits them. 0 is unbounded
+		uint32_t textureBudgetMB = 0;
+		//device memory the renderer may use (in MiB), below the budget VK_EXT_memory_budget reports. 0 only uses the reported
+		//budget. Past it the least recently drawn textures lose their largest mip levels until they are drawn again
+		uint32_t memoryBudgetMB = 0;
+
+		//streams the pages of large textures into a page cache texture, driven by the pages the fragment shader asks for,
+		//instead of uploading them whole (sparse virtual texturing)
+		bool virtualTexturing = false;
+		//textures with a side of at least this many texels are virtual
+		uint32_t virtualTextureMinSize = 4096;
+		//side of the page cache texture in texels
+		uint32_t virtualTextureCacheSize = 4096;
+		//page files of the virtual textures are stored here
+		std::string virtualTextureDirectory = "texture_cache";
+
+		//models and textures are read from this pack when it exists and has them, loose files otherwise. Shaders prefer their
+		//loose files, so edits still hot reload. Empty disables it
+		std::string assetPack = "assets.pack";
+
+		//lays down the depth of the scene in a position only subpass first, so the shading subpass only runs the fragment shader
+		//for the visible surface (EQUAL depth test). Z toggles it at runtime
+		bool depthPrepass = false;
+
+		//culls clusters of triangles on the GPU against a depth pyramid of the previous frame, then re-tests the rejected ones
+		//against the depth drawn so far (two phase hierarchical-Z occlusion culling)
+		bool occlusionCulling = false;
+
+		//renders into an internal target scaled to keep the GPU frame time under targetFrameTime, then upscales to the swap chain
+		bool dynamicResolution = false;
+		//in milliseconds
+		double targetFrameTime = 16.6;
+		//bounds of the render scale, relative to the swap chain size
+		float minRenderScale = 0.5f;
+		float maxRenderScale = 1.0f;
+		//GPU frame times averaged per resolution decision
+		uint32_t resolutionWindow = 16;
+		//also lowers the MSAA sample count once the scale is at its minimum (rebuilds the render targets)
+		bool dynamicSamples = false;
+	};
+}
@@ -0,0 +1,226 @@
+#include "ResidencyManager.hpp"
+#include <algorithm>
+
+namespace vulkanExample
+{
+	namespace
+	{
+		constexpr double ESTIMATED_BUDGET_SHARE = 0.8;
+	}
+
+	void ResidencyManager::create(VkPhysicalDevice physicalDevice, bool memoryBudget, const Config& config)
+	{
+		this->physicalDevice = physicalDevice;
+		this->memoryBudget = memoryBudget;
+		this->config = config;
+		this->config.lowWater = std::min(config.lowWater, config.highWater);
+		resources.clear();
+		freeIds.clear();
+		frame = 0;
+		lastChangeFrame = 0;
+		budget = {};
+		stats = {};
+
+		VkPhysicalDeviceMemoryProperties memoryProperties;
+		vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+		VkDeviceSize deviceLocal = 0;
+		for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++)
+		{
+			if (memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)
+				deviceLocal = std::max(deviceLocal, memoryProperties.memoryHeaps[i].size);
+		}
+		estimatedBudget = static_cast<VkDeviceSize>(deviceLocal * ESTIMATED_BUDGET_SHARE);
+	}
+
+	uint32_t ResidencyManager::add(VkDeviceSize bytes, VkDeviceSize reducedBytes, VkDeviceSize fullBytes)
+	{
+		uint32_t id;
+		if (!freeIds.empty())
+		{
+			id = freeIds.back();
+			freeIds.pop_back();
+		}
+		else
+		{
+			id = static_cast<uint32_t>(resources.size());
+			resources.emplace_back();
+		}
+
+		resources[id] = Resource{};
+		resources[id].alive = true;
+		//new resources count as used, so they are not the first ones evicted
+		resources[id].lastUsedFrame = frame;
+		update(id, bytes, reducedBytes, fullBytes);
+		return id;
+	}
+
+	void ResidencyManager::update(uint32_t id, VkDeviceSize bytes, VkDeviceSize reducedBytes, VkDeviceSize fullBytes)
+	{
+		Resource& resource = resources[id];
+		resource.bytes = bytes;
+		resource.reducedBytes = std::min(reducedBytes, bytes);
+		resource.fullBytes = std::max(fullBytes, bytes);
+		resource.pending = false;
+	}
+
+	void ResidencyManager::remove(uint32_t id)
+	{
+		resources[id] = Resource{};
+		freeIds.push_back(id);
+	}
+
+	void ResidencyManager::touch(uint32_t id, uint64_t frame, float distance)
+	{
+		Resource& resource = resources[id];
+		//the nearest draw of the frame decides
+		if (resource.lastUsedFrame != frame)
+			resource.distance = distance;
+		else
+			resource.distance = std::min(resource.distance, distance);
+		resource.lastUsedFrame = frame;
+	}
+
+	const ResidencyManager::Budget& ResidencyManager::beginFrame(uint64_t frame)
+	{
+		this->frame = frame;
+
+		budget = {};
+		if (memoryBudget)
+		{
+			VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties{};
+			budgetProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+			VkPhysicalDeviceMemoryProperties2 memoryProperties{};
+			memoryProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+			memoryProperties.pNext = &budgetProperties;
+			vkGetPhysicalDeviceMemoryProperties2(physicalDevice, &memoryProperties);
+
+			for (uint32_t i = 0; i < memoryProperties.memoryProperties.memoryHeapCount; i++)
+			{
+				if (!(memoryProperties.memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT))
+					continue;
+				budget.budget += budgetProperties.heapBudget[i];
+				budget.usage += budgetProperties.heapUsage[i];
+			}
+			budget.measured = true;
+		}
+		else
+		{
+			budget.budget = estimatedBudget;
+			for (const Resource& resource : resources)
+				budget.usage += resource.bytes;
+		}
+
+		if (config.budgetCap > 0)
+			budget.budget = budget.budget > 0 ? std::min(budget.budget, config.budgetCap) : config.budgetCap;
+		return budget;
+	}
+
+	std::vector<uint32_t> ResidencyManager::selectEvictions()
+	{
+		std::vector<uint32_t> evictions;
+		VkDeviceSize usage = getProjectedUsage();
+		if (isCoolingDown() || budget.budget == 0 || usage <= static_cast<VkDeviceSize>(budget.budget * config.highWater))
+			return evictions;
+
+		std::vector<uint32_t> candidates;
+		for (uint32_t id = 0; id < resources.size(); id++)
+		{
+			const Resource& resource = resources[id];
+			if (resource.alive && !resource.pending && resource.reducedBytes < resource.bytes)
+				candidates.push_back(id);
+		}
+		//least recently drawn first, then the farthest, then the largest
+		std::sort(candidates.begin(), candidates.end(), [this](uint32_t a, uint32_t b) {
+			const Resource& first = resources[a];
+			const Resource& second = resources[b];
+			if (first.lastUsedFrame != second.lastUsedFrame)
+				return first.lastUsedFrame < second.lastUsedFrame;
+			if (first.distance != second.distance)
+				return first.distance > second.distance;
+			return first.bytes > second.bytes;
+		});
+
+		VkDeviceSize target = static_cast<VkDeviceSize>(budget.budget * config.lowWater);
+		for (uint32_t id : candidates)
+		{
+			if (usage <= target)
+				break;
+			const Resource& resource = resources[id];
+			VkDeviceSize freed = resource.bytes - resource.reducedBytes;
+			usage -= std::min(usage, freed);
+			stats.evictedBytes += freed;
+			evictions.push_back(id);
+		}
+
+		stats.evictions += evictions.size();
+		if (!evictions.empty())
+			lastChangeFrame = frame;
+		return evictions;
+	}
+
+	std::vector<uint32_t> ResidencyManager::selectRestores()
+	{
+		std::vector<uint32_t> restores;
+		if (isCoolingDown() || budget.budget == 0)
+			return restores;
+
+		std::vector<uint32_t> candidates;
+		for (uint32_t id = 0; id < resources.size(); id++)
+		{
+			const Resource& resource = resources[id];
+			if (resource.alive && !resource.pending && resource.bytes < resource.fullBytes &&
+				resource.lastUsedFrame + config.restoreWindow >= frame)
+				candidates.push_back(id);
+		}
+		std::sort(candidates.begin(), candidates.end(), [this](uint32_t a, uint32_t b) {
+			return resources[a].distance < resources[b].distance;
+		});
+
+		VkDeviceSize usage = getProjectedUsage();
+		VkDeviceSize target = static_cast<VkDeviceSize>(budget.budget * config.lowWater);
+		for (uint32_t id : candidates)
+		{
+			Resource& resource = resources[id];
+			VkDeviceSize growth = resource.fullBytes - resource.bytes;
+			//nearer ones come first, a farther one that fits would take memory they need later
+			if (usage + growth > target)
+				break;
+			usage += growth;
+			resource.pending = true;
+			restores.push_back(id);
+		}
+
+		stats.restores += restores.size();
+		if (!restores.empty())
+			lastChangeFrame = frame;
+		return restores;
+	}
+
+	void ResidencyManager::cancelRestore(uint32_t id)
+	{
+		resources[id].pending = false;
+	}
+
+	ResidencyManager::Stats ResidencyManager::takeStats()
+	{
+		Stats taken = stats;
+		stats = {};
+		return taken;
+	}
+
+	bool ResidencyManager::isCoolingDown() const
+	{
+		return lastChangeFrame != 0 && frame < lastChangeFrame + config.cooldownFrames;
+	}
+
+	VkDeviceSize ResidencyManager::getProjectedUsage() const
+	{
+		VkDeviceSize usage = budget.usage;
+		for (const Resource& resource : resources)
+		{
+			if (resource.alive && resource.pending)
+				usage += resource.fullBytes - resource.bytes;
+		}
+		return usage;
+	}
+}
@@ -0,0 +1,98 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <vector>
+
+namespace vulkanExample
+{
+	// Keeps the device memory of the renderer under a budget.
+	// The budget comes from VK_EXT_memory_budget when the device has it (what the OS currently grants the process, measured with
+	// everything it allocated), otherwise it is a share of the device local heaps and the usage is the sum of the tracked resources.
+	// A configured cap lowers either.
+	// Resources report their size, their size after one more downgrade step (the same if they can't shrink) and their full size,
+	// and are touched every frame they are drawn with their distance to the camera. Past the high water mark the ones unused the
+	// longest, then the farthest, are downgraded one step until the usage is back under the low water mark. Downgraded ones that
+	// are drawn again are restored, nearest first, as long as that stays under the low water mark, so a restore never triggers
+	// an eviction right away. Decisions wait a few frames after changes, the measured usage lags behind the deferred deletes
+	class ResidencyManager
+	{
+	public:
+		struct Config
+		{
+			//in bytes, 0 only uses the device budget
+			VkDeviceSize budgetCap = 0;
+			float highWater = 0.9f;
+			float lowWater = 0.75f;
+			//frames between two decisions that changed something
+			uint32_t cooldownFrames = 8;
+			//a downgraded resource is only restored if it was drawn during the last frames
+			uint32_t restoreWindow = 4;
+		};
+
+		struct Budget
+		{
+			VkDeviceSize budget = 0;
+			VkDeviceSize usage = 0;
+			//reported by VK_EXT_memory_budget, otherwise estimated
+			bool measured = false;
+		};
+
+		struct Stats
+		{
+			uint64_t evictions = 0;
+			uint64_t restores = 0;
+			VkDeviceSize evictedBytes = 0;
+		};
+
+		//memoryBudget: VK_EXT_memory_budget is enabled on the device
+		void create(VkPhysicalDevice physicalDevice, bool memoryBudget, const Config& config);
+
+		//returns the id of the resource
+		uint32_t add(VkDeviceSize bytes, VkDeviceSize reducedBytes, VkDeviceSize fullBytes);
+		void update(uint32_t id, VkDeviceSize bytes, VkDeviceSize reducedBytes, VkDeviceSize fullBytes);
+		void remove(uint32_t id);
+		void touch(uint32_t id, uint64_t frame, float distance);
+
+		//queries the budget and usage, once per frame before the decisions
+		const Budget& beginFrame(uint64_t frame);
+		//resources to downgrade one step this frame, in order. Counted as evictions
+		std::vector<uint32_t> selectEvictions();
+		//downgraded resources to restore to their full size. They are pending until update() or cancelRestore() is called
+		std::vector<uint32_t> selectRestores();
+		void cancelRestore(uint32_t id);
+
+		const Budget& getBudget() const { return budget; }
+		//counts since the last call
+		Stats takeStats();
+
+	private:
+		struct Resource
+		{
+			VkDeviceSize bytes = 0;
+			VkDeviceSize reducedBytes = 0;
+			VkDeviceSize fullBytes = 0;
+			uint64_t lastUsedFrame = 0;
+			float distance = 0.0f;
+			bool pending = false;
+			bool alive = false;
+		};
+
+		VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+		bool memoryBudget = false;
+		Config config;
+		//share of the device local heaps used as the budget without VK_EXT_memory_budget, the rest is left to the render targets
+		//and other processes
+		VkDeviceSize estimatedBudget = 0;
+
+		std::vector<Resource> resources;
+		std::vector<uint32_t> freeIds;
+		uint64_t frame = 0;
+		uint64_t lastChangeFrame = 0;
+		Budget budget;
+		Stats stats;
+
+		bool isCoolingDown() const;
+		//usage plus what the pending restores will add
+		VkDeviceSize getProjectedUsage() const;
+	};
+}
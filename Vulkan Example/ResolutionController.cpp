@@ -0,0 +1,78 @@
+#include "ResolutionController.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace vulkanExample
+{
+	namespace
+	{
+		//aims a bit below the target, so the next frames have some room
+		constexpr double TARGET_HEADROOM = 0.9;
+		//only raises the resolution once frames are clearly faster than the target
+		constexpr double RAISE_THRESHOLD = 0.75;
+		//largest scale increase per decision
+		constexpr float MAX_GROWTH = 1.1f;
+		//scales are multiples of this, so tiny corrections don't change the resolution every window
+		constexpr float SCALE_STEP = 1.0f / 32.0f;
+	}
+
+	void ResolutionController::configure(const Config& config)
+	{
+		this->config = config;
+		this->config.maxScale = std::min(std::max(config.maxScale, SCALE_STEP), 1.0f);
+		this->config.minScale = std::min(std::max(config.minScale, SCALE_STEP), this->config.maxScale);
+		this->config.window = std::max(config.window, 1u);
+		this->config.minSamples = std::min(config.minSamples, config.maxSamples);
+		scale = this->config.maxScale;
+		samples = this->config.maxSamples;
+		frameTimes.clear();
+		frameTimes.reserve(this->config.window);
+		averageMs = 0.0;
+	}
+
+	bool ResolutionController::addFrameTime(double gpuMs)
+	{
+		frameTimes.push_back(gpuMs);
+		if (frameTimes.size() < config.window)
+			return false;
+
+		double sum = 0.0;
+		for (double frameTime : frameTimes)
+			sum += frameTime;
+		averageMs = sum / frameTimes.size();
+		frameTimes.clear();
+		if (averageMs <= 0.0)
+			return false;
+
+		bool overBudget = averageMs > config.targetMs;
+		bool underBudget = averageMs < config.targetMs * RAISE_THRESHOLD;
+
+		//the cost of a frame is roughly proportional to its pixels, the square of the scale
+		float wanted = scale;
+		if (overBudget || underBudget)
+			wanted = scale * static_cast<float>(std::sqrt(config.targetMs * TARGET_HEADROOM / averageMs));
+		wanted = std::min(wanted, scale * MAX_GROWTH);
+		wanted = std::floor(wanted / SCALE_STEP) * SCALE_STEP;
+		//below 10 steps the growth is less than a step and would be rounded away, so under budget it's at least one step
+		if (underBudget)
+			wanted = std::max(wanted, std::floor(scale / SCALE_STEP) * SCALE_STEP + SCALE_STEP);
+		wanted = std::min(std::max(wanted, config.minScale), config.maxScale);
+		//rounding down never raises the resolution while over budget, and never lowers it while under
+		if ((overBudget && wanted > scale) || (underBudget && wanted < scale) || (!overBudget && !underBudget))
+			wanted = scale;
+
+		VkSampleCountFlagBits wantedSamples = samples;
+		if (config.adjustSamples)
+		{
+			if (overBudget && scale <= config.minScale && samples > config.minSamples)
+				wantedSamples = static_cast<VkSampleCountFlagBits>(samples >> 1);
+			else if (underBudget && scale >= config.maxScale && samples < config.maxSamples)
+				wantedSamples = static_cast<VkSampleCountFlagBits>(samples << 1);
+		}
+
+		bool changed = wanted != scale || wantedSamples != samples;
+		scale = wanted;
+		samples = wantedSamples;
+		return changed;
+	}
+}
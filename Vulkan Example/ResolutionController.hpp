@@ -0,0 +1,47 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <vector>
+
+namespace vulkanExample
+{
+	// Picks the render scale (and optionally the MSAA sample count) that keeps the GPU frame time under a target.
+	// Decisions use the average of the last frames and only happen once a full window was measured with the current setting,
+	// so frames recorded before a change don't count. Resolution is cut quickly when over budget and raised slowly, which avoids
+	// oscillating around the target
+	class ResolutionController
+	{
+	public:
+		struct Config
+		{
+			double targetMs = 16.6;
+			float minScale = 0.5f;
+			float maxScale = 1.0f;
+			//frames averaged per decision
+			uint32_t window = 16;
+			//drops MSAA samples once the scale reached its minimum, and restores them at the maximum
+			bool adjustSamples = false;
+			//the render pass always resolves, so it needs at least 2 samples
+			VkSampleCountFlagBits minSamples = VK_SAMPLE_COUNT_2_BIT;
+			VkSampleCountFlagBits maxSamples = VK_SAMPLE_COUNT_2_BIT;
+		};
+
+		void configure(const Config& config);
+
+		//returns true if the scale or the sample count changed
+		bool addFrameTime(double gpuMs);
+
+		float getScale() const { return scale; }
+		float getMaxScale() const { return config.maxScale; }
+		VkSampleCountFlagBits getSamples() const { return samples; }
+		//average of the last full window
+		double getAverageMs() const { return averageMs; }
+
+	private:
+		Config config;
+		float scale = 1.0f;
+		VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_2_BIT;
+		std::vector<double> frameTimes;
+		double averageMs = 0.0;
+	};
+}
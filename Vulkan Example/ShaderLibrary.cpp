@@ -0,0 +1,246 @@
+#include "ShaderLibrary.hpp"
+#include "Hash.hpp"
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+#if __has_include(<shaderc/shaderc.hpp>) && !defined(VULKAN_EXAMPLE_NO_SHADERC)
+#include <shaderc/shaderc.hpp>
+#define VULKAN_EXAMPLE_SHADERC
+#ifdef _MSC_VER
+//the Vulkan SDK ships the static library. The debug one (with the d suffix) is an optional SDK component
+#ifdef _DEBUG
+#pragma comment(lib, "shaderc_combinedd.lib")
+#else
+#pragma comment(lib, "shaderc_combined.lib")
+#endif
+#endif
+#endif
+
+namespace vulkanExample
+{
+	//bump to invalidate every cached SPIR-V variant (e.g. when the compile options change)
+	static const uint32_t CACHE_VERSION = 2;
+
+	//numbers the temporary files of writeFileAtomic, so threads writing the same file don't write the same temporary file
+	static std::mutex temporaryMutex;
+	static uint64_t temporaryCounter = 0;
+
+	void ShaderLibrary::create(VkDevice device, DerivedDataCache* cache, const AssetPack* pack)
+	{
+		this->device = device;
+		this->cache = cache;
+		this->pack = pack;
+	}
+
+	void ShaderLibrary::destroy()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for (auto& module : modules)
+			vkDestroyShaderModule(device, module.second, nullptr);
+		modules.clear();
+		device = VK_NULL_HANDLE;
+	}
+
+	VkShaderModule ShaderLibrary::getModule(const ShaderVariant& variant)
+	{
+		uint64_t hash = 0;
+		Spirv spirv;
+		loadSpirv(variant, spirv, hash);
+
+		std::lock_guard<std::mutex> lock(mutex);
+		auto found = modules.find(hash);
+		if (found != modules.end())
+			return found->second;
+
+		VkShaderModuleCreateInfo createInfo{};
+		createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+		//straight from the mapped file when it was read from disk
+		createInfo.codeSize = spirv.size;
+		createInfo.pCode = spirv.words;
+
+		VkShaderModule shaderModule;
+		if (vkCreateShaderModule(device, &createInfo, nullptr, &shaderModule) != VK_SUCCESS)
+			throw std::runtime_error("failed to create shader module!");
+
+		modules.emplace(hash, shaderModule);
+		return shaderModule;
+	}
+
+	ShaderLibrary::Stats ShaderLibrary::getStats()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return stats;
+	}
+
+	bool ShaderLibrary::hasRuntimeCompiler()
+	{
+#ifdef VULKAN_EXAMPLE_SHADERC
+		return true;
+#else
+		return false;
+#endif
+	}
+
+	void ShaderLibrary::loadSpirv(const ShaderVariant& variant, Spirv& spirv, uint64_t& hash)
+	{
+		MappedFile source;
+		AssetPack::Asset packedSource;
+		bool hasSource = source.open(variant.sourcePath) || (pack != nullptr && pack->read(variant.sourcePath, packedSource));
+		if (hasSource)
+		{
+			const char* sourceText = reinterpret_cast<const char*>(source.isOpen() ? source.data() : packedSource.data());
+			size_t sourceSize = source.isOpen() ? source.size() : packedSource.size();
+			CacheKey key("spirv", CACHE_VERSION);
+			key.addSource(sourceText, sourceSize).add(variant.stage);
+			for (const std::string& define : variant.defines)
+				key.add(define);
+			hash = key.getHash();
+
+			if (cache != nullptr && cache->load(key, spirv.cached) && isSpirv(spirv.cached.data(), spirv.cached.size()))
+			{
+				spirv.point(spirv.cached.data(), spirv.cached.size());
+				std::lock_guard<std::mutex> lock(mutex);
+				stats.cacheHits++;
+				return;
+			}
+
+			if (hasRuntimeCompiler())
+			{
+				//an outdated precompiled file would hide the error, so there is no fallback once the source can be compiled
+				if (!compile(sourceText, sourceSize, variant, spirv.compiled))
+					throw std::runtime_error("failed to compile shader " + variant.sourcePath + "!");
+				spirv.point(spirv.compiled.data(), spirv.compiled.size() * sizeof(uint32_t));
+				if (cache != nullptr && !cache->store(key, spirv.words, spirv.size))
+					std::cout << "Can't cache shader " << variant.sourcePath << std::endl;
+				std::lock_guard<std::mutex> lock(mutex);
+				stats.compiled++;
+				return;
+			}
+		}
+
+		if (!variant.precompiledPath.empty() && readSpirvFile(variant.precompiledPath, spirv.file))
+			spirv.point(spirv.file.data(), spirv.file.size());
+		else if (!variant.precompiledPath.empty() && readPackedSpirv(variant.precompiledPath, spirv.packed))
+			spirv.point(spirv.packed.data(), spirv.packed.size());
+		else
+			throw std::runtime_error("failed to load shader " + variant.sourcePath + "!");
+
+		//the precompiled file isn't tied to a source version, so it's keyed by its own contents
+		hash = hashXxh3(spirv.words, spirv.size);
+		std::lock_guard<std::mutex> lock(mutex);
+		stats.precompiledLoads++;
+	}
+
+	bool ShaderLibrary::compile(const char* source, size_t sourceSize, const ShaderVariant& variant, std::vector<uint32_t>& spirv)
+	{
+#ifdef VULKAN_EXAMPLE_SHADERC
+		shaderc_shader_kind kind;
+		switch (variant.stage)
+		{
+		case VK_SHADER_STAGE_VERTEX_BIT:
+			kind = shaderc_glsl_vertex_shader;
+			break;
+		case VK_SHADER_STAGE_FRAGMENT_BIT:
+			kind = shaderc_glsl_fragment_shader;
+			break;
+		case VK_SHADER_STAGE_COMPUTE_BIT:
+			kind = shaderc_glsl_compute_shader;
+			break;
+		default:
+			return false;
+		}
+
+		shaderc::CompileOptions options;
+		options.SetTargetEnvironment(shaderc_target_env_vulkan, shaderc_env_version_vulkan_1_2);
+		options.SetOptimizationLevel(shaderc_optimization_level_performance);
+		for (const std::string& define : variant.defines)
+		{
+			//NAME or NAME=VALUE, like glslc -D
+			size_t separator = define.find('=');
+			if (separator == std::string::npos)
+				options.AddMacroDefinition(define);
+			else
+				options.AddMacroDefinition(define.substr(0, separator), define.substr(separator + 1));
+		}
+
+		shaderc::Compiler compiler;
+		shaderc::SpvCompilationResult result = compiler.CompileGlslToSpv(source, sourceSize, kind, variant.sourcePath.c_str(), options);
+		if (result.GetCompilationStatus() != shaderc_compilation_status_success)
+		{
+			std::cerr << "Shader compilation failed: " << result.GetErrorMessage() << std::endl;
+			return false;
+		}
+
+		spirv.assign(result.cbegin(), result.cend());
+		std::cout << "Compiled " << variant.sourcePath;
+		for (const std::string& define : variant.defines)
+			std::cout << " -D" << define;
+		std::cout << std::endl;
+		return true;
+#else
+		(void)source;
+		(void)sourceSize;
+		(void)variant;
+		(void)spirv;
+		return false;
+#endif
+	}
+
+	bool ShaderLibrary::readPackedSpirv(const std::string& path, AssetPack::Asset& spirv) const
+	{
+		if (pack == nullptr || !pack->read(path, spirv))
+			return false;
+		//entries are 4 KiB aligned, so the view can be read as words like a mapped file
+		return isSpirv(spirv.data(), spirv.size());
+	}
+
+	bool isSpirv(const void* data, size_t size)
+	{
+		//SPIR-V is a stream of 32 bit words starting with the magic number
+		return size > 0 && size % sizeof(uint32_t) == 0 && *static_cast<const uint32_t*>(data) == 0x07230203;
+	}
+
+	bool readSpirvFile(const std::string& path, MappedFile& spirv)
+	{
+		if (!spirv.open(path))
+			return false;
+
+		bool valid = isSpirv(spirv.data(), spirv.size());
+		if (!valid)
+			spirv.close();
+		return valid;
+	}
+
+	bool writeFileAtomic(const std::string& path, const void* data, size_t size)
+	{
+		std::string temporaryPath;
+		{
+			std::lock_guard<std::mutex> lock(temporaryMutex);
+			temporaryPath = path + '.' + std::to_string(++temporaryCounter) + ".tmp";
+		}
+
+		std::error_code error;
+		{
+			std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+			if (!file.is_open())
+				return false;
+			file.write(static_cast<const char*>(data), size);
+			if (!file.good())
+			{
+				file.close();
+				std::filesystem::remove(temporaryPath, error);
+				return false;
+			}
+		}
+
+		std::filesystem::rename(temporaryPath, path, error);
+		if (error)
+		{
+			std::filesystem::remove(temporaryPath, error);
+			return false;
+		}
+		return true;
+	}
+}
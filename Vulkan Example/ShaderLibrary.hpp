@@ -0,0 +1,86 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include "AssetPack.hpp"
+#include "DerivedDataCache.hpp"
+#include "MappedFile.hpp"
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace vulkanExample
+{
+	// One compiled form of a GLSL source: its stage plus the preprocessor defines it was compiled with
+	struct ShaderVariant
+	{
+		std::string sourcePath;
+		VkShaderStageFlagBits stage;
+		std::vector<std::string> defines;
+		//SPIR-V produced by compile_shaders.py, used when the source can't be compiled at runtime
+		std::string precompiledPath;
+	};
+
+	// Compiles shader variants with libshaderc into the derived data cache, keyed by a hash of the source, the stage and the
+	// defines, so a variant is only compiled again when its source changes. Shader modules are kept for the library lifetime.
+	// Without libshaderc the cache is still read, and missing variants fall back to the precompiled SPIR-V.
+	// Sources and precompiled files missing on disk are read from the asset pack, loose files win so edits hot reload
+	class ShaderLibrary
+	{
+	public:
+		struct Stats
+		{
+			uint32_t cacheHits = 0;
+			uint32_t compiled = 0;
+			uint32_t precompiledLoads = 0;
+		};
+
+		//cache and pack may be null, otherwise they must outlive the library
+		void create(VkDevice device, DerivedDataCache* cache, const AssetPack* pack = nullptr);
+		void destroy();
+
+		//thread safe, pipelines are built on worker threads
+		VkShaderModule getModule(const ShaderVariant& variant);
+		Stats getStats();
+
+		static bool hasRuntimeCompiler();
+
+	private:
+		// SPIR-V words, from the derived data cache, a precompiled file, the asset pack, or just compiled.
+		// words points into whichever of them holds the code
+		struct Spirv
+		{
+			DerivedDataCache::Entry cached;
+			MappedFile file;
+			AssetPack::Asset packed;
+			std::vector<uint32_t> compiled;
+			const uint32_t* words = nullptr;
+			size_t size = 0;
+
+			void point(const void* data, size_t bytes)
+			{
+				words = static_cast<const uint32_t*>(data);
+				size = bytes;
+			}
+		};
+
+		VkDevice device = VK_NULL_HANDLE;
+		DerivedDataCache* cache = nullptr;
+		const AssetPack* pack = nullptr;
+		std::mutex mutex;
+		//keyed by the content hash, so an edited source gets a new module
+		std::unordered_map<uint64_t, VkShaderModule> modules;
+		Stats stats;
+
+		void loadSpirv(const ShaderVariant& variant, Spirv& spirv, uint64_t& hash);
+		bool compile(const char* source, size_t sourceSize, const ShaderVariant& variant, std::vector<uint32_t>& spirv);
+		bool readPackedSpirv(const std::string& path, AssetPack::Asset& spirv) const;
+	};
+
+	//checks the words look like SPIR-V
+	bool isSpirv(const void* data, size_t size);
+	//maps the file and checks it looks like SPIR-V
+	bool readSpirvFile(const std::string& path, MappedFile& spirv);
+	//writes to a temporary file first, so a crash never leaves a truncated file behind
+	bool writeFileAtomic(const std::string& path, const void* data, size_t size);
+}
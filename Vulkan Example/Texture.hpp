@@ -0,0 +1,44 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace vulkanExample
+{
+	// Sampled image loaded from disk. Shared by every material referencing the same file
+	struct Texture
+	{
+		std::string path;
+		VkImage image = VK_NULL_HANDLE;
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		VkImageView view = VK_NULL_HANDLE;
+		uint32_t mipLevels = 1;
+		//slot in the texture table
+		uint32_t tableIndex = 0;
+
+		//size it is loaded at: the file's, or fewer levels under the maximum texture size. A downgraded texture starts
+		//droppedLevels below it (half the size per level)
+		uint32_t width = 0;
+		uint32_t height = 0;
+		uint32_t droppedLevels = 0;
+		//of the image as it is now, and with every level
+		VkDeviceSize memorySize = 0;
+		VkDeviceSize fullMemorySize = 0;
+		//id in the residency manager
+		uint32_t residencyId = 0;
+	};
+
+	// Pixels of a texture file decoded to RGBA8, or RGB8 for files without alpha, before they are uploaded. RGB is expanded
+	// to RGBA while it is written to the staging buffer
+	struct TextureData
+	{
+		uint32_t width = 0;
+		uint32_t height = 0;
+		//3 or 4
+		uint32_t channels = 4;
+		//levels of the file above width x height that were never decoded, under the maximum texture size
+		uint32_t skippedLevels = 0;
+		std::vector<unsigned char> pixels;
+	};
+}
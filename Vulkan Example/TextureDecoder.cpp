@@ -0,0 +1,115 @@
+#include "TextureDecoder.hpp"
+#include "JpegDecoder.hpp"
+#include "PixelFormat.hpp"
+#include <stb_image.h>
+#include <algorithm>
+#include <climits>
+
+namespace vulkanExample
+{
+	namespace
+	{
+		//1/8 scale, a single coefficient per block
+		constexpr uint32_t MAX_JPEG_SHIFT = 3;
+
+		//files without alpha are decoded as RGB, a quarter smaller until convertToRgba expands them into the staging buffer.
+		//Grey files are still expanded by stb_image
+		bool decodeWithStb(const unsigned char* data, size_t size, TextureData& texture)
+		{
+			int width, height, fileChannels;
+			if (size > INT_MAX || !stbi_info_from_memory(data, static_cast<int>(size), &width, &height, &fileChannels))
+				return false;
+			int channels = fileChannels == 3 ? STBI_rgb : STBI_rgb_alpha;
+			stbi_uc* pixels = stbi_load_from_memory(data, static_cast<int>(size), &width, &height, &fileChannels, channels);
+			if (!pixels)
+				return false;
+
+			texture.width = static_cast<uint32_t>(width);
+			texture.height = static_cast<uint32_t>(height);
+			texture.channels = static_cast<uint32_t>(channels);
+			texture.pixels.assign(pixels, pixels + static_cast<size_t>(width) * height * channels);
+			stbi_image_free(pixels);
+			return true;
+		}
+	}
+
+	uint32_t getTextureLevelShift(uint32_t width, uint32_t height, uint32_t maxSize)
+	{
+		uint32_t shift = 0;
+		uint32_t longest = std::max(width, height);
+		while (maxSize != 0 && longest > maxSize && longest > 1)
+		{
+			longest = (longest + 1) / 2;
+			shift++;
+		}
+		return shift;
+	}
+
+	bool decodeTexture(const unsigned char* data, size_t size, uint32_t levelShift, TextureData& texture)
+	{
+		//at full size stb_image's integer IDCT is faster, the scaled one only pays off below it
+		TextureData decoded;
+		uint32_t remainingShift = levelShift;
+		uint32_t jpegShift = std::min(levelShift, MAX_JPEG_SHIFT);
+		if (jpegShift > 0 && isJpeg(data, size) && decodeJpeg(data, size, jpegShift, decoded))
+			remainingShift -= jpegShift;
+		else if (!decodeWithStb(data, size, decoded))
+			return false;
+
+		decoded.skippedLevels = levelShift - remainingShift;
+		if (remainingShift == 0)
+		{
+			texture = std::move(decoded);
+			return true;
+		}
+
+		uint32_t factor = 1u << remainingShift;
+		texture.width = (decoded.width + factor - 1) / factor;
+		texture.height = (decoded.height + factor - 1) / factor;
+		texture.channels = decoded.channels;
+		texture.skippedLevels = levelShift;
+		texture.pixels.resize(static_cast<size_t>(texture.width) * texture.height * texture.channels);
+		downsampleBox(decoded.pixels.data(), decoded.width, decoded.height, decoded.channels, factor, texture.pixels.data());
+		return true;
+	}
+
+	uint64_t getMipChainBytes(uint32_t width, uint32_t height)
+	{
+		uint64_t bytes = 0;
+		while (true)
+		{
+			bytes += static_cast<uint64_t>(width) * height * 4;
+			if (width == 1 && height == 1)
+				return bytes;
+			width = std::max(width / 2, 1u);
+			height = std::max(height / 2, 1u);
+		}
+	}
+
+	uint32_t getBudgetTextureSize(const std::vector<std::pair<uint32_t, uint32_t>>& sizes, uint64_t budgetBytes)
+	{
+		auto getBytes = [&sizes](uint32_t maxSize) {
+			uint64_t bytes = 0;
+			for (const auto& size : sizes)
+			{
+				uint32_t shift = getTextureLevelShift(size.first, size.second, maxSize);
+				uint32_t factor = 1u << shift;
+				bytes += getMipChainBytes((size.first + factor - 1) / factor, (size.second + factor - 1) / factor);
+			}
+			return bytes;
+		};
+		if (getBytes(0) <= budgetBytes)
+			return 0;
+
+		uint32_t longest = 1;
+		for (const auto& size : sizes)
+			longest = std::max({ longest, size.first, size.second });
+		//the largest power of two below the longest side is the first cap that reduces anything
+		uint32_t maxSize = 1;
+		while (maxSize * 2 < longest && maxSize < (1u << 30))
+			maxSize *= 2;
+		while (maxSize > 1 && getBytes(maxSize) > budgetBytes)
+			maxSize /= 2;
+		return maxSize;
+	}
+}
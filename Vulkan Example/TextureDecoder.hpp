@@ -0,0 +1,27 @@
+#pragma once
+#include "Texture.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace vulkanExample
+{
+	// Decoding of texture files under a maximum size: the levels above it would never be sampled, so they are neither decoded
+	// nor uploaded, and the mip chain starts at the first level that fits
+
+	//levels to skip (each halves the sides, rounded up) for the longest side to be at most maxSize. 0 is unlimited
+	uint32_t getTextureLevelShift(uint32_t width, uint32_t height, uint32_t maxSize);
+
+	//decodes a texture file levelShift levels below its size, to RGB or RGBA like TextureData. JPEGs are reduced by up to 3
+	//levels in the DCT domain (decodeJpeg), the rest of the way and other formats are decoded whole by stb_image and box
+	//filtered. False if stb_image can't decode it either
+	bool decodeTexture(const unsigned char* data, size_t size, uint32_t levelShift, TextureData& texture);
+
+	//RGBA8 bytes of the whole mip chain of an image, what it takes in device memory (before alignment)
+	uint64_t getMipChainBytes(uint32_t width, uint32_t height);
+
+	//largest power of two maximum size under which the mip chains of textures of these sizes fit in budgetBytes, 0 if they
+	//already fit at full size. 1 if nothing does
+	uint32_t getBudgetTextureSize(const std::vector<std::pair<uint32_t, uint32_t>>& sizes, uint64_t budgetBytes);
+}
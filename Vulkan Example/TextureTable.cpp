@@ -0,0 +1,160 @@
+#include "TextureTable.hpp"
+#include <stdexcept>
+
+namespace vulkanExample
+{
+	void TextureTable::create(VkDevice device, bool bindless, uint32_t capacity, DescriptorAllocator& allocator)
+	{
+		this->device = device;
+		this->allocator = &allocator;
+		this->bindless = bindless;
+		this->capacity = capacity;
+		count = 0;
+
+		VkDescriptorSetLayoutBinding binding{};
+		binding.binding = 0;
+		binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		binding.descriptorCount = bindless ? capacity : 1;
+		binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+		binding.pImmutableSamplers = nullptr;
+
+		//partially bound: elements that were never written are fine as long as no draw reads them.
+		//variable count: the set is allocated with exactly the capacity, the layout only gives the upper bound
+		VkDescriptorBindingFlags bindingFlags = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+			VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT;
+		VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo{};
+		bindingFlagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+		bindingFlagsInfo.bindingCount = 1;
+		bindingFlagsInfo.pBindingFlags = &bindingFlags;
+
+		VkDescriptorSetLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layoutInfo.bindingCount = 1;
+		layoutInfo.pBindings = &binding;
+		if (bindless)
+		{
+			layoutInfo.pNext = &bindingFlagsInfo;
+			layoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+		}
+
+		if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &layout) != VK_SUCCESS)
+			throw std::runtime_error("failed to create texture descriptor set layout!");
+
+		if (bindless)
+			createBindlessSet();
+		else
+			allocator.registerLayout(layout, { { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 } });
+	}
+
+	void TextureTable::destroy()
+	{
+		if (device == VK_NULL_HANDLE)
+			return;
+
+		//frees the set too
+		if (bindless)
+			vkDestroyDescriptorPool(device, pool, nullptr);
+		else
+			allocator->resetPersistent(layout);
+		pool = VK_NULL_HANDLE;
+		vkDestroyDescriptorSetLayout(device, layout, nullptr);
+		sets.clear();
+		images.clear();
+		count = 0;
+		device = VK_NULL_HANDLE;
+	}
+
+	uint32_t TextureTable::add(VkImageView imageView, VkSampler sampler)
+	{
+		if (count >= capacity)
+			throw std::runtime_error("texture table is full!");
+
+		uint32_t index = count++;
+
+		VkDescriptorImageInfo imageInfo{};
+		imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		imageInfo.imageView = imageView;
+		imageInfo.sampler = sampler;
+		images.push_back(imageInfo);
+
+		VkWriteDescriptorSet write = makeWrite(index);
+		if (!bindless)
+		{
+			//adding the same view and sampler twice shares the set
+			sets.push_back(allocator->allocateCached(layout, { write }));
+			return index;
+		}
+
+		write.dstSet = sets[0];
+		vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+		return index;
+	}
+
+	VkDescriptorSet TextureTable::replace(uint32_t index, VkImageView imageView, VkSampler sampler)
+	{
+		VkDescriptorSet previous = VK_NULL_HANDLE;
+		if (!bindless)
+			previous = allocator->releaseCached(layout, { makeWrite(index) });
+
+		images[index].imageView = imageView;
+		images[index].sampler = sampler;
+		VkWriteDescriptorSet write = makeWrite(index);
+		if (!bindless)
+		{
+			//the released set isn't reused here, frames in flight may still read it
+			sets[index] = allocator->allocateCached(layout, { write });
+			return previous;
+		}
+
+		write.dstSet = sets[0];
+		vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+		return VK_NULL_HANDLE;
+	}
+
+	VkWriteDescriptorSet TextureTable::makeWrite(uint32_t index) const
+	{
+		VkWriteDescriptorSet write{};
+		write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write.dstBinding = 0;
+		write.dstArrayElement = bindless ? index : 0;
+		write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		write.descriptorCount = 1;
+		write.pImageInfo = &images[index];
+		return write;
+	}
+
+	void TextureTable::createBindlessSet()
+	{
+		VkDescriptorPoolSize poolSize{};
+		poolSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		poolSize.descriptorCount = capacity;
+
+		VkDescriptorPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+		poolInfo.poolSizeCount = 1;
+		poolInfo.pPoolSizes = &poolSize;
+		poolInfo.maxSets = 1;
+
+		if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &pool) != VK_SUCCESS)
+			throw std::runtime_error("failed to create texture descriptor pool!");
+
+		uint32_t variableCount = capacity;
+		VkDescriptorSetVariableDescriptorCountAllocateInfo variableCountInfo{};
+		variableCountInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_VARIABLE_DESCRIPTOR_COUNT_ALLOCATE_INFO;
+		variableCountInfo.descriptorSetCount = 1;
+		variableCountInfo.pDescriptorCounts = &variableCount;
+
+		VkDescriptorSetAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocInfo.pNext = &variableCountInfo;
+		allocInfo.descriptorPool = pool;
+		allocInfo.descriptorSetCount = 1;
+		allocInfo.pSetLayouts = &layout;
+
+		VkDescriptorSet set;
+		if (vkAllocateDescriptorSets(device, &allocInfo, &set) != VK_SUCCESS)
+			throw std::runtime_error("failed to allocate texture descriptor set!");
+		sets.push_back(set);
+	}
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include "DescriptorAllocator.hpp"
+#include <cstdint>
+#include <vector>
+
+namespace vulkanExample
+{
+	// Descriptor set 1: the textures of every material.
+	// With descriptor indexing it's a single set holding one large update-after-bind array of combined image samplers,
+	// bound once per frame and indexed in the fragment shader by the material index push constant.
+	// Without it, every texture gets its own cached set from the descriptor allocator and draws are batched by texture
+	class TextureTable
+	{
+	public:
+		//the allocator is only used without bindless, and must outlive the table
+		void create(VkDevice device, bool bindless, uint32_t capacity, DescriptorAllocator& allocator);
+		void destroy();
+
+		//returns the index the shaders use for the texture. In bindless mode the descriptor is written right away,
+		//which is allowed while the set is bound as long as in flight frames don't use that element
+		uint32_t add(VkImageView imageView, VkSampler sampler);
+		//points the index at another view, e.g. a texture with more or fewer mip levels. In bindless mode the GPU must be done
+		//with the frames that used the previous descriptor. Otherwise the index gets a new set and the previous one stays valid:
+		//it is returned, unless other indices share it, for recycleSet() once the frames that used it are done
+		VkDescriptorSet replace(uint32_t index, VkImageView imageView, VkSampler sampler);
+		//reuses a set returned by replace() for a later texture
+		void recycleSet(VkDescriptorSet set) { allocator->recycle(layout, set); }
+
+		VkDescriptorSetLayout getLayout() const { return layout; }
+		bool isBindless() const { return bindless; }
+		uint32_t size() const { return count; }
+		uint32_t getCapacity() const { return capacity; }
+		//bindless: the only set, for every texture. Otherwise the set of that texture
+		VkDescriptorSet getSet(uint32_t textureIndex) const { return bindless ? sets[0] : sets[textureIndex]; }
+
+	private:
+		VkDevice device = VK_NULL_HANDLE;
+		DescriptorAllocator* allocator = nullptr;
+		bool bindless = false;
+		uint32_t capacity = 0;
+		uint32_t count = 0;
+		VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+		//bindless only, update after bind sets need a pool created for them
+		VkDescriptorPool pool = VK_NULL_HANDLE;
+		std::vector<VkDescriptorSet> sets;
+		//what every index was written with
+		std::vector<VkDescriptorImageInfo> images;
+
+		void createBindlessSet();
+		VkWriteDescriptorSet makeWrite(uint32_t index) const;
+	};
+}
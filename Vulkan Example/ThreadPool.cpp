@@ -0,0 +1,47 @@
+#include "ThreadPool.hpp"
+
+namespace vulkanExample
+{
+	ThreadPool::ThreadPool(uint32_t threadCount)
+	{
+		if (threadCount == 0)
+		{
+			//hardware_concurrency is 0 when it can't be determined, one core is left to the main thread
+			unsigned cores = std::thread::hardware_concurrency();
+			threadCount = cores > 1 ? cores - 1 : 1;
+		}
+
+		workers.reserve(threadCount);
+		for (uint32_t i = 0; i < threadCount; i++)
+			workers.emplace_back(&ThreadPool::workerLoop, this);
+	}
+
+	ThreadPool::~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		condition.notify_all();
+		//queued tasks are still run, so nobody waits forever on a future
+		for (std::thread& worker : workers)
+			worker.join();
+	}
+
+	void ThreadPool::workerLoop()
+	{
+		for (;;)
+		{
+			std::function<void()> task;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				condition.wait(lock, [this]() { return stopping || !tasks.empty(); });
+				if (tasks.empty())
+					return;
+				task = std::move(tasks.front());
+				tasks.pop_front();
+			}
+			task();
+		}
+	}
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace vulkanExample
+{
+	// Fixed set of worker threads for background jobs (pipeline builds, decoding, I/O completions)
+	class ThreadPool
+	{
+	public:
+		//0 uses one thread per hardware thread minus the main one
+		explicit ThreadPool(uint32_t threadCount = 0);
+		~ThreadPool();
+
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+
+		//queues the task. Exceptions thrown by it are rethrown by the returned future
+		template<typename Task>
+		auto submit(Task&& task) -> std::future<decltype(task())>
+		{
+			using Result = decltype(task());
+			//std::function needs a copyable callable, the packaged task is not
+			auto packaged = std::make_shared<std::packaged_task<Result()>>(std::forward<Task>(task));
+			std::future<Result> result = packaged->get_future();
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				tasks.emplace_back([packaged]() { (*packaged)(); });
+			}
+			condition.notify_one();
+			return result;
+		}
+
+		uint32_t size() const { return static_cast<uint32_t>(workers.size()); }
+
+	private:
+		std::vector<std::thread> workers;
+		std::deque<std::function<void()>> tasks;
+		std::mutex mutex;
+		std::condition_variable condition;
+		bool stopping = false;
+
+		void workerLoop();
+	};
+}
@@ -46,6 +46,24 @@ namespace vulkanExample
             return attributeDescriptions;
         }
 
+        //the depth pre-pass reads a separate stream of tightly packed positions, a third of the interleaved vertex size
+        static VkVertexInputBindingDescription getPositionBindingDescription() {
+            VkVertexInputBindingDescription bindingDescription{};
+            bindingDescription.binding = 0;
+            bindingDescription.stride = sizeof(glm::vec3);
+            bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+            return bindingDescription;
+        }
+
+        static VkVertexInputAttributeDescription getPositionAttributeDescription() {
+            VkVertexInputAttributeDescription attributeDescription{};
+            attributeDescription.binding = 0;
+            attributeDescription.location = 0;
+            attributeDescription.format = VK_FORMAT_R32G32B32_SFLOAT;
+            attributeDescription.offset = 0;
+            return attributeDescription;
+        }
+
 
         bool operator==(const Vertex& other) const {
             return pos == other.pos && color == other.color && texCoord == other.texCoord;
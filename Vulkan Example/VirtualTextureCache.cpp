@@ -0,0 +1,848 @@
+#include "VirtualTextureCache.hpp"
+#include "Hash.hpp"
+#include "PixelFormat.hpp"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+namespace vulkanExample
+{
+	namespace
+	{
+		constexpr char PAGE_FILE_MAGIC[8] = { 'V', 'T', 'P', 'A', 'G', 'E', 'S', '\0' };
+		constexpr uint32_t PAGE_FILE_VERSION = 1;
+		//one fragment of every FEEDBACK_BLOCK x FEEDBACK_BLOCK block writes feedback, must match shader.frag
+		constexpr uint32_t FEEDBACK_BLOCK = 8;
+		constexpr size_t MAX_LOADS_IN_FLIGHT = 64;
+		constexpr size_t MAX_UPLOADS_PER_FRAME = 16;
+		//frames a page is kept after it was last requested, longer than the feedback of the frames in flight takes to arrive
+		constexpr uint64_t EVICTION_DELAY = 8;
+		//slot coordinates are 8 bits in the page table
+		constexpr uint32_t MAX_SLOTS_PER_SIDE = 256;
+
+		struct PageFileHeader
+		{
+			char magic[8];
+			uint32_t version;
+			uint32_t width;
+			uint32_t height;
+			uint32_t pageSize;
+			uint32_t pageBorder;
+			uint32_t pageCount;
+		};
+
+		// RGBA8 texels of one level
+		struct Level
+		{
+			uint32_t width = 0;
+			uint32_t height = 0;
+			std::vector<unsigned char> pixels;
+		};
+
+		float toLinear(unsigned char value)
+		{
+			float c = value / 255.0f;
+			return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+		}
+
+		unsigned char toSrgb(float c)
+		{
+			c = std::clamp(c, 0.0f, 1.0f);
+			float value = c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+			return static_cast<unsigned char>(value * 255.0f + 0.5f);
+		}
+
+		//2x2 box filter, the color in linear space like the blits of generateMipmaps filter the sRGB texture.
+		//The last row and column of odd sizes are clamped
+		Level downsample(const Level& source, const std::array<float, 256>& linear)
+		{
+			Level level;
+			level.width = std::max(source.width / 2, 1u);
+			level.height = std::max(source.height / 2, 1u);
+			level.pixels.resize(static_cast<size_t>(level.width) * level.height * 4);
+			for (uint32_t y = 0; y < level.height; y++)
+			{
+				uint32_t y0 = std::min(y * 2, source.height - 1);
+				uint32_t y1 = std::min(y * 2 + 1, source.height - 1);
+				for (uint32_t x = 0; x < level.width; x++)
+				{
+					uint32_t x0 = std::min(x * 2, source.width - 1);
+					uint32_t x1 = std::min(x * 2 + 1, source.width - 1);
+					const unsigned char* texels[4] = {
+						&source.pixels[(static_cast<size_t>(y0) * source.width + x0) * 4],
+						&source.pixels[(static_cast<size_t>(y0) * source.width + x1) * 4],
+						&source.pixels[(static_cast<size_t>(y1) * source.width + x0) * 4],
+						&source.pixels[(static_cast<size_t>(y1) * source.width + x1) * 4]
+					};
+					unsigned char* target = &level.pixels[(static_cast<size_t>(y) * level.width + x) * 4];
+					for (uint32_t channel = 0; channel < 3; channel++)
+					{
+						float sum = 0.0f;
+						for (const unsigned char* texel : texels)
+							sum += linear[texel[channel]];
+						target[channel] = toSrgb(sum * 0.25f);
+					}
+					uint32_t alpha = 0;
+					for (const unsigned char* texel : texels)
+						alpha += texel[3];
+					target[3] = static_cast<unsigned char>((alpha + 2) / 4);
+				}
+			}
+			return level;
+		}
+
+		uint32_t wrap(int64_t value, uint32_t size)
+		{
+			int64_t wrapped = value % static_cast<int64_t>(size);
+			return static_cast<uint32_t>(wrapped < 0 ? wrapped + size : wrapped);
+		}
+
+		void writePageFile(const std::string& path, const VirtualTextureLayout& layout, const TextureData& data)
+		{
+			//written next to it and renamed, so an interrupted build never leaves a page file that looks complete
+			std::string temporary = path + ".tmp";
+			std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+			if (!file)
+				throw std::runtime_error("failed to create page file " + temporary + "!");
+
+			PageFileHeader header{};
+			std::memcpy(header.magic, PAGE_FILE_MAGIC, sizeof(header.magic));
+			header.version = PAGE_FILE_VERSION;
+			header.width = layout.width;
+			header.height = layout.height;
+			header.pageSize = VirtualTextureLayout::PAGE_SIZE;
+			header.pageBorder = VirtualTextureLayout::PAGE_BORDER;
+			header.pageCount = layout.pageCount;
+			file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+			std::array<float, 256> linear;
+			for (uint32_t i = 0; i < 256; i++)
+				linear[i] = toLinear(static_cast<unsigned char>(i));
+
+			const uint32_t slotSize = VirtualTextureLayout::SLOT_SIZE;
+			std::vector<unsigned char> page(VirtualTextureLayout::PAGE_BYTES);
+			Level level{ data.width, data.height, std::vector<unsigned char>(static_cast<size_t>(data.width) * data.height * 4) };
+			convertToRgba(data.pixels.data(), data.channels, level.pixels.data(), static_cast<size_t>(data.width) * data.height, PixelConversion());
+			for (uint32_t levelIndex = 0; levelIndex < layout.levels; levelIndex++)
+			{
+				if (levelIndex > 0)
+					level = downsample(level, linear);
+
+				VkExtent2D pages = layout.getLevelPages(levelIndex);
+				for (uint32_t pageY = 0; pageY < pages.height; pageY++)
+				{
+					for (uint32_t pageX = 0; pageX < pages.width; pageX++)
+					{
+						int64_t originX = static_cast<int64_t>(pageX) * VirtualTextureLayout::PAGE_SIZE - VirtualTextureLayout::PAGE_BORDER;
+						int64_t originY = static_cast<int64_t>(pageY) * VirtualTextureLayout::PAGE_SIZE - VirtualTextureLayout::PAGE_BORDER;
+						for (uint32_t y = 0; y < slotSize; y++)
+						{
+							uint32_t sourceY = wrap(originY + y, level.height);
+							for (uint32_t x = 0; x < slotSize; x++)
+							{
+								uint32_t sourceX = wrap(originX + x, level.width);
+								std::memcpy(&page[(static_cast<size_t>(y) * slotSize + x) * 4],
+									&level.pixels[(static_cast<size_t>(sourceY) * level.width + sourceX) * 4], 4);
+							}
+						}
+						file.write(reinterpret_cast<const char*>(page.data()), page.size());
+					}
+				}
+			}
+
+			file.close();
+			if (!file)
+				throw std::runtime_error("failed to write page file " + temporary + "!");
+			std::filesystem::rename(temporary, path);
+		}
+
+		//complete, for the same layout and newer than the image file it was built from
+		bool isPageFileValid(const std::string& path, const VirtualTextureLayout& layout, const std::string& sourcePath)
+		{
+			std::error_code error;
+			if (!std::filesystem::exists(path, error))
+				return false;
+			auto pageFileTime = std::filesystem::last_write_time(path, error);
+			if (error)
+				return false;
+			//an image only found in the asset pack has no time to compare, the page file stays valid
+			auto sourceTime = std::filesystem::exists(sourcePath, error) ? std::filesystem::last_write_time(sourcePath, error) : pageFileTime;
+			if (error || sourceTime > pageFileTime)
+				return false;
+			uintmax_t size = std::filesystem::file_size(path, error);
+			if (error || size != sizeof(PageFileHeader) + VirtualTextureLayout::PAGE_BYTES * layout.pageCount)
+				return false;
+
+			std::ifstream file(path, std::ios::binary);
+			PageFileHeader header{};
+			if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)))
+				return false;
+			return std::memcmp(header.magic, PAGE_FILE_MAGIC, sizeof(header.magic)) == 0 && header.version == PAGE_FILE_VERSION &&
+				header.width == layout.width && header.height == layout.height && header.pageSize == VirtualTextureLayout::PAGE_SIZE &&
+				header.pageBorder == VirtualTextureLayout::PAGE_BORDER && header.pageCount == layout.pageCount;
+		}
+
+		//safe to call from the thread pool. Only the pages touched are read from the disk
+		std::vector<unsigned char> readPageData(const MappedFile& file, uint64_t offset)
+		{
+			if (offset + VirtualTextureLayout::PAGE_BYTES > file.size())
+				throw std::runtime_error("page at " + std::to_string(offset) + " is outside of its page file!");
+			const unsigned char* page = file.data() + offset;
+			return std::vector<unsigned char>(page, page + VirtualTextureLayout::PAGE_BYTES);
+		}
+	}
+
+	VirtualTextureLayout VirtualTextureLayout::make(uint32_t width, uint32_t height)
+	{
+		VirtualTextureLayout layout;
+		layout.width = std::max(width, 1u);
+		layout.height = std::max(height, 1u);
+		while (true)
+		{
+			layout.levelFirstPage.push_back(layout.pageCount);
+			VkExtent2D pages = layout.getLevelPages(layout.levels);
+			layout.pageCount += pages.width * pages.height;
+			layout.levels++;
+			if (pages.width == 1 && pages.height == 1)
+				break;
+		}
+		return layout;
+	}
+
+	VkExtent2D VirtualTextureLayout::getLevelSize(uint32_t level) const
+	{
+		return { std::max(width >> level, 1u), std::max(height >> level, 1u) };
+	}
+
+	VkExtent2D VirtualTextureLayout::getLevelPages(uint32_t level) const
+	{
+		VkExtent2D size = getLevelSize(level);
+		return { (size.width + PAGE_SIZE - 1) / PAGE_SIZE, (size.height + PAGE_SIZE - 1) / PAGE_SIZE };
+	}
+
+	uint32_t VirtualTextureLayout::getPage(uint32_t level, uint32_t x, uint32_t y) const
+	{
+		return levelFirstPage[level] + y * getLevelPages(level).width + x;
+	}
+
+	VkDeviceSize VirtualTextureLayout::getFullResolutionBytes() const
+	{
+		VkDeviceSize bytes = 0;
+		uint32_t mipWidth = width;
+		uint32_t mipHeight = height;
+		while (true)
+		{
+			bytes += static_cast<VkDeviceSize>(mipWidth) * mipHeight * 4;
+			if (mipWidth == 1 && mipHeight == 1)
+				break;
+			mipWidth = std::max(mipWidth / 2, 1u);
+			mipHeight = std::max(mipHeight / 2, 1u);
+		}
+		return bytes;
+	}
+
+	void VirtualTextureCache::create(VkDevice device, const MemoryTypeFinder& findMemoryType, DescriptorAllocator& descriptorAllocator,
+		ThreadPool& threadPool, const std::string& directory, uint32_t cacheSize)
+	{
+		this->device = device;
+		this->findMemoryType = findMemoryType;
+		this->descriptorAllocator = &descriptorAllocator;
+		this->threadPool = &threadPool;
+		this->directory = directory;
+		//whole slots only
+		uint32_t slotsPerSide = std::clamp(cacheSize / VirtualTextureLayout::SLOT_SIZE, 1u, MAX_SLOTS_PER_SIDE);
+		this->cacheSize = slotsPerSide * VirtualTextureLayout::SLOT_SIZE;
+
+		//page cache, texture descriptions, page table and feedback
+		std::vector<VkDescriptorSetLayoutBinding> bindings = {
+			{ 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr },
+			{ 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr },
+			{ 2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr },
+			{ 3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr }
+		};
+		VkDescriptorSetLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+		layoutInfo.pBindings = bindings.data();
+		if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &setLayout) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create virtual texture descriptor set layout!");
+		}
+		descriptorAllocator.registerLayout(setLayout, { { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 }, { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3 } });
+
+		//a single level, the shader picks the level through the page table. The borders keep the filter inside the slot
+		VkSamplerCreateInfo samplerInfo{};
+		samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+		samplerInfo.magFilter = VK_FILTER_LINEAR;
+		samplerInfo.minFilter = VK_FILTER_LINEAR;
+		samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.maxLod = 0.0f;
+		if (vkCreateSampler(device, &samplerInfo, nullptr, &sampler) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create virtual texture sampler!");
+		}
+
+		//word 0 is the feedback cell
+		table.assign(1, 0);
+		pages.assign(1, PageRef{});
+		textures.clear();
+		stats = {};
+	}
+
+	void VirtualTextureCache::destroy()
+	{
+		if (device == VK_NULL_HANDLE)
+			return;
+
+		destroyFrameData();
+		//the reads still running only fill their futures
+		loads.clear();
+		pinnedUploads.clear();
+		if (cacheImage != VK_NULL_HANDLE)
+		{
+			vkDestroyImageView(device, cacheView, nullptr);
+			vkDestroyImage(device, cacheImage, nullptr);
+			vkFreeMemory(device, cacheMemory, nullptr);
+			destroyBuffer(textureInfos);
+			cacheView = VK_NULL_HANDLE;
+			cacheImage = VK_NULL_HANDLE;
+			cacheMemory = VK_NULL_HANDLE;
+		}
+		vkDestroySampler(device, sampler, nullptr);
+		vkDestroyDescriptorSetLayout(device, setLayout, nullptr);
+		sampler = VK_NULL_HANDLE;
+		setLayout = VK_NULL_HANDLE;
+		cacheInitialized = false;
+		device = VK_NULL_HANDLE;
+	}
+
+	TextureData VirtualTextureCache::addTexture(const std::string& path, uint32_t tableIndex, uint32_t width, uint32_t height,
+		const std::function<TextureData()>& decode)
+	{
+		VirtualTexture texture;
+		texture.tableIndex = tableIndex;
+		texture.layout = VirtualTextureLayout::make(width, height);
+
+		//the stem keeps it readable, the hash of the path tells apart files with the same name
+		std::ostringstream name;
+		name << std::filesystem::path(path).stem().string() << "_" << std::hex << std::setw(16) << std::setfill('0')
+			<< hashString(std::filesystem::absolute(path).string()) << ".vtpages";
+		std::filesystem::create_directories(directory);
+		texture.pageFile = (std::filesystem::path(directory) / name.str()).string();
+
+		if (!isPageFileValid(texture.pageFile, texture.layout, path))
+		{
+			auto start = std::chrono::steady_clock::now();
+			TextureData data = decode();
+			if (data.width != texture.layout.width || data.height != texture.layout.height)
+				throw std::runtime_error("texture " + path + " changed size while it was loaded!");
+			writePageFile(texture.pageFile, texture.layout, data);
+			std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+			std::cout << "Built page file " << texture.pageFile << ": " << texture.layout.pageCount << " pages, " << texture.layout.levels
+				<< " levels in " << elapsed.count() << " ms" << std::endl;
+		}
+		texture.pageData = std::make_shared<MappedFile>();
+		if (!texture.pageData->open(texture.pageFile, MappedFile::Access::Random))
+			throw std::runtime_error("failed to open page file " + texture.pageFile + "!");
+
+		//the position of every level, then its pages
+		texture.tableOffset = static_cast<uint32_t>(table.size());
+		texture.firstPageWord = texture.tableOffset + texture.layout.levels;
+		for (uint32_t level = 0; level < texture.layout.levels; level++)
+			table.push_back(texture.firstPageWord + texture.layout.levelFirstPage[level]);
+		table.resize(texture.firstPageWord + texture.layout.pageCount, 0);
+		pages.resize(table.size());
+		for (uint32_t level = 0; level < texture.layout.levels; level++)
+		{
+			VkExtent2D levelPages = texture.layout.getLevelPages(level);
+			for (uint32_t y = 0; y < levelPages.height; y++)
+			{
+				for (uint32_t x = 0; x < levelPages.width; x++)
+					pages[texture.firstPageWord + texture.layout.getPage(level, x, y)] = { static_cast<uint32_t>(textures.size()), level, x, y };
+			}
+		}
+		textures.push_back(texture);
+
+		//the page of the coarsest level without its border
+		uint32_t tailLevel = texture.layout.levels - 1;
+		VkExtent2D tailSize = texture.layout.getLevelSize(tailLevel);
+		std::vector<unsigned char> tail = readPageData(*texture.pageData, getPageOffset(texture.firstPageWord + texture.layout.levelFirstPage[tailLevel]));
+		TextureData data;
+		data.width = tailSize.width;
+		data.height = tailSize.height;
+		data.pixels.resize(static_cast<size_t>(tailSize.width) * tailSize.height * 4);
+		for (uint32_t y = 0; y < tailSize.height; y++)
+		{
+			size_t source = (static_cast<size_t>(y + VirtualTextureLayout::PAGE_BORDER) * VirtualTextureLayout::SLOT_SIZE + VirtualTextureLayout::PAGE_BORDER) * 4;
+			std::memcpy(&data.pixels[static_cast<size_t>(y) * tailSize.width * 4], &tail[source], static_cast<size_t>(tailSize.width) * 4);
+		}
+		return data;
+	}
+
+	void VirtualTextureCache::createCache(uint32_t materialCount)
+	{
+		uint32_t slotsPerSide = cacheSize / VirtualTextureLayout::SLOT_SIZE;
+		slots.assign(static_cast<size_t>(slotsPerSide) * slotsPerSide, CacheSlot{});
+		freeSlots.clear();
+		for (uint32_t slot = static_cast<uint32_t>(slots.size()); slot-- > 0;)
+			freeSlots.push_back(slot);
+		if (slots.size() < textures.size())
+			throw std::runtime_error("the virtual texture cache can't hold the coarsest page of every texture!");
+
+		pageSlots.assign(table.size(), -1);
+		pageLoading.assign(table.size(), false);
+		pageWanted.assign(table.size(), false);
+
+		VkImageCreateInfo imageInfo{};
+		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imageInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageInfo.format = VK_FORMAT_R8G8B8A8_SRGB;
+		imageInfo.extent = { cacheSize, cacheSize, 1 };
+		imageInfo.mipLevels = 1;
+		imageInfo.arrayLayers = 1;
+		imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageInfo.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		if (vkCreateImage(device, &imageInfo, nullptr, &cacheImage) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create virtual texture cache image!");
+		}
+
+		VkMemoryRequirements memRequirements;
+		vkGetImageMemoryRequirements(device, cacheImage, &memRequirements);
+		std::optional<uint32_t> memoryType = findMemoryType(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		if (!memoryType.has_value()) {
+			throw std::runtime_error("failed to find suitable memory type for the virtual texture cache!");
+		}
+		VkMemoryAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		allocInfo.allocationSize = memRequirements.size;
+		allocInfo.memoryTypeIndex = memoryType.value();
+		if (vkAllocateMemory(device, &allocInfo, nullptr, &cacheMemory) != VK_SUCCESS) {
+			throw std::runtime_error("failed to allocate virtual texture cache memory!");
+		}
+		vkBindImageMemory(device, cacheImage, cacheMemory, 0);
+		cacheBytes = memRequirements.size;
+
+		VkImageViewCreateInfo viewInfo{};
+		viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+		viewInfo.image = cacheImage;
+		viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+		viewInfo.format = VK_FORMAT_R8G8B8A8_SRGB;
+		viewInfo.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+		if (vkCreateImageView(device, &viewInfo, nullptr, &cacheView) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create virtual texture cache view!");
+		}
+		cacheInitialized = false;
+
+		//indexed by the material, so every table slot has one
+		std::vector<TextureInfo> infos(std::max(materialCount, 1u));
+		for (const VirtualTexture& texture : textures)
+		{
+			if (texture.tableIndex < infos.size())
+				infos[texture.tableIndex] = { texture.tableOffset, texture.layout.levels, texture.layout.width, texture.layout.height };
+		}
+		VkDeviceSize infoSize = sizeof(TextureInfo) * infos.size();
+		textureInfos = createBuffer(infoSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+		void* data;
+		vkMapMemory(device, textureInfos.memory, 0, infoSize, 0, &data);
+		std::memcpy(data, infos.data(), infoSize);
+		vkUnmapMemory(device, textureInfos.memory);
+
+		for (const VirtualTexture& texture : textures)
+		{
+			uint32_t page = texture.firstPageWord + texture.layout.levelFirstPage[texture.layout.levels - 1];
+			uint32_t slot = allocateSlot().value();
+			slots[slot] = { page, 0, true };
+			pageSlots[page] = static_cast<int32_t>(slot);
+			pinnedUploads.push_back({ slot, readPageData(*texture.pageData, getPageOffset(page)) });
+		}
+		tableDirty = true;
+	}
+
+	void VirtualTextureCache::createFrameData(uint32_t slotCount)
+	{
+		VkDeviceSize tableSize = sizeof(uint32_t) * table.size();
+		//the pinned pages go with the uploads of the first frame
+		VkDeviceSize stagingSize = VirtualTextureLayout::PAGE_BYTES * (MAX_UPLOADS_PER_FRAME + textures.size());
+
+		frames.resize(slotCount);
+		for (FrameData& data : frames)
+		{
+			data.pageTable = createBuffer(tableSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+			vkMapMemory(device, data.pageTable.memory, 0, tableSize, 0, reinterpret_cast<void**>(&data.pageTableData));
+			data.tableVersion = 0;
+			//read back by the CPU, cached memory when there is some
+			data.feedback = createBuffer(tableSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
+			vkMapMemory(device, data.feedback.memory, 0, tableSize, 0, reinterpret_cast<void**>(&data.feedbackData));
+			std::memset(data.feedbackData, 0, tableSize);
+			data.feedbackPending = false;
+			data.staging = createBuffer(stagingSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+			vkMapMemory(device, data.staging.memory, 0, stagingSize, 0, reinterpret_cast<void**>(&data.stagingData));
+			data.uploads.clear();
+
+			VkDescriptorImageInfo cacheInfo{ sampler, cacheView, VK_IMAGE_LAYOUT_GENERAL };
+			VkDescriptorBufferInfo bufferInfos[3] = {
+				{ textureInfos.buffer, 0, VK_WHOLE_SIZE },
+				{ data.pageTable.buffer, 0, VK_WHOLE_SIZE },
+				{ data.feedback.buffer, 0, VK_WHOLE_SIZE }
+			};
+			std::vector<VkWriteDescriptorSet> writes(4);
+			for (uint32_t binding = 0; binding < writes.size(); binding++)
+			{
+				writes[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+				writes[binding].dstBinding = binding;
+				writes[binding].descriptorCount = 1;
+				if (binding == 0) {
+					writes[binding].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+					writes[binding].pImageInfo = &cacheInfo;
+				}
+				else {
+					writes[binding].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+					writes[binding].pBufferInfo = &bufferInfos[binding - 1];
+				}
+			}
+			data.set = descriptorAllocator->allocateCached(setLayout, writes);
+		}
+	}
+
+	void VirtualTextureCache::destroyFrameData()
+	{
+		if (frames.empty())
+			return;
+
+		//point to the buffers destroyed below
+		descriptorAllocator->resetPersistent(setLayout);
+		for (FrameData& data : frames)
+		{
+			//the uploads assigned to a slot are recorded in the same frame, so none are lost here
+			destroyBuffer(data.pageTable);
+			destroyBuffer(data.feedback);
+			destroyBuffer(data.staging);
+		}
+		frames.clear();
+	}
+
+	void VirtualTextureCache::beginFrame(uint32_t slot, uint64_t frame)
+	{
+		this->frame = frame;
+		FrameData& data = frames[slot];
+
+		if (data.feedbackPending)
+		{
+			for (uint32_t word = 1; word < table.size(); word++)
+			{
+				if (data.feedbackData[word] == 0)
+					continue;
+				data.feedbackData[word] = 0;
+				if (pages[word].texture != UINT32_MAX)
+				{
+					request(word);
+					stats.pagesRequested++;
+				}
+			}
+			data.feedbackPending = false;
+		}
+
+		startLoads();
+		applyLoads(data);
+		if (tableDirty)
+			resolveTable();
+
+		if (data.tableVersion != tableVersion)
+		{
+			std::memcpy(data.pageTableData, table.data(), sizeof(uint32_t) * table.size());
+			data.tableVersion = tableVersion;
+		}
+		//walks through every cell of the block, 37 and 64 are coprime
+		data.pageTableData[0] = static_cast<uint32_t>((frame * 37) % (FEEDBACK_BLOCK * FEEDBACK_BLOCK));
+		data.feedbackPending = true;
+	}
+
+	void VirtualTextureCache::recordUploads(VkCommandBuffer commandBuffer, uint32_t slot)
+	{
+		FrameData& data = frames[slot];
+		if (data.uploads.empty() && cacheInitialized)
+			return;
+
+		//the frames before only sampled the slots being replaced, so their reads just have to be done
+		VkImageMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = cacheImage;
+		barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+		barrier.oldLayout = cacheInitialized ? VK_IMAGE_LAYOUT_GENERAL : VK_IMAGE_LAYOUT_UNDEFINED;
+		barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer,
+			VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+			0, nullptr,
+			0, nullptr,
+			1, &barrier);
+		cacheInitialized = true;
+
+		if (!data.uploads.empty())
+		{
+			vkCmdCopyBufferToImage(commandBuffer, data.staging.buffer, cacheImage, VK_IMAGE_LAYOUT_GENERAL,
+				static_cast<uint32_t>(data.uploads.size()), data.uploads.data());
+		}
+
+		barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+			0, nullptr,
+			0, nullptr,
+			1, &barrier);
+
+		stats.pagesUploaded += data.uploads.size();
+		data.uploads.clear();
+	}
+
+	void VirtualTextureCache::recordFeedbackBarrier(VkCommandBuffer commandBuffer)
+	{
+		VkMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+	}
+
+	VirtualTextureCache::Stats VirtualTextureCache::takeStats()
+	{
+		Stats taken = stats;
+		taken.textures = static_cast<uint32_t>(textures.size());
+		taken.slotCount = static_cast<uint32_t>(slots.size());
+		taken.residentPages = static_cast<uint32_t>(slots.size() - freeSlots.size());
+		for (const VirtualTexture& texture : textures)
+		{
+			taken.pageCount += texture.layout.pageCount;
+			taken.fullResolutionBytes += texture.layout.getFullResolutionBytes();
+		}
+		taken.residentBytes = VirtualTextureLayout::PAGE_BYTES * taken.residentPages;
+		taken.cacheBytes = cacheBytes;
+
+		stats.pagesRequested = 0;
+		stats.pagesUploaded = 0;
+		return taken;
+	}
+
+	void VirtualTextureCache::request(uint32_t page)
+	{
+		//the first resident page on the way to the coarsest level is the one sampled meanwhile
+		for (uint32_t current = page;; current = getParent(current))
+		{
+			if (pageSlots[current] >= 0)
+			{
+				slots[pageSlots[current]].lastUsed = frame;
+				return;
+			}
+			if (!pageLoading[current] && !pageWanted[current])
+			{
+				pageWanted[current] = true;
+				wanted.push_back(current);
+			}
+			if (pages[current].level + 1 >= textures[pages[current].texture].layout.levels)
+				return;
+		}
+	}
+
+	void VirtualTextureCache::startLoads()
+	{
+		//coarse pages first, they cover more of the screen and are the fallback of the finer ones
+		std::sort(wanted.begin(), wanted.end(), [this](uint32_t a, uint32_t b) { return pages[a].level > pages[b].level; });
+		for (uint32_t page : wanted)
+		{
+			pageWanted[page] = false;
+			//the others are requested again by the next feedback that still needs them
+			if (loads.size() >= MAX_LOADS_IN_FLIGHT)
+				continue;
+
+			pageLoading[page] = true;
+			std::shared_ptr<MappedFile> file = textures[pages[page].texture].pageData;
+			uint64_t offset = getPageOffset(page);
+			loads.push_back({ page, threadPool->submit([file, offset]() { return readPageData(*file, offset); }) });
+		}
+		wanted.clear();
+	}
+
+	void VirtualTextureCache::applyLoads(FrameData& data)
+	{
+		for (const auto& pinned : pinnedUploads)
+			queueUpload(data, pinned.first, pinned.second);
+		pinnedUploads.clear();
+
+		for (auto load = loads.begin(); load != loads.end() && data.uploads.size() < MAX_UPLOADS_PER_FRAME;)
+		{
+			if (load->pixels.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+			{
+				++load;
+				continue;
+			}
+
+			uint32_t page = load->page;
+			pageLoading[page] = false;
+			try
+			{
+				std::vector<unsigned char> pixels = load->pixels.get();
+				//without a slot that wasn't used recently the page is dropped, a later feedback asks for it again
+				std::optional<uint32_t> slot = allocateSlot();
+				if (slot.has_value())
+				{
+					slots[slot.value()] = { page, frame, false };
+					pageSlots[page] = static_cast<int32_t>(slot.value());
+					tableDirty = true;
+					queueUpload(data, slot.value(), pixels);
+				}
+			}
+			catch (const std::exception& e)
+			{
+				std::cerr << "failed to load virtual texture page: " << e.what() << std::endl;
+			}
+			load = loads.erase(load);
+		}
+	}
+
+	void VirtualTextureCache::queueUpload(FrameData& data, uint32_t slot, const std::vector<unsigned char>& pixels)
+	{
+		VkDeviceSize offset = VirtualTextureLayout::PAGE_BYTES * data.uploads.size();
+		std::memcpy(data.stagingData + offset, pixels.data(), VirtualTextureLayout::PAGE_BYTES);
+
+		uint32_t slotsPerSide = cacheSize / VirtualTextureLayout::SLOT_SIZE;
+		VkBufferImageCopy region{};
+		region.bufferOffset = offset;
+		region.bufferRowLength = 0;
+		region.bufferImageHeight = 0;
+		region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+		region.imageOffset = { static_cast<int32_t>(slot % slotsPerSide * VirtualTextureLayout::SLOT_SIZE),
+			static_cast<int32_t>(slot / slotsPerSide * VirtualTextureLayout::SLOT_SIZE), 0 };
+		region.imageExtent = { VirtualTextureLayout::SLOT_SIZE, VirtualTextureLayout::SLOT_SIZE, 1 };
+		data.uploads.push_back(region);
+	}
+
+	std::optional<uint32_t> VirtualTextureCache::allocateSlot()
+	{
+		if (!freeSlots.empty())
+		{
+			uint32_t slot = freeSlots.back();
+			freeSlots.pop_back();
+			return slot;
+		}
+
+		//least recently requested, among the ones no frame in flight may still ask for
+		std::optional<uint32_t> oldest;
+		for (uint32_t slot = 0; slot < slots.size(); slot++)
+		{
+			const CacheSlot& candidate = slots[slot];
+			if (candidate.pinned || candidate.lastUsed + EVICTION_DELAY > frame)
+				continue;
+			if (!oldest.has_value() || candidate.lastUsed < slots[oldest.value()].lastUsed)
+				oldest = slot;
+		}
+		if (oldest.has_value())
+		{
+			pageSlots[slots[oldest.value()].page] = -1;
+			slots[oldest.value()].page = UINT32_MAX;
+			tableDirty = true;
+		}
+		return oldest;
+	}
+
+	void VirtualTextureCache::resolveTable()
+	{
+		//coarsest level first, so a missing page takes the entry of its parent
+		uint32_t slotsPerSide = cacheSize / VirtualTextureLayout::SLOT_SIZE;
+		for (const VirtualTexture& texture : textures)
+		{
+			const VirtualTextureLayout& layout = texture.layout;
+			for (uint32_t level = layout.levels; level-- > 0;)
+			{
+				VkExtent2D levelPages = layout.getLevelPages(level);
+				for (uint32_t y = 0; y < levelPages.height; y++)
+				{
+					for (uint32_t x = 0; x < levelPages.width; x++)
+					{
+						uint32_t word = texture.firstPageWord + layout.getPage(level, x, y);
+						int32_t slot = pageSlots[word];
+						if (slot >= 0)
+						{
+							uint32_t slotIndex = static_cast<uint32_t>(slot);
+							table[word] = (slotIndex % slotsPerSide) | ((slotIndex / slotsPerSide) << 8) | (level << 16);
+						}
+						else if (level + 1 < layout.levels)
+							table[word] = table[texture.firstPageWord + layout.getPage(level + 1, x / 2, y / 2)];
+					}
+				}
+			}
+		}
+		tableVersion++;
+		tableDirty = false;
+	}
+
+	uint32_t VirtualTextureCache::getParent(uint32_t page) const
+	{
+		const PageRef& ref = pages[page];
+		const VirtualTexture& texture = textures[ref.texture];
+		return texture.firstPageWord + texture.layout.getPage(ref.level + 1, ref.x / 2, ref.y / 2);
+	}
+
+	uint64_t VirtualTextureCache::getPageOffset(uint32_t page) const
+	{
+		const VirtualTexture& texture = textures[pages[page].texture];
+		return sizeof(PageFileHeader) + VirtualTextureLayout::PAGE_BYTES * (page - texture.firstPageWord);
+	}
+
+	VirtualTextureCache::Allocation VirtualTextureCache::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties)
+	{
+		Allocation allocation;
+		VkBufferCreateInfo bufferInfo{};
+		bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		bufferInfo.size = size;
+		bufferInfo.usage = usage;
+		bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		if (vkCreateBuffer(device, &bufferInfo, nullptr, &allocation.buffer) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create virtual texture buffer!");
+		}
+
+		VkMemoryRequirements memRequirements;
+		vkGetBufferMemoryRequirements(device, allocation.buffer, &memRequirements);
+		std::optional<uint32_t> memoryType = findMemoryType(memRequirements.memoryTypeBits, properties);
+		//host cached is only a preference
+		if (!memoryType.has_value() && (properties & VK_MEMORY_PROPERTY_HOST_CACHED_BIT))
+			memoryType = findMemoryType(memRequirements.memoryTypeBits, properties & ~VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
+		if (!memoryType.has_value()) {
+			throw std::runtime_error("failed to find suitable memory type for a virtual texture buffer!");
+		}
+
+		VkMemoryAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		allocInfo.allocationSize = memRequirements.size;
+		allocInfo.memoryTypeIndex = memoryType.value();
+		if (vkAllocateMemory(device, &allocInfo, nullptr, &allocation.memory) != VK_SUCCESS) {
+			throw std::runtime_error("failed to allocate virtual texture buffer memory!");
+		}
+		vkBindBufferMemory(device, allocation.buffer, allocation.memory, 0);
+		return allocation;
+	}
+
+	void VirtualTextureCache::destroyBuffer(Allocation& allocation)
+	{
+		vkDestroyBuffer(device, allocation.buffer, nullptr);
+		vkFreeMemory(device, allocation.memory, nullptr);
+		allocation = {};
+	}
+}
@@ -0,0 +1,221 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include "DescriptorAllocator.hpp"
+#include "MappedFile.hpp"
+#include "Texture.hpp"
+#include "ThreadPool.hpp"
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace vulkanExample
+{
+	// How a virtual texture is cut into pages. Every level of its mip chain is split into pages of PAGE_SIZE texels, each
+	// stored with a PAGE_BORDER texel border (wrapped, like the repeat mode of the material sampler) so bilinear filtering never
+	// reads the neighbouring slot of the page cache. The levels stop at the first one that fits in a single page
+	struct VirtualTextureLayout
+	{
+		static constexpr uint32_t PAGE_SIZE = 120;
+		static constexpr uint32_t PAGE_BORDER = 4;
+		//side of a stored page with its border, and of a slot of the page cache
+		static constexpr uint32_t SLOT_SIZE = PAGE_SIZE + 2 * PAGE_BORDER;
+		static constexpr VkDeviceSize PAGE_BYTES = static_cast<VkDeviceSize>(SLOT_SIZE) * SLOT_SIZE * 4;
+
+		uint32_t width = 0;
+		uint32_t height = 0;
+		uint32_t levels = 0;
+		//index of the first page of every level, pages are numbered level by level and row by row
+		std::vector<uint32_t> levelFirstPage;
+		uint32_t pageCount = 0;
+
+		static VirtualTextureLayout make(uint32_t width, uint32_t height);
+		VkExtent2D getLevelSize(uint32_t level) const;
+		VkExtent2D getLevelPages(uint32_t level) const;
+		uint32_t getPage(uint32_t level, uint32_t x, uint32_t y) const;
+		//of the regular texture with a full mip chain, what createTextureImage uploads
+		VkDeviceSize getFullResolutionBytes() const;
+	};
+
+	// Streams the pages of large textures into a fixed size page cache texture.
+	// Every virtual texture is cut into pages once and stored in a page file on disk, rebuilt when the image file is newer.
+	// The fragment shader (VIRTUAL_TEXTURES in shader.frag) picks the level from the texture coordinate derivatives and looks up
+	// the page in a page table: the cache slot of the finest resident level covering it. One fragment out of every 8x8 block,
+	// a different one each frame, also writes the page it wanted into a feedback buffer. That low resolution feedback is read
+	// back once the frame completed, the missing pages (and their missing parents, coarsest first) are read from the page
+	// files on the thread pool and copied into the least recently used cache slots at the start of a later frame.
+	// The single page of the coarsest level of every texture stays resident, so the page table always has something to point to.
+	// Page tables, feedback and staging exist once per frame slot, so nothing the GPU is still reading is overwritten
+	class VirtualTextureCache
+	{
+	public:
+		//no value if none of the types has the properties
+		using MemoryTypeFinder = std::function<std::optional<uint32_t>(uint32_t typeBits, VkMemoryPropertyFlags properties)>;
+
+		struct Stats
+		{
+			uint32_t textures = 0;
+			uint32_t residentPages = 0;
+			uint32_t pageCount = 0;
+			uint32_t slotCount = 0;
+			//memory of the resident pages and of the whole cache texture
+			VkDeviceSize residentBytes = 0;
+			VkDeviceSize cacheBytes = 0;
+			//of the same textures uploaded at full resolution with every mip level
+			VkDeviceSize fullResolutionBytes = 0;
+			//since the last takeStats()
+			uint64_t pagesRequested = 0;
+			uint64_t pagesUploaded = 0;
+		};
+
+		//layout of descriptor set 2 of the scene pipelines. cacheSize is the side of the page cache texture in texels,
+		//page files are stored in directory
+		void create(VkDevice device, const MemoryTypeFinder& findMemoryType, DescriptorAllocator& descriptorAllocator, ThreadPool& threadPool,
+			const std::string& directory, uint32_t cacheSize);
+		void destroy();
+
+		//opens the page file of the image file, building it from decode() if it is missing or out of date. Materials reading
+		//texture table slot tableIndex then sample it virtually. Returns the coarsest level, to fill the regular texture slot
+		TextureData addTexture(const std::string& path, uint32_t tableIndex, uint32_t width, uint32_t height,
+			const std::function<TextureData()>& decode);
+		//the cache texture and the texture descriptions of materialCount table slots. After every texture was added
+		void createCache(uint32_t materialCount);
+		//page tables, feedback and staging of slotCount frame slots
+		void createFrameData(uint32_t slotCount);
+		void destroyFrameData();
+
+		//reads the feedback the slot's previous frame wrote, starts the page loads it asks for and assigns the finished
+		//ones to cache slots. The GPU must be done with the slot
+		void beginFrame(uint32_t slot, uint64_t frame);
+		//copies the pages assigned in beginFrame into the cache. Outside of a render pass, before the scene
+		void recordUploads(VkCommandBuffer commandBuffer, uint32_t slot);
+		//makes the feedback the scene wrote visible to the host. After the scene
+		void recordFeedbackBarrier(VkCommandBuffer commandBuffer);
+
+		VkDescriptorSetLayout getLayout() const { return setLayout; }
+		VkDescriptorSet getSet(uint32_t slot) const { return frames[slot].set; }
+		VkDeviceSize getCacheBytes() const { return cacheBytes; }
+		bool isCreated() const { return setLayout != VK_NULL_HANDLE; }
+		Stats takeStats();
+
+	private:
+		// Matches VirtualTexture in shader.frag (std430). levels is 0 for materials sampled the regular way
+		struct TextureInfo
+		{
+			uint32_t tableOffset = 0;
+			uint32_t levels = 0;
+			uint32_t width = 0;
+			uint32_t height = 0;
+		};
+
+		struct VirtualTexture
+		{
+			std::string pageFile;
+			//mapped for random access, shared with the page reads still running on the thread pool
+			std::shared_ptr<MappedFile> pageData;
+			uint32_t tableIndex = 0;
+			VirtualTextureLayout layout;
+			//word of the page table holding the position of level 0, the other levels follow. The pages come after them
+			uint32_t tableOffset = 0;
+			uint32_t firstPageWord = 0;
+		};
+
+		// A page table word that is a page
+		struct PageRef
+		{
+			uint32_t texture = UINT32_MAX;
+			uint32_t level = 0;
+			uint32_t x = 0;
+			uint32_t y = 0;
+		};
+
+		struct CacheSlot
+		{
+			//page table word of the page in it
+			uint32_t page = UINT32_MAX;
+			uint64_t lastUsed = 0;
+			bool pinned = false;
+		};
+
+		struct PageLoad
+		{
+			uint32_t page;
+			std::future<std::vector<unsigned char>> pixels;
+		};
+
+		// Buffer and the memory bound to it
+		struct Allocation
+		{
+			VkBuffer buffer = VK_NULL_HANDLE;
+			VkDeviceMemory memory = VK_NULL_HANDLE;
+		};
+
+		struct FrameData
+		{
+			Allocation pageTable;
+			uint32_t* pageTableData = nullptr;
+			uint64_t tableVersion = 0;
+			Allocation feedback;
+			uint32_t* feedbackData = nullptr;
+			//the frame recorded with this slot writes feedback, read the next time the slot is used
+			bool feedbackPending = false;
+			Allocation staging;
+			unsigned char* stagingData = nullptr;
+			std::vector<VkBufferImageCopy> uploads;
+			VkDescriptorSet set = VK_NULL_HANDLE;
+		};
+
+		VkDevice device = VK_NULL_HANDLE;
+		MemoryTypeFinder findMemoryType;
+		DescriptorAllocator* descriptorAllocator = nullptr;
+		ThreadPool* threadPool = nullptr;
+		std::string directory;
+		uint32_t cacheSize = 0;
+
+		VkDescriptorSetLayout setLayout = VK_NULL_HANDLE;
+		VkSampler sampler = VK_NULL_HANDLE;
+		VkImage cacheImage = VK_NULL_HANDLE;
+		VkDeviceMemory cacheMemory = VK_NULL_HANDLE;
+		VkImageView cacheView = VK_NULL_HANDLE;
+		VkDeviceSize cacheBytes = 0;
+		//the first upload moves it out of VK_IMAGE_LAYOUT_UNDEFINED, it stays in VK_IMAGE_LAYOUT_GENERAL afterwards
+		bool cacheInitialized = false;
+		Allocation textureInfos;
+
+		std::vector<VirtualTexture> textures;
+		//word 0 is the feedback cell of the frame, then the textures (see VirtualTexture). Resolved to cache slots
+		std::vector<uint32_t> table;
+		uint64_t tableVersion = 1;
+		bool tableDirty = true;
+		std::vector<PageRef> pages;
+		//cache slot of every page table word, -1 if not resident
+		std::vector<int32_t> pageSlots;
+		std::vector<bool> pageLoading;
+		std::vector<bool> pageWanted;
+		std::vector<uint32_t> wanted;
+		std::vector<CacheSlot> slots;
+		std::vector<uint32_t> freeSlots;
+		std::vector<PageLoad> loads;
+		//coarsest pages, read when the cache is created and uploaded by the first frame
+		std::vector<std::pair<uint32_t, std::vector<unsigned char>>> pinnedUploads;
+
+		std::vector<FrameData> frames;
+		uint64_t frame = 0;
+		Stats stats;
+
+		void request(uint32_t page);
+		void startLoads();
+		void applyLoads(FrameData& data);
+		void queueUpload(FrameData& data, uint32_t slot, const std::vector<unsigned char>& pixels);
+		std::optional<uint32_t> allocateSlot();
+		void resolveTable();
+		uint32_t getParent(uint32_t page) const;
+		uint64_t getPageOffset(uint32_t page) const;
+
+		Allocation createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties);
+		void destroyBuffer(Allocation& allocation);
+	};
+}
@@ -8,18 +8,28 @@
 #include "glm/gtc/matrix_transform.hpp"
 #include <tiny_obj_loader.h>
 #include "UniformBufferObject.hpp"
+#include "PlatformUtils.hpp"
+#include "MappedFile.hpp"
+#include "AssetPack.hpp"
+#include "DerivedDataCache.hpp"
+#include "MathSimd.hpp"
+#include "PixelFormat.hpp"
+#include "TextureDecoder.hpp"
 #include <filesystem>
 #include <stb_image.h>
 #include <stdexcept>
 #include <vector>
 #include <iostream>
 #include <cstring>
+#include <cctype>
 #include <optional>
 #include <set>
 #include <cstdint> 
+#include <cstddef>
 #include <algorithm> 
 #include <fstream>
 #include <chrono>
+#include <cmath>
 #include <unordered_map>
 
 
@@ -105,10 +115,13 @@ namespace vulkanExample
 #pragma endregion
 
 	// Constructor
-	VulkanInterface::VulkanInterface(const uint32_t width, const uint32_t height)
+	VulkanInterface::VulkanInterface(const uint32_t width, const uint32_t height, const RenderSettings& settings)
+		: settings(settings)
 	{
 		w_width = width;
 		w_height = height;
+		framesInFlight = std::clamp(settings.framesInFlight, 1u, MAX_FRAMES_IN_FLIGHT);
+		framePacer.setFrameRateLimit(settings.frameRateLimit);
 		// Request Validation Layer (debug)
 		validationLayers = {
 		"VK_LAYER_KHRONOS_validation",
@@ -129,23 +142,29 @@ namespace vulkanExample
 	void VulkanInterface::cleanupSwapChain()
 	{
 
-		vkDestroyImageView(logicalDevice, colorImageView, nullptr);
-		vkDestroyImage(logicalDevice, colorImage, nullptr);
-		vkFreeMemory(logicalDevice, colorImageMemory, nullptr);
-
-		vkDestroyImageView(logicalDevice, depthImageView, nullptr);
-		vkDestroyImage(logicalDevice, depthImage, nullptr);
-		vkFreeMemory(logicalDevice, depthImageMemory, nullptr);
+		//the pyramid is sized after the depth target, and a view of it is destroyed with the render graph
+		occlusionCuller.destroyTargets();
+		//the transient images are sized after the swap chain
+		renderGraph.reset();
 
 		for (size_t i = 0; i < swapChainFramebuffers.size(); i++) {
 			vkDestroyFramebuffer(logicalDevice, swapChainFramebuffers[i], nullptr);
 		}
 
 		vkFreeCommandBuffers(logicalDevice, commandPool, static_cast<uint32_t>(commandBuffers.size()), commandBuffers.data());
-
-		vkDestroyPipeline(logicalDevice, graphicsPipeline, nullptr);
+		gpuTimer.destroy();
+		fragmentCounter.destroy();
+		destroyUpscalePass();
+
+		//every variant depends on the render pass and the swap chain extent
+		pipelineLibrary.clear();
+		graphicsPipeline = VK_NULL_HANDLE;
+		depthPipeline = VK_NULL_HANDLE;
 		vkDestroyPipelineLayout(logicalDevice, pipelineLayout, nullptr);
 		vkDestroyRenderPass(logicalDevice, renderPass, nullptr);
+		if (lateRenderPass != VK_NULL_HANDLE)
+			vkDestroyRenderPass(logicalDevice, lateRenderPass, nullptr);
+		lateRenderPass = VK_NULL_HANDLE;
 
 		for (size_t i = 0; i < swapChainImageViews.size(); i++) {
 			vkDestroyImageView(logicalDevice, swapChainImageViews[i], nullptr);
@@ -158,21 +177,48 @@ namespace vulkanExample
 			vkFreeMemory(logicalDevice, uniformBuffersMemory[i], nullptr);
 		}
 
-		vkDestroyDescriptorPool(logicalDevice, descriptorPool, nullptr);
+		//the sets point to the uniform buffers destroyed above
+		descriptorAllocator.resetPersistent(descriptorSetLayout);
+		//page tables and feedback are per swap chain image too
+		virtualTextures.destroyFrameData();
 
 	}
 
 	void VulkanInterface::cleanup()
 	{
+		shaderWatcher.stop();
 		cleanupSwapChain();
+		savePipelineCache();
+		reportDerivedData();
+		vkDestroyPipelineCache(logicalDevice, pipelineCache, nullptr);
+		shaderLibrary.destroy();
+		//their submissions complete before the graphics ones waiting on them
+		transferQueue.destroy();
+		computeQueue.destroy();
+		//runs the remaining deferred deletes (staging buffers, upload command buffers) before their pools go away
+		graphicsTimeline.destroy();
 		vkDestroySampler(logicalDevice, textureSampler, nullptr);
-
-		vkDestroyImageView(logicalDevice, textureImageView, nullptr);
-
-		vkDestroyImage(logicalDevice, textureImage, nullptr);
-		vkFreeMemory(logicalDevice, textureImageMemory, nullptr);
+		if (upscaleSetLayout != VK_NULL_HANDLE)
+		{
+			vkDestroySampler(logicalDevice, upscaleSampler, nullptr);
+			vkDestroyPipelineLayout(logicalDevice, upscalePipelineLayout, nullptr);
+			vkDestroyDescriptorSetLayout(logicalDevice, upscaleSetLayout, nullptr);
+		}
+		occlusionCuller.destroy();
+		virtualTextures.destroy();
+
+		//the files still being read are dropped
+		textureRestores.clear();
+		for (Texture& texture : textures) {
+			vkDestroyImageView(logicalDevice, texture.view, nullptr);
+			vkDestroyImage(logicalDevice, texture.image, nullptr);
+			vkFreeMemory(logicalDevice, texture.memory, nullptr);
+		}
+		textures.clear();
 
 
+		textureTable.destroy();
+		descriptorAllocator.destroy();
 		vkDestroyDescriptorSetLayout(logicalDevice, descriptorSetLayout, nullptr);
 
 		vkDestroyBuffer(logicalDevice, indexBuffer, nullptr);
@@ -181,15 +227,11 @@ namespace vulkanExample
 
 		vkDestroyBuffer(logicalDevice, vertexBuffer, nullptr);
 		vkFreeMemory(logicalDevice, vertexBufferMemory, nullptr);
+		vkDestroyBuffer(logicalDevice, positionBuffer, nullptr);
+		vkFreeMemory(logicalDevice, positionBufferMemory, nullptr);
 
 
-		for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
-		{
-			//destroy semaphores
-			vkDestroySemaphore(logicalDevice, renderFinishedSemaphores[i], nullptr);
-			vkDestroySemaphore(logicalDevice, imageAvailableSemaphores[i], nullptr);
-			vkDestroyFence(logicalDevice, inFlightFences[i], nullptr);
-		}
+		destroySyncObjects();
 
 		//destroy command poll
 		vkDestroyCommandPool(logicalDevice, commandPool, nullptr);
@@ -218,15 +260,171 @@ namespace vulkanExample
 
 	void VulkanInterface::mainLoop()
 	{
+		lastPresentTime = lastStatsTime = glfwGetTime();
 		while (!glfwWindowShouldClose(window))
 		{
-			glfwPollEvents();
-			drawFrame();
+			if (settings.renderOnDemand && !needsRedraw())
+			{
+				//sleeps on the event queue instead of spinning. Only wakes up for input, resize or the minimum refresh
+				waitForChanges();
+			}
+			else
+			{
+				glfwPollEvents();
+			}
+
+			if (!settings.renderOnDemand || needsRedraw() || glfwGetTime() - lastPresentTime >= settings.minRefreshInterval)
+			{
+				redrawRequested = false;
+				framePacer.waitForNextFrame();
+				drawFrame();
+				lastPresentTime = glfwGetTime();
+				frameStats.framesDrawn++;
+			}
+			else
+			{
+				frameStats.framesSkipped++;
+			}
+
+			reportFrameStats();
 		}
 		
 		vkDeviceWaitIdle(logicalDevice);
 	}
 
+	void VulkanInterface::requestRedraw()
+	{
+		redrawRequested = true;
+		//wakes up the main thread if it is blocked in glfwWaitEventsTimeout
+		glfwPostEmptyEvent();
+	}
+
+	bool VulkanInterface::needsRedraw() const
+	{
+		//held keys move the camera or rotate the model every frame
+		return redrawRequested || frameBufferResized || pressedKeys != KeyboardKeys::KEY_NONE;
+	}
+
+	void VulkanInterface::waitForChanges()
+	{
+		double timeout = settings.minRefreshInterval - (glfwGetTime() - lastPresentTime);
+		if (settings.statsInterval > 0.0)
+			timeout = std::min(timeout, settings.statsInterval - (glfwGetTime() - lastStatsTime));
+		if (timeout <= 0.0)
+		{
+			glfwPollEvents();
+			return;
+		}
+
+		//measures how much CPU the process burns while it is supposed to be idle
+		double wallStart = glfwGetTime();
+		double cpuStart = getProcessCpuTime();
+		glfwWaitEventsTimeout(timeout);
+		frameStats.idleWallTime += glfwGetTime() - wallStart;
+		frameStats.idleCpuTime += getProcessCpuTime() - cpuStart;
+	}
+
+	void VulkanInterface::reportFrameStats()
+	{
+		if (settings.statsInterval <= 0.0)
+			return;
+
+		double now = glfwGetTime();
+		double elapsed = now - lastStatsTime;
+		if (elapsed < settings.statsInterval)
+			return;
+
+		std::cout << "Frames drawn: " << frameStats.framesDrawn << " (" << frameStats.framesDrawn / elapsed << " fps";
+		if (frameStats.framesDrawn > 0)
+			std::cout << ", " << 1000.0 * elapsed / frameStats.framesDrawn << " ms/frame";
+		std::cout << ")"
+			<< " skipped: " << frameStats.framesSkipped;
+		if (frameStats.idleWallTime > 0.0)
+		{
+			std::cout << " idle: " << frameStats.idleWallTime << "s"
+				<< " idle CPU usage: " << 100.0 * frameStats.idleCpuTime / frameStats.idleWallTime << "%";
+		}
+		if (frameStats.framesDrawn > 0)
+		{
+			double frames = static_cast<double>(frameStats.framesDrawn);
+			std::cout << " per frame: " << frameStats.drawCalls / frames << " draws, "
+				<< frameStats.pipelineBinds / frames << " pipeline binds, "
+				<< frameStats.descriptorSetBinds / frames << " descriptor set binds, "
+				<< frameStats.pushConstantUpdates / frames << " push constant updates";
+		}
+		if (frameStats.gpuFramesTimed > 0)
+		{
+			std::cout << " GPU: " << frameStats.gpuTime / frameStats.gpuFramesTimed << " ms/frame";
+			if (settings.dynamicResolution)
+				std::cout << " render scale: " << resolutionController.getScale();
+		}
+		if (frameStats.framesCounted > 0)
+		{
+			//about 1 per pixel once every pixel is shaded only for its visible surface
+			std::cout << " fragment shader invocations: " << frameStats.fragmentInvocations / frameStats.framesCounted << "/frame, "
+				<< static_cast<double>(frameStats.fragmentInvocations) / std::max<uint64_t>(frameStats.fragmentPixels, 1) << "/pixel"
+				<< (depthPrepassEnabled ? " (depth pre-pass)" : "");
+		}
+		if (frameStats.framesCulled > 0)
+		{
+			//the late clusters were occluded in the previous frame but not in this one
+			double frames = static_cast<double>(frameStats.framesCulled);
+			std::cout << " clusters per frame: " << frameStats.clustersOccluded / frames << " occluded, "
+				<< frameStats.clustersOutsideFrustum / frames << " outside the frustum, "
+				<< frameStats.clustersDrawnEarly / frames << " + " << frameStats.clustersDrawnLate / frames << " drawn (early + late) of "
+				<< occlusionCuller.getClusterCount();
+		}
+		if (frameStats.gpuFramesTimed > 0 || transferQueue.isTimed() || computeQueue.isTimed())
+		{
+			//share of the interval each queue spent executing work, they overlap when the async queues are in use
+			auto printBusy = [elapsed](const char* name, bool timed, double ms) {
+				std::cout << " " << name << " ";
+				if (timed)
+					std::cout << 100.0 * ms / (1000.0 * elapsed) << "%";
+				else
+					std::cout << "n/a";
+			};
+			std::cout << " queue busy:";
+			printBusy("graphics", gpuTimer.isSupported(), frameStats.gpuTime);
+			printBusy("transfer", transferQueue.isTimed(), frameStats.transferBusyTime);
+			printBusy("compute", computeQueue.isTimed(), frameStats.computeBusyTime);
+		}
+		if (frameStats.memoryBudget > 0)
+		{
+			ResidencyManager::Stats residencyStats = residency.takeStats();
+			std::cout << " device memory: " << frameStats.memoryUsage / (1024 * 1024) << "/" << frameStats.memoryBudget / (1024 * 1024) << " MiB"
+				<< (frameStats.memoryMeasured ? "" : " (estimated)") << " textures downgraded: " << residencyStats.evictions
+				<< " (" << residencyStats.evictedBytes / (1024 * 1024) << " MiB) restored: " << residencyStats.restores;
+		}
+		if (virtualTexturingEnabled)
+		{
+			//what is resident against what uploading the same textures whole would take
+			VirtualTextureCache::Stats virtualStats = virtualTextures.takeStats();
+			std::cout << " virtual textures: " << virtualStats.residentPages << "/" << virtualStats.pageCount << " pages resident ("
+				<< virtualStats.residentBytes / (1024 * 1024) << " MiB of a " << virtualStats.cacheBytes / (1024 * 1024) << " MiB cache, "
+				<< virtualStats.fullResolutionBytes / (1024 * 1024) << " MiB at full resolution) requested: " << virtualStats.pagesRequested
+				<< " uploaded: " << virtualStats.pagesUploaded;
+		}
+		const DescriptorAllocator::Stats& descriptorStats = descriptorAllocator.getStats();
+		std::cout << " descriptor pools: " << descriptorStats.pools << " sets: " << descriptorStats.setsAllocated
+			<< " cache hits: " << descriptorStats.cacheHits << "/" << descriptorStats.cacheHits + descriptorStats.cacheMisses;
+		if (renderGraph.getStats().lazyBytes > 0)
+		{
+			std::cout << " lazy attachment memory committed: " << renderGraph.getCommittedLazyBytes() / 1024 << "/"
+				<< renderGraph.getStats().lazyBytes / 1024 << " KB";
+		}
+		FramePacer::LatencyStats latency = framePacer.takeLatencyStats();
+		if (latency.samples > 0)
+		{
+			std::cout << " input-to-present latency: " << latency.averageMs() << "ms avg " << latency.maxMs << "ms max"
+				<< (presentWaitEnabled ? "" : " (until present call)");
+		}
+		std::cout << std::endl;
+
+		frameStats.reset();
+		lastStatsTime = now;
+	}
+
 
 #pragma region INSTANCE_INIT
 
@@ -259,46 +457,72 @@ namespace vulkanExample
 		pickPhysicalDevices();
 		//Logical Device
 		createLogicalDevice();
+		//models, textures and shaders in a single mapped file, if it was built (--build-pack)
+		if (!settings.assetPack.empty() && assetPack.open(settings.assetPack))
+			std::cout << "Reading assets from " << settings.assetPack << std::endl;
+		//SPIR-V, the pipeline cache, welded meshes and decoded textures of the previous runs
+		derivedData.create(settings.derivedDataDirectory, static_cast<uint64_t>(settings.derivedDataMaxMB) * 1024 * 1024);
+		//runtime compiled shader variants, cached as derived data
+		shaderLibrary.create(logicalDevice, &derivedData, assetPack.isOpen() ? &assetPack : nullptr);
+		//loads the pipeline cache of the previous run
+		createPipelineCache();
+		//rebuilds the pipelines whenever a shader source (or the SPIR-V from compile_shaders.py) changes
+		if (settings.hotReloadShaders)
+			shaderWatcher.start("shaders", { ".vert", ".frag", ".spv" }, [this]() { requestRedraw(); });
+		//picks the starting sample count when it's adjusted at runtime
+		configureDynamicResolution();
+		//the depth buffer must be sampled for the depth pyramid
+		configureOcclusionCulling();
 		//Creates swap chain
 		createSwapChain();
 		//creates image views
 		createImageViews();
 		//create render pass
 		createRenderPass();
+		//one transient pool list per frame in flight
+		descriptorAllocator.create(logicalDevice, framesInFlight);
 		//create descriptor layout
 		createDescriptorSetLayout();
+		//upscale pass of the dynamic resolution
+		createUpscaleLayout();
+		//descriptor set of the material textures
+		createTextureTable();
+		//descriptor set of the virtual textures, part of the pipeline layout
+		configureVirtualTexturing();
 		//create graphics pipeline
 		createGraphicsPipeline();
 		//creates command poll
 		createCommandPool();
-		// Enables multisampling
-		createColorResources();
-		//Create Depth Buffer
-		createDepthResources();
+		//dedicated transfer and async compute queues, if the device has them
+		createAsyncQueues();
+		//multisampled color and depth buffers, and the barriers of the frame
+		createRenderGraph();
 		//creates frame buffer
 		createFrameBuffers();
-		//Create Texture Image
-		createTextureImage();
-		//Creates image View
-		createTextureImageView();
+		createUpscalePass();
 		//creates texture sampler
 		createTextureSampler();
+		//budget of the device memory, before anything is tracked
+		configureResidency();
 		// Loads model
 		loadModel({ 0.0f, 0.0f, 0.0f }, modelScale);
+		//Creates the material textures and makes them available to the shaders
+		createTextureImages();
 		//Creates Vertex Buffer
 		createVertextBuffer();
 		//creates Index Buffer
 		createIndexBuffer();
+		//culling pipelines, the clusters and the depth pyramid
+		createOcclusionCuller();
 		//creates uniform buffers
 		createUniformBuffers();
-		//creates descriptor poll
-		createDescriptorPool();
 		//create descriptor sets
 		createDescriptorSets();
 		//creates command buffers
 		createCommandBuffers();
 		//create semaphores
 		createSyncObjects();
+		reportDerivedData();
 	}
 	
 
@@ -346,8 +570,36 @@ namespace vulkanExample
 		auto instance = reinterpret_cast<VulkanInterface*>(glfwGetWindowUserPointer(window));
 		if (instance != nullptr)
 		{
+			//any key event may change what is on screen
+			instance->requestRedraw();
+			if (action == GLFW_PRESS || action == GLFW_RELEASE)
+				instance->framePacer.recordInput();
+
 			switch (key)
 			{
+			case GLFW_KEY_P:
+				if (action == GLFW_PRESS)
+					instance->cyclePresentMode();
+				break;
+			case GLFW_KEY_V:
+				//switches between the push constant and uniform buffer transform paths to compare frame times
+				if (action == GLFW_PRESS)
+					instance->settings.pushConstantMVP = !instance->settings.pushConstantMVP;
+				break;
+			case GLFW_KEY_C:
+				//the new variant is built in the background if it's not cached yet
+				if (action == GLFW_PRESS)
+					instance->cycleDebugView();
+				break;
+			case GLFW_KEY_Z:
+				if (action == GLFW_PRESS)
+					instance->toggleDepthPrepass();
+				break;
+			case GLFW_KEY_F:
+				//takes effect at the next frame boundary, as the sync objects have to be recreated
+				if (action == GLFW_PRESS)
+					instance->pendingFramesInFlight = instance->framesInFlight % MAX_FRAMES_IN_FLIGHT + 1;
+				break;
 			case GLFW_KEY_S:
 				if (action == GLFW_PRESS)
 					instance->pressedKeys += KeyboardKeys::KEY_S;
@@ -410,6 +662,14 @@ namespace vulkanExample
 			instance->frameBufferResized = true;
 	}
 
+	//called when the window content was damaged (e.g. uncovered by another window) and has to be presented again
+	void VulkanInterface::onWindowRefresh(GLFWwindow* window)
+	{
+		auto instance = reinterpret_cast<VulkanInterface*>(glfwGetWindowUserPointer(window));
+		if (instance != nullptr)
+			instance->redrawRequested = true;
+	}
+
 	void VulkanInterface::initWindow(const uint32_t width, const uint32_t height)
 	{
 		//initialize glfw
@@ -424,6 +684,7 @@ namespace vulkanExample
 		window = glfwCreateWindow(width, height, "Vulkan Example", nullptr, nullptr);
 		glfwSetWindowUserPointer(window, this);
 		glfwSetWindowSizeCallback(window, framebufferResizeCallback);
+		glfwSetWindowRefreshCallback(window, onWindowRefresh);
 		pressedKeys = KeyboardKeys::KEY_NONE;
 		glfwSetKeyCallback(window, onKeyPress);
 		//glfwSetCursorPosCallback(window, onMouseMove);
@@ -449,7 +710,8 @@ namespace vulkanExample
 		appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
 		appInfo.pEngineName = "GM Engine";
 		appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-		appInfo.apiVersion = VK_API_VERSION_1_0;
+		//1.2 is needed to query extended device features (e.g. present wait)
+		appInfo.apiVersion = VK_API_VERSION_1_2;
 
 		// Get extensions from GLFW 
 		glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
@@ -509,17 +771,32 @@ namespace vulkanExample
 		}
 
 		vkDeviceWaitIdle(logicalDevice);
+		//present ids belong to a swap chain: the presents of the old one are counted as done now that the device is idle,
+		//and the new one starts over from 1
+		framePacer.onPresentCompleted(presentId);
+		presentId = 0;
 		cleanupSwapChain();
+		//the pipeline library is empty now, so no pipeline is built for the old sample count or subpasses anymore
+		if (renderTargetsChanged)
+		{
+			if (settings.dynamicResolution)
+				msaaSamples = resolutionController.getSamples();
+			renderTargetsChanged = false;
+		}
 		createSwapChain();
+		//the new swap chain may have a different number of images. The device is idle, so nothing is in use
+		imageTimelineValues.assign(swapChainImages.size(), 0);
 		createImageViews();
 		createRenderPass();
 		createGraphicsPipeline();
-		createColorResources();
-		createDepthResources();
+		createRenderGraph();
+		createOcclusionCuller();
 		createFrameBuffers();
+		createUpscalePass();
 		createUniformBuffers();
-		createDescriptorPool();
 		createDescriptorSets();
+		if (virtualTexturingEnabled)
+			virtualTextures.createFrameData(static_cast<uint32_t>(swapChainImages.size()));
 		createCommandBuffers();
 
 	}
@@ -592,6 +869,7 @@ namespace vulkanExample
 		if (vkCreateSwapchainKHR(logicalDevice, &createInfo, nullptr, &swapChain) != VK_SUCCESS) {
 			throw std::runtime_error("failed to create swap chain!");
 		}
+		std::cout << "Swap chain present mode: " << presentModeName(presentMode) << ", frames in flight: " << framesInFlight << std::endl;
 
 		//saves swap chain format and extent
 		swapChainImageFormat = surfaceFormat.format;
@@ -604,28 +882,6 @@ namespace vulkanExample
 
 	}
 	
-	std::vector<char> VulkanInterface::readFile(const std::string& filename) 
-	{
-		
-		//opens file, start at the end
-		std::ifstream file(filename, std::ios::ate | std::ios::binary);
-		if (!file.is_open() || !file.good()) {
-			throw std::runtime_error("failed to open file!");
-		}
-		//grab file size
-		size_t fileSize = (size_t)file.tellg();
-		std::vector<char> buffer(fileSize);
-
-		//change pointer and read buffer
-		file.seekg(0);
-		file.read(buffer.data(), fileSize);
-		//close file
-		file.close();
-
-		return buffer;
-	}
-
-
 	void VulkanInterface::createImageViews()
 	{
 		//resize vector
@@ -647,15 +903,14 @@ namespace vulkanExample
 
 		//clear color data on load
 		colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-		//store color after rendering
-		colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+		//only resolved into the swap chain image, so never stored: tile based GPUs then don't need memory for it at all
+		colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 		//same here, but with stencil. Just don't care now, as we are not using stencils
 		colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 		colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 
-		//we don't care about the inial layout as the image will be cleared
-		colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		// after rendering, the image is ready to be presented
+		//the render graph transitions every attachment before the pass and after it, so the pass keeps their layouts
+		colorAttachment.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 		colorAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
 		//configures color attachment reference for sub-passes
@@ -672,7 +927,7 @@ namespace vulkanExample
 		depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 		depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 		depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-		depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		depthAttachment.initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 		depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
 		VkAttachmentReference depthAttachmentRef{};
@@ -687,8 +942,9 @@ namespace vulkanExample
 		colorAttachmentResolve.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
 		colorAttachmentResolve.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 		colorAttachmentResolve.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-		colorAttachmentResolve.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		colorAttachmentResolve.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+		//transitioned to the present layout by the render graph
+		colorAttachmentResolve.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		colorAttachmentResolve.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
 		VkAttachmentReference colorAttachmentResolveRef{};
 		colorAttachmentResolveRef.attachment = 2;
@@ -703,6 +959,34 @@ namespace vulkanExample
 		subpass.pDepthStencilAttachment = &depthAttachmentRef;
 		subpass.pResolveAttachments = &colorAttachmentResolveRef;
 
+		//depth pre-pass: a first subpass only writes the depth, then the shading subpass above tests against it
+		depthPrepassEnabled = settings.depthPrepass;
+		VkSubpassDescription depthSubpass{};
+		depthSubpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		depthSubpass.colorAttachmentCount = 0;
+		depthSubpass.pDepthStencilAttachment = &depthAttachmentRef;
+		std::vector<VkSubpassDescription> subpasses;
+		if (depthPrepassEnabled)
+			subpasses.push_back(depthSubpass);
+		subpasses.push_back(subpass);
+
+		//the shading subpass reads the depth in its early fragment tests. Both subpasses touch the same pixel only, so by region
+		VkSubpassDependency depthDependency{};
+		depthDependency.srcSubpass = 0;
+		depthDependency.dstSubpass = 1;
+		depthDependency.srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		depthDependency.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		depthDependency.dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+		depthDependency.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT;
+		depthDependency.dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+
+		//occlusion culling builds the depth pyramid from the depth of the early pass, and the late pass draws on top of its color
+		if (occlusionCullingEnabled)
+		{
+			colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+			depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+		}
 
 		std::array<VkAttachmentDescription, 3> attachments = { colorAttachment, depthAttachment, colorAttachmentResolve };
 
@@ -711,20 +995,11 @@ namespace vulkanExample
 		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
 		renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
 		renderPassInfo.pAttachments = attachments.data();
-		renderPassInfo.subpassCount = 1;
-		renderPassInfo.pSubpasses = &subpass;
-
-		//creates a subpass
-		VkSubpassDependency dependency{};
-		dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-		dependency.dstSubpass = 0;
-		dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-		dependency.srcAccessMask = 0;
-		dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-		dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-		
-		renderPassInfo.dependencyCount = 1;
-		renderPassInfo.pDependencies = &dependency;
+		renderPassInfo.subpassCount = static_cast<uint32_t>(subpasses.size());
+		renderPassInfo.pSubpasses = subpasses.data();
+		//no external dependencies: the barriers recorded by the render graph around the pass synchronize the attachments
+		renderPassInfo.dependencyCount = depthPrepassEnabled ? 1 : 0;
+		renderPassInfo.pDependencies = depthPrepassEnabled ? &depthDependency : nullptr;
 
 
 		//creates render pass
@@ -732,18 +1007,24 @@ namespace vulkanExample
 			throw std::runtime_error("failed to create render pass!");
 		}
 
+		//the late pass of occlusion culling draws on top of the early pass. Only the load and store operations differ,
+		//so it's compatible with the same pipelines and framebuffers
+		if (occlusionCullingEnabled)
+		{
+			attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+			attachments[0].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+			attachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+			attachments[1].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+			if (vkCreateRenderPass(logicalDevice, &renderPassInfo, nullptr, &lateRenderPass) != VK_SUCCESS) {
+				throw std::runtime_error("failed to create late render pass!");
+			}
+		}
+
 	}
 
 	void VulkanInterface::createDescriptorSetLayout()
 	{
-		VkDescriptorSetLayoutBinding samplerLayoutBinding{};
-		samplerLayoutBinding.binding = 1;
-		samplerLayoutBinding.descriptorCount = 1;
-		samplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-		samplerLayoutBinding.pImmutableSamplers = nullptr;
-		samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-
-
+		//the textures live in set 1 (see createTextureTable)
 		VkDescriptorSetLayoutBinding uboLayoutBinding{};
 		uboLayoutBinding.binding = 0;
 		uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
@@ -752,7 +1033,7 @@ namespace vulkanExample
 		uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 		uboLayoutBinding.pImmutableSamplers = nullptr;
 
-		std::array<VkDescriptorSetLayoutBinding, 2> bindings = { uboLayoutBinding, samplerLayoutBinding };
+		std::array<VkDescriptorSetLayoutBinding, 1> bindings = { uboLayoutBinding };
 
 		VkDescriptorSetLayoutCreateInfo createInfo{};
 		createInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
@@ -764,15 +1045,124 @@ namespace vulkanExample
 			throw std::runtime_error("failed to create descriptor set layout");
 		}
 
+		descriptorAllocator.registerLayout(descriptorSetLayout, { { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1 } });
+
+	}
+
+	void VulkanInterface::createTextureTable()
+	{
+		textureTable.create(logicalDevice, bindlessTexturesEnabled, textureTableCapacity, descriptorAllocator);
+		if (bindlessTexturesEnabled)
+			std::cout << "Textures: bindless table of " << textureTableCapacity << " descriptors, bound once per frame" << std::endl;
+		else
+			std::cout << "Textures: one descriptor set per texture, draws batched by texture" << std::endl;
+	}
+
+	void VulkanInterface::configureVirtualTexturing()
+	{
+		if (!settings.virtualTexturing)
+			return;
+
+		//the shader writes its feedback from the fragment stage and finds the texture through the material index push constant
+		if (!deviceFeatures.fragmentStoresAndAtomics || sizeof(PushConstants) > deviceProperties.limits.maxPushConstantsSize)
+		{
+			std::cout << "Virtual texturing needs fragment stores and the material index push constant, textures are uploaded whole" << std::endl;
+			return;
+		}
+
+		virtualTextures.create(logicalDevice, [this](uint32_t typeBits, VkMemoryPropertyFlags properties) { return findOptionalMemoryType(typeBits, properties); },
+			descriptorAllocator, threadPool, settings.virtualTextureDirectory, settings.virtualTextureCacheSize);
+		virtualTexturingEnabled = true;
+		std::cout << "Virtual texturing: textures of " << settings.virtualTextureMinSize << " texels and more are streamed through a "
+			<< settings.virtualTextureCacheSize << " texel page cache" << std::endl;
 	}
 
 	void VulkanInterface::createGraphicsPipeline()
 	{
-		auto vertShaderCode = readFile("shaders/vert.spv");
-		auto fragShaderCode = readFile("shaders/frag.spv");
+		pushConstantMVPSupported = sizeof(PushConstants) <= deviceProperties.limits.maxPushConstantsSize;
+		if (!pushConstantMVPSupported)
+			std::cout << "Push constants too small for the MVP matrix, using the uniform buffer" << std::endl;
+
+		//Creates pipeline layout infor
+		//They are commonly used to pass the transformation matrix to the vertex shader, or to create texture samplers in the fragment shader
+		//the layout is shared by every pipeline variant, so the push constant range is declared even when the UBO variant is used
+		VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		//set 0: uniform buffer, set 1: material textures, set 2: page cache and page table of the virtual textures
+		std::vector<VkDescriptorSetLayout> setLayouts = { descriptorSetLayout, textureTable.getLayout() };
+		if (virtualTexturingEnabled)
+			setLayouts.push_back(virtualTextures.getLayout());
+		pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+		pipelineLayoutInfo.pSetLayouts = setLayouts.data(); //Descriptor set layouts
+		VkPushConstantRange pushConstantRange{};
+		pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+		pushConstantRange.offset = 0;
+		pushConstantRange.size = sizeof(PushConstants);
+		pipelineLayoutInfo.pushConstantRangeCount = pushConstantMVPSupported ? 1 : 0;
+		pipelineLayoutInfo.pPushConstantRanges = pushConstantMVPSupported ? &pushConstantRange : nullptr;
+		
+		//creates pipeline layout
+		if (vkCreatePipelineLayout(logicalDevice, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create pipeline layout!");
+		}
+
+		//pipelines are built on the thread pool, so the builder must only read state that stays the same until the swap chain is recreated
+		pipelineLibrary.create(logicalDevice, threadPool, [this](const PipelineVariant& variant) {
+			VkPipeline pipeline = buildGraphicsPipeline(variant);
+			//in on demand mode nothing else would draw the frame that switches to it
+			requestRedraw();
+			return pipeline;
+		}, [this](VkPipeline pipeline) {
+			//frames already submitted may still use the replaced pipeline
+			graphicsTimeline.deferUntilIdle([this, pipeline]() { vkDestroyPipeline(logicalDevice, pipeline, nullptr); });
+		});
+		//the first frame needs a pipeline. The other variants are built when they are first selected
+		selectPipelineVariant(true);
+
+		ShaderLibrary::Stats shaderStats = shaderLibrary.getStats();
+		std::cout << "Shaders: " << shaderStats.cacheHits << " from cache, " << shaderStats.compiled << " compiled, "
+			<< shaderStats.precompiledLoads << " precompiled" << (ShaderLibrary::hasRuntimeCompiler() ? "" : " (built without libshaderc)") << std::endl;
+	}
+
+	VkPipeline VulkanInterface::buildGraphicsPipeline(const PipelineVariant& variant)
+	{
+		ShaderVariant vertexShader{ "shaders/shader.vert", VK_SHADER_STAGE_VERTEX_BIT, {}, "shaders/vert.spv" };
+		if (variant.depthOnly)
+			vertexShader = { "shaders/depth.vert", VK_SHADER_STAGE_VERTEX_BIT, {}, "shaders/depth_vert.spv" };
+		if (variant.pushConstantMVP)
+		{
+			vertexShader.defines.push_back("PUSH_CONSTANT_MVP");
+			vertexShader.precompiledPath = variant.depthOnly ? "shaders/depth_vert_pc.spv" : "shaders/vert_pc.spv";
+		}
+		ShaderVariant fragmentShader{ "shaders/shader.frag", VK_SHADER_STAGE_FRAGMENT_BIT, {}, "shaders/frag.spv" };
+		if (variant.bindlessTextures)
+		{
+			fragmentShader.defines.push_back("BINDLESS_TEXTURES");
+			fragmentShader.precompiledPath = "shaders/frag_bindless.spv";
+		}
+		if (variant.virtualTextures)
+		{
+			fragmentShader.defines.push_back("VIRTUAL_TEXTURES");
+			fragmentShader.precompiledPath = variant.bindlessTextures ? "shaders/frag_bindless_vt.spv" : "shaders/frag_vt.spv";
+		}
 
-		VkShaderModule vertShaderModule = createShaderModule(vertShaderCode);
-		VkShaderModule fragShaderModule = createShaderModule(fragShaderCode);
+		//modules are owned by the shader library and shared between variants
+		VkShaderModule vertShaderModule = shaderLibrary.getModule(vertexShader);
+		//the depth pre-pass has no fragment shader, the depth is all it writes
+		VkShaderModule fragShaderModule = variant.depthOnly ? VK_NULL_HANDLE : shaderLibrary.getModule(fragmentShader);
+
+		//the debug view is a specialization constant (constant_id 0), so the driver compiles out the other views
+		uint32_t debugView = static_cast<uint32_t>(variant.debugView);
+		VkSpecializationMapEntry specializationEntry{};
+		specializationEntry.constantID = 0;
+		specializationEntry.offset = 0;
+		specializationEntry.size = sizeof(debugView);
+
+		VkSpecializationInfo specializationInfo{};
+		specializationInfo.mapEntryCount = 1;
+		specializationInfo.pMapEntries = &specializationEntry;
+		specializationInfo.dataSize = sizeof(debugView);
+		specializationInfo.pData = &debugView;
 
 		//creates pipeline info structure for vertex shader
 		VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
@@ -788,6 +1178,7 @@ namespace vulkanExample
 		fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
 		fragShaderStageInfo.module = fragShaderModule;
 		fragShaderStageInfo.pName = "main";
+		fragShaderStageInfo.pSpecializationInfo = &specializationInfo;
 
 
 		VkPipelineShaderStageCreateInfo shaderStages[] = { vertShaderStageInfo, fragShaderStageInfo };
@@ -809,6 +1200,16 @@ namespace vulkanExample
 		vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
 		vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
 
+		//the depth pre-pass reads the position buffer instead
+		auto positionBinding = Vertex::getPositionBindingDescription();
+		auto positionAttribute = Vertex::getPositionAttributeDescription();
+		if (variant.depthOnly)
+		{
+			vertexInputInfo.vertexAttributeDescriptionCount = 1;
+			vertexInputInfo.pVertexBindingDescriptions = &positionBinding;
+			vertexInputInfo.pVertexAttributeDescriptions = &positionAttribute;
+		}
+
 		//primitives will be drawn as normal triangles for now
 		VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
 		inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
@@ -868,7 +1269,8 @@ namespace vulkanExample
 		//for now, we disable multi-sampling
 		VkPipelineMultisampleStateCreateInfo multisampling{};
 		multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-		multisampling.sampleShadingEnable = VK_TRUE;
+		//nothing to shade per sample without a fragment shader
+		multisampling.sampleShadingEnable = variant.depthOnly ? VK_FALSE : VK_TRUE;
 		multisampling.minSampleShading = 0.2f; // Optional
 		multisampling.rasterizationSamples = msaaSamples;
 		multisampling.pSampleMask = nullptr; // Optional
@@ -885,13 +1287,20 @@ namespace vulkanExample
 		colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
 		colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
 		colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+		//the overdraw view adds up a constant for every fragment shaded
+		if (variant.debugView == DebugView::Overdraw)
+		{
+			colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
+			colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE;
+		}
 
 		//leaves logid operator disabled for color blending
 		VkPipelineColorBlendStateCreateInfo colorBlending{};
 		colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
 		colorBlending.logicOpEnable = VK_FALSE;
 		colorBlending.logicOp = VK_LOGIC_OP_COPY; // Optional
-		colorBlending.attachmentCount = 1;
+		//the depth pre-pass subpass has no color attachment
+		colorBlending.attachmentCount = variant.depthOnly ? 0 : 1;
 		colorBlending.pAttachments = &colorBlendAttachment;
 		colorBlending.blendConstants[0] = 0.0f; // Optional
 		colorBlending.blendConstants[1] = 0.0f; // Optional
@@ -899,10 +1308,10 @@ namespace vulkanExample
 		colorBlending.blendConstants[3] = 0.0f; // Optional
 
 
-		//define dynamic states as viewport and line width
+		//viewport and scissor are set when recording, they follow the render scale
 		VkDynamicState dynamicStates[] = {
 			VK_DYNAMIC_STATE_VIEWPORT,
-			VK_DYNAMIC_STATE_LINE_WIDTH
+			VK_DYNAMIC_STATE_SCISSOR
 		};
 		//configure dynamic states
 		VkPipelineDynamicStateCreateInfo dynamicState{};
@@ -910,25 +1319,18 @@ namespace vulkanExample
 		dynamicState.dynamicStateCount = 2;
 		dynamicState.pDynamicStates = dynamicStates;
 
-		//Creates pipeline layout infor
-		//They are commonly used to pass the transformation matrix to the vertex shader, or to create texture samplers in the fragment shader
-		VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
-		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-		pipelineLayoutInfo.setLayoutCount = 1; // 1 descriptor set layout
-		pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout; //Descriptor set layout
-		pipelineLayoutInfo.pushConstantRangeCount = 0; // Optional
-		pipelineLayoutInfo.pPushConstantRanges = nullptr; // Optional
-		
-		//creates pipeline layout
-		if (vkCreatePipelineLayout(logicalDevice, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
-			throw std::runtime_error("failed to create pipeline layout!");
-		}
-
 		VkPipelineDepthStencilStateCreateInfo depthStencil{};
 		depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
 		depthStencil.depthTestEnable = VK_TRUE;
 		depthStencil.depthWriteEnable = VK_TRUE;
 		depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
+		//after the pre-pass only the closest surface is left to shade. Its depth is already written
+		bool shadesAfterPrepass = variant.depthPrepass && !variant.depthOnly;
+		if (shadesAfterPrepass)
+		{
+			depthStencil.depthWriteEnable = VK_FALSE;
+			depthStencil.depthCompareOp = VK_COMPARE_OP_EQUAL;
+		}
 
 		depthStencil.depthBoundsTestEnable = VK_FALSE;
 		depthStencil.minDepthBounds = 0.0f; // Optional
@@ -942,7 +1344,7 @@ namespace vulkanExample
 		//now that the layout is done, we can create the pipeline
 		VkGraphicsPipelineCreateInfo pipelineInfo{};
 		pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-		pipelineInfo.stageCount = 2;
+		pipelineInfo.stageCount = variant.depthOnly ? 1 : 2;
 		//pass vertex and fragment shaders
 		pipelineInfo.pStages = shaderStages;
 		//populate data from above
@@ -953,24 +1355,149 @@ namespace vulkanExample
 		pipelineInfo.pMultisampleState = &multisampling;
 		pipelineInfo.pDepthStencilState = &depthStencil;
 		pipelineInfo.pColorBlendState = &colorBlending;
-		pipelineInfo.pDynamicState = nullptr; // Optional
+		pipelineInfo.pDynamicState = &dynamicState;
 		pipelineInfo.layout = pipelineLayout;
 		pipelineInfo.renderPass = renderPass;
-		pipelineInfo.subpass = 0;
+		pipelineInfo.subpass = shadesAfterPrepass ? 1 : 0;
 		//Vulkan allows you to define a base pipeline from an existing one, so it makes derivation easier. Not doing this here though
 		pipelineInfo.basePipelineHandle = VK_NULL_HANDLE; // Optional
 		pipelineInfo.basePipelineIndex = -1; // Optional
 
 		
 
-		//creates pipeline
-		if (vkCreateGraphicsPipelines(logicalDevice, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &graphicsPipeline) != VK_SUCCESS) {
+		//creates pipeline. The pipeline cache makes builds of variants seen in previous runs much cheaper
+		VkPipeline pipeline;
+		if (vkCreateGraphicsPipelines(logicalDevice, pipelineCache, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS) {
 			throw std::runtime_error("failed to create graphics pipeline!");
 		}
+		return pipeline;
+	}
+
+	// Switches to the variant selected in the settings, or to the hot reloaded version of the current one.
+	// Without wait, a variant that isn't built yet is requested and the current pipeline stays in use until it's ready
+	void VulkanInterface::selectPipelineVariant(bool wait)
+	{
+		PipelineVariant wanted;
+		wanted.debugView = settings.debugView;
+		wanted.pushConstantMVP = settings.pushConstantMVP && pushConstantMVPSupported;
+		wanted.bindlessTextures = textureTable.isBindless();
+		wanted.virtualTextures = virtualTexturingEnabled;
+		wanted.depthPrepass = depthPrepassEnabled;
+
+		//with the depth pre-pass, both pipelines have to be ready before switching, as their vertex transforms must match
+		VkPipeline pipeline = wait ? pipelineLibrary.get(wanted) : pipelineLibrary.request(wanted);
+		VkPipeline prepassPipeline = VK_NULL_HANDLE;
+		if (depthPrepassEnabled)
+			prepassPipeline = wait ? pipelineLibrary.get(wanted.getDepthOnly()) : pipelineLibrary.request(wanted.getDepthOnly());
+		if (pipeline == VK_NULL_HANDLE || (depthPrepassEnabled && prepassPipeline == VK_NULL_HANDLE))
+		{
+			if (graphicsPipeline != VK_NULL_HANDLE)
+			{
+				graphicsPipeline = pipelineLibrary.request(activeVariant);
+				if (depthPrepassEnabled)
+					depthPipeline = pipelineLibrary.request(activeVariant.getDepthOnly());
+			}
+			return;
+		}
+
+		bool variantChanged = graphicsPipeline == VK_NULL_HANDLE || wanted != activeVariant;
+		graphicsPipeline = pipeline;
+		depthPipeline = prepassPipeline;
+		activeVariant = wanted;
+		pushConstantMVPEnabled = wanted.pushConstantMVP;
+		if (!variantChanged)
+			return;
+		// per vertex: mat4 * vec4 = 16 MUL + 12 ADD. The uniform buffer path adds two mat4 * mat4 (2 * (64 MUL + 48 ADD))
+		std::cout << "Debug view: " << debugViewName(wanted.debugView) << ", vertex transform: " << (pushConstantMVPEnabled ?
+			"push constant MVP, 16 MUL + 12 ADD per vertex" : "uniform buffer model/view/proj, 144 MUL + 108 ADD per vertex")
+			<< (depthPrepassEnabled ? ", depth pre-pass" : "") << std::endl;
+	}
+
+	// Starts rebuilding the pipelines in the background if the watcher saw shader changes. They are swapped in
+	// by selectPipelineVariant once built, so this never waits for the compiler
+	void VulkanInterface::reloadChangedShaders()
+	{
+		std::vector<std::string> changed = shaderWatcher.takeChanges();
+		if (changed.empty())
+			return;
+
+		std::cout << "Shader changes detected:";
+		for (const std::string& fileName : changed)
+			std::cout << " " << fileName;
+		std::cout << ", rebuilding " << pipelineLibrary.size() << " pipeline variants" << std::endl;
+		pipelineLibrary.reload();
+	}
+
+	void VulkanInterface::cycleDebugView()
+	{
+		uint32_t next = (static_cast<uint32_t>(settings.debugView) + 1) % static_cast<uint32_t>(DebugView::Count);
+		settings.debugView = static_cast<DebugView>(next);
+	}
+
+	void VulkanInterface::toggleDepthPrepass()
+	{
+		//the subpasses are part of the render pass, which every pipeline is built against
+		settings.depthPrepass = !settings.depthPrepass;
+		renderTargetsChanged = true;
+	}
+
+	CacheKey VulkanInterface::getPipelineCacheKey() const
+	{
+		return CacheKey("pipeline-cache", 1).add(deviceProperties.vendorID).add(deviceProperties.deviceID).add(deviceProperties.driverVersion)
+			.add(deviceProperties.pipelineCacheUUID);
+	}
+
+	void VulkanInterface::reportDerivedData()
+	{
+		DerivedDataCache::Stats stats = derivedData.getStats();
+		std::cout << "Derived data: " << stats.hits << " hits, " << stats.misses << " misses (" << stats.corrupt << " corrupt), "
+			<< stats.bytesRead / (1024 * 1024) << " MiB read, " << stats.bytesWritten / (1024 * 1024) << " MiB written, " << stats.evictions
+			<< " evicted, " << stats.entries << " entries (" << stats.totalBytes / (1024 * 1024) << " MiB) in " << settings.derivedDataDirectory
+			<< std::endl;
+	}
+
+	void VulkanInterface::createPipelineCache()
+	{
+		//handed to the driver straight from the mapping
+		DerivedDataCache::Entry data;
+		derivedData.load(getPipelineCacheKey(), data);
+
+		//drivers should ignore data from another device or driver version, but not all of them do. So check the header first:
+		//header size, header version, vendor id, device id, pipeline cache UUID
+		bool valid = data.size() >= 16 + VK_UUID_SIZE;
+		if (valid)
+		{
+			uint32_t header[4];
+			std::memcpy(header, data.data(), sizeof(header));
+			valid = header[1] == VK_PIPELINE_CACHE_HEADER_VERSION_ONE && header[2] == deviceProperties.vendorID &&
+				header[3] == deviceProperties.deviceID && std::memcmp(data.data() + 16, deviceProperties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+		}
+
+		VkPipelineCacheCreateInfo createInfo{};
+		createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+		createInfo.initialDataSize = valid ? data.size() : 0;
+		createInfo.pInitialData = valid ? data.data() : nullptr;
+
+		if (vkCreatePipelineCache(logicalDevice, &createInfo, nullptr, &pipelineCache) != VK_SUCCESS)
+			throw std::runtime_error("failed to create pipeline cache!");
+
+		if (valid)
+			std::cout << "Loaded pipeline cache (" << data.size() << " bytes)" << std::endl;
+	}
+
+	void VulkanInterface::savePipelineCache()
+	{
+		size_t size = 0;
+		if (vkGetPipelineCacheData(logicalDevice, pipelineCache, &size, nullptr) != VK_SUCCESS || size == 0)
+			return;
+
+		std::vector<char> data(size);
+		if (vkGetPipelineCacheData(logicalDevice, pipelineCache, &size, data.data()) != VK_SUCCESS)
+			return;
 
-		//destroy shaders (WHY??)
-		vkDestroyShaderModule(logicalDevice, fragShaderModule, nullptr);
-		vkDestroyShaderModule(logicalDevice, vertShaderModule, nullptr);
+		//replaces the previous run's, under the same key
+		if (!derivedData.store(getPipelineCacheKey(), data.data(), size))
+			std::cout << "Can't write pipeline cache to " << settings.derivedDataDirectory << std::endl;
 	}
 
 	void VulkanInterface::createFrameBuffers()
@@ -978,12 +1505,15 @@ namespace vulkanExample
 		//resize array of frame buffers
 		swapChainFramebuffers.resize(swapChainImageViews.size());
 
+		//with dynamic resolution the scene resolves into the scene color target instead, the same for every image
+		VkExtent2D extent = settings.dynamicResolution ? renderTargetExtent : swapChainExtent;
+
 		//for each swap chain image view, create a framebuffer
 		for (size_t i = 0; i < swapChainImageViews.size(); i++) {
 			std::array<VkImageView, 3> attachments[] = {
-				colorImageView,
-				depthImageView,
-				swapChainImageViews[i]
+				renderGraph.getImageView(colorTarget),
+				renderGraph.getImageView(depthTarget),
+				settings.dynamicResolution ? renderGraph.getImageView(sceneColorTarget) : swapChainImageViews[i]
 			};
 			//populate data
 			VkFramebufferCreateInfo framebufferInfo{};
@@ -993,8 +1523,8 @@ namespace vulkanExample
 			//VkImageView objects that should be bound to it
 			framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments->size());
 			framebufferInfo.pAttachments = attachments->data();
-			framebufferInfo.width = swapChainExtent.width;
-			framebufferInfo.height = swapChainExtent.height;
+			framebufferInfo.width = extent.width;
+			framebufferInfo.height = extent.height;
 			framebufferInfo.layers = 1;
 
 			if (vkCreateFramebuffer(logicalDevice, &framebufferInfo, nullptr, &swapChainFramebuffers[i]) != VK_SUCCESS) {
@@ -1009,7 +1539,8 @@ namespace vulkanExample
 		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
 		//since we will be recording commands for drawing, we have to use the graphics queue
 		poolInfo.queueFamilyIndex = queueFamilies.graphicsFamily.value();
-		poolInfo.flags = 0; // Optional
+		//command buffers are re-recorded every frame (the push constants change), so they must be individually resettable
+		poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
 
 
 		if (vkCreateCommandPool(logicalDevice, &poolInfo, nullptr, &commandPool) != VK_SUCCESS) {
@@ -1018,6 +1549,38 @@ namespace vulkanExample
 
 	}
 
+	void VulkanInterface::createAsyncQueues()
+	{
+		uint32_t graphicsFamily = queueFamilies.graphicsFamily.value();
+		auto describe = [](std::optional<uint32_t> family, const AsyncQueue& queue) -> std::string {
+			if (!family.has_value())
+				return "graphics queue (no dedicated family)";
+			if (!queue.isCreated())
+				return "graphics queue (family " + std::to_string(family.value()) + " needs timeline semaphores)";
+			return "family " + std::to_string(family.value()) + (queue.isTimed() ? "" : " (not timed)");
+		};
+
+		//waiting on another queue without blocking and the acquire submissions need timeline semaphores,
+		//without them everything stays on the graphics queue
+		if (timelineSemaphoreEnabled && queueFamilies.transferFamily.has_value())
+		{
+			VkQueue queue;
+			vkGetDeviceQueue(logicalDevice, queueFamilies.transferFamily.value(), 0, &queue);
+			transferQueue.create(logicalDevice, physicalDevice, queueFamilies.transferFamily.value(), queue, graphicsTimeline,
+				graphicsFamily, commandPool, hostQueryResetEnabled);
+		}
+		if (timelineSemaphoreEnabled && queueFamilies.computeFamily.has_value())
+		{
+			VkQueue queue;
+			vkGetDeviceQueue(logicalDevice, queueFamilies.computeFamily.value(), 0, &queue);
+			computeQueue.create(logicalDevice, physicalDevice, queueFamilies.computeFamily.value(), queue, graphicsTimeline,
+				graphicsFamily, commandPool, hostQueryResetEnabled);
+		}
+
+		std::cout << "Transfer queue: " << describe(queueFamilies.transferFamily, transferQueue) << std::endl;
+		std::cout << "Async compute queue: " << describe(queueFamilies.computeFamily, computeQueue) << std::endl;
+	}
+
 	void VulkanInterface::createCommandBuffers()
 	{
 		//resizes the vector
@@ -1034,92 +1597,210 @@ namespace vulkanExample
 		if (vkAllocateCommandBuffers(logicalDevice, &allocInfo, commandBuffers.data()) != VK_SUCCESS) {
 			throw std::runtime_error("failed to allocate command buffers!");
 		}
-		
-		for (size_t i = 0; i < commandBuffers.size(); i++) {
-			//configures command buffer
-			VkCommandBufferBeginInfo beginInfo{};
-			beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-			//no flags applicable
-			beginInfo.flags = 0; //optional
-			//only relevant for secondary buffers
-			beginInfo.pInheritanceInfo = nullptr; // Optional
-
-
-			//begins recording command buffer
-			//all functions that start now with vkCmd are recorded to the buffer
-			if (vkBeginCommandBuffer(commandBuffers[i], &beginInfo) != VK_SUCCESS) {
-				throw std::runtime_error("failed to begin recording command buffer!");
-			}
 
+		//one timer slot per command buffer
+		if (!gpuTimer.create(logicalDevice, physicalDevice, queueFamilies.graphicsFamily.value(), static_cast<uint32_t>(commandBuffers.size()))
+			&& settings.dynamicResolution)
+			std::cout << "The graphics queue has no timestamps, the render scale stays fixed" << std::endl;
+		fragmentCounter.create(logicalDevice, pipelineStatisticsEnabled, static_cast<uint32_t>(commandBuffers.size()));
+	}
 
+	// Records the frame for the given swap chain image. Called every frame once the image is no longer in use by the GPU
+	void VulkanInterface::recordCommandBuffer(uint32_t imageIndex)
+	{
+		VkCommandBuffer commandBuffer = commandBuffers[imageIndex];
 
+		//configures command buffer
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		//recorded again next time the image is used
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		//only relevant for secondary buffers
+		beginInfo.pInheritanceInfo = nullptr; // Optional
 
-			//configures render pass
-			VkRenderPassBeginInfo renderPassInfo{};
-			renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-			renderPassInfo.renderPass = renderPass;
-			renderPassInfo.framebuffer = swapChainFramebuffers[i];
-			//define render area
-			renderPassInfo.renderArea.offset = { 0, 0 };
-			renderPassInfo.renderArea.extent = swapChainExtent;
-			
-			//this is the Clear color define in the color attachment. Cofigured now to be black with 100% opacity
-			
-			std::array<VkClearValue, 2> clearValues{};
-			clearValues[0].color = { 0.0f, 0.0f, 0.0f, 1.0f };
-			clearValues[1].depthStencil = { 1.0f, 0 };
 
-			renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
-			renderPassInfo.pClearValues = clearValues.data();
+		//begins recording command buffer (implicitly resets it)
+		//all functions that start now with vkCmd are recorded to the buffer
+		if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+			throw std::runtime_error("failed to begin recording command buffer!");
+		}
 
-			//render pass is recorded as first step
-			vkCmdBeginRenderPass(commandBuffers[i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-			//Bind graphics pipeline
-			vkCmdBindPipeline(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
-			
-			//Binds vertex buffer with command buffer
-			VkBuffer vertexBuffers[] = { vertexBuffer };
-			VkDeviceSize offsets[] = { 0 };
-			vkCmdBindVertexBuffers(commandBuffers[i], 0, 1, vertexBuffers, offsets);
-			
-			vkCmdBindIndexBuffer(commandBuffers[i], indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+		//the passes and their barriers
+		recordingImageIndex = imageIndex;
+		renderGraph.setImportedImage(swapChainTarget, swapChainImages[imageIndex], swapChainImageViews[imageIndex]);
+		gpuTimer.begin(commandBuffer, imageIndex);
+		renderGraph.execute(commandBuffer);
+		gpuTimer.end(commandBuffer, imageIndex);
 
-			vkCmdBindDescriptorSets(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets[i], 0, nullptr);
+		//end recording
+		if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+			throw std::runtime_error("failed to record command buffer!");
+		}
 
+	}
 
-			//Draws indexed, now that we have index buffers
-			vkCmdDrawIndexed(commandBuffers[i], static_cast<uint32_t>(indices.size()), 1, 0, 0, 0);
+	// Draws the scene into the multisampled color buffer, resolved into the swap chain image.
+	// With the depth pre-pass, a position only subpass writes the depth first and the shading subpass only tests it.
+	// With occlusion culling, the early phase clears the attachments and the late phase draws the clusters it adds on top
+	void VulkanInterface::recordScenePass(VkCommandBuffer commandBuffer, ScenePhase phase)
+	{
+		uint32_t imageIndex = recordingImageIndex;
+
+		//configures render pass
+		VkRenderPassBeginInfo renderPassInfo{};
+		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+		renderPassInfo.renderPass = phase == ScenePhase::Late ? lateRenderPass : renderPass;
+		renderPassInfo.framebuffer = swapChainFramebuffers[imageIndex];
+		//define render area, only the scaled part of the target with dynamic resolution
+		VkExtent2D extent = getScaledExtent();
+		renderPassInfo.renderArea.offset = { 0, 0 };
+		renderPassInfo.renderArea.extent = extent;
+		
+		//this is the Clear color define in the color attachment. Cofigured now to be black with 100% opacity
+		
+		std::array<VkClearValue, 2> clearValues{};
+		clearValues[0].color = { 0.0f, 0.0f, 0.0f, 1.0f };
+		clearValues[1].depthStencil = { 1.0f, 0 };
+
+		renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+		renderPassInfo.pClearValues = clearValues.data();
+
+		//counts the shading work of both subpasses (and both phases), the pre-pass has no fragment shader
+		if (phase != ScenePhase::Late)
+			fragmentCounter.begin(commandBuffer, imageIndex);
+		//render pass is recorded as first step
+		vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+		//viewport and scissor are dynamic, so a new render scale doesn't need new pipelines
+		VkViewport viewport{ 0.0f, 0.0f, static_cast<float>(extent.width), static_cast<float>(extent.height), 0.0f, 1.0f };
+		VkRect2D scissor{ { 0, 0 }, extent };
+		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+		//index buffer, set 0 and the push constants are shared by both subpasses (every variant has the same layout)
+		vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets[imageIndex], 0, nullptr);
+		frameStats.descriptorSetBinds++;
+		if (virtualTexturingEnabled)
+		{
+			VkDescriptorSet virtualTextureSet = virtualTextures.getSet(imageIndex);
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 2, 1, &virtualTextureSet, 0, nullptr);
+			frameStats.descriptorSetBinds++;
+		}
 
-			//end render pass
-			vkCmdEndRenderPass(commandBuffers[i]);
+		//the whole block goes once per frame. Afterwards only the material index changes between draws
+		const std::vector<DrawPacket>& packets = drawQueue.getPackets();
+		if (pushConstantMVPSupported && !packets.empty())
+		{
+			drawConstants.materialIndex = meshDraws[packets.front().drawIndex].materialIndex;
+			vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PushConstants), &drawConstants);
+			frameStats.pushConstantUpdates++;
+		}
 
-			//end recording
-			if (vkEndCommandBuffer(commandBuffers[i]) != VK_SUCCESS) {
-				throw std::runtime_error("failed to record command buffer!");
+		VkDeviceSize offsets[] = { 0 };
+		if (depthPrepassEnabled)
+		{
+			//lays down the closest depth of every pixel, front to back
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, depthPipeline);
+			frameStats.pipelineBinds++;
+			vkCmdBindVertexBuffers(commandBuffer, 0, 1, &positionBuffer, offsets);
+			for (const DrawPacket& packet : depthQueue.getPackets())
+			{
+				recordDraw(commandBuffer, meshDraws[packet.drawIndex], phase);
 			}
+			vkCmdNextSubpass(commandBuffer, VK_SUBPASS_CONTENTS_INLINE);
 		}
 
-	}
+		//Bind graphics pipeline
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+		frameStats.pipelineBinds++;
 
+		//Binds vertex buffer with command buffer
+		VkBuffer vertexBuffers[] = { vertexBuffer };
+		vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
 
-	void VulkanInterface::createBuffer
-	(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory)
-	{
-		VkBufferCreateInfo bufferInfo{};
-		bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-		bufferInfo.size = size;
-		bufferInfo.usage = usage;
-		bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-		
-		if (vkCreateBuffer(logicalDevice, &bufferInfo, nullptr, &buffer) != VK_SUCCESS)
+		//bindless: every texture is reachable through the one table set, so it's bound once for the whole frame.
+		//the queue is sorted by material, so otherwise every texture is bound once
+		VkDescriptorSet boundTextureSet = VK_NULL_HANDLE;
+		uint64_t textureBinds = 0;
+		for (const DrawPacket& packet : packets)
 		{
-			throw std::runtime_error("failed to create vertex buffer");
-		}
+			const MeshDraw& draw = meshDraws[packet.drawIndex];
+			VkDescriptorSet textureSet = textureTable.getSet(draw.materialIndex);
+			if (textureSet != boundTextureSet)
+			{
+				vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 1, 1, &textureSet, 0, nullptr);
+				boundTextureSet = textureSet;
+				textureBinds++;
+			}
 
+			if (pushConstantMVPSupported && draw.materialIndex != drawConstants.materialIndex)
+			{
+				drawConstants.materialIndex = draw.materialIndex;
+				vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+					offsetof(PushConstants, materialIndex), sizeof(uint32_t), &drawConstants.materialIndex);
+				frameStats.pushConstantUpdates++;
+			}
+
+			//Draws indexed, now that we have index buffers
+			recordDraw(commandBuffer, draw, phase);
+		}
+		frameStats.descriptorSetBinds += textureBinds;
+
+#ifndef NDEBUG
+		//the material field of the key is the texture table slot, so without bindless every material change is a texture bind
+		uint64_t expectedTextureBinds = textureTable.isBindless() ? std::min<uint64_t>(1, packets.size()) : drawQueue.countBinds().materialBinds;
+		if (textureBinds != expectedTextureBinds || !drawQueue.isBindMinimal())
+			std::cerr << "Draw queue recorded " << textureBinds << " texture binds, " << expectedTextureBinds << " expected" << std::endl;
+#endif
+
+		//end render pass
+		vkCmdEndRenderPass(commandBuffer);
+		if (phase != ScenePhase::Early)
+			fragmentCounter.end(commandBuffer, imageIndex);
+	}
+
+	void VulkanInterface::recordDraw(VkCommandBuffer commandBuffer, const MeshDraw& draw, ScenePhase phase)
+	{
+		if (phase == ScenePhase::All)
+		{
+			vkCmdDrawIndexed(commandBuffer, draw.indexCount, 1, draw.firstIndex, 0, 0);
+			frameStats.drawCalls++;
+			return;
+		}
+
+		//the culled clusters are draws without instances. Without multiDrawIndirect, every cluster is its own indirect draw
+		OcclusionCuller::Phase cullPhase = phase == ScenePhase::Early ? OcclusionCuller::Phase::Early : OcclusionCuller::Phase::Late;
+		uint32_t maxDraws = multiDrawIndirectEnabled ? std::max(deviceProperties.limits.maxDrawIndirectCount, 1u) : 1;
+		for (uint32_t first = 0; first < draw.clusterCount; first += maxDraws)
+		{
+			uint32_t count = std::min(maxDraws, draw.clusterCount - first);
+			vkCmdDrawIndexedIndirect(commandBuffer, occlusionCuller.getDrawBuffer(), occlusionCuller.getDrawOffset(cullPhase, draw.firstCluster + first),
+				count, sizeof(VkDrawIndexedIndirectCommand));
+			frameStats.drawCalls++;
+		}
+	}
 
-		//Get memory requirements
-		VkMemoryRequirements memRequirements;
-		vkGetBufferMemoryRequirements(logicalDevice, buffer, &memRequirements);
+
+	void VulkanInterface::createBuffer
+	(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory)
+	{
+		VkBufferCreateInfo bufferInfo{};
+		bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		bufferInfo.size = size;
+		bufferInfo.usage = usage;
+		bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		
+		if (vkCreateBuffer(logicalDevice, &bufferInfo, nullptr, &buffer) != VK_SUCCESS)
+		{
+			throw std::runtime_error("failed to create vertex buffer");
+		}
+
+
+		//Get memory requirements
+		VkMemoryRequirements memRequirements;
+		vkGetBufferMemoryRequirements(logicalDevice, buffer, &memRequirements);
 
 		// allocate memory for the buffer
 		VkMemoryAllocateInfo allocInfo{};
@@ -1137,86 +1818,31 @@ namespace vulkanExample
 	}
 
 
-	void VulkanInterface::createDescriptorPool()
-	{
-		std::array<VkDescriptorPoolSize, 2> poolSizes{};
-		poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		poolSizes[0].descriptorCount = static_cast<uint32_t>(swapChainImages.size());
-		poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-		poolSizes[1].descriptorCount = static_cast<uint32_t>(swapChainImages.size());
-
-		VkDescriptorPoolCreateInfo createInfo{};
-		createInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-		createInfo.poolSizeCount = static_cast<size_t>(poolSizes.size());
-		createInfo.pPoolSizes = poolSizes.data();
-		//maximum device sets
-		createInfo.maxSets = static_cast<uint32_t>(swapChainImages.size());
-
-		if (vkCreateDescriptorPool(logicalDevice, &createInfo, nullptr, &descriptorPool) != VK_SUCCESS)
-		{
-			throw std::runtime_error("Failed to create descriptor pool");
-		}
-
-
-	}
-
 	void VulkanInterface::createDescriptorSets()
 	{
-		//creates descriptor set layouts
-		std::vector<VkDescriptorSetLayout> layouts(swapChainImages.size(), descriptorSetLayout);
-
-		VkDescriptorSetAllocateInfo allocInfo{};
-		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-		allocInfo.descriptorPool = descriptorPool;
-		allocInfo.descriptorSetCount = static_cast<uint32_t>(swapChainImages.size());
-		allocInfo.pSetLayouts = layouts.data();
-
 		descriptorSets.resize(swapChainImages.size());
-		//Allocate descriptor sets
-		if (vkAllocateDescriptorSets(logicalDevice, &allocInfo, descriptorSets.data()) != VK_SUCCESS) {
-			throw std::runtime_error("failed to allocate descriptor sets!");
-		}
-		
 		for (size_t i = 0; i < swapChainImages.size(); i++) {
 			// Buffer info, as the descriptor refers to a buffer
 			VkDescriptorBufferInfo bufferInfo{};
 			bufferInfo.buffer = uniformBuffers[i];
 			bufferInfo.offset = 0;
 			bufferInfo.range = sizeof(UniformBufferObject);
-			
-			VkDescriptorImageInfo imageInfo{};
-			imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-			imageInfo.imageView = textureImageView;
-			imageInfo.sampler = textureSampler;
-
-			std::array<VkWriteDescriptorSet, 2> descriptorWrites{};
-			descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-			descriptorWrites[0].dstSet = descriptorSets[i];
+
+			VkWriteDescriptorSet descriptorWrite{};
+			descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
 			//same binding as the vertex
-			descriptorWrites[0].dstBinding = 0;
+			descriptorWrite.dstBinding = 0;
 			// If it was an array, we could specify the index here
-			descriptorWrites[0].dstArrayElement = 0;
-						   
-			descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-			//specify how many array elements we want to update (in case it was an array)
-			descriptorWrites[0].descriptorCount = 1;
-						   
-			descriptorWrites[0].pBufferInfo = &bufferInfo;
-			descriptorWrites[0].pImageInfo = nullptr; // Optional
-			descriptorWrites[0].pTexelBufferView = nullptr; // Optional
+			descriptorWrite.dstArrayElement = 0;
 
-			descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-			descriptorWrites[1].dstSet = descriptorSets[i];
-			descriptorWrites[1].dstBinding = 1;
-			descriptorWrites[1].dstArrayElement = 0;
-			descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-			descriptorWrites[1].descriptorCount = 1;
-			descriptorWrites[1].pBufferInfo = nullptr;
-			descriptorWrites[1].pImageInfo = &imageInfo;
-			descriptorWrites[1].pTexelBufferView = nullptr; // Optional
+			descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+			//specify how many array elements we want to update (in case it was an array)
+			descriptorWrite.descriptorCount = 1;
 
+			descriptorWrite.pBufferInfo = &bufferInfo;
 
-			vkUpdateDescriptorSets(logicalDevice, static_cast<size_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+			//the sets never change once written, so the allocator writes them and hands out cached ones
+			descriptorSets[i] = descriptorAllocator.allocateCached(descriptorSetLayout, { descriptorWrite });
 		}
 	}
 
@@ -1255,9 +1881,9 @@ namespace vulkanExample
 
 		//copy vertex data to vertex buffer (from CPU to GPU)
 		copyBuffer(stagingBuffer, indexBuffer, size);
-		// destroy temporary buffer
-		vkDestroyBuffer(logicalDevice, stagingBuffer, nullptr);
-		vkFreeMemory(logicalDevice, stagingBufferMemory, nullptr);
+		// destroy temporary buffer once the copy is done
+		destroyBufferDeferred(stagingBuffer, stagingBufferMemory);
+		residency.add(size, size, size);
 
 	}
 
@@ -1326,7 +1952,8 @@ namespace vulkanExample
 		// Not using mipmaping or Level of Detail
 		samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
 		samplerInfo.minLod = 0.0f; // Optional
-		samplerInfo.maxLod = static_cast<float>(mipLevels);
+		//shared by textures with different mip counts, so every level is allowed
+		samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
 		samplerInfo.mipLodBias = 0.0f; // Optional
 		
 		//creates sampler
@@ -1336,11 +1963,6 @@ namespace vulkanExample
 
 	}
 
-	void VulkanInterface::createTextureImageView()
-	{
-		textureImageView = createImageView(textureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_ASPECT_COLOR_BIT, mipLevels);
-	}
-
 	VkImageView VulkanInterface::createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t mipLevels)
 	{
 		VkImageViewCreateInfo viewInfo{};
@@ -1383,7 +2005,7 @@ namespace vulkanExample
 		barrier.subresourceRange.layerCount = 1;
 
 
-		if (newLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL) {
+		if (newLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL || newLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL) {
 			barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
 
 			if (hasStencilComponent(format)) {
@@ -1394,30 +2016,13 @@ namespace vulkanExample
 			barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
 		}
 
-		if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) {
-			barrier.srcAccessMask = 0;
-			barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-
-			sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-			destinationStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-		}
-		else if (oldLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL && newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
-			barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-			barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-
-			sourceStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-			destinationStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-		}
-		else if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL) {
-			barrier.srcAccessMask = 0;
-			barrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-
-			sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-			destinationStage = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-		}
-		else {
-			throw std::invalid_argument("unsupported layout transition!");
-		}
+		//waits for whatever used the old layout, only its writes have to be made available
+		AccessInfo source = getLayoutAccessInfo(oldLayout);
+		AccessInfo destination = getLayoutAccessInfo(newLayout);
+		barrier.srcAccessMask = source.write ? source.access : 0;
+		barrier.dstAccessMask = destination.access;
+		sourceStage = source.stages;
+		destinationStage = destination.stages;
 
 
 		vkCmdPipelineBarrier(
@@ -1468,36 +2073,671 @@ namespace vulkanExample
 		return {};
 	}
 
-	void VulkanInterface::createColorResources()
+	void VulkanInterface::createRenderGraph()
 	{
-		VkFormat colorFormat = swapChainImageFormat;
+		VkFormat depthFormat = findDepthFormat();
+		VkImageAspectFlags depthAspect = VK_IMAGE_ASPECT_DEPTH_BIT;
+		if (hasStencilComponent(depthFormat))
+			depthAspect |= VK_IMAGE_ASPECT_STENCIL_BIT;
+
+		//only live during the pass (the color buffer is resolved into the swap chain image), so their contents are never stored.
+		//As transient attachments with lazily allocated memory, tile based GPUs keep them in on-chip memory and don't commit any.
+		//Occlusion culling stores both for the late pass, so there they are regular images. Sized for the maximum render scale
+		//with dynamic resolution
+		renderTargetExtent = swapChainExtent;
+		if (settings.dynamicResolution)
+		{
+			float maxScale = resolutionController.getMaxScale();
+			renderTargetExtent.width = std::max(1u, static_cast<uint32_t>(std::ceil(swapChainExtent.width * maxScale)));
+			renderTargetExtent.height = std::max(1u, static_cast<uint32_t>(std::ceil(swapChainExtent.height * maxScale)));
+		}
 
-		createImage(swapChainExtent.width, swapChainExtent.height, 1, msaaSamples, colorFormat, 
-			VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
-			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, colorImage, colorImageMemory);
-		colorImageView = createImageView(colorImage, colorFormat, VK_IMAGE_ASPECT_COLOR_BIT, 1);
+		VkImageUsageFlags colorUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+		if (!occlusionCullingEnabled)
+			colorUsage |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+		colorTarget = renderGraph.addTransientImage("msaa color", { swapChainImageFormat, renderTargetExtent, msaaSamples, colorUsage,
+			VK_IMAGE_ASPECT_COLOR_BIT });
+		//with occlusion culling the depth is sampled for the depth pyramid between the two scene passes, so it can't be transient
+		VkImageUsageFlags depthUsage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+		depthUsage |= occlusionCullingEnabled ? VK_IMAGE_USAGE_SAMPLED_BIT : VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+		depthTarget = renderGraph.addTransientImage("depth", { depthFormat, renderTargetExtent, msaaSamples, depthUsage, depthAspect });
+		//acquired images are waited for at the color attachment output stage (see drawFrame)
+		swapChainTarget = renderGraph.importImage("swap chain", { swapChainImageFormat, swapChainExtent }, VK_IMAGE_LAYOUT_UNDEFINED,
+			VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, ResourceAccess::Present);
+
+		//the scene resolves into the swap chain image, or with dynamic resolution into a sampled target
+		//that the upscale pass stretches over the swap chain image
+		uint32_t sceneOutput = swapChainTarget;
+		if (settings.dynamicResolution)
+		{
+			sceneColorTarget = renderGraph.addTransientImage("scene color", { swapChainImageFormat, renderTargetExtent, VK_SAMPLE_COUNT_1_BIT,
+				VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_IMAGE_ASPECT_COLOR_BIT });
+			sceneOutput = sceneColorTarget;
+		}
+
+		//the page cache is only read by the scene, which the cache synchronizes itself
+		if (virtualTexturingEnabled)
+		{
+			renderGraph.addPass("virtual texture uploads", {}, [this](VkCommandBuffer commandBuffer) {
+					virtualTextures.recordUploads(commandBuffer, recordingImageIndex);
+				}, true);
+		}
+
+		if (!occlusionCullingEnabled)
+		{
+			renderGraph.addPass("scene", {
+					{ colorTarget, ResourceAccess::ColorAttachment },
+					{ depthTarget, ResourceAccess::DepthAttachment },
+					{ sceneOutput, ResourceAccess::ColorAttachment }
+				}, [this](VkCommandBuffer commandBuffer) { recordScenePass(commandBuffer, ScenePhase::All); });
+		}
+		else
+		{
+			//the culling passes only use buffers and the pyramid, which the culler synchronizes itself
+			renderGraph.addPass("early cull", {}, [this](VkCommandBuffer commandBuffer) {
+					occlusionCuller.recordEarlyCull(commandBuffer, recordingImageIndex, drawMVP);
+				}, true);
+			renderGraph.addPass("scene early", {
+					{ colorTarget, ResourceAccess::ColorAttachment },
+					{ depthTarget, ResourceAccess::DepthAttachment },
+					{ sceneOutput, ResourceAccess::ColorAttachment }
+				}, [this](VkCommandBuffer commandBuffer) { recordScenePass(commandBuffer, ScenePhase::Early); });
+			renderGraph.addPass("depth pyramid", {
+					{ depthTarget, ResourceAccess::ComputeSampled }
+				}, [this](VkCommandBuffer commandBuffer) { occlusionCuller.recordPyramid(commandBuffer, getScaledExtent()); }, true);
+			renderGraph.addPass("late cull", {}, [this](VkCommandBuffer commandBuffer) {
+					occlusionCuller.recordLateCull(commandBuffer, recordingImageIndex);
+				}, true);
+			//resolves the color of both phases again
+			renderGraph.addPass("scene late", {
+					{ colorTarget, ResourceAccess::ColorAttachmentLoad },
+					{ depthTarget, ResourceAccess::DepthAttachmentLoad },
+					{ sceneOutput, ResourceAccess::ColorAttachment }
+				}, [this](VkCommandBuffer commandBuffer) { recordScenePass(commandBuffer, ScenePhase::Late); });
+		}
+
+		if (virtualTexturingEnabled)
+		{
+			renderGraph.addPass("virtual texture feedback", {}, [this](VkCommandBuffer commandBuffer) {
+					virtualTextures.recordFeedbackBarrier(commandBuffer);
+				}, true);
+		}
+
+		if (settings.dynamicResolution)
+		{
+			renderGraph.addPass("upscale", {
+					{ sceneColorTarget, ResourceAccess::FragmentSampled },
+					{ swapChainTarget, ResourceAccess::ColorAttachment }
+				}, [this](VkCommandBuffer commandBuffer) { recordUpscalePass(commandBuffer); });
+		}
+
+		renderGraph.compile();
+		renderGraph.realize(logicalDevice, [this](uint32_t typeBits, VkMemoryPropertyFlags properties) { return findOptionalMemoryType(typeBits, properties); });
+		renderGraph.printMemoryReport(std::cout);
 	}
 
+	void VulkanInterface::configureDynamicResolution()
+	{
+		if (!settings.dynamicResolution)
+			return;
+
+		ResolutionController::Config config;
+		config.targetMs = settings.targetFrameTime;
+		config.minScale = settings.minRenderScale;
+		config.maxScale = settings.maxRenderScale;
+		config.window = settings.resolutionWindow;
+		config.adjustSamples = settings.dynamicSamples;
+		config.maxSamples = settings.dynamicSamples ? getDeviceMaxSampleCount() : msaaSamples;
+		resolutionController.configure(config);
+		msaaSamples = resolutionController.getSamples();
+
+		std::cout << "Dynamic resolution: " << config.targetMs << " ms target, scale " << config.minScale << " to " << config.maxScale
+			<< ", " << msaaSamples << "x MSAA" << std::endl;
+	}
 
-	void VulkanInterface::createDepthResources()
+	void VulkanInterface::configureOcclusionCulling()
 	{
-		VkFormat depthFormat = findDepthFormat();
-		createImage(swapChainExtent.width, swapChainExtent.height, 1, msaaSamples,
-			depthFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 
-			depthImage, depthImageMemory);
-		depthImageView = createImageView(depthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT, 1);
-		transitionImageLayout(depthImage, depthFormat, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, 1);
+		if (!settings.occlusionCulling)
+			return;
+
+		//every sample count the render targets may use. The controller goes from 2 samples up to the device maximum
+		VkSampleCountFlags usedSamples = msaaSamples;
+		if (settings.dynamicResolution && settings.dynamicSamples)
+			usedSamples = ((getDeviceMaxSampleCount() << 1) - 1) & ~VK_SAMPLE_COUNT_1_BIT;
+
+		VkFormatProperties formatProperties;
+		vkGetPhysicalDeviceFormatProperties(physicalDevice, findDepthFormat(), &formatProperties);
+		if (!(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT)
+			|| (deviceProperties.limits.sampledImageDepthSampleCounts & usedSamples) != usedSamples)
+		{
+			std::cout << "The depth buffer can't be sampled, occlusion culling is disabled" << std::endl;
+			return;
+		}
+
+		occlusionCullingEnabled = true;
+		multiDrawIndirectEnabled = deviceFeatures.multiDrawIndirect == VK_TRUE;
+	}
+
+	void VulkanInterface::createOcclusionCuller()
+	{
+		if (!occlusionCullingEnabled)
+			return;
+
+		if (!occlusionCuller.isCreated())
+		{
+			occlusionCuller.create(logicalDevice, [this](uint32_t typeBits, VkMemoryPropertyFlags properties) { return findOptionalMemoryType(typeBits, properties); },
+				shaderLibrary, pipelineCache, descriptorAllocator, clusters);
+			std::cout << "Occlusion culling: " << clusters.size() << " clusters of up to " << OcclusionCuller::CLUSTER_TRIANGLES << " triangles, "
+				<< (multiDrawIndirectEnabled ? "one indirect draw per material" : "one indirect draw per cluster") << std::endl;
+		}
+		occlusionCuller.createTargets(renderGraph.getImage(depthTarget), findDepthFormat(), renderTargetExtent,
+			static_cast<uint32_t>(swapChainImages.size()));
+	}
+
+	void VulkanInterface::collectOcclusionStats(uint32_t imageIndex)
+	{
+		std::optional<OcclusionCuller::Stats> stats = occlusionCuller.collect(imageIndex);
+		if (!stats.has_value())
+			return;
+		frameStats.clustersDrawnEarly += stats->earlyDrawn;
+		frameStats.clustersDrawnLate += stats->lateDrawn;
+		frameStats.clustersOccluded += stats->occluded;
+		frameStats.clustersOutsideFrustum += stats->frustumCulled;
+		frameStats.framesCulled++;
+	}
+
+	void VulkanInterface::collectQueueBusyTime()
+	{
+		if (transferQueue.isCreated())
+		{
+			frameStats.transferBusyTime += transferQueue.collectBusyTime();
+			transferQueue.collectGarbage();
+		}
+		if (computeQueue.isCreated())
+		{
+			frameStats.computeBusyTime += computeQueue.collectBusyTime();
+			computeQueue.collectGarbage();
+		}
+	}
+
+	void VulkanInterface::createUpscaleLayout()
+	{
+		if (!settings.dynamicResolution)
+			return;
+
+		VkSamplerCreateInfo samplerInfo{};
+		samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+		samplerInfo.magFilter = VK_FILTER_LINEAR;
+		samplerInfo.minFilter = VK_FILTER_LINEAR;
+		samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		samplerInfo.maxLod = 0.0f;
+		if (vkCreateSampler(logicalDevice, &samplerInfo, nullptr, &upscaleSampler) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create upscale sampler!");
+		}
+
+		VkDescriptorSetLayoutBinding binding{};
+		binding.binding = 0;
+		binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		binding.descriptorCount = 1;
+		binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+		VkDescriptorSetLayoutCreateInfo layoutInfo{};
+		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		layoutInfo.bindingCount = 1;
+		layoutInfo.pBindings = &binding;
+		if (vkCreateDescriptorSetLayout(logicalDevice, &layoutInfo, nullptr, &upscaleSetLayout) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create upscale descriptor set layout!");
+		}
+		descriptorAllocator.registerLayout(upscaleSetLayout, { { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 } });
+
+		//uvScale and uvMax of upscale.frag
+		VkPushConstantRange pushConstantRange{};
+		pushConstantRange.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+		pushConstantRange.offset = 0;
+		pushConstantRange.size = 4 * sizeof(float);
+
+		VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+		pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		pipelineLayoutInfo.setLayoutCount = 1;
+		pipelineLayoutInfo.pSetLayouts = &upscaleSetLayout;
+		pipelineLayoutInfo.pushConstantRangeCount = 1;
+		pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+		if (vkCreatePipelineLayout(logicalDevice, &pipelineLayoutInfo, nullptr, &upscalePipelineLayout) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create upscale pipeline layout!");
+		}
+	}
+
+	// Render pass, pipeline, framebuffers and descriptor set of the upscale pass. Depend on the swap chain and the scene color target
+	void VulkanInterface::createUpscalePass()
+	{
+		if (!settings.dynamicResolution)
+			return;
+
+		//every pixel is overwritten, so the old contents don't matter. The render graph handles the layouts
+		VkAttachmentDescription attachment{};
+		attachment.format = swapChainImageFormat;
+		attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+		attachment.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+		attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+		attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+		attachment.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+		attachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+		VkAttachmentReference attachmentRef{ 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+		VkSubpassDescription subpass{};
+		subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		subpass.colorAttachmentCount = 1;
+		subpass.pColorAttachments = &attachmentRef;
+
+		VkRenderPassCreateInfo renderPassInfo{};
+		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+		renderPassInfo.attachmentCount = 1;
+		renderPassInfo.pAttachments = &attachment;
+		renderPassInfo.subpassCount = 1;
+		renderPassInfo.pSubpasses = &subpass;
+		if (vkCreateRenderPass(logicalDevice, &renderPassInfo, nullptr, &upscaleRenderPass) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create upscale render pass!");
+		}
+
+		upscaleFramebuffers.resize(swapChainImageViews.size());
+		for (size_t i = 0; i < swapChainImageViews.size(); i++) {
+			VkFramebufferCreateInfo framebufferInfo{};
+			framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+			framebufferInfo.renderPass = upscaleRenderPass;
+			framebufferInfo.attachmentCount = 1;
+			framebufferInfo.pAttachments = &swapChainImageViews[i];
+			framebufferInfo.width = swapChainExtent.width;
+			framebufferInfo.height = swapChainExtent.height;
+			framebufferInfo.layers = 1;
+			if (vkCreateFramebuffer(logicalDevice, &framebufferInfo, nullptr, &upscaleFramebuffers[i]) != VK_SUCCESS) {
+				throw std::runtime_error("failed to create upscale framebuffer!");
+			}
+		}
+
+		//not hot reloaded, only the scene pipelines are
+		VkShaderModule vertShaderModule = shaderLibrary.getModule({ "shaders/upscale.vert", VK_SHADER_STAGE_VERTEX_BIT, {}, "shaders/upscale_vert.spv" });
+		VkShaderModule fragShaderModule = shaderLibrary.getModule({ "shaders/upscale.frag", VK_SHADER_STAGE_FRAGMENT_BIT, {}, "shaders/upscale_frag.spv" });
+
+		VkPipelineShaderStageCreateInfo shaderStages[2] = {};
+		shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+		shaderStages[0].module = vertShaderModule;
+		shaderStages[0].pName = "main";
+		shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+		shaderStages[1].module = fragShaderModule;
+		shaderStages[1].pName = "main";
+
+		//the triangle is generated from the vertex index
+		VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+		vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+
+		VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+		inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+		inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+		VkViewport viewport{ 0.0f, 0.0f, static_cast<float>(swapChainExtent.width), static_cast<float>(swapChainExtent.height), 0.0f, 1.0f };
+		VkRect2D scissor{ { 0, 0 }, swapChainExtent };
+		VkPipelineViewportStateCreateInfo viewportState{};
+		viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+		viewportState.viewportCount = 1;
+		viewportState.pViewports = &viewport;
+		viewportState.scissorCount = 1;
+		viewportState.pScissors = &scissor;
+
+		VkPipelineRasterizationStateCreateInfo rasterizer{};
+		rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+		rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+		rasterizer.lineWidth = 1.0f;
+		rasterizer.cullMode = VK_CULL_MODE_NONE;
+		rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+
+		VkPipelineMultisampleStateCreateInfo multisampling{};
+		multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+		multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+		VkPipelineColorBlendAttachmentState colorBlendAttachment{};
+		colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+		VkPipelineColorBlendStateCreateInfo colorBlending{};
+		colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+		colorBlending.attachmentCount = 1;
+		colorBlending.pAttachments = &colorBlendAttachment;
+
+		VkGraphicsPipelineCreateInfo pipelineInfo{};
+		pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+		pipelineInfo.stageCount = 2;
+		pipelineInfo.pStages = shaderStages;
+		pipelineInfo.pVertexInputState = &vertexInputInfo;
+		pipelineInfo.pInputAssemblyState = &inputAssembly;
+		pipelineInfo.pViewportState = &viewportState;
+		pipelineInfo.pRasterizationState = &rasterizer;
+		pipelineInfo.pMultisampleState = &multisampling;
+		pipelineInfo.pColorBlendState = &colorBlending;
+		pipelineInfo.layout = upscalePipelineLayout;
+		pipelineInfo.renderPass = upscaleRenderPass;
+		pipelineInfo.subpass = 0;
+		if (vkCreateGraphicsPipelines(logicalDevice, pipelineCache, 1, &pipelineInfo, nullptr, &upscalePipeline) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create upscale pipeline!");
+		}
+
+		VkDescriptorImageInfo imageInfo{ upscaleSampler, renderGraph.getImageView(sceneColorTarget), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+		VkWriteDescriptorSet write{};
+		write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write.dstBinding = 0;
+		write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		write.descriptorCount = 1;
+		write.pImageInfo = &imageInfo;
+		upscaleSet = descriptorAllocator.allocateCached(upscaleSetLayout, { write });
+	}
+
+	void VulkanInterface::destroyUpscalePass()
+	{
+		if (upscaleRenderPass == VK_NULL_HANDLE)
+			return;
 
+		for (VkFramebuffer framebuffer : upscaleFramebuffers)
+			vkDestroyFramebuffer(logicalDevice, framebuffer, nullptr);
+		upscaleFramebuffers.clear();
+		vkDestroyPipeline(logicalDevice, upscalePipeline, nullptr);
+		vkDestroyRenderPass(logicalDevice, upscaleRenderPass, nullptr);
+		upscalePipeline = VK_NULL_HANDLE;
+		upscaleRenderPass = VK_NULL_HANDLE;
+		//points to the scene color view of the old render graph
+		descriptorAllocator.resetPersistent(upscaleSetLayout);
+		upscaleSet = VK_NULL_HANDLE;
+	}
+
+	void VulkanInterface::recordUpscalePass(VkCommandBuffer commandBuffer)
+	{
+		VkRenderPassBeginInfo renderPassInfo{};
+		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+		renderPassInfo.renderPass = upscaleRenderPass;
+		renderPassInfo.framebuffer = upscaleFramebuffers[recordingImageIndex];
+		renderPassInfo.renderArea.offset = { 0, 0 };
+		renderPassInfo.renderArea.extent = swapChainExtent;
+		vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, upscalePipeline);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, upscalePipelineLayout, 0, 1, &upscaleSet, 0, nullptr);
+
+		//same scale as the scene pass recorded just before
+		VkExtent2D extent = getScaledExtent();
+		float width = static_cast<float>(renderTargetExtent.width);
+		float height = static_cast<float>(renderTargetExtent.height);
+		float upscale[4] = { extent.width / width, extent.height / height, (extent.width - 0.5f) / width, (extent.height - 0.5f) / height };
+		vkCmdPushConstants(commandBuffer, upscalePipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(upscale), upscale);
+
+		vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+		vkCmdEndRenderPass(commandBuffer);
+	}
+
+	void VulkanInterface::updateRenderScale(uint32_t imageIndex)
+	{
+		std::optional<double> gpuTime = gpuTimer.collect(imageIndex);
+		if (!gpuTime.has_value())
+			return;
+		frameStats.gpuTime += gpuTime.value();
+		frameStats.gpuFramesTimed++;
+
+		if (!settings.dynamicResolution || !resolutionController.addFrameTime(gpuTime.value()))
+			return;
+
+		//a new scale only changes the viewport. A new sample count needs new render targets and pipelines
+		//(applied by recreateSwapChain, pipelines still being built must match the current render pass)
+		if (resolutionController.getSamples() != msaaSamples)
+			renderTargetsChanged = true;
+		VkExtent2D extent = getScaledExtent();
+		std::cout << "GPU time " << resolutionController.getAverageMs() << " ms, render scale " << resolutionController.getScale()
+			<< " (" << extent.width << "x" << extent.height << ", " << resolutionController.getSamples() << "x MSAA)" << std::endl;
+		requestRedraw();
+	}
+
+	void VulkanInterface::collectFragmentCount(uint32_t imageIndex)
+	{
+		std::optional<uint64_t> invocations = fragmentCounter.collect(imageIndex);
+		if (!invocations.has_value())
+			return;
+		//the scale may have changed since, close enough for an average
+		VkExtent2D extent = getScaledExtent();
+		frameStats.fragmentInvocations += invocations.value();
+		frameStats.fragmentPixels += static_cast<uint64_t>(extent.width) * extent.height;
+		frameStats.framesCounted++;
+	}
+
+	VkExtent2D VulkanInterface::getScaledExtent() const
+	{
+		if (!settings.dynamicResolution)
+			return swapChainExtent;
+
+		float scale = resolutionController.getScale();
+		VkExtent2D extent;
+		extent.width = std::min(renderTargetExtent.width, std::max(1u, static_cast<uint32_t>(swapChainExtent.width * scale + 0.5f)));
+		extent.height = std::min(renderTargetExtent.height, std::max(1u, static_cast<uint32_t>(swapChainExtent.height * scale + 0.5f)));
+		return extent;
+	}
+
+	namespace
+	{
+		// Reads the .mtl files from the asset pack, or from the material directory when the pack doesn't have them
+		class PackMaterialReader : public tinyobj::MaterialReader
+		{
+		public:
+			PackMaterialReader(const AssetPack& pack, const std::string& materialDirectory)
+				: pack(pack), materialDirectory(materialDirectory), fileReader(materialDirectory)
+			{
+			}
+
+			bool operator()(const std::string& materialId, std::vector<tinyobj::material_t>* materials, std::map<std::string, int>* materialMap,
+				std::string* warning, std::string* error) override
+			{
+				AssetPack::Asset asset;
+				if (!pack.read(materialDirectory + materialId, asset))
+					return fileReader(materialId, materials, materialMap, warning, error);
+				MemoryStreamBuffer buffer(asset.data(), asset.size());
+				std::istream stream(&buffer);
+				tinyobj::LoadMtl(materialMap, materials, &stream, warning, error);
+				return true;
+			}
+
+		private:
+			const AssetPack& pack;
+			std::string materialDirectory;
+			tinyobj::MaterialFileReader fileReader;
+		};
+
+		//bump when the welding, the clusters or the layout of CachedMesh change
+		constexpr uint32_t MESH_CACHE_VERSION = 1;
+		//bump when the decoding or the layout of CachedTexture change
+		constexpr uint32_t TEXTURE_CACHE_VERSION = 3;
+
+		// Decoded texture in the derived data cache: this header, then the pixels. Keyed by the file and the levels skipped
+		struct CachedTexture
+		{
+			uint32_t width;
+			uint32_t height;
+			uint32_t channels;
+			uint32_t skippedLevels;
+		};
+
+		// Welded mesh in the derived data cache: this header, the vertices, indices, draws and clusters, then the diffuse
+		// texture name of every material slot, each a 32 bit length and the characters
+		struct CachedMesh
+		{
+			uint32_t vertexCount;
+			uint32_t indexCount;
+			uint32_t drawCount;
+			uint32_t clusterCount;
+			uint32_t slotCount;
+			uint32_t namesSize;
+		};
+
+		template<typename T>
+		void appendArray(std::vector<unsigned char>& output, const T* items, size_t count)
+		{
+			const unsigned char* bytes = reinterpret_cast<const unsigned char*>(items);
+			output.insert(output.end(), bytes, bytes + count * sizeof(T));
+		}
+
+		//false if the data ends first
+		template<typename T>
+		bool readArray(const unsigned char*& data, const unsigned char* end, std::vector<T>& items, size_t count)
+		{
+			if (static_cast<size_t>(end - data) < count * sizeof(T))
+				return false;
+			items.resize(count);
+			std::memcpy(items.data(), data, count * sizeof(T));
+			data += count * sizeof(T);
+			return true;
+		}
+
+		//names of the mtllib statements of an .obj file, what its materials depend on
+		std::vector<std::string> findMaterialLibraries(const unsigned char* data, size_t size)
+		{
+			std::vector<std::string> libraries;
+			const char* text = reinterpret_cast<const char*>(data);
+			const char* end = text + size;
+			for (const char* line = text; line < end;) {
+				const char* lineEnd = static_cast<const char*>(std::memchr(line, '\n', end - line));
+				if (lineEnd == nullptr)
+					lineEnd = end;
+				if (lineEnd - line > 7 && std::strncmp(line, "mtllib", 6) == 0 && std::isspace(static_cast<unsigned char>(line[6]))) {
+					const char* name = line + 7;
+					while (name < lineEnd) {
+						while (name < lineEnd && std::isspace(static_cast<unsigned char>(*name)))
+							name++;
+						const char* nameEnd = name;
+						while (nameEnd < lineEnd && !std::isspace(static_cast<unsigned char>(*nameEnd)))
+							nameEnd++;
+						if (nameEnd != name)
+							libraries.emplace_back(name, nameEnd);
+						name = nameEnd;
+					}
+				}
+				line = lineEnd + 1;
+			}
+			return libraries;
+		}
 	}
 
 	void VulkanInterface::loadModel(glm::vec3 position, glm::vec3 scale)
+	{
+		//parsed in place from the pack or the mapping. The .mtl file and its textures are looked up next to the model
+		AssetPack::Asset packedModel;
+		MappedFile modelFile;
+		if (!assetPack.read(MODEL_PATH, packedModel) && !modelFile.open(MODEL_PATH)) {
+			throw std::runtime_error("failed to open model " + MODEL_PATH + "!");
+		}
+		const unsigned char* modelData = modelFile.isOpen() ? modelFile.data() : packedModel.data();
+		size_t modelSize = modelFile.isOpen() ? modelFile.size() : packedModel.size();
+		std::string materialDirectory = std::filesystem::path(MODEL_PATH).parent_path().string();
+		if (!materialDirectory.empty())
+			materialDirectory += '/';
+
+		//the welded mesh is derived from the model, its material libraries and the transform baked into the vertices
+		CacheKey meshKey("mesh", MESH_CACHE_VERSION);
+		meshKey.addSource(modelData, modelSize, &threadPool).add(position).add(scale);
+		for (const std::string& library : findMaterialLibraries(modelData, modelSize)) {
+			AssetPack::Asset packedLibrary;
+			MappedFile libraryFile;
+			if (assetPack.read(materialDirectory + library, packedLibrary))
+				meshKey.add(library).addSource(packedLibrary.data(), packedLibrary.size());
+			else if (libraryFile.open(materialDirectory + library))
+				meshKey.add(library).addSource(libraryFile.data(), libraryFile.size());
+		}
+
+		//diffuse texture of every material slot, resolved once the draws are known
+		std::vector<std::string> textureNames;
+		DerivedDataCache::Entry cachedMesh;
+		if (!derivedData.load(meshKey, cachedMesh) || !readCachedMesh(cachedMesh.data(), cachedMesh.size(), textureNames)) {
+			weldMesh(modelData, modelSize, materialDirectory, position, scale, textureNames);
+			std::vector<unsigned char> mesh = writeCachedMesh(textureNames);
+			derivedData.store(meshKey, mesh.data(), mesh.size());
+		}
+
+		materialTexturePaths.assign(textureNames.size(), std::string());
+		for (const MeshDraw& draw : meshDraws)
+			materialTexturePaths[draw.materialIndex] = resolveTexturePath(textureNames[draw.materialIndex], materialDirectory);
+
+		std::cout << "Loaded " << vertices.size() << " vertices and " << indices.size() << " indices in "
+			<< meshDraws.size() << " materials" << (cachedMesh.size() != 0 ? " from the derived data cache" : "") << std::endl;
+	}
+
+	bool VulkanInterface::readCachedMesh(const unsigned char* data, size_t size, std::vector<std::string>& textureNames)
+	{
+		const unsigned char* end = data + size;
+		CachedMesh header;
+		if (size < sizeof(header))
+			return false;
+		std::memcpy(&header, data, sizeof(header));
+		data += sizeof(header);
+
+		std::vector<unsigned char> names;
+		bool valid = readArray(data, end, vertices, header.vertexCount) && readArray(data, end, indices, header.indexCount) &&
+			readArray(data, end, meshDraws, header.drawCount) && readArray(data, end, clusters, header.clusterCount) &&
+			readArray(data, end, names, header.namesSize) && data == end;
+
+		textureNames.clear();
+		for (size_t offset = 0; valid && textureNames.size() < header.slotCount;) {
+			uint32_t length = 0;
+			valid = names.size() - offset >= sizeof(length);
+			if (!valid)
+				break;
+			std::memcpy(&length, names.data() + offset, sizeof(length));
+			offset += sizeof(length);
+			valid = names.size() - offset >= length;
+			if (valid)
+				textureNames.emplace_back(reinterpret_cast<const char*>(names.data()) + offset, length);
+			offset += length;
+		}
+		for (const MeshDraw& draw : meshDraws)
+			valid = valid && draw.materialIndex < textureNames.size();
+
+		if (!valid) {
+			vertices.clear();
+			indices.clear();
+			meshDraws.clear();
+			clusters.clear();
+		}
+		return valid;
+	}
+
+	std::vector<unsigned char> VulkanInterface::writeCachedMesh(const std::vector<std::string>& textureNames) const
+	{
+		std::vector<unsigned char> names;
+		for (const std::string& name : textureNames) {
+			uint32_t length = static_cast<uint32_t>(name.size());
+			appendArray(names, &length, 1);
+			appendArray(names, name.data(), name.size());
+		}
+
+		CachedMesh header{ static_cast<uint32_t>(vertices.size()), static_cast<uint32_t>(indices.size()), static_cast<uint32_t>(meshDraws.size()),
+			static_cast<uint32_t>(clusters.size()), static_cast<uint32_t>(textureNames.size()), static_cast<uint32_t>(names.size()) };
+		std::vector<unsigned char> mesh;
+		appendArray(mesh, &header, 1);
+		appendArray(mesh, vertices.data(), vertices.size());
+		appendArray(mesh, indices.data(), indices.size());
+		appendArray(mesh, meshDraws.data(), meshDraws.size());
+		appendArray(mesh, clusters.data(), clusters.size());
+		appendArray(mesh, names.data(), names.size());
+		return mesh;
+	}
+
+	void VulkanInterface::weldMesh(const unsigned char* modelData, size_t modelSize, const std::string& materialDirectory, glm::vec3 position,
+		glm::vec3 scale, std::vector<std::string>& textureNames)
 	{
 		tinyobj::attrib_t attrib;
 		std::vector<tinyobj::shape_t> shapes;
 		std::vector<tinyobj::material_t> materials;
 		std::string warn, err;
 
-		if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, MODEL_PATH.c_str())) {
+		MemoryStreamBuffer modelBuffer(modelData, modelSize);
+		std::istream modelStream(&modelBuffer);
+		PackMaterialReader materialReader(assetPack, materialDirectory);
+		if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, &modelStream, &materialReader)) {
 			throw std::runtime_error(warn + err);
 		}
 
@@ -1509,84 +2749,612 @@ namespace vulkanExample
 #endif
 
 		std::unordered_map<Vertex, uint32_t> uniqueVertices{};
+		//indices grouped by material slot. The last slot gets the faces without a material
+		std::vector<std::vector<uint32_t>> materialIndices(materials.size() + 1);
 	
 		for (const auto& shape : shapes) {
-			for (const auto& index : shape.mesh.indices) {
-				Vertex vertex{};
+			size_t indexOffset = 0;
+			for (size_t face = 0; face < shape.mesh.num_face_vertices.size(); face++) {
+				int materialId = face < shape.mesh.material_ids.size() ? shape.mesh.material_ids[face] : -1;
+				size_t slot = materialId >= 0 && static_cast<size_t>(materialId) < materials.size() ? materialId : materials.size();
+				size_t faceVertices = shape.mesh.num_face_vertices[face];
+
+				for (size_t v = 0; v < faceVertices; v++) {
+					const tinyobj::index_t& index = shape.mesh.indices[indexOffset + v];
+					Vertex vertex{};
+
+
+					vertex.pos = {
+						(attrib.vertices[3 * index.vertex_index + 0] + position.x) * scale.x,
+						(attrib.vertices[3 * index.vertex_index + 1] + position.y) * scale.y,
+						(attrib.vertices[3 * index.vertex_index + 2] + position.z) * scale.z
+					};
+
+					vertex.texCoord = {
+						attrib.texcoords[2 * index.texcoord_index + 0],
+						1.0f - attrib.texcoords[2 * index.texcoord_index + 1]
+					};
+
+					vertex.color = { 1.0f, 1.0f, 1.0f };
+
+					if (uniqueVertices.count(vertex) == 0) {
+						uniqueVertices[vertex] = static_cast<uint32_t>(vertices.size());
+						vertices.push_back(vertex);
+					}
+
+					materialIndices[slot].push_back(uniqueVertices[vertex]);
+				}
+				indexOffset += faceVertices;
+			}
+		}
+
+		//one contiguous index range per material. materialIndex holds the slot until the textures are loaded
+		meshDraws.clear();
+		clusters.clear();
+		textureNames.assign(materialIndices.size(), std::string());
+		for (size_t slot = 0; slot < materialIndices.size(); slot++) {
+			if (materialIndices[slot].empty())
+				continue;
+
+			glm::vec3 minimum = vertices[materialIndices[slot].front()].pos;
+			glm::vec3 maximum = minimum;
+			for (uint32_t index : materialIndices[slot]) {
+				minimum = glm::min(minimum, vertices[index].pos);
+				maximum = glm::max(maximum, vertices[index].pos);
+			}
+
+			MeshDraw draw{ static_cast<uint32_t>(indices.size()), static_cast<uint32_t>(materialIndices[slot].size()), static_cast<uint32_t>(slot),
+				(minimum + maximum) * 0.5f };
+			indices.insert(indices.end(), materialIndices[slot].begin(), materialIndices[slot].end());
+			draw.firstCluster = static_cast<uint32_t>(clusters.size());
+			buildClusters(vertices, indices, draw.firstIndex, draw.indexCount, clusters);
+			draw.clusterCount = static_cast<uint32_t>(clusters.size()) - draw.firstCluster;
+			meshDraws.push_back(draw);
+
+			if (slot < materials.size())
+				textureNames[slot] = materials[slot].diffuse_texname;
+		}
+	}
+
+	std::string VulkanInterface::resolveTexturePath(const std::string& textureName, const std::string& materialDirectory) const
+	{
+		if (textureName.empty())
+			return TEXTURE_PATH;
+
+		//map_Kd is relative to the .mtl file, but the textures of the repo live in the textures directory
+		std::filesystem::path name(textureName);
+		for (const std::filesystem::path& candidate : { std::filesystem::path(materialDirectory) / name, std::filesystem::path("textures") / name.filename() }) {
+			if (assetPack.contains(candidate.generic_string()) || std::filesystem::exists(candidate))
+				return candidate.generic_string();
+		}
+
+		std::cerr << "Texture " << textureName << " not found, using " << TEXTURE_PATH << std::endl;
+		return TEXTURE_PATH;
+	}
+
+	void VulkanInterface::createTextureImages()
+	{
+		auto start = std::chrono::steady_clock::now();
+		//the first frame's matrices (see updateUniformBuffer): the textures of the draws it sees are read first, nearest first
+		glm::mat4 model = glm::rotate(glm::mat4(1.0f), rotation * glm::radians(15.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+		glm::mat4 view = glm::lookAt(cameraPos, cameraPos + cameraFront, cameraUp);
+		glm::mat4 projection = glm::perspective(glm::radians(30.0f), swapChainExtent.width / (float)swapChainExtent.height, zNear, zFar);
+		glm::mat4 viewProjection = projection * view * model;
+
+		struct TextureLoad
+		{
+			std::string path;
+			AssetReader::Priority priority = AssetReader::Priority::Hidden;
+			float viewDepth = 0.0f;
+			//no pixels for a virtual texture, only its size is read
+			std::future<TextureData> data;
+		};
+		std::vector<TextureLoad> loads;
+		std::unordered_map<std::string, size_t> loadIndices;
+		for (const MeshDraw& draw : meshDraws) {
+			const std::string& path = materialTexturePaths[draw.materialIndex];
+			glm::vec4 clip = viewProjection * glm::vec4(draw.center, 1.0f);
+			bool visible = clip.w > 0.0f && std::abs(clip.x) <= clip.w && std::abs(clip.y) <= clip.w && std::abs(clip.z) <= clip.w;
+
+			auto index = loadIndices.find(path);
+			if (index == loadIndices.end()) {
+				index = loadIndices.emplace(path, loads.size()).first;
+				loads.push_back({ path, AssetReader::Priority::Hidden, clip.w });
+			}
+			TextureLoad& load = loads[index->second];
+			if (visible && (load.priority != AssetReader::Priority::Visible || clip.w < load.viewDepth)) {
+				load.priority = AssetReader::Priority::Visible;
+				load.viewDepth = clip.w;
+			}
+			else if (!visible && load.priority != AssetReader::Priority::Visible)
+				load.viewDepth = std::min(load.viewDepth, clip.w);
+		}
+		std::stable_sort(loads.begin(), loads.end(), [](const TextureLoad& a, const TextureLoad& b) {
+			return a.priority != b.priority ? a.priority < b.priority : a.viewDepth < b.viewDepth;
+		});
+
+		uint32_t virtualMinSize = virtualTexturingEnabled ? settings.virtualTextureMinSize : UINT32_MAX;
+		//the budget needs every size before the first texture is decoded, only the headers are read for it. Virtual textures
+		//aren't uploaded whole, so they don't count
+		budgetTextureSize = 0;
+		if (settings.textureBudgetMB > 0) {
+			std::vector<std::pair<uint32_t, uint32_t>> sizes;
+			for (const TextureLoad& load : loads) {
+				uint32_t width, height;
+				if (readTextureSize(load.path, width, height) && std::max(width, height) < virtualMinSize) {
+					uint32_t factor = 1u << getTextureLevelShift(width, height, getMaxTextureSize(load.path));
+					sizes.emplace_back((width + factor - 1) / factor, (height + factor - 1) / factor);
+				}
+			}
+			budgetTextureSize = getBudgetTextureSize(sizes, static_cast<uint64_t>(settings.textureBudgetMB) * 1024 * 1024);
+		}
+
+		//every read is queued before the first image is created, so the files are read and decoded while the main thread uploads
+		auto decode = [this, virtualMinSize](const std::string& path, const unsigned char* data, size_t size) {
+			//a virtual texture is only decoded if its page file has to be rebuilt
+			int texWidth = 0, texHeight = 0, texChannels = 0;
+			if (stbi_info_from_memory(data, static_cast<int>(size), &texWidth, &texHeight, &texChannels) &&
+				static_cast<uint32_t>(std::max(texWidth, texHeight)) >= virtualMinSize) {
+				TextureData header;
+				header.width = static_cast<uint32_t>(texWidth);
+				header.height = static_cast<uint32_t>(texHeight);
+				return header;
+			}
+			return decodeTextureData(path, data, size, getMaxTextureSize(path));
+		};
+		size_t packedCount = 0;
+		for (TextureLoad& load : loads) {
+			std::string path = load.path;
+			//already mapped: the thread pool runs the loads in the order they are queued, so the priorities still hold
+			if (assetPack.contains(path)) {
+				const AssetPack* pack = &assetPack;
+				load.data = threadPool.submit([pack, path, decode]() {
+					AssetPack::Asset asset;
+					if (!pack->read(path, asset))
+						throw std::runtime_error("failed to read texture image " + path + " from the asset pack!");
+					return decode(path, asset.data(), asset.size());
+				});
+				packedCount++;
+			}
+			else
+				load.data = assetReader.read(path, load.priority, [path, decode](const unsigned char* data, size_t size) { return decode(path, data, size); });
+		}
 
+		//texture table slot of every file
+		std::unordered_map<std::string, uint32_t> loadedTextures;
+		size_t visibleCount = 0;
+		//of the textures loaded whole: how many skipped levels, and their mip chains as loaded and at the files' sizes
+		size_t reducedCount = 0;
+		uint64_t loadedBytes = 0;
+		uint64_t fileBytes = 0;
+		for (TextureLoad& load : loads) {
+			const std::string& path = load.path;
+			TextureData data = load.data.get();
+			Texture texture;
+			uint32_t tableIndex = textureTable.size();
+			//a virtual texture's slot holds its coarsest level, sampled until the page cache exists and by the non virtual pipelines
+			if (data.pixels.empty())
+				texture = createTextureImage(path, virtualTextures.addTexture(path, tableIndex, data.width, data.height,
+					[this, path]() { return loadTextureData(path, 0); }));
+			else {
+				if (data.skippedLevels > 0)
+					reducedCount++;
+				loadedBytes += getMipChainBytes(data.width, data.height);
+				fileBytes += getMipChainBytes(data.width << data.skippedLevels, data.height << data.skippedLevels);
+				texture = createTextureImage(path, data);
+			}
+			texture.tableIndex = textureTable.add(texture.view, textureSampler);
+			loadedTextures.emplace(path, texture.tableIndex);
+			textures.push_back(texture);
+			if (tableTextures.size() <= texture.tableIndex)
+				tableTextures.resize(texture.tableIndex + 1);
+			tableTextures[texture.tableIndex] = textures.size() - 1;
+			trackTexture(textures.size() - 1);
+			if (load.priority == AssetReader::Priority::Visible)
+				visibleCount++;
+		}
+
+		for (MeshDraw& draw : meshDraws)
+			draw.materialIndex = loadedTextures[materialTexturePaths[draw.materialIndex]];
+
+		AssetReader::Stats readStats = assetReader.takeStats();
+		std::cout << "Loaded " << textures.size() << " textures for " << meshDraws.size() << " materials, " << visibleCount << " visible ones first ("
+			<< packedCount << " from the asset pack, " << readStats.bytes / (1024 * 1024) << " MiB read through " << assetReader.getBackendName()
+			<< " in " << readStats.submissions << " submissions), " << getPixelKernelName(getPixelKernel()) << " pixel conversion" << std::endl;
+		if (settings.maxTextureSize > 0 || !settings.textureSizes.empty() || settings.textureBudgetMB > 0 || reducedCount > 0) {
+			double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			std::cout << "Texture sizes: " << reducedCount << " of " << textures.size() << " textures reduced (max " << settings.maxTextureSize;
+			if (settings.textureBudgetMB > 0)
+				std::cout << ", " << budgetTextureSize << " to fit " << settings.textureBudgetMB << " MiB";
+			std::cout << ", 0 is unlimited), " << loadedBytes / (1024 * 1024) << " MiB of mip chains instead of " << fileBytes / (1024 * 1024)
+				<< " MiB, loaded in " << milliseconds << " ms" << std::endl;
+		}
 
-				vertex.pos = {
-					(attrib.vertices[3 * index.vertex_index + 0] + position.x) * scale.x,
-					(attrib.vertices[3 * index.vertex_index + 1] + position.y) * scale.y,
-					(attrib.vertices[3 * index.vertex_index + 2] + position.z) * scale.z
-				};
+		if (virtualTexturingEnabled)
+		{
+			virtualTextures.createCache(textureTableCapacity);
+			virtualTextures.createFrameData(static_cast<uint32_t>(swapChainImages.size()));
+			//a fixed size, whatever is resident in it
+			VkDeviceSize cacheBytes = virtualTextures.getCacheBytes();
+			residency.add(cacheBytes, cacheBytes, cacheBytes);
+			VirtualTextureCache::Stats stats = virtualTextures.takeStats();
+			std::cout << "Virtual textures: " << stats.textures << " with " << stats.pageCount << " pages, " << stats.slotCount
+				<< " cache slots (" << stats.cacheBytes / (1024 * 1024) << " MiB) instead of " << stats.fullResolutionBytes / (1024 * 1024)
+				<< " MiB at full resolution" << std::endl;
+		}
+	}
 
-				vertex.texCoord = {
-					attrib.texcoords[2 * index.texcoord_index + 0],
-					1.0f - attrib.texcoords[2 * index.texcoord_index + 1]
-				};
+	void VulkanInterface::buildDrawQueue()
+	{
+		//a single pipeline per frame for now, but its variant key keeps the field meaningful once there are more
+		uint32_t pipelineId = activeVariant.key();
+
+		drawQueue.clear();
+		depthQueue.clear();
+		for (size_t i = 0; i < meshDraws.size(); i++) {
+			const MeshDraw& draw = meshDraws[i];
+			//the camera looks down -z in view space
+			float viewDepth = -(drawModelView * glm::vec4(draw.center, 1.0f)).z;
+			float depth = (viewDepth - zNear) / (zFar - zNear);
+			drawQueue.push(DrawQueue::makeKey(0, pipelineId, draw.materialIndex, depth), static_cast<uint32_t>(i));
+			//the pre-pass has a single pipeline and no materials, so only the depth orders it: strictly front to back,
+			//which rejects the most hidden fragments. The shading subpass can then stay sorted by material
+			if (depthPrepassEnabled)
+				depthQueue.push(DrawQueue::makeKey(0, 0, 0, depth), static_cast<uint32_t>(i));
+		}
+		drawQueue.sort(&threadPool);
+		depthQueue.sort(&threadPool);
+	}
 
-				vertex.color = { 1.0f, 1.0f, 1.0f };
 
-				if (uniqueVertices.count(vertex) == 0) {
-					uniqueVertices[vertex] = static_cast<uint32_t>(vertices.size());
-					vertices.push_back(vertex);
-				}
+	TextureData VulkanInterface::loadTextureData(const std::string& path, uint32_t maxSize)
+	{
+		AssetPack::Asset asset;
+		if (assetPack.read(path, asset))
+			return decodeTextureData(path, asset.data(), asset.size(), maxSize);
+
+		//decoded from the mapping, stb_image doesn't need its own buffered reads
+		MappedFile file;
+		if (!file.open(path)) {
+			throw std::runtime_error("failed to open texture image " + path + "!");
+		}
+		return decodeTextureData(path, file.data(), file.size(), maxSize);
+	}
 
-				indices.push_back(uniqueVertices[vertex]);
+	TextureData VulkanInterface::decodeTextureData(const std::string& path, const unsigned char* data, size_t size, uint32_t maxSize)
+	{
+		//the levels skipped depend on the file's size, so the header is read before the cache is
+		int texWidth, texHeight, texChannels;
+		if (!stbi_info_from_memory(data, static_cast<int>(size), &texWidth, &texHeight, &texChannels)) {
+			throw std::runtime_error("failed to load texture image " + path + "!");
+		}
+		uint32_t levelShift = getTextureLevelShift(static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight), maxSize);
+
+		CacheKey key("texture", TEXTURE_CACHE_VERSION);
+		key.addSource(data, size, &threadPool).add(levelShift);
+		DerivedDataCache::Entry cached;
+		CachedTexture header;
+		if (derivedData.load(key, cached) && cached.size() >= sizeof(header)) {
+			std::memcpy(&header, cached.data(), sizeof(header));
+			if ((header.channels == 3 || header.channels == 4) &&
+				cached.size() == sizeof(header) + static_cast<size_t>(header.width) * header.height * header.channels) {
+				TextureData textureData;
+				textureData.width = header.width;
+				textureData.height = header.height;
+				textureData.channels = header.channels;
+				textureData.skippedLevels = header.skippedLevels;
+				textureData.pixels.assign(cached.data() + sizeof(header), cached.data() + cached.size());
+				return textureData;
 			}
 		}
-		
-		std::cout << "Loaded " << vertices.size() << " vertices and " << indices.size() << " indices" << std::endl;
 
+		//only the levels that are uploaded are decoded, the mip chain then starts at the first of them
+		TextureData textureData;
+		if (!decodeTexture(data, size, levelShift, textureData)) {
+			throw std::runtime_error("failed to load texture image " + path + "!");
+		}
+
+		header = { textureData.width, textureData.height, textureData.channels, textureData.skippedLevels };
+		std::vector<unsigned char> entry(sizeof(header) + textureData.pixels.size());
+		std::memcpy(entry.data(), &header, sizeof(header));
+		std::memcpy(entry.data() + sizeof(header), textureData.pixels.data(), textureData.pixels.size());
+		derivedData.store(key, entry.data(), entry.size());
+		return textureData;
 	}
 
+	uint32_t VulkanInterface::getMaxTextureSize(const std::string& path) const
+	{
+		auto texture = settings.textureSizes.find(path);
+		uint32_t maxSize = texture != settings.textureSizes.end() ? texture->second : settings.maxTextureSize;
+		//0 is no limit of its own for each of them
+		for (uint32_t limit : { budgetTextureSize, deviceProperties.limits.maxImageDimension2D }) {
+			if (limit != 0)
+				maxSize = maxSize == 0 ? limit : std::min(maxSize, limit);
+		}
+		return maxSize;
+	}
 
-	void VulkanInterface::createTextureImage()
+	bool VulkanInterface::readTextureSize(const std::string& path, uint32_t& width, uint32_t& height)
 	{
-		VkBuffer stagingBuffer;
-		VkDeviceMemory stagingBufferMemory;
-		
+		//stb_image only parses the header, the rest of a mapped file is never read
+		AssetPack::Asset asset;
+		MappedFile file;
+		const unsigned char* data = nullptr;
+		size_t size = 0;
+		if (assetPack.read(path, asset)) {
+			data = asset.data();
+			size = asset.size();
+		}
+		else if (file.open(path)) {
+			data = file.data();
+			size = file.size();
+		}
 		int texWidth, texHeight, texChannels;
-		stbi_uc* pixels = stbi_load(TEXTURE_PATH.c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
-		VkDeviceSize imageSize = texWidth * texHeight * 4;
+		if (!data || !stbi_info_from_memory(data, static_cast<int>(size), &texWidth, &texHeight, &texChannels))
+			return false;
+		width = static_cast<uint32_t>(texWidth);
+		height = static_cast<uint32_t>(texHeight);
+		return true;
+	}
 
-		if (!pixels) {
-			throw std::runtime_error("failed to load texture image!");
-		}
+	Texture VulkanInterface::createTextureImage(const std::string& path, const TextureData& textureData)
+	{
+		Texture texture;
+		texture.path = path;
+		texture.width = textureData.width;
+		texture.height = textureData.height;
 
+		VkBuffer stagingBuffer;
+		VkDeviceMemory stagingBufferMemory;
 
-		mipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(texWidth, texHeight)))) + 1;
+		int texWidth = static_cast<int>(textureData.width);
+		int texHeight = static_cast<int>(textureData.height);
+		size_t pixelCount = static_cast<size_t>(texWidth) * texHeight;
+		VkDeviceSize imageSize = pixelCount * 4;
+
+		uint32_t mipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(texWidth, texHeight)))) + 1;
 
 		createBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
 			stagingBuffer, stagingBufferMemory);
 		
-		//copy image to memory
+		//converted straight into the mapping: RGB expanded and alpha premultiplied on the way, without an RGBA copy in between
 		void* data;
 		vkMapMemory(logicalDevice, stagingBufferMemory, 0, imageSize, 0, &data);
-		memcpy(data, pixels, static_cast<size_t>(imageSize));
+		PixelConversion conversion;
+		conversion.premultiplyAlpha = settings.premultiplyAlpha;
+		convertToRgba(textureData.pixels.data(), textureData.channels, static_cast<unsigned char*>(data), pixelCount, conversion);
 		vkUnmapMemory(logicalDevice, stagingBufferMemory);
-		//free image
-		stbi_image_free(pixels);
 
 		createImage(texWidth, texHeight, mipLevels, VK_SAMPLE_COUNT_1_BIT,
 			VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_TILING_OPTIMAL, 
 			VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-			textureImage, textureImageMemory);
+			texture.image, texture.memory);
 
-		//Transition the texture image to VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL
-		transitionImageLayout(textureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mipLevels);
-		copyBufferToImage(stagingBuffer, textureImage, static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight));
+		//Transitions the texture image to VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL and copies the first level
+		copyBufferToImage(stagingBuffer, texture.image, static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight), mipLevels);
 
 		//prepares for shader
 		// This is no longer needed, transitioned to VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL while generating mipmaps
 		//transitionImageLayout(textureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, mipLevels);
 
-		generateMipmaps(textureImage, VK_FORMAT_R8G8B8A8_SRGB, texWidth, texHeight, mipLevels);
+		generateMipmaps(texture.image, VK_FORMAT_R8G8B8A8_SRGB, texWidth, texHeight, mipLevels);
+
+		destroyBufferDeferred(stagingBuffer, stagingBufferMemory);
+
+		texture.mipLevels = mipLevels;
+		texture.view = createImageView(texture.image, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_ASPECT_COLOR_BIT, mipLevels);
+
+		VkMemoryRequirements memoryRequirements;
+		vkGetImageMemoryRequirements(logicalDevice, texture.image, &memoryRequirements);
+		texture.memorySize = memoryRequirements.size;
+		texture.fullMemorySize = memoryRequirements.size;
+		return texture;
+
+	}
+
+	void VulkanInterface::trackTexture(size_t index)
+	{
+		Texture& texture = textures[index];
+		texture.residencyId = residency.add(texture.memorySize, getTextureReducedSize(texture), texture.fullMemorySize);
+		residencyTextures[texture.residencyId] = index;
+	}
+
+	VkDeviceSize VulkanInterface::getTextureReducedSize(const Texture& texture) const
+	{
+		//the next step halves both sides
+		uint32_t longest = std::max(texture.width, texture.height) >> texture.droppedLevels;
+		if (texture.mipLevels < 2 || longest / 2 < MIN_RESIDENT_SIZE)
+			return texture.memorySize;
+		return texture.memorySize / 4;
+	}
+
+	void VulkanInterface::configureResidency()
+	{
+		ResidencyManager::Config config;
+		config.budgetCap = static_cast<VkDeviceSize>(settings.memoryBudgetMB) * 1024 * 1024;
+		residency.create(physicalDevice, memoryBudgetEnabled, config);
+
+		std::cout << "Memory budget: " << (memoryBudgetEnabled ? "VK_EXT_memory_budget" : "estimated from the device local heaps");
+		if (config.budgetCap > 0)
+			std::cout << ", capped at " << settings.memoryBudgetMB << " MiB";
+		std::cout << std::endl;
+	}
+
+	void VulkanInterface::updateResidency()
+	{
+		if (textures.empty())
+			return;
+
+		//0 is the frame of the resources added before the first one
+		uint64_t frame = frameCounter + 1;
+		for (const MeshDraw& draw : meshDraws) {
+			float viewDepth = -(drawModelView * glm::vec4(draw.center, 1.0f)).z;
+			residency.touch(textures[tableTextures[draw.materialIndex]].residencyId, frame, viewDepth);
+		}
+
+		const ResidencyManager::Budget& budget = residency.beginFrame(frame);
+		uint32_t restored = finishTextureRestores();
+
+		VkDeviceSize evictedBytes = 0;
+		std::vector<uint32_t> evictions = residency.selectEvictions();
+		for (uint32_t id : evictions) {
+			Texture& texture = textures[residencyTextures[id]];
+			VkDeviceSize before = texture.memorySize;
+			downgradeTexture(texture);
+			evictedBytes += before - std::min(before, texture.memorySize);
+		}
+
+		std::vector<uint32_t> restores = residency.selectRestores();
+		for (uint32_t id : restores) {
+			size_t index = residencyTextures[id];
+			std::string path = textures[index].path;
+			if (assetPack.contains(path))
+				textureRestores.push_back({ index, threadPool.submit([this, path]() { return loadTextureData(path, getMaxTextureSize(path)); }) });
+			else
+				textureRestores.push_back({ index, assetReader.read(path, AssetReader::Priority::Background,
+					[this, path](const unsigned char* data, size_t size) { return decodeTextureData(path, data, size, getMaxTextureSize(path)); }) });
+		}
+
+		frameStats.memoryBudget = budget.budget;
+		frameStats.memoryUsage = budget.usage;
+		frameStats.memoryMeasured = budget.measured;
+
+		if (!evictions.empty() || !restores.empty() || restored > 0) {
+			std::cout << "Residency: budget " << budget.budget / (1024 * 1024) << " MiB, usage " << budget.usage / (1024 * 1024) << " MiB"
+				<< (budget.measured ? "" : " (estimated)") << ", " << evictions.size() << " textures downgraded ("
+				<< evictedBytes / (1024 * 1024) << " MiB), " << restores.size() << " restores started, " << restored << " restored"
+				<< std::endl;
+		}
+	}
+
+	uint32_t VulkanInterface::finishTextureRestores()
+	{
+		uint32_t restored = 0;
+		for (auto restore = textureRestores.begin(); restore != textureRestores.end();) {
+			if (restore->data.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+				++restore;
+				continue;
+			}
+
+			Texture& texture = textures[restore->texture];
+			try {
+				replaceTexture(texture, createTextureImage(texture.path, restore->data.get()));
+				restored++;
+			}
+			catch (const std::exception& e) {
+				//stays downgraded, it is tried again the next time it is selected
+				std::cerr << "failed to restore texture " << texture.path << ": " << e.what() << std::endl;
+				residency.cancelRestore(texture.residencyId);
+			}
+			restore = textureRestores.erase(restore);
+		}
+		return restored;
+	}
+
+	void VulkanInterface::downgradeTexture(Texture& texture)
+	{
+		Texture reduced = texture;
+		reduced.droppedLevels = texture.droppedLevels + 1;
+		reduced.mipLevels = texture.mipLevels - 1;
+		uint32_t width = std::max(texture.width >> reduced.droppedLevels, 1u);
+		uint32_t height = std::max(texture.height >> reduced.droppedLevels, 1u);
+		createImage(width, height, reduced.mipLevels, VK_SAMPLE_COUNT_1_BIT,
+			VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_TILING_OPTIMAL,
+			VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			reduced.image, reduced.memory);
+
+		VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+
+		//levels 1 and up of the current image are levels 0 and up of the reduced one
+		VkImageMemoryBarrier barriers[2]{};
+		for (VkImageMemoryBarrier& barrier : barriers) {
+			barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			barrier.subresourceRange.baseArrayLayer = 0;
+			barrier.subresourceRange.layerCount = 1;
+		}
+		//the frames submitted before only read it
+		barriers[0].image = texture.image;
+		barriers[0].subresourceRange.baseMipLevel = 1;
+		barriers[0].subresourceRange.levelCount = reduced.mipLevels;
+		barriers[0].oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		barriers[0].newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		barriers[0].srcAccessMask = 0;
+		barriers[0].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		barriers[1].image = reduced.image;
+		barriers[1].subresourceRange.baseMipLevel = 0;
+		barriers[1].subresourceRange.levelCount = reduced.mipLevels;
+		barriers[1].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		barriers[1].newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barriers[1].srcAccessMask = 0;
+		barriers[1].dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer,
+			VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+			0, nullptr,
+			0, nullptr,
+			2, barriers);
+
+		std::vector<VkImageCopy> regions(reduced.mipLevels);
+		for (uint32_t i = 0; i < reduced.mipLevels; i++) {
+			VkImageCopy& region = regions[i];
+			region = {};
+			region.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, i + 1, 0, 1 };
+			region.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, i, 0, 1 };
+			region.extent = { std::max(width >> i, 1u), std::max(height >> i, 1u), 1 };
+		}
+		vkCmdCopyImage(commandBuffer,
+			texture.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			reduced.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			static_cast<uint32_t>(regions.size()), regions.data());
+
+		//the current image goes back to the layout its descriptor expects until it is destroyed
+		barriers[0].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		barriers[0].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		barriers[0].srcAccessMask = 0;
+		barriers[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		barriers[1].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barriers[1].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		barriers[1].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barriers[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+			0, nullptr,
+			0, nullptr,
+			2, barriers);
+
+		endSingleTimeCommands(commandBuffer);
 
-		vkDestroyBuffer(logicalDevice, stagingBuffer, nullptr);
-		vkFreeMemory(logicalDevice, stagingBufferMemory, nullptr);
+		reduced.view = createImageView(reduced.image, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_ASPECT_COLOR_BIT, reduced.mipLevels);
+		VkMemoryRequirements memoryRequirements;
+		vkGetImageMemoryRequirements(logicalDevice, reduced.image, &memoryRequirements);
+		reduced.memorySize = memoryRequirements.size;
+		replaceTexture(texture, reduced);
+	}
 
+	void VulkanInterface::replaceTexture(Texture& texture, Texture replacement)
+	{
+		//a bindless descriptor can't change while a submitted frame may still read it. Only frames that change the residency stall
+		if (textureTable.isBindless())
+			graphicsTimeline.wait(graphicsTimeline.lastSubmittedValue());
+
+		VkImageView view = texture.view;
+		VkImage image = texture.image;
+		VkDeviceMemory memory = texture.memory;
+		graphicsTimeline.deferUntilIdle([this, view, image, memory]() {
+			vkDestroyImageView(logicalDevice, view, nullptr);
+			vkDestroyImage(logicalDevice, image, nullptr);
+			vkFreeMemory(logicalDevice, memory, nullptr);
+		});
+
+		replacement.tableIndex = texture.tableIndex;
+		replacement.residencyId = texture.residencyId;
+		texture = replacement;
+		VkDescriptorSet previousSet = textureTable.replace(texture.tableIndex, texture.view, textureSampler);
+		if (previousSet != VK_NULL_HANDLE)
+			graphicsTimeline.deferUntilIdle([this, previousSet]() { textureTable.recycleSet(previousSet); });
+		residency.update(texture.residencyId, texture.memorySize, getTextureReducedSize(texture), texture.fullMemorySize);
 	}
 
 
@@ -1595,6 +3363,12 @@ namespace vulkanExample
 #ifndef FORCE_MAX_MSAA
 		return VK_SAMPLE_COUNT_2_BIT;
 #else
+		return getDeviceMaxSampleCount();
+#endif
+	}
+
+	VkSampleCountFlagBits VulkanInterface::getDeviceMaxSampleCount()
+	{
 		VkPhysicalDeviceProperties physicalDeviceProperties;
 		vkGetPhysicalDeviceProperties(physicalDevice, &physicalDeviceProperties);
 
@@ -1608,7 +3382,6 @@ namespace vulkanExample
 		if (counts & VK_SAMPLE_COUNT_2_BIT) { return VK_SAMPLE_COUNT_2_BIT; }
 
 		return VK_SAMPLE_COUNT_1_BIT;
-#endif
 	}
 
 	void VulkanInterface::generateMipmaps(VkImage image, VkFormat format, int32_t texWidth, int32_t texHeight, uint32_t mipLevels) {
@@ -1725,9 +3498,25 @@ namespace vulkanExample
 
 		//copy vertex data to vertex buffer (from CPU to GPU)
 		copyBuffer(stagingBuffer, vertexBuffer, size);
-		// destroy temporary buffer
-		vkDestroyBuffer(logicalDevice, stagingBuffer, nullptr);
-		vkFreeMemory(logicalDevice, stagingBufferMemory, nullptr);
+		// destroy temporary buffer once the copy is done
+		destroyBufferDeferred(stagingBuffer, stagingBufferMemory);
+
+		//the depth pre-pass only needs the positions, so it fetches 12 bytes per vertex instead of 32
+		std::vector<glm::vec3> positions(vertices.size());
+		for (size_t i = 0; i < vertices.size(); i++)
+			positions[i] = vertices[i].pos;
+		VkDeviceSize positionSize = sizeof(positions[0]) * positions.size();
+		createBuffer(positionSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			stagingBuffer, stagingBufferMemory);
+		vkMapMemory(logicalDevice, stagingBufferMemory, 0, positionSize, 0, &data);
+		memcpy(data, positions.data(), (size_t)positionSize);
+		vkUnmapMemory(logicalDevice, stagingBufferMemory);
+		createBuffer(positionSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, flags, positionBuffer, positionBufferMemory);
+		copyBuffer(stagingBuffer, positionBuffer, positionSize);
+		destroyBufferDeferred(stagingBuffer, stagingBufferMemory);
+
+		//the mesh has a single level of detail, so the residency manager only counts it
+		residency.add(size + positionSize, size + positionSize, size + positionSize);
 	}
 
 
@@ -1750,24 +3539,79 @@ namespace vulkanExample
 
 		return commandBuffer;
 	}
+	// Submits without waiting. Later commands on the same queue are ordered by their own barriers,
+	// and the next frame waits on uploadTimelineValue before reading the uploaded data
 	void VulkanInterface::endSingleTimeCommands(VkCommandBuffer commandBuffer)
 	{
 		vkEndCommandBuffer(commandBuffer);
 
-		VkSubmitInfo submitInfo{};
-		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers = &commandBuffer;
+		uploadTimelineValue = graphicsTimeline.submit({ commandBuffer });
 
-		vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
-		vkQueueWaitIdle(graphicsQueue);
+		graphicsTimeline.deferUntil(uploadTimelineValue, [this, commandBuffer]() {
+			vkFreeCommandBuffers(logicalDevice, commandPool, 1, &commandBuffer);
+		});
+	}
 
-		vkFreeCommandBuffers(logicalDevice, commandPool, 1, &commandBuffer);
+	VkCommandBuffer VulkanInterface::beginUploadCommands()
+	{
+		if (transferQueue.isCreated())
+			return transferQueue.begin();
+		return beginSingleTimeCommands();
 	}
 
-	void VulkanInterface::copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height)
+	OwnershipTransfer VulkanInterface::createUploadHandoff() const
 	{
-		VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+		uint32_t graphicsFamily = queueFamilies.graphicsFamily.value();
+		return OwnershipTransfer(transferQueue.isCreated() ? transferQueue.getFamily() : graphicsFamily, graphicsFamily);
+	}
+
+	// On the transfer queue, the graphics queue acquires the resources in a submission that waits for the copies on the GPU.
+	// uploadTimelineValue stays a graphics timeline value either way
+	void VulkanInterface::endUploadCommands(VkCommandBuffer commandBuffer, const OwnershipTransfer& handoff)
+	{
+		if (!transferQueue.isCreated())
+		{
+			endSingleTimeCommands(commandBuffer);
+			return;
+		}
+		uploadTimelineValue = transferQueue.submit(commandBuffer, handoff);
+	}
+
+	void VulkanInterface::destroyBufferDeferred(VkBuffer buffer, VkDeviceMemory memory)
+	{
+		//the graphics submissions acquiring the uploads waited for the transfer queue, so this covers its copies too
+		graphicsTimeline.deferUntilIdle([this, buffer, memory]() {
+			vkDestroyBuffer(logicalDevice, buffer, nullptr);
+			vkFreeMemory(logicalDevice, memory, nullptr);
+		});
+	}
+
+	void VulkanInterface::copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height, uint32_t mipLevels)
+	{
+		VkCommandBuffer commandBuffer = beginUploadCommands();
+
+		VkImageSubresourceRange range{};
+		range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		range.baseMipLevel = 0;
+		range.levelCount = mipLevels;
+		range.baseArrayLayer = 0;
+		range.layerCount = 1;
+
+		//every level, generateMipmaps writes the others
+		VkImageMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = image;
+		barrier.subresourceRange = range;
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+			0, nullptr,
+			0, nullptr,
+			1, &barrier);
 
 		VkBufferImageCopy region{};
 		region.bufferOffset = 0;
@@ -1795,22 +3639,38 @@ namespace vulkanExample
 			&region
 		);
 
-		endSingleTimeCommands(commandBuffer);
+		//the mipmaps are blitted on the graphics queue, the layout stays the same
+		OwnershipTransfer handoff = createUploadHandoff();
+		handoff.addImage(image, range, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+			VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+		endUploadCommands(commandBuffer, handoff);
 	}
 
 	void VulkanInterface::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size)
 	{
-		VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+		VkCommandBuffer commandBuffer = beginUploadCommands();
 
 		VkBufferCopy copyRegion{};
 		copyRegion.size = size;
 		vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
 
-		endSingleTimeCommands(commandBuffer);
-
+		//vertex, position and index buffers
+		OwnershipTransfer handoff = createUploadHandoff();
+		handoff.addBuffer(dstBuffer, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+			VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
+		endUploadCommands(commandBuffer, handoff);
 	}
 
 	uint32_t VulkanInterface::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties)
+	{
+		std::optional<uint32_t> memoryType = findOptionalMemoryType(typeFilter, properties);
+		if (!memoryType.has_value())
+			throw std::runtime_error("failed to find suitable memory type!");
+		return memoryType.value();
+	}
+
+	std::optional<uint32_t> VulkanInterface::findOptionalMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties)
 	{
 		VkPhysicalDeviceMemoryProperties memProperties;
 		vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
@@ -1821,38 +3681,101 @@ namespace vulkanExample
 				return i;
 			}
 		}
-
-		throw std::runtime_error("failed to find suitable memory type!");
-
+		return {};
 	}
 
 
 	void VulkanInterface::createSyncObjects()
 	{
-		imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-		renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-		inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
-		imagesInFlight.resize(swapChainImages.size(), VK_NULL_HANDLE);
+		//the swap chain still needs binary semaphores for acquire and present. Everything else is tracked by the timeline
+		imageAvailableSemaphores.resize(framesInFlight);
+		renderFinishedSemaphores.resize(framesInFlight);
+		frameTimelineValues.assign(framesInFlight, 0);
+		imageTimelineValues.assign(swapChainImages.size(), 0);
 
 		VkSemaphoreCreateInfo semaphoreInfo{};
 		semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-		VkFenceCreateInfo fenceInfo{};
-		fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-		fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-
-		for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+		for (size_t i = 0; i < framesInFlight; i++)
 		{
 			//create semaphores
 			if (vkCreateSemaphore(logicalDevice, &semaphoreInfo, nullptr, &imageAvailableSemaphores[i]) != VK_SUCCESS ||
-				vkCreateSemaphore(logicalDevice, &semaphoreInfo, nullptr, &renderFinishedSemaphores[i]) != VK_SUCCESS ||
-				vkCreateFence(logicalDevice, &fenceInfo, nullptr, &inFlightFences[i])) {
+				vkCreateSemaphore(logicalDevice, &semaphoreInfo, nullptr, &renderFinishedSemaphores[i]) != VK_SUCCESS) {
 
 				throw std::runtime_error("failed to create semaphores!");
 			}
 		}
 	}
 
+	void VulkanInterface::destroySyncObjects()
+	{
+		for (size_t i = 0; i < imageAvailableSemaphores.size(); i++)
+		{
+			//destroy semaphores
+			vkDestroySemaphore(logicalDevice, renderFinishedSemaphores[i], nullptr);
+			vkDestroySemaphore(logicalDevice, imageAvailableSemaphores[i], nullptr);
+		}
+		imageAvailableSemaphores.clear();
+		renderFinishedSemaphores.clear();
+	}
+
+	// Changes the frames in flight depth. Needs an idle device, so only happens at a frame boundary
+	void VulkanInterface::applyFramesInFlight()
+	{
+		if (pendingFramesInFlight == 0 || pendingFramesInFlight == framesInFlight)
+		{
+			pendingFramesInFlight = 0;
+			return;
+		}
+
+		vkDeviceWaitIdle(logicalDevice);
+		destroySyncObjects();
+		framesInFlight = pendingFramesInFlight;
+		pendingFramesInFlight = 0;
+		currentFrame = 0;
+		createSyncObjects();
+		descriptorAllocator.setFrameCount(framesInFlight);
+		std::cout << "Frames in flight: " << framesInFlight << std::endl;
+	}
+
+	void VulkanInterface::cyclePresentMode()
+	{
+		static const VkPresentModeKHR modes[] = {
+			VK_PRESENT_MODE_FIFO_KHR, VK_PRESENT_MODE_FIFO_RELAXED_KHR, VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR
+		};
+		const size_t modeCount = sizeof(modes) / sizeof(modes[0]);
+
+		size_t current = std::find(modes, modes + modeCount, settings.presentMode) - modes;
+		settings.presentMode = modes[(current + 1) % modeCount];
+		//the present mode is baked into the swap chain, so it has to be recreated
+		frameBufferResized = true;
+	}
+
+	// Latency control: don't start a new frame while more than maxQueuedPresents presents are waiting for the display.
+	// Without a limit, the presents that carry input are only polled so their latency is still measured
+	void VulkanInterface::waitForQueuedPresents()
+	{
+#ifdef VK_KHR_present_wait
+		if (!presentWaitEnabled)
+			return;
+		if (settings.maxQueuedPresents == 0) {
+			std::optional<uint64_t> waitId;
+			while ((waitId = framePacer.getOldestQueuedPresent()).has_value() &&
+				vkWaitForPresent(logicalDevice, swapChain, waitId.value(), 0) == VK_SUCCESS)
+				framePacer.onPresentCompleted(waitId.value());
+			return;
+		}
+		if (presentId <= settings.maxQueuedPresents)
+			return;
+
+		uint64_t waitId = presentId - settings.maxQueuedPresents;
+		//time out after 100ms so a minimized or occluded window can't hang the loop
+		VkResult result = vkWaitForPresent(logicalDevice, swapChain, waitId, 100000000ull);
+		if (result == VK_SUCCESS)
+			framePacer.onPresentCompleted(waitId);
+#endif
+	}
+
 	void VulkanInterface::updateViewPosition()
 	{
 		
@@ -1916,12 +3839,23 @@ namespace vulkanExample
 		ubo.view = glm::lookAt(cameraPos, cameraPos + cameraFront, cameraUp);
 
 		//45 degree vertical field-of-view.The other parameters are the aspect ratio, nearand far view planes.
-		ubo.proj = glm::perspective(glm::radians(30.0f), swapChainExtent.width / (float)swapChainExtent.height, 0.1f, 10.0f);
+		ubo.proj = glm::perspective(glm::radians(30.0f), swapChainExtent.width / (float)swapChainExtent.height, zNear, zFar);
 
 
 		//GLM was made for OpenGL, therefore it will render upside down in Vulkan. Have to adjust that
 		ubo.proj[1][1] *= -1.0f;
 
+		drawModelView = ubo.view * ubo.model;
+		//the matrices are the same for every vertex of the draw, so multiply them once here instead of per vertex.
+		//Occlusion culling projects the clusters with it too
+		drawMVP = multiplySimd(multiplySimd(ubo.proj, ubo.view), ubo.model);
+
+		if (pushConstantMVPEnabled)
+		{
+			drawConstants.mvp = drawMVP;
+			return;
+		}
+
 		//copies memory
 		void* data;
 		vkMapMemory(logicalDevice, uniformBuffersMemory[currentImage], 0, sizeof(ubo), 0, &data);
@@ -1933,7 +3867,14 @@ namespace vulkanExample
 
 	void VulkanInterface::drawFrame()
 	{
-		vkWaitForFences(logicalDevice, 1, &inFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
+		applyFramesInFlight();
+		waitForQueuedPresents();
+
+		//the frame slot (and its semaphores) can be reused once the GPU reached the value of its last submission
+		graphicsTimeline.wait(frameTimelineValues[currentFrame]);
+		graphicsTimeline.collectGarbage();
+		//so are the transient descriptor sets allocated for it
+		descriptorAllocator.resetFrame(currentFrame);
 		
 		//acquires image, infinite timeout for now
 		uint32_t imageIndex;
@@ -1950,42 +3891,47 @@ namespace vulkanExample
 		}
 
 
-		// Check if a previous frame is using this image (i.e. there is its fence to wait on)
-		if (imagesInFlight[imageIndex] != VK_NULL_HANDLE) {
-			vkWaitForFences(logicalDevice, 1, &imagesInFlight[imageIndex], VK_TRUE, UINT64_MAX);
-		}
-		// Mark the image as now being in use by this frame
-		imagesInFlight[imageIndex] = inFlightFences[currentFrame];
+		// A previous frame may still use this image's uniform buffer and command buffer. Usually it is already done, so this doesn't block
+		graphicsTimeline.wait(imageTimelineValues[imageIndex]);
+		//so its timestamps and statistics are ready too
+		updateRenderScale(imageIndex);
+		collectFragmentCount(imageIndex);
+		collectOcclusionStats(imageIndex);
+		collectQueueBusyTime();
+		//reads the pages the image's previous frame asked for and assigns the loaded ones to cache slots
+		if (virtualTexturingEnabled)
+			virtualTextures.beginFrame(imageIndex, frameCounter + 1);
 
+		reloadChangedShaders();
+		selectPipelineVariant(false);
 		updateUniformBuffer(imageIndex);
+		buildDrawQueue();
+		//before recording, the draws must see the replaced texture descriptors
+		updateResidency();
+		recordCommandBuffer(imageIndex);
 
 
-		//prepares command buffer submission (Queue submission and synchronization done by semaphore)
-		VkSubmitInfo submitInfo{};
-		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-		
 		//wait for this semaphore (in other words, wait for vkAcquireNextImage... to finish)
-		VkSemaphore waitSemaphores[] = { imageAvailableSemaphores[currentFrame] };
-		VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-		
-		submitInfo.waitSemaphoreCount = 1;
-		submitInfo.pWaitSemaphores = waitSemaphores;
-		submitInfo.pWaitDstStageMask = waitStages;
-		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers = &commandBuffers[imageIndex];
+		std::vector<GpuTimeline::Wait> waits = {
+			{ imageAvailableSemaphores[currentFrame], 0, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT }
+		};
+
+		//uploads are submitted without blocking, so the first frames after a load wait for them on the GPU
+		if (!graphicsTimeline.isComplete(uploadTimelineValue))
+		{
+			if (graphicsTimeline.usesTimelineSemaphore())
+				waits.push_back({ graphicsTimeline.getSemaphore(), uploadTimelineValue, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT });
+			else
+				graphicsTimeline.wait(uploadTimelineValue);
+		}
 
 		//Semaphore that will be used by renderer
 		VkSemaphore signalSemaphores[] = { renderFinishedSemaphores[currentFrame] };
-		submitInfo.signalSemaphoreCount = 1;
-		submitInfo.pSignalSemaphores = signalSemaphores;
-
-		//Reset fences
-		vkResetFences(logicalDevice, 1, &inFlightFences[currentFrame]);
 
 		//submits command buffer to graphics queue
-		if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, inFlightFences[currentFrame]) != VK_SUCCESS) {
-			throw std::runtime_error("failed to submit draw command buffer!");
-		}
+		uint64_t submitValue = graphicsTimeline.submit({ commandBuffers[imageIndex] }, waits, { renderFinishedSemaphores[currentFrame] });
+		frameTimelineValues[currentFrame] = submitValue;
+		imageTimelineValues[imageIndex] = submitValue;
 
 		//Presentation part
 		VkPresentInfoKHR presentInfo{};
@@ -2003,10 +3949,26 @@ namespace vulkanExample
 
 		presentInfo.pResults = nullptr; // Optional
 
+		//tags the present with an id so we can later wait until it is actually on screen
+		presentId++;
+#ifdef VK_KHR_present_id
+		VkPresentIdKHR presentIdInfo{};
+		presentIdInfo.sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR;
+		presentIdInfo.swapchainCount = 1;
+		presentIdInfo.pPresentIds = &presentId;
+		if (presentWaitEnabled)
+			presentInfo.pNext = &presentIdInfo;
+#endif
+		framePacer.onPresentQueued(presentId);
+
 		//presents rendering on screen
 		result = vkQueuePresentKHR(presentQueue, &presentInfo);
+
+		//without present wait the best we can measure is when the present call returns
+		if (!presentWaitEnabled)
+			framePacer.onPresentCompleted(presentId);
 		
-		if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || frameBufferResized)
+		if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || frameBufferResized || renderTargetsChanged)
 		{
 			frameBufferResized = false;
 			recreateSwapChain();
@@ -2017,29 +3979,11 @@ namespace vulkanExample
 		}
 
 		//increments current frame
-		currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
-
-	}
-
-	VkShaderModule VulkanInterface::createShaderModule(const std::vector<char>& code)
-	{
-		VkShaderModuleCreateInfo createInfo{};
-		createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-		createInfo.codeSize = code.size();
-		//has to cast from char to uint32 to satisfy pointer type
-		createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
-
-		//creates shader
-		VkShaderModule shaderModule;
-		if (vkCreateShaderModule(logicalDevice, &createInfo, nullptr, &shaderModule) != VK_SUCCESS) {
-			throw std::runtime_error("failed to create shader module!");
-		}
+		currentFrame = (currentFrame + 1) % framesInFlight;
+		frameCounter++;
 
-		return shaderModule;
 	}
 
-
-
 	bool VulkanInterface::checkValidationLayerSupport() {
 		uint32_t layerCount;
 		vkEnumerateInstanceLayerProperties(&layerCount, nullptr);
@@ -2081,27 +4025,54 @@ namespace vulkanExample
 		std::vector<VkPhysicalDevice> deviceList(deviceCount);
 		vkEnumeratePhysicalDevices(instance, &deviceCount, deviceList.data());
 
-		for (VkPhysicalDevice &device : deviceList)
+		std::vector<DeviceCandidate> candidates;
+		std::vector<QueueFamilyIndices> candidateQueues;
+		for (uint32_t i = 0; i < deviceCount; i++)
 		{
-			std::optional<QueueFamilyIndices> result = checkDevice(device);
-			if (result.has_value())
-			{
-				physicalDevice = device;
-				msaaSamples = getMaxUsableSampleCount();
-				queueFamilies = result.value();
-				vkGetPhysicalDeviceProperties(device, &deviceProperties);
-				vkGetPhysicalDeviceFeatures(device, &deviceFeatures);
-				break;
-			}
+			QueueFamilyIndices indices;
+			candidates.push_back(inspectDevice(deviceList[i], i, indices));
+			candidateQueues.push_back(indices);
+		}
+
+		//the command line wins over the environment
+		std::string selection = settings.device.empty() ? getEnvironmentVariable("VULKAN_EXAMPLE_DEVICE") : settings.device;
+		std::optional<size_t> chosen = selectDevice(candidates, selection);
+
+		for (const DeviceCandidate& candidate : candidates)
+		{
+			std::cout << "Device " << candidate.index << ": " << candidate.name << " (";
+			if (candidate.missing.empty())
+				std::cout << "score " << scoreDevice(candidate) << ")";
+			else
+				std::cout << "unsuitable, " << candidate.missing << ")";
+			std::cout << std::endl;
 		}
 
-		if (physicalDevice == VK_NULL_HANDLE)
+		if (!chosen.has_value())
 			throw std::runtime_error("Failed to find a suitable GPU");
+
+		const DeviceCandidate& candidate = candidates[chosen.value()];
+		physicalDevice = candidate.device;
+		msaaSamples = getMaxUsableSampleCount();
+		queueFamilies = candidateQueues[chosen.value()];
+		vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+		vkGetPhysicalDeviceFeatures(physicalDevice, &deviceFeatures);
+
+		std::cout << "Using device " << candidate.index << ": " << candidate.name << (selection.empty() ? "" : " (selected)") << std::endl
+			<< "  " << describeDevice(candidate) << std::endl
+			<< "  queue families: graphics " << queueFamilies.graphicsFamily.value() << ", present " << queueFamilies.presentFamily.value();
+		if (queueFamilies.transferFamily.has_value())
+			std::cout << ", transfer " << queueFamilies.transferFamily.value();
+		if (queueFamilies.computeFamily.has_value())
+			std::cout << ", compute " << queueFamilies.computeFamily.value();
+		std::cout << ", max MSAA " << getDeviceMaxSampleCount() << "x" << std::endl;
 		// prints device information if debugging
 		printDeviceExtensionSupport(physicalDevice);
 	}
 
-	std::optional<QueueFamilyIndices> VulkanInterface::checkDevice(VkPhysicalDevice device)
+	// Only rejects devices for what the renderer really needs. CPU implementations (lavapipe, SwiftShader) are accepted,
+	// they just rank last, so they can be selected for headless benchmark runs
+	DeviceCandidate VulkanInterface::inspectDevice(VkPhysicalDevice device, uint32_t index, QueueFamilyIndices& indices)
 	{
 		VkPhysicalDeviceProperties properties;
 		VkPhysicalDeviceFeatures features;
@@ -2109,33 +4080,53 @@ namespace vulkanExample
 		vkGetPhysicalDeviceProperties(device, &properties);
 		vkGetPhysicalDeviceFeatures(device, &features);
 
-		if ((properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU || properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU) && features.geometryShader)
-		{
+		DeviceCandidate candidate;
+		candidate.device = device;
+		candidate.index = index;
+		candidate.name = properties.deviceName;
+		candidate.type = properties.deviceType;
+		candidate.apiVersion = properties.apiVersion;
 
-			QueueFamilyIndices indices = findQueueFamilies(device);
-			
-#ifndef NDEBUG
-			std::cout << "Found suitable device" << std::endl;
-			if (properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU)
-				std::cout << "Device Type:" << "VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU" << std::endl;
-			else
-				std::cout << "Device Type:" << "VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU" << std::endl;
-			std::cout << "Device Name:" << properties.deviceName << std::endl;
-			std::cout << "Vendor ID:" << properties.vendorID << std::endl;
-			std::cout << "API Version:" << properties.apiVersion << std::endl;
-			std::cout << "Driver Version:" << properties.driverVersion << std::endl;
-			std::cout << "Has queue supporting VK_QUEUE_GRAPHICS_BIT: " << (indices.graphicsFamily.has_value() ? "true" : "false") << std::endl;
-#endif
-			
-			VkPhysicalDeviceFeatures supportedFeatures;
-			vkGetPhysicalDeviceFeatures(device, &supportedFeatures);
+		VkPhysicalDeviceMemoryProperties memoryProperties;
+		vkGetPhysicalDeviceMemoryProperties(device, &memoryProperties);
+		for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++)
+		{
+			if (memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)
+				candidate.deviceLocalMemory = std::max(candidate.deviceLocalMemory, memoryProperties.memoryHeaps[i].size);
+		}
 
-			if (indices.isValid() && checkDeviceExtensionSupport(device) && querySwapChainSupport(device).isAdequate() 
-				&& supportedFeatures.samplerAnisotropy)
-				return indices;
+		indices = findQueueFamilies(device);
+		candidate.dedicatedTransfer = indices.transferFamily.has_value();
+		candidate.asyncCompute = indices.computeFamily.has_value();
+		candidate.multiDrawIndirect = features.multiDrawIndirect == VK_TRUE;
+		candidate.pipelineStatistics = features.pipelineStatisticsQuery == VK_TRUE;
+		if (properties.apiVersion >= VK_API_VERSION_1_2)
+		{
+			VkPhysicalDeviceVulkan12Features features12{};
+			features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+			VkPhysicalDeviceFeatures2 features2{};
+			features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+			features2.pNext = &features12;
+			vkGetPhysicalDeviceFeatures2(device, &features2);
+			candidate.timelineSemaphore = features12.timelineSemaphore == VK_TRUE;
+			candidate.descriptorIndexing = features12.runtimeDescriptorArray && features12.descriptorBindingPartiallyBound &&
+				features12.descriptorBindingSampledImageUpdateAfterBind && features12.descriptorBindingVariableDescriptorCount;
 		}
 
-		return std::nullopt;
+		//createLogicalDevice enables these two unconditionally
+		if (!indices.graphicsFamily.has_value())
+			candidate.missing = "no graphics queue";
+		else if (!indices.presentFamily.has_value())
+			candidate.missing = "can't present to the window surface";
+		else if (!checkDeviceExtensionSupport(device))
+			candidate.missing = "missing a required device extension";
+		else if (!querySwapChainSupport(device).isAdequate())
+			candidate.missing = "no swap chain format or present mode";
+		else if (!features.samplerAnisotropy)
+			candidate.missing = "no sampler anisotropy";
+		else if (!features.sampleRateShading)
+			candidate.missing = "no sample rate shading";
+		return candidate;
 	}
 
 	//Checks all available capabiliti4es, formats and present modes available from the swap chain and populate SwapChainSupportDetails struct
@@ -2168,14 +4159,16 @@ namespace vulkanExample
 
 	VkPresentModeKHR VulkanInterface::chooseSwapPresentMode(const std::vector<VkPresentModeKHR>& availablePresentModes) 
 	{
-	// if Mailboox (similar to tripple buffer) is available, select this one
+		// FIFO: vsync, lowest power. FIFO_RELAXED: vsync but tears when late. MAILBOX: no tearing, latest frame wins (similar to tripple buffer)
+		// IMMEDIATE: no vsync, lowest latency with tearing
 		for (const auto& availablePresentMode : availablePresentModes) {
-			if (availablePresentMode == VK_PRESENT_MODE_MAILBOX_KHR) {
+			if (availablePresentMode == settings.presentMode) {
 				return availablePresentMode;
 			}
 		}
 
-		//otherwise just uses nomal FIFO (double buffer)
+		//otherwise just uses nomal FIFO (double buffer), which is always available
+		std::cout << "Present mode " << presentModeName(settings.presentMode) << " not supported, using FIFO" << std::endl;
 		return VK_PRESENT_MODE_FIFO_KHR;
 	}
 
@@ -2242,6 +4235,21 @@ namespace vulkanExample
 		return requiredExtensions.empty();
 	}
 
+	bool VulkanInterface::isDeviceExtensionSupported(VkPhysicalDevice device, const char* extensionName)
+	{
+		uint32_t extensionCount;
+		vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+
+		std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+		vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
+
+		for (const auto& extension : availableExtensions) {
+			if (strcmp(extension.extensionName, extensionName) == 0)
+				return true;
+		}
+		return false;
+	}
+
 	void VulkanInterface::printDeviceExtensionSupport(VkPhysicalDevice device)
 	{
 #ifndef NDEBUG
@@ -2277,12 +4285,25 @@ namespace vulkanExample
 		//Need to find at least one queue that supports VK_QUEUE_GRAPHICS_BIT
 		int i = 0;
 		for (const auto& queueFamily : queueFamiliesProperties) {
-			// Looking for a queue which has transfer capabilities, but it is not a graphic queue.
-			// Unfortunately, my setup doesn't have one
-			if ((queueFamily.queueFlags & VK_QUEUE_TRANSFER_BIT) && !(queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT))
-				std::cout << "Found queue " << i << " with transfer bit AND not Graphics bit" << std::endl;
-			
-			if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+			bool graphics = (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0;
+			bool compute = (queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT) != 0;
+			//graphics and compute families support transfers even without the bit
+			bool transfer = (queueFamily.queueFlags & VK_QUEUE_TRANSFER_BIT) != 0 || compute;
+
+			//async compute: any compute family that doesn't also run the frames
+			if (compute && !graphics && !indices.computeFamily.has_value())
+				indices.computeFamily = i;
+			//the copy engine (transfer only) is preferred, otherwise any family without graphics is better than the graphics queue
+			if (transfer && !graphics && queueFamily.queueCount > 0)
+			{
+				bool transferOnly = !compute;
+				bool currentIsTransferOnly = indices.transferFamily.has_value() &&
+					!(queueFamiliesProperties[indices.transferFamily.value()].queueFlags & VK_QUEUE_COMPUTE_BIT);
+				if (!indices.transferFamily.has_value() || (transferOnly && !currentIsTransferOnly))
+					indices.transferFamily = i;
+			}
+
+			if (graphics) {
 				indices.graphicsFamily = i;
 				VkBool32 presentSupport = false;
 				vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
@@ -2307,19 +4328,28 @@ namespace vulkanExample
 		if (!queueFamilies.graphicsFamily.has_value() || !queueFamilies.presentFamily.has_value())
 			throw std::runtime_error("Queue has not been initialized or found");
 		
-		std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-		std::set<uint32_t> uniqueQueueFamilies = { queueFamilies.graphicsFamily.value(), queueFamilies.presentFamily.value() };
-
+		//one queue per family. The frames get the highest priority, async compute comes next and uploads last,
+		//a family serving several roles gets the highest priority among them
+		std::map<uint32_t, float> queuePriorities;
+		auto addQueue = [&queuePriorities](std::optional<uint32_t> family, float priority) {
+			if (family.has_value())
+				queuePriorities[family.value()] = std::max(queuePriorities[family.value()], priority);
+		};
+		addQueue(queueFamilies.graphicsFamily, GRAPHICS_QUEUE_PRIORITY);
+		addQueue(queueFamilies.presentFamily, GRAPHICS_QUEUE_PRIORITY);
+		addQueue(queueFamilies.computeFamily, COMPUTE_QUEUE_PRIORITY);
+		addQueue(queueFamilies.transferFamily, TRANSFER_QUEUE_PRIORITY);
 
-		for (uint32_t queueFamily : uniqueQueueFamilies) {
+		std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
+		for (const auto& queuePriority : queuePriorities) {
 			VkDeviceQueueCreateInfo queueCreateInfo{};
 			//add structure type
 			queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
 			// add indec
-			queueCreateInfo.queueFamilyIndex = queueFamily;
+			queueCreateInfo.queueFamilyIndex = queuePriority.first;
 			queueCreateInfo.queueCount = 1;
-			//set fixed prio
-			queueCreateInfo.pQueuePriorities = new const float{ 1.0f };
+			//points into the map, which outlives vkCreateDevice
+			queueCreateInfo.pQueuePriorities = &queuePriority.second;
 			queueCreateInfos.push_back(queueCreateInfo);
 		}
 
@@ -2336,9 +4366,130 @@ namespace vulkanExample
 		// enables anisotropy filter
 		deviceFeatures.samplerAnisotropy = VK_TRUE;
 		deviceFeatures.sampleRateShading = VK_TRUE;
+		//every supported feature is enabled, this one only counts the fragment shader invocations
+		pipelineStatisticsEnabled = deviceFeatures.pipelineStatisticsQuery == VK_TRUE;
+
+		enabledDeviceExtensions = deviceExtensions;
+		//extension feature structures enabled through VkDeviceCreateInfo::pNext
+		void* featureChain = nullptr;
+
+		//timeline semaphores (core in 1.2) replace the per frame fences. Without them GpuTimeline falls back to fences
+		VkPhysicalDeviceVulkan12Features features12{};
+		features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+		if (deviceProperties.apiVersion >= VK_API_VERSION_1_2)
+		{
+			VkPhysicalDeviceFeatures2 features2{};
+			features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+			features2.pNext = &features12;
+			vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+
+			timelineSemaphoreEnabled = features12.timelineSemaphore == VK_TRUE;
+			bindlessTexturesEnabled = features12.runtimeDescriptorArray && features12.descriptorBindingPartiallyBound &&
+				features12.descriptorBindingSampledImageUpdateAfterBind && features12.descriptorBindingVariableDescriptorCount;
+			//only enable what we use
+			VkPhysicalDeviceVulkan12Features supported12 = features12;
+			features12 = {};
+			features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+			features12.timelineSemaphore = supported12.timelineSemaphore;
+			//lets a transfer only queue time its work, it can't reset queries itself
+			features12.hostQueryReset = supported12.hostQueryReset;
+			hostQueryResetEnabled = supported12.hostQueryReset == VK_TRUE;
+			features12.pNext = featureChain;
+			featureChain = &features12;
+		}
+
+		//descriptor indexing (core in 1.2, VK_EXT_descriptor_indexing before) for the bindless texture table
+		VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexingFeatures{};
+		indexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+		bool indexingExtension = deviceProperties.apiVersion < VK_API_VERSION_1_2 && deviceProperties.apiVersion >= VK_API_VERSION_1_1 &&
+			isDeviceExtensionSupported(physicalDevice, VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+		if (indexingExtension)
+		{
+			VkPhysicalDeviceFeatures2 features2{};
+			features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+			features2.pNext = &indexingFeatures;
+			vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+			bindlessTexturesEnabled = indexingFeatures.runtimeDescriptorArray && indexingFeatures.descriptorBindingPartiallyBound &&
+				indexingFeatures.descriptorBindingSampledImageUpdateAfterBind && indexingFeatures.descriptorBindingVariableDescriptorCount;
+		}
+		//the material index is the same for the whole draw, which still needs dynamic indexing of sampler arrays
+		bindlessTexturesEnabled = bindlessTexturesEnabled && settings.bindlessTextures && deviceFeatures.shaderSampledImageArrayDynamicIndexing;
+
+		textureTableCapacity = std::max(1u, settings.maxTextures);
+		if (bindlessTexturesEnabled)
+		{
+			VkPhysicalDeviceDescriptorIndexingPropertiesEXT indexingProperties{};
+			indexingProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES_EXT;
+			VkPhysicalDeviceProperties2 properties2{};
+			properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+			properties2.pNext = &indexingProperties;
+			vkGetPhysicalDeviceProperties2(physicalDevice, &properties2);
+			textureTableCapacity = std::min({ textureTableCapacity, indexingProperties.maxDescriptorSetUpdateAfterBindSampledImages,
+				indexingProperties.maxDescriptorSetUpdateAfterBindSamplers, indexingProperties.maxPerStageDescriptorUpdateAfterBindSampledImages,
+				indexingProperties.maxPerStageDescriptorUpdateAfterBindSamplers });
+
+			//only enable what we use
+			if (indexingExtension)
+			{
+				indexingFeatures = {};
+				indexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+				indexingFeatures.runtimeDescriptorArray = VK_TRUE;
+				indexingFeatures.descriptorBindingPartiallyBound = VK_TRUE;
+				indexingFeatures.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+				indexingFeatures.descriptorBindingVariableDescriptorCount = VK_TRUE;
+				indexingFeatures.pNext = featureChain;
+				featureChain = &indexingFeatures;
+				enabledDeviceExtensions.push_back(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+			}
+			else
+			{
+				features12.runtimeDescriptorArray = VK_TRUE;
+				features12.descriptorBindingPartiallyBound = VK_TRUE;
+				features12.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+				features12.descriptorBindingVariableDescriptorCount = VK_TRUE;
+			}
+		}
+
+		//optional: what the OS currently grants the process, the budget of the texture residency
+		memoryBudgetEnabled = deviceProperties.apiVersion >= VK_API_VERSION_1_1 &&
+			isDeviceExtensionSupported(physicalDevice, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+		if (memoryBudgetEnabled)
+			enabledDeviceExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+
+		//optional: present id + present wait give us real "frame is on screen" timestamps for latency control
+#if defined(VK_KHR_present_id) && defined(VK_KHR_present_wait)
+		VkPhysicalDevicePresentIdFeaturesKHR presentIdFeatures{};
+		presentIdFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+		VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures{};
+		presentWaitFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+
+		if (deviceProperties.apiVersion >= VK_API_VERSION_1_1 &&
+			isDeviceExtensionSupported(physicalDevice, VK_KHR_PRESENT_ID_EXTENSION_NAME) &&
+			isDeviceExtensionSupported(physicalDevice, VK_KHR_PRESENT_WAIT_EXTENSION_NAME))
+		{
+			presentIdFeatures.pNext = &presentWaitFeatures;
+			VkPhysicalDeviceFeatures2 features2{};
+			features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+			features2.pNext = &presentIdFeatures;
+			vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+
+			presentWaitEnabled = presentIdFeatures.presentId && presentWaitFeatures.presentWait;
+		}
+
+		if (presentWaitEnabled)
+		{
+			enabledDeviceExtensions.push_back(VK_KHR_PRESENT_ID_EXTENSION_NAME);
+			enabledDeviceExtensions.push_back(VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+			//the core features still go through pEnabledFeatures
+			presentWaitFeatures.pNext = featureChain;
+			featureChain = &presentIdFeatures;
+		}
+#endif
+		deviceCreateInfo.pNext = featureChain;
+
 		//Adds extensions
-		deviceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-		deviceCreateInfo.ppEnabledExtensionNames = deviceExtensions.data();
+		deviceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(enabledDeviceExtensions.size());
+		deviceCreateInfo.ppEnabledExtensionNames = enabledDeviceExtensions.data();
 
 		if (enableValidationLayers) {
 			deviceCreateInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
@@ -2362,6 +4513,18 @@ namespace vulkanExample
 		if (presentQueue == nullptr)
 			throw std::runtime_error("Failed to allocate present queue");
 
+#ifdef VK_KHR_present_wait
+		if (presentWaitEnabled)
+		{
+			vkWaitForPresent = (PFN_vkWaitForPresentKHR)vkGetDeviceProcAddr(logicalDevice, "vkWaitForPresentKHR");
+			presentWaitEnabled = vkWaitForPresent != nullptr;
+		}
+#endif
+		std::cout << "Present wait: " << (presentWaitEnabled ? "enabled" : "not available") << std::endl;
+
+		graphicsTimeline.create(logicalDevice, graphicsQueue, timelineSemaphoreEnabled);
+		std::cout << "Frame synchronization: " << (timelineSemaphoreEnabled ? "timeline semaphore" : "fences (no timeline semaphore support)") << std::endl;
+
 	}
 
 
@@ -4,9 +4,38 @@
 #include "QueueFamilyIndices.hpp"
 #include "SwapChainSupportDetails.hpp"
 #include "Vertex.hpp"
+#include "RenderSettings.hpp"
+#include "FrameStats.hpp"
+#include "FramePacer.hpp"
+#include "GpuTimeline.hpp"
+#include "AsyncQueue.hpp"
+#include "PushConstants.hpp"
+#include "ThreadPool.hpp"
+#include "AssetPack.hpp"
+#include "AssetReader.hpp"
+#include "DerivedDataCache.hpp"
+#include "ShaderLibrary.hpp"
+#include "PipelineLibrary.hpp"
+#include "FileWatcher.hpp"
+#include "DescriptorAllocator.hpp"
+#include "TextureTable.hpp"
+#include "MeshDraw.hpp"
+#include "Texture.hpp"
+#include "DrawQueue.hpp"
+#include "RenderGraph.hpp"
+#include "GpuTimer.hpp"
+#include "FragmentCounter.hpp"
+#include "OcclusionCuller.hpp"
+#include "ResolutionController.hpp"
+#include "DeviceSelection.hpp"
+#include "ResidencyManager.hpp"
+#include "VirtualTextureCache.hpp"
 #include <vector>
+#include <atomic>
 #include <string>
 #include <map>
+#include <future>
+#include <unordered_map>
 namespace vulkanExample
 {
 
@@ -69,6 +98,16 @@ namespace vulkanExample
 		return out;
 	}
 
+	// Draws of one scene render pass. Without occlusion culling, everything is drawn in one pass
+	enum class ScenePhase
+	{
+		All,
+		//the clusters that passed the culling against the previous frame
+		Early,
+		//the clusters that were rejected by the early phase but are visible in this frame's depth
+		Late
+	};
+
 	class VulkanInterface
 	{
 
@@ -78,9 +117,11 @@ namespace vulkanExample
 		static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity, VkDebugUtilsMessageTypeFlagsEXT messageType, const VkDebugUtilsMessengerCallbackDataEXT* pCallbackData, void* pUserData);
 		VkResult CreateDebugUtilsMessengerEXT(VkInstance instance, const VkDebugUtilsMessengerCreateInfoEXT* pCreateInfo, const VkAllocationCallbacks* pAllocator, VkDebugUtilsMessengerEXT* pDebugMessenger);
 		void DestroyDebugUtilsMessengerEXT(VkInstance instance, VkDebugUtilsMessengerEXT debugMessenger, const VkAllocationCallbacks* pAllocator);
-		VulkanInterface(const uint32_t width, const uint32_t height);
+		VulkanInterface(const uint32_t width, const uint32_t height, const RenderSettings& settings = {});
 		~VulkanInterface();
 		void run();
+		//marks the frame as dirty so it gets redrawn in on demand mode. Safe to call from any thread (e.g. streaming completions)
+		void requestRedraw();
 		
 
 	private:
@@ -115,25 +156,126 @@ namespace vulkanExample
 		glm::vec3 cameraPos = glm::vec3(2.0f, 2.0f, 2.0f);
 		glm::vec3 cameraFront = glm::vec3(-2.0f, -2.0f, -2.0f);
 		glm::vec3 cameraUp = glm::vec3(0.0f, 0.0f, 1.0f);
+		const float zNear = 0.1f;
+		const float zFar = 10.0f;
 
 
 		uint64_t frameCounter = 0;
+
+		RenderSettings settings;
+		FrameStats frameStats;
+		//set whenever something visible changed and a new frame has to be presented
+		std::atomic<bool> redrawRequested{ true };
+		double lastPresentTime = 0.0;
+		double lastStatsTime = 0.0;
 		
 
-		const int MAX_FRAMES_IN_FLIGHT = 2;
+		//upper bound for the frames in flight setting
+		static constexpr uint32_t MAX_FRAMES_IN_FLIGHT = 4;
+		//uploads can wait, async compute is usually part of a frame
+		static constexpr float GRAPHICS_QUEUE_PRIORITY = 1.0f;
+		static constexpr float COMPUTE_QUEUE_PRIORITY = 0.5f;
+		static constexpr float TRANSFER_QUEUE_PRIORITY = 0.25f;
+		uint32_t framesInFlight = 2;
+		//applied at the next frame boundary, 0 if no change is pending
+		uint32_t pendingFramesInFlight = 0;
 		size_t currentFrame = 0;
 		bool frameBufferResized = false;
+
+		FramePacer framePacer;
+		//VK_KHR_present_id + VK_KHR_present_wait, only used if the device supports both
+		bool presentWaitEnabled = false;
+		uint64_t presentId = 0;
+#ifdef VK_KHR_present_wait
+		PFN_vkWaitForPresentKHR vkWaitForPresent = nullptr;
+#endif
 		
 
 		std::vector<VkSemaphore> imageAvailableSemaphores;
 		std::vector<VkSemaphore> renderFinishedSemaphores;
-		std::vector<VkFence> inFlightFences;
-		std::vector<VkFence> imagesInFlight;
+
+		//all graphics queue submissions signal increasing values on this timeline
+		GpuTimeline graphicsTimeline;
+		bool timelineSemaphoreEnabled = false;
+		//timeline value of the last submission that used each frame slot / swap chain image
+		std::vector<uint64_t> frameTimelineValues;
+		std::vector<uint64_t> imageTimelineValues;
+		//value of the last upload (buffer copies, layout transitions, mipmaps). Frames must not start before it
+		uint64_t uploadTimelineValue = 0;
+		//not created without a dedicated family or without timeline semaphores, the graphics queue does the work then.
+		//The copies of the uploads run on the transfer queue, the mipmaps still on the graphics queue (blits need it)
+		AsyncQueue transferQueue;
+		AsyncQueue computeQueue;
+		bool hostQueryResetEnabled = false;
+
+		//false if the constants don't fit in maxPushConstantsSize (then the uniform buffer is always used)
+		bool pushConstantMVPSupported = false;
+		//whether the pipeline in use reads the MVP from the push constants or from the uniform buffer
+		bool pushConstantMVPEnabled = false;
+		PushConstants drawConstants{};
+
+		ThreadPool threadPool;
+		DerivedDataCache derivedData;
+		//texture files, read with io_uring where available and decoded on the thread pool
+		AssetReader assetReader{ threadPool };
+		//mapped once, its entries are read and decoded on the thread pool instead of going through the asset reader
+		AssetPack assetPack;
+		ShaderLibrary shaderLibrary;
+		PipelineLibrary pipelineLibrary;
+		VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+		//variant of graphicsPipeline. Switching keeps the current one until the new variant is built
+		PipelineVariant activeVariant;
+		FileWatcher shaderWatcher;
+
+		//pools of every descriptor set outside of the bindless texture table
+		DescriptorAllocator descriptorAllocator;
+		//descriptor set 1, every material texture
+		TextureTable textureTable;
+		//descriptor indexing features are supported and enabled
+		bool bindlessTexturesEnabled = false;
+		uint32_t textureTableCapacity = 0;
+		//every texture loaded once, whatever the number of materials using it
+		std::vector<Texture> textures;
+		//index in textures of every texture table slot, and of every residency id
+		std::vector<size_t> tableTextures;
+		std::unordered_map<uint32_t, size_t> residencyTextures;
+		//keeps the device memory under the budget by downgrading the textures that weren't drawn for the longest
+		ResidencyManager residency;
+		//VK_EXT_memory_budget, otherwise the budget is estimated from the heap sizes
+		bool memoryBudgetEnabled = false;
+		//textures below this size (in pixels, on their longest side) are never downgraded further
+		static constexpr uint32_t MIN_RESIDENT_SIZE = 64;
+		//full size textures being read from disk by the asset reader
+		struct TextureRestore
+		{
+			size_t texture;
+			std::future<TextureData> data;
+		};
+		std::vector<TextureRestore> textureRestores;
+		//maximum texture size that fits the textures in textureBudgetMB, 0 if they fit at full size
+		uint32_t budgetTextureSize = 0;
+		//large textures streamed page by page, sampled through descriptor set 2
+		VirtualTextureCache virtualTextures;
+		bool virtualTexturingEnabled = false;
+		//diffuse texture of every material slot of the model, empty if the slot has no geometry
+		std::vector<std::string> materialTexturePaths;
+		//one draw per material
+		std::vector<MeshDraw> meshDraws;
+		//meshDraws in recording order, rebuilt and sorted every frame
+		DrawQueue drawQueue;
+		//meshDraws strictly front to back, for the depth pre-pass
+		DrawQueue depthQueue;
+		//view * model of the current frame, used for the depth of the draw keys
+		glm::mat4 drawModelView = glm::mat4(1.0f);
+		//projection * view * model of the current frame, whatever the pipeline reads
+		glm::mat4 drawMVP = glm::mat4(1.0f);
 
 		std::vector<const char*> validationLayers;
 		const std::vector<const char*> deviceExtensions = {
 			VK_KHR_SWAPCHAIN_EXTENSION_NAME
 		};
+		//required extensions plus the optional ones the device supports
+		std::vector<const char*> enabledDeviceExtensions;
 
 		std::vector<VkImage> swapChainImages;
 		std::vector<VkImageView> swapChainImageViews;
@@ -157,32 +299,64 @@ namespace vulkanExample
 		VkRenderPass renderPass;
 		VkPipelineLayout pipelineLayout;
 		VkDescriptorSetLayout descriptorSetLayout;
-		VkPipeline graphicsPipeline;
+		VkPipeline graphicsPipeline = VK_NULL_HANDLE;
+		//position only pipeline of the depth pre-pass, the variant of activeVariant.getDepthOnly()
+		VkPipeline depthPipeline = VK_NULL_HANDLE;
+		//the render pass was created with the depth pre-pass subpass. Follows settings.depthPrepass when the swap chain is recreated
+		bool depthPrepassEnabled = false;
 		VkCommandPool commandPool;
-		VkDescriptorPool descriptorPool;
 		std::vector<VkDescriptorSet> descriptorSets;
 		VkBuffer vertexBuffer;
 		VkDeviceMemory vertexBufferMemory;
+		//vertex positions only, read by the depth pre-pass
+		VkBuffer positionBuffer;
+		VkDeviceMemory positionBufferMemory;
 		VkBuffer indexBuffer;
 		VkDeviceMemory indexBufferMemory;
 		VkPhysicalDeviceProperties deviceProperties;
 		VkPhysicalDeviceFeatures deviceFeatures;
 		QueueFamilyIndices queueFamilies;
-		uint32_t mipLevels;
 		VkSampleCountFlagBits msaaSamples = VK_SAMPLE_COUNT_1_BIT;
 
-		VkImage textureImage;
-		VkImageView textureImageView;
+		//shared by every texture
 		VkSampler textureSampler;
-		VkDeviceMemory textureImageMemory;
-
-		VkImage depthImage;
-		VkDeviceMemory depthImageMemory;
-		VkImageView depthImageView;
 
-		VkImage colorImage;
-		VkDeviceMemory colorImageMemory;
-		VkImageView colorImageView;
+		//owns the multisampled color and depth images and the barriers between the passes. Rebuilt with the swap chain
+		RenderGraph renderGraph;
+		uint32_t colorTarget = 0;
+		uint32_t depthTarget = 0;
+		uint32_t swapChainTarget = 0;
+		//swap chain image the command buffer being recorded renders to
+		uint32_t recordingImageIndex = 0;
+
+		//GPU time of every command buffer, one timer slot per swap chain image
+		GpuTimer gpuTimer;
+		//fragment shader invocations of the scene pass, same slots
+		FragmentCounter fragmentCounter;
+		bool pipelineStatisticsEnabled = false;
+		//clusters of every draw, see OcclusionCuller. The scene is drawn in two render passes when culling,
+		//the second one loads the attachments of the first and adds the clusters the late phase found visible
+		OcclusionCuller occlusionCuller;
+		std::vector<Cluster> clusters;
+		bool occlusionCullingEnabled = false;
+		//draws all the clusters of a draw with one vkCmdDrawIndexedIndirect, otherwise one per cluster
+		bool multiDrawIndirectEnabled = false;
+		VkRenderPass lateRenderPass = VK_NULL_HANDLE;
+		//dynamic resolution: the scene is drawn into the top left part of a target sized for the maximum scale,
+		//so changing the scale only changes the viewport. The upscale pass stretches it over the swap chain image
+		ResolutionController resolutionController;
+		VkExtent2D renderTargetExtent{};
+		uint32_t sceneColorTarget = 0;
+		//the sample count or the depth pre-pass changed, the render targets and pipelines are rebuilt at the end of the frame
+		bool renderTargetsChanged = false;
+		//sampler, set layout and pipeline layout live as long as the device, the rest is rebuilt with the swap chain
+		VkSampler upscaleSampler = VK_NULL_HANDLE;
+		VkDescriptorSetLayout upscaleSetLayout = VK_NULL_HANDLE;
+		VkPipelineLayout upscalePipelineLayout = VK_NULL_HANDLE;
+		VkRenderPass upscaleRenderPass = VK_NULL_HANDLE;
+		VkPipeline upscalePipeline = VK_NULL_HANDLE;
+		VkDescriptorSet upscaleSet = VK_NULL_HANDLE;
+		std::vector<VkFramebuffer> upscaleFramebuffers;
 
 		uint32_t w_width;
 		uint32_t w_height;
@@ -192,10 +366,14 @@ namespace vulkanExample
 		static void framebufferResizeCallback(GLFWwindow* window, int width, int height);
 		static void onKeyPress(GLFWwindow* window, int key, int scancode, int action, int mods);
 		static void onMouseMove(GLFWwindow* window, double xpos, double ypos);
+		static void onWindowRefresh(GLFWwindow* window);
 		void initVulkan();
 		void createSurface();
 		bool checkValidationLayerSupport();
 		void mainLoop();
+		bool needsRedraw() const;
+		void waitForChanges();
+		void reportFrameStats();
 		void cleanup();
 		void createInstance();
 		void setupDebugMessenger();
@@ -209,40 +387,115 @@ namespace vulkanExample
 		void createImageViews();
 		void createRenderPass();
 		void createDescriptorSetLayout();
+		void createTextureTable();
+		//decides if large textures are virtual and creates the layout of their descriptor set
+		void configureVirtualTexturing();
 		void createGraphicsPipeline();
+		VkPipeline buildGraphicsPipeline(const PipelineVariant& variant);
+		void selectPipelineVariant(bool wait);
+		void reloadChangedShaders();
+		void cycleDebugView();
+		//rebuilds the render pass and pipelines with or without the depth pre-pass at the end of the frame
+		void toggleDepthPrepass();
+		void createPipelineCache();
+		void savePipelineCache();
+		//one pipeline cache per device and driver version
+		CacheKey getPipelineCacheKey() const;
+		void reportDerivedData();
 		void createFrameBuffers();
 		void createCommandPool();
+		void createAsyncQueues();
+		//adds the busy time of the async queues to the stats and frees their finished command buffers
+		void collectQueueBusyTime();
 		void createCommandBuffers();
-		void createColorResources();
-		void createDepthResources();
-		void createTextureImage();
+		void recordCommandBuffer(uint32_t imageIndex);
+		//declares the frame's images and passes, and creates the transient images
+		void createRenderGraph();
+		void recordScenePass(VkCommandBuffer commandBuffer, ScenePhase phase);
+		void recordDraw(VkCommandBuffer commandBuffer, const MeshDraw& draw, ScenePhase phase);
+		//checks that the depth buffer can be sampled at every sample count in use
+		void configureOcclusionCulling();
+		void createOcclusionCuller();
+		//reads the cluster counts of the image's previous frame
+		void collectOcclusionStats(uint32_t imageIndex);
+		void configureDynamicResolution();
+		void createUpscaleLayout();
+		void createUpscalePass();
+		void destroyUpscalePass();
+		void recordUpscalePass(VkCommandBuffer commandBuffer);
+		//reads the GPU time of the image's previous frame and lets the resolution controller react to it
+		void updateRenderScale(uint32_t imageIndex);
+		//reads the fragment shader invocations of the image's previous frame
+		void collectFragmentCount(uint32_t imageIndex);
+		//part of the render target drawn this frame
+		VkExtent2D getScaledExtent() const;
+		//loads every material texture, skipping files already loaded, and points the draws at their table slots
+		void createTextureImages();
+		//decodes a texture from the asset pack or its file, safe to call from the thread pool
+		TextureData loadTextureData(const std::string& path, uint32_t maxSize);
+		//decodes the contents of a texture file already read with its longest side at most maxSize (0 is unlimited), or reads
+		//the pixels from the derived data cache. path only names it in errors
+		TextureData decodeTextureData(const std::string& path, const unsigned char* data, size_t size, uint32_t maxSize);
+		//maximum size of the texture: its own or the global one from the settings, lowered to the texture budget's and the
+		//device's limits
+		uint32_t getMaxTextureSize(const std::string& path) const;
+		//size of the file's first level, from the asset pack or the file. False if it isn't a supported image
+		bool readTextureSize(const std::string& path, uint32_t& width, uint32_t& height);
+		Texture createTextureImage(const std::string& path, const TextureData& data);
+		//registers the texture with the residency manager
+		void trackTexture(size_t index);
+		VkDeviceSize getTextureReducedSize(const Texture& texture) const;
+		void configureResidency();
+		//touches the drawn textures, then applies the downgrades and starts the restores the residency manager decided
+		void updateResidency();
+		//swaps in the textures read back from disk, returns how many
+		uint32_t finishTextureRestores();
+		//copies every level but the first into a new image of half the size
+		void downgradeTexture(Texture& texture);
+		//points the table slot of the texture at the replacement and destroys the old image once the GPU is done with it
+		void replaceTexture(Texture& texture, Texture replacement);
+		std::string resolveTexturePath(const std::string& textureName, const std::string& materialDirectory) const;
+		//fills the draw queue with the current pipeline, material and depth of every draw and sorts it
+		void buildDrawQueue();
 		void createVertextBuffer();
 		void createIndexBuffer();
 		void createUniformBuffers();
-		void createDescriptorPool();
 		void createDescriptorSets();
 		void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& memory);
 		VkCommandBuffer beginSingleTimeCommands();
 		void endSingleTimeCommands(VkCommandBuffer commandBuffer);
+		void destroyBufferDeferred(VkBuffer buffer, VkDeviceMemory memory);
 		void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
-		void copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height);
+		//transitions every level to VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, copies the first one
+		void copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height, uint32_t mipLevels);
+		//recorded on the transfer queue when there is one, otherwise like the single time commands.
+		//The handoff lists what the graphics queue uses afterwards
+		VkCommandBuffer beginUploadCommands();
+		OwnershipTransfer createUploadHandoff() const;
+		void endUploadCommands(VkCommandBuffer commandBuffer, const OwnershipTransfer& handoff);
 		void createSyncObjects();
+		void destroySyncObjects();
+		void applyFramesInFlight();
+		void waitForQueuedPresents();
+		void cyclePresentMode();
 		void updateUniformBuffer(uint32_t currentImage);
 		void updateViewPosition();
 		void drawFrame();
 		VkSampleCountFlagBits getMaxUsableSampleCount();
+		VkSampleCountFlagBits getDeviceMaxSampleCount();
 		void generateMipmaps(VkImage image, VkFormat format, int32_t texWidth, int32_t texHeight, uint32_t mipLevels);
 		void createImage(uint32_t width, uint32_t height, uint32_t mipLevels, VkSampleCountFlagBits numSamples, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage,
 			VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory);
-		void createTextureImageView();
 		void createTextureSampler();
 		VkImageView createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t mipLevels);
 		void transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t mipLevels);
 		uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
+		std::optional<uint32_t> findOptionalMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
 		bool checkDeviceExtensionSupport(VkPhysicalDevice device);
+		bool isDeviceExtensionSupported(VkPhysicalDevice device, const char* extensionName);
 		void printDeviceExtensionSupport(VkPhysicalDevice device);
-		VkShaderModule createShaderModule(const std::vector<char>& code);
-		std::optional<QueueFamilyIndices> checkDevice(VkPhysicalDevice device);
+		//fills indices with the queue families of the device
+		DeviceCandidate inspectDevice(VkPhysicalDevice device, uint32_t index, QueueFamilyIndices& indices);
 		QueueFamilyIndices findQueueFamilies(VkPhysicalDevice device);
 		SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice device);
 		VkSurfaceFormatKHR chooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& availableFormats);
@@ -253,7 +506,12 @@ namespace vulkanExample
 		bool hasStencilComponent(VkFormat format);
 
 		void loadModel(glm::vec3 position, glm::vec3 scale);
-		static std::vector<char> readFile(const std::string& filename);
+		//parses the model and welds its vertices into vertices, indices, meshDraws and clusters
+		void weldMesh(const unsigned char* modelData, size_t modelSize, const std::string& materialDirectory, glm::vec3 position,
+			glm::vec3 scale, std::vector<std::string>& textureNames);
+		//the welded mesh as stored in the derived data cache, false if the data is malformed
+		bool readCachedMesh(const unsigned char* data, size_t size, std::vector<std::string>& textureNames);
+		std::vector<unsigned char> writeCachedMesh(const std::vector<std::string>& textureNames) const;
 	};
 
 } //namespace
@@ -1,9 +1,15 @@
 #include "VulkanInterface.hpp"
+#include "AssetPack.hpp"
+#include "Benchmarks.hpp"
 
 // std
 #include <iostream>
 #include <stdexcept>
 #include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <string>
+#include <vector>
 
 
 using namespace vulkanExample;
@@ -12,11 +18,238 @@ const uint32_t WIDTH = 1920;
 const uint32_t HEIGHT = 1080;
 
 
+static void printUsage()
+{
+    std::cout << "Usage: VulkanExample [options]" << std::endl
+        << "  --device <index|name>    physical device to use (default: best scored, or VULKAN_EXAMPLE_DEVICE)" << std::endl
+        << "  --on-demand              only redraws when something changed" << std::endl
+        << "  --min-refresh <seconds>  minimum refresh interval while rendering on demand" << std::endl
+        << "  --stats <seconds>        frame statistics interval (0 disables)" << std::endl
+        << "  --present-mode <mode>    fifo, fifo-relaxed, mailbox or immediate (P cycles at runtime)" << std::endl
+        << "  --frames-in-flight <n>   1 to 4 (F cycles at runtime)" << std::endl
+        << "  --fps-limit <fps>        frame limiter, 0 is unlimited" << std::endl
+        << "  --max-queued-presents <n> waits for presents to reach the display (needs VK_KHR_present_wait)" << std::endl
+        << "  --ubo-mvp                sends model, view and projection in the uniform buffer (V toggles at runtime)" << std::endl
+        << "  --debug-view <view>      textured, uv, vertex-color or overdraw (C cycles at runtime)" << std::endl
+        << "  --cache <dir>            directory of the derived data: SPIR-V, pipeline cache, meshes, textures (--shader-cache works too)" << std::endl
+        << "  --cache-size <MiB>       least recently used derived data is deleted past this size (default 2048, 0 = unbounded)" << std::endl
+        << "  --no-hot-reload          doesn't watch the shaders directory for changes" << std::endl
+        << "  --no-bindless            binds one texture per draw batch even if descriptor indexing is supported" << std::endl
+        << "  --max-textures <n>       size of the texture table" << std::endl
+        << "  --premultiply-alpha      multiplies the texture colors by their alpha while uploading them" << std::endl
+        << "  --max-texture-size <texels> longest side textures are loaded at, the levels above it aren't decoded (0 = unlimited)" << std::endl
+        << "  --texture-size <path>=<texels> maximum size of a single texture" << std::endl
+        << "  --texture-budget <MiB>   lowers the maximum texture size until the textures' mip chains fit (0 = unbounded)" << std::endl
+        << "  --memory-budget <MiB>    device memory cap, textures are downgraded past it (0 = device budget)" << std::endl
+        << "  --virtual-texturing [size] streams textures of at least size texels (default 4096) page by page" << std::endl
+        << "  --virtual-texture-cache <texels> side of the page cache texture (default 4096)" << std::endl
+        << "  --depth-prepass          draws the depth first, then shades with an EQUAL depth test (Z toggles at runtime)" << std::endl
+        << "  --occlusion-culling      culls clusters on the GPU against a depth pyramid (two phase hierarchical-Z)" << std::endl
+        << "  --dynamic-resolution [ms] scales the render resolution to hold a GPU frame time (default 16.6)" << std::endl
+        << "  --render-scale <min> <max> bounds of the dynamic resolution scale (default 0.5 1.0)" << std::endl
+        << "  --resolution-window <n>  GPU frame times averaged per resolution change" << std::endl
+        << "  --dynamic-msaa           lowers the MSAA sample count when the minimum scale isn't enough" << std::endl
+        << "  --pack <path>            asset pack to read the models, textures and shaders from (default: assets.pack, if it exists)" << std::endl
+        << "  --no-pack                only reads loose files" << std::endl
+        << "  --build-pack <path> [--no-lz4] [inputs...] packs the files under inputs (default: models textures shaders) and exits" << std::endl
+        << "  --bench-sort [count]     sorts count random draw keys (default 1000000) and exits" << std::endl
+        << "  --bench-io [path]        reads the files under path (default: textures) streamed and mapped, warm and cold, and exits" << std::endl
+        << "  --bench-loads [path]     loads the files under path synchronously and through the asset reader, and exits" << std::endl
+        << "  --bench-startup [pack]   loads the assets of the pack (default: assets.pack) from loose files and from the pack, and exits" << std::endl
+        << "  --bench-decode [path]    decodes the images under path (default: textures) and 200 synthetic ones with each pixel kernel, and exits" << std::endl
+        << "  --bench-texture-size [path] decodes the images under path (default: textures) under each maximum texture size, and exits" << std::endl
+        << "  --test-render-graph      checks the barriers, culling and aliasing the render graph schedules for sample graphs, and exits" << std::endl;
+}
 
+// Packs the inputs into a single asset pack, compressing the entries LZ4 shrinks enough
+static int buildPack(const std::string& output, const std::vector<std::string>& inputs, bool compress)
+{
+    AssetPack::BuildStats stats;
+    if (!AssetPack::build(output, inputs, compress, stats))
+    {
+        std::cerr << "failed to build asset pack " << output << "!" << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cout << "Packed " << stats.entries << " files (" << stats.bytes / 1024 << " KiB) into " << output << ", "
+        << stats.compressed << " compressed, " << stats.storedBytes / 1024 << " KiB stored" << std::endl;
+    return EXIT_SUCCESS;
+}
+
+// Fills the render settings from the command line. Unknown arguments are reported and ignored
+static RenderSettings parseArguments(int argc, char* argv[])
+{
+    RenderSettings settings;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (arg == "--device" && hasValue)
+            settings.device = argv[++i];
+        else if (arg == "--on-demand")
+            settings.renderOnDemand = true;
+        else if (arg == "--min-refresh" && hasValue)
+            settings.minRefreshInterval = std::atof(argv[++i]);
+        else if (arg == "--stats" && hasValue)
+            settings.statsInterval = std::atof(argv[++i]);
+        else if (arg == "--present-mode" && hasValue)
+        {
+            auto mode = parsePresentMode(argv[++i]);
+            if (mode.has_value())
+                settings.presentMode = mode.value();
+            else
+                std::cerr << "Unknown present mode " << argv[i] << std::endl;
+        }
+        else if (arg == "--frames-in-flight" && hasValue)
+            settings.framesInFlight = static_cast<uint32_t>(std::atoi(argv[++i]));
+        else if (arg == "--fps-limit" && hasValue)
+            settings.frameRateLimit = std::atof(argv[++i]);
+        else if (arg == "--max-queued-presents" && hasValue)
+            settings.maxQueuedPresents = static_cast<uint32_t>(std::atoi(argv[++i]));
+        else if (arg == "--ubo-mvp")
+            settings.pushConstantMVP = false;
+        else if (arg == "--debug-view" && hasValue)
+        {
+            auto view = parseDebugView(argv[++i]);
+            if (view.has_value())
+                settings.debugView = view.value();
+            else
+                std::cerr << "Unknown debug view " << argv[i] << std::endl;
+        }
+        else if ((arg == "--cache" || arg == "--shader-cache") && hasValue)
+            settings.derivedDataDirectory = argv[++i];
+        else if (arg == "--cache-size" && hasValue)
+            settings.derivedDataMaxMB = static_cast<uint32_t>(std::atoi(argv[++i]));
+        else if (arg == "--no-hot-reload")
+            settings.hotReloadShaders = false;
+        else if (arg == "--no-bindless")
+            settings.bindlessTextures = false;
+        else if (arg == "--depth-prepass")
+            settings.depthPrepass = true;
+        else if (arg == "--occlusion-culling")
+            settings.occlusionCulling = true;
+        else if (arg == "--max-textures" && hasValue)
+            settings.maxTextures = static_cast<uint32_t>(std::atoi(argv[++i]));
+        else if (arg == "--premultiply-alpha")
+            settings.premultiplyAlpha = true;
+        else if (arg == "--max-texture-size" && hasValue)
+            settings.maxTextureSize = static_cast<uint32_t>(std::atoi(argv[++i]));
+        else if (arg == "--texture-size" && hasValue)
+        {
+            std::string value = argv[++i];
+            size_t separator = value.rfind('=');
+            if (separator != std::string::npos && separator > 0)
+                settings.textureSizes[value.substr(0, separator)] = static_cast<uint32_t>(std::atoi(value.c_str() + separator + 1));
+            else
+                std::cerr << "Expected <path>=<texels> after --texture-size, got " << value << std::endl;
+        }
+        else if (arg == "--texture-budget" && hasValue)
+            settings.textureBudgetMB = static_cast<uint32_t>(std::atoi(argv[++i]));
+        else if (arg == "--memory-budget" && hasValue)
+            settings.memoryBudgetMB = static_cast<uint32_t>(std::atoi(argv[++i]));
+        else if (arg == "--virtual-texturing")
+        {
+            settings.virtualTexturing = true;
+            if (hasValue && std::isdigit(static_cast<unsigned char>(argv[i + 1][0])))
+                settings.virtualTextureMinSize = static_cast<uint32_t>(std::atoi(argv[++i]));
+        }
+        else if (arg == "--virtual-texture-cache" && hasValue)
+            settings.virtualTextureCacheSize = static_cast<uint32_t>(std::atoi(argv[++i]));
+        else if (arg == "--dynamic-resolution")
+        {
+            settings.dynamicResolution = true;
+            if (hasValue && std::isdigit(static_cast<unsigned char>(argv[i + 1][0])))
+                settings.targetFrameTime = std::atof(argv[++i]);
+        }
+        else if (arg == "--render-scale" && i + 2 < argc)
+        {
+            settings.minRenderScale = static_cast<float>(std::atof(argv[++i]));
+            settings.maxRenderScale = static_cast<float>(std::atof(argv[++i]));
+        }
+        else if (arg == "--resolution-window" && hasValue)
+            settings.resolutionWindow = static_cast<uint32_t>(std::atoi(argv[++i]));
+        else if (arg == "--dynamic-msaa")
+            settings.dynamicSamples = true;
+        else if (arg == "--pack" && hasValue)
+            settings.assetPack = argv[++i];
+        else if (arg == "--no-pack")
+            settings.assetPack.clear();
+        else if (arg == "--build-pack" && hasValue)
+        {
+            std::string output = argv[++i];
+            bool compress = true;
+            std::vector<std::string> inputs;
+            for (; i + 1 < argc; i++)
+            {
+                if (std::strcmp(argv[i + 1], "--no-lz4") == 0)
+                    compress = false;
+                else if (argv[i + 1][0] != '-')
+                    inputs.push_back(argv[i + 1]);
+                else
+                    break;
+            }
+            if (inputs.empty())
+                inputs = { "models", "textures", "shaders" };
+            std::exit(buildPack(output, inputs, compress));
+        }
+        else if (arg == "--bench-sort")
+        {
+            size_t count = 1000000;
+            if (hasValue && std::isdigit(static_cast<unsigned char>(argv[i + 1][0])))
+                count = static_cast<size_t>(std::atoll(argv[++i]));
+            std::exit(benchmarkDrawSort(count));
+        }
+        else if (arg == "--bench-io")
+        {
+            std::string path = "textures";
+            if (hasValue && argv[i + 1][0] != '-')
+                path = argv[++i];
+            std::exit(benchmarkFileReads(path));
+        }
+        else if (arg == "--bench-loads")
+        {
+            std::string path = "textures";
+            if (hasValue && argv[i + 1][0] != '-')
+                path = argv[++i];
+            std::exit(benchmarkAssetLoads(path));
+        }
+        else if (arg == "--bench-startup")
+        {
+            std::string path = "assets.pack";
+            if (hasValue && argv[i + 1][0] != '-')
+                path = argv[++i];
+            std::exit(benchmarkStartup(path));
+        }
+        else if (arg == "--bench-decode")
+        {
+            std::string path = "textures";
+            if (hasValue && argv[i + 1][0] != '-')
+                path = argv[++i];
+            std::exit(benchmarkTextureDecode(path));
+        }
+        else if (arg == "--bench-texture-size")
+        {
+            std::string path = "textures";
+            if (hasValue && argv[i + 1][0] != '-')
+                path = argv[++i];
+            std::exit(benchmarkTextureSizes(path));
+        }
+        else if (arg == "--test-render-graph")
+            std::exit(testRenderGraph());
+        else if (arg == "--help")
+        {
+            printUsage();
+            std::exit(EXIT_SUCCESS);
+        }
+        else
+            std::cerr << "Ignoring unknown argument " << arg << std::endl;
+    }
+    return settings;
+}
 
 
-int WinMain() {
-    VulkanInterface app(WIDTH, HEIGHT);
+int WinMain(const RenderSettings& settings) {
+    VulkanInterface app(WIDTH, HEIGHT, settings);
     try
     {
         //runs app with defined size
@@ -31,4 +264,4 @@ int WinMain() {
 }
 
 
-int main() { return WinMain(); } //To allow switching between Windows and Console (debug)
\ No newline at end of file
+int main(int argc, char* argv[]) { return WinMain(parseArguments(argc, argv)); } //To allow switching between Windows and Console (debug)
@@ -1,11 +1,37 @@
 import os
+import sys
 
-## Sticking with simple now, let's just hard-code the shaders. This can be extended later for folder search and compile
-## of fragment and vector shaders (if multiples)
+## Build time compilation of the shader variants. The application compiles the same variants at runtime through
+## libshaderc into its SPIR-V cache when available, these files are the fallback when it is not.
+## Debug views are specialization constants, so they don't need separate files here.
 ## This script has to be configured in your pre-build configuration in your IDE
-result = os.system("glslc.exe shader.frag -o frag.spv")
-if (result != 0):
-    exit(1)
-result = os.system("glslc.exe shader.vert -o vert.spv")
-if (result != 0):
-    exit(1)
\ No newline at end of file
+GLSLC = "glslc.exe" if sys.platform == "win32" else "glslc"
+
+## (source, output, defines)
+VARIANTS = [
+    ("shader.frag", "frag.spv", []),
+    ## texture table indexed by the material (descriptor indexing)
+    ("shader.frag", "frag_bindless.spv", ["BINDLESS_TEXTURES"]),
+    ## large textures streamed through the page cache
+    ("shader.frag", "frag_vt.spv", ["VIRTUAL_TEXTURES"]),
+    ("shader.frag", "frag_bindless_vt.spv", ["BINDLESS_TEXTURES", "VIRTUAL_TEXTURES"]),
+    ("shader.vert", "vert.spv", []),
+    ## model-view-projection matrix precomputed on the CPU and passed as a push constant
+    ("shader.vert", "vert_pc.spv", ["PUSH_CONSTANT_MVP"]),
+    ## position only vertex shader of the depth pre-pass
+    ("depth.vert", "depth_vert.spv", []),
+    ("depth.vert", "depth_vert_pc.spv", ["PUSH_CONSTANT_MVP"]),
+    ## dynamic resolution: scales the scene target up to the swap chain image
+    ("upscale.vert", "upscale_vert.spv", []),
+    ("upscale.frag", "upscale_frag.spv", []),
+    ## occlusion culling: depth pyramid levels (the first one from the depth buffer) and the cluster culling
+    ("hiz.comp", "hiz_depth_comp.spv", ["DEPTH_SOURCE"]),
+    ("hiz.comp", "hiz_comp.spv", []),
+    ("cull.comp", "cull_comp.spv", []),
+]
+
+for source, output, defines in VARIANTS:
+    arguments = " ".join("-D" + define for define in defines)
+    result = os.system(GLSLC + " -O " + arguments + " " + source + " -o " + output)
+    if (result != 0):
+        exit(1)
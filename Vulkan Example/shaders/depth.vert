@@ -0,0 +1,30 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// Depth pre-pass: reads only the position stream and has no fragment shader. The transform must be written exactly
+// like in shader.vert (and both declare gl_Position invariant), so the shading subpass passes its EQUAL depth test
+#ifdef PUSH_CONSTANT_MVP
+layout(push_constant) uniform PushConstants
+{
+    mat4 mvp;
+} constants;
+#else
+layout(binding=0) uniform UniformBufferObject
+{
+    mat4 model;
+    mat4 view;
+    mat4 proj;
+} ubo;
+#endif
+
+layout(location = 0) in vec3 inPosition;
+
+invariant gl_Position;
+
+void main() {
+#ifdef PUSH_CONSTANT_MVP
+    gl_Position = constants.mvp * vec4(inPosition, 1.0);
+#else
+    gl_Position = ubo.proj * ubo.view * ubo.model * vec4(inPosition, 1.0);
+#endif
+}
\ No newline at end of file
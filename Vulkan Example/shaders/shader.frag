@@ -1,18 +1,127 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 
-layout(binding = 1) uniform sampler2D texSampler;
+// BINDLESS_TEXTURES: every material texture is in one array (see TextureTable.hpp), indexed by the material of the draw.
+// The index is the same for the whole draw (dynamically uniform), so it doesn't need nonuniformEXT.
+// Otherwise set 1 holds only the texture of the current draw batch
+#ifdef BINDLESS_TEXTURES
+#extension GL_EXT_nonuniform_qualifier : require
+layout(set = 1, binding = 0) uniform sampler2D textures[];
+#else
+layout(set = 1, binding = 0) uniform sampler2D texSampler;
+#endif
+
+layout(push_constant) uniform PushConstants
+{
+    layout(offset = 64) uint materialIndex;
+} constants;
+
+// VIRTUAL_TEXTURES: large textures are streamed page by page into a page cache texture (see VirtualTextureCache.hpp).
+// The page table holds, for every page of every level, the cache slot of the finest resident page covering it.
+// Word 0 is the cell of the 8x8 block whose fragment writes the page it wanted into the feedback buffer this frame
+#ifdef VIRTUAL_TEXTURES
+layout(set = 2, binding = 0) uniform sampler2D pageCache;
+
+// levels is 0 for the materials sampled the regular way
+struct VirtualTexture
+{
+    uint tableOffset;
+    uint levels;
+    uint width;
+    uint height;
+};
+
+layout(std430, set = 2, binding = 1) readonly buffer VirtualTextures
+{
+    VirtualTexture virtualTextures[];
+};
+
+layout(std430, set = 2, binding = 2) readonly buffer PageTable
+{
+    uint pageTable[];
+};
+
+layout(std430, set = 2, binding = 3) writeonly buffer Feedback
+{
+    uint feedback[];
+};
+
+// must match VirtualTextureLayout
+const uint PAGE_SIZE = 120u;
+const uint PAGE_BORDER = 4u;
+const uint SLOT_SIZE = 128u;
+const uint FEEDBACK_BLOCK = 8u;
+#endif
 
 layout(location = 0) in vec3 fragColor;
 layout(location = 1) in vec2 fragTexCoord;
 
 layout(location = 0) out vec4 outColor;
 
+// Debug view, set when the pipeline is created (see DebugView in PipelineVariant.hpp).
+// The driver folds the constant, so every variant only contains its own branch
+// 0: texture, 1: texture coordinates as colors, 2: vertex colors on top of the texture,
+// 3: overdraw, a constant the pipeline adds up for every shaded fragment
+layout(constant_id = 0) const int DEBUG_VIEW = 0;
+
+#ifdef VIRTUAL_TEXTURES
+uvec2 getLevelSize(VirtualTexture virtualTexture, uint level) {
+    return max(uvec2(virtualTexture.width, virtualTexture.height) >> level, uvec2(1));
+}
+
+vec4 sampleVirtual(VirtualTexture virtualTexture, vec2 texCoord) {
+    //the level of the regular texture the sampler would have picked, from the derivatives before the wrap
+    vec2 texel = texCoord * vec2(virtualTexture.width, virtualTexture.height);
+    vec2 dx = dFdx(texel);
+    vec2 dy = dFdy(texel);
+    float lod = 0.5 * log2(max(max(dot(dx, dx), dot(dy, dy)), 1e-8));
+    uint level = uint(clamp(round(lod), 0.0, float(virtualTexture.levels - 1u)));
+
+    //repeat addressing, like the material sampler
+    vec2 uv = fract(texCoord);
+    uvec2 levelSize = getLevelSize(virtualTexture, level);
+    uvec2 levelPages = (levelSize + PAGE_SIZE - 1u) / PAGE_SIZE;
+    uvec2 page = min(uvec2(uv * vec2(levelSize)) / PAGE_SIZE, levelPages - 1u);
+    uint pageWord = pageTable[virtualTexture.tableOffset + level] + page.y * levelPages.x + page.x;
+
+    uvec2 cell = uvec2(gl_FragCoord.xy) % FEEDBACK_BLOCK;
+    if (cell.x + cell.y * FEEDBACK_BLOCK == pageTable[0])
+        feedback[pageWord] = 1u;
+
+    //slot x, slot y and level of the page actually resident, the page itself or the nearest coarser one
+    uint entry = pageTable[pageWord];
+    uvec2 slot = uvec2(entry & 0xffu, (entry >> 8) & 0xffu);
+    uint residentLevel = entry >> 16;
+    uvec2 residentPage = page >> (residentLevel - level);
+    vec2 inPage = uv * vec2(getLevelSize(virtualTexture, residentLevel)) - vec2(residentPage * PAGE_SIZE);
+    inPage = clamp(inPage, vec2(0.0), vec2(PAGE_SIZE));
+
+    vec2 cacheTexel = vec2(slot * SLOT_SIZE + PAGE_BORDER) + inPage;
+    return textureLod(pageCache, cacheTexel / vec2(textureSize(pageCache, 0)), 0.0);
+}
+#endif
+
+vec4 sampleMaterial(vec2 texCoord) {
+#ifdef VIRTUAL_TEXTURES
+    //the material is the same for the whole draw, so the branch is uniform and the derivatives stay defined
+    VirtualTexture virtualTexture = virtualTextures[constants.materialIndex];
+    if (virtualTexture.levels > 0)
+        return sampleVirtual(virtualTexture, texCoord);
+#endif
+#ifdef BINDLESS_TEXTURES
+    return texture(textures[constants.materialIndex], texCoord);
+#else
+    return texture(texSampler, texCoord);
+#endif
+}
+
 void main() {
-    //Shows coordinates using colors
-    //outColor = vec4(fragTexCoord, 0.0, 1);
-    //Show vertex colors on top of texture
-    //outColor = vec4(fragColor * texture(texSampler, fragTexCoord).rgb, 1.0);
-    
-    outColor = texture(texSampler, fragTexCoord);
+    if (DEBUG_VIEW == 1)
+        outColor = vec4(fragTexCoord, 0.0, 1);
+    else if (DEBUG_VIEW == 2)
+        outColor = vec4(fragColor * sampleMaterial(fragTexCoord).rgb, 1.0);
+    else if (DEBUG_VIEW == 3)
+        outColor = vec4(0.125, 0.05, 0.02, 1.0);
+    else
+        outColor = sampleMaterial(fragTexCoord);
 }
\ No newline at end of file
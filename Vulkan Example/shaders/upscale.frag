@@ -0,0 +1,21 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// Stretches the part of the scene target that was rendered this frame over the swap chain image (bilinear)
+layout(set = 0, binding = 0) uniform sampler2D sceneColor;
+
+layout(push_constant) uniform Upscale
+{
+    //rendered size / target size
+    vec2 uvScale;
+    //center of the last rendered texel, so the filter never reads outside of the rendered area
+    vec2 uvMax;
+} upscale;
+
+layout(location = 0) in vec2 fragTexCoord;
+
+layout(location = 0) out vec4 outColor;
+
+void main() {
+    outColor = texture(sceneColor, min(fragTexCoord * upscale.uvScale, upscale.uvMax));
+}
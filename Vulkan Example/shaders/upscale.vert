@@ -0,0 +1,10 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// One triangle covering the whole screen, no vertex buffer: (0,0), (2,0), (0,2) in texture coordinates
+layout(location = 0) out vec2 fragTexCoord;
+
+void main() {
+    fragTexCoord = vec2((gl_VertexIndex << 1) & 2, gl_VertexIndex & 2);
+    gl_Position = vec4(fragTexCoord * 2.0 - 1.0, 0.0, 1.0);
+}